@@ -0,0 +1,184 @@
+// CubeMapAtlas.cpp
+//
+
+#include "CubeMapAtlas.h"
+#include "Trace.h"
+#include <cmath>
+
+CubeMapAtlas::CubeMapAtlas() {
+	minResolution = 512;
+	maxResolution = 1024;
+	fboRead = fboDraw = 0;
+}
+
+CubeMapAtlas::~CubeMapAtlas() {
+	// GL objects are owned by the registry, see release()
+}
+
+/** whether the current context has cubemap arrays, glTexStorage3D and glCopyImageSubData */
+bool CubeMapAtlas::isSupported() {
+	if(gl3wIsSupported(4, 3)){
+		return true;
+	}
+	return GPUResources::hasExtension("GL_ARB_texture_cube_map_array")
+			&& GPUResources::hasExtension("GL_ARB_texture_storage")
+			&& GPUResources::hasExtension("GL_ARB_copy_image");
+}
+
+/** sets the range of the class resolutions (powers of two) */
+void CubeMapAtlas::setResolutionLimits(int minResolution, int maxResolution) {
+	this->minResolution = minResolution;
+	this->maxResolution = maxResolution;
+}
+
+/**
+ * Adds a cubemap to be packed by the next build(). Its resolution and format are
+ * queried from the texture, a cubemap without storage is not packed.
+ * @return id of the cubemap for entry()
+ */
+int CubeMapAtlas::add(GLuint cubeMap) {
+	Source s;
+	s.cubeMap = cubeMap;
+	s.resolution = 0;
+	s.internalFormat = GL_RGB8;
+	if(cubeMap){
+		GLint width = 0, format = 0;
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		s.resolution = width;
+		s.internalFormat = static_cast<GLenum>(format);
+	}
+	// unsized formats are not accepted by glTexStorage3D
+	if(s.internalFormat == GL_RGB){
+		s.internalFormat = GL_RGB8;
+	} else if(s.internalFormat == GL_RGBA){
+		s.internalFormat = GL_RGBA8;
+	}
+	sources.push_back(s);
+	Entry e;
+	e.sizeClass = -1;
+	e.layer = -1;
+	entries.push_back(e);
+	return static_cast<int>(sources.size())-1;
+}
+
+/** resolution of the size class a source is packed into */
+int CubeMapAtlas::classResolutionFor(int resolution, GLenum internalFormat) const {
+	if(GPUResources::bytesPerBlock(internalFormat)){
+		// compressed textures cannot be blitted into, keep their resolution
+		return resolution;
+	}
+	int r = 1 << static_cast<int>(std::floor(std::log2(static_cast<double>(resolution)) + 0.5));
+	return r < minResolution ? minResolution : (r > maxResolution ? maxResolution : r);
+}
+
+/**
+ * Creates the cubemap arrays of all size classes and copies (or resamples)
+ * the added cubemaps into their layers.
+ * @return false if nothing could be packed (always if the context does not support the atlas)
+ */
+bool CubeMapAtlas::build(GPUResources& resources) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "cubemap atlas");
+	if(!isSupported()){
+		return false;
+	}
+	// assign size classes and layers
+	for(size_t i = 0; i < sources.size(); i++){
+		const Source& s = sources[i];
+		if(s.resolution <= 0){
+			continue;
+		}
+		int resolution = classResolutionFor(s.resolution, s.internalFormat);
+		size_t c = 0;
+		while(c < classes.size() && !(classes[c].resolution == resolution && classes[c].internalFormat == s.internalFormat)){
+			c++;
+		}
+		if(c == classes.size()){
+			SizeClass sc;
+			sc.resolution = resolution;
+			sc.internalFormat = s.internalFormat;
+			sc.layers = 0;
+			sc.texture = 0;
+			classes.push_back(sc);
+		}
+		entries[i].sizeClass = static_cast<int>(c);
+		entries[i].layer = classes[c].layers++;
+	}
+	// allocate the arrays
+	for(size_t c = 0; c < classes.size(); c++){
+		SizeClass& sc = classes[c];
+		sc.texture = resources.createTexture(GPUResources::CAT_TEXTURE, "cubemap atlas");
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, sc.texture);
+		glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, sc.internalFormat, sc.resolution, sc.resolution, 6*sc.layers);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+		resources.setTextureStorage(sc.texture, sc.internalFormat, sc.resolution, sc.resolution, 6*sc.layers, 1);
+		TRACE_INFO("atlas", "size class %d: %d layers of %dx%d", static_cast<int>(c), sc.layers, sc.resolution, sc.resolution);
+	}
+	// fill the layers
+	for(size_t i = 0; i < sources.size(); i++){
+		const Entry& e = entries[i];
+		if(e.sizeClass < 0){
+			continue;
+		}
+		const Source& s = sources[i];
+		const SizeClass& sc = classes[e.sizeClass];
+		if(s.resolution == sc.resolution){
+			// all 6 faces at once, the faces of a cubemap are its layers 0-5
+			glCopyImageSubData(s.cubeMap, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+					sc.texture, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6*e.layer,
+					s.resolution, s.resolution, 6);
+		} else {
+			if(!fboRead){
+				fboRead = resources.createFramebuffer("atlas resample read");
+				fboDraw = resources.createFramebuffer("atlas resample draw");
+			}
+			resample(s, sc, e.layer);
+		}
+	}
+	resources.releaseFramebuffer(fboRead);
+	resources.releaseFramebuffer(fboDraw);
+	return !classes.empty();
+}
+
+/**
+ * Resamples the faces of a source into a layer of a size class with a linear filtered blit.
+ * The framebuffer bindings are restored afterwards, read and draw buffer are only set on
+ * the framebuffers of the atlas.
+ */
+void CubeMapAtlas::resample(const Source& source, const SizeClass& sizeClass, int layer) {
+	TRACE_DEBUG("atlas", "resampling %dx%d to %dx%d", source.resolution, source.resolution,
+			sizeClass.resolution, sizeClass.resolution);
+	GLint previousRead = 0, previousDraw = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fboRead);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboDraw);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	for(int face = 0; face < 6; face++){
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, source.cubeMap, 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sizeClass.texture, 0, 6*layer + face);
+		glBlitFramebuffer(0, 0, source.resolution, source.resolution,
+				0, 0, sizeClass.resolution, sizeClass.resolution, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previousRead));
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(previousDraw));
+}
+
+/** deletes the cubemap arrays and forgets the added cubemaps */
+void CubeMapAtlas::release(GPUResources& resources) {
+	for(size_t c = 0; c < classes.size(); c++){
+		resources.releaseTexture(classes[c].texture);
+	}
+	classes.clear();
+	sources.clear();
+	entries.clear();
+}
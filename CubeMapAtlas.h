@@ -0,0 +1,72 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GPUResources.h"
+#include <vector>
+
+/*
+ * Cubemap array atlas of the environment maps sampled by the objects.
+ *
+ * The cubemaps added to the atlas are sorted into size classes keyed by resolution and
+ * internal format, each size class is a single GL_TEXTURE_CUBE_MAP_ARRAY holding one layer
+ * (6 faces) per cubemap. The resolution of a class is the power of two closest to the
+ * source resolution, clamped to [minResolution, maxResolution], so sources of similar size
+ * share a class. Sources of a different resolution than their class are resampled with a
+ * filtered blit at build time, block compressed sources cannot be render targets and are
+ * put into a class of their own resolution instead.
+ *
+ * Objects reference their map by size class and layer, so draws can be sorted by
+ * class and only need a texture bind when the class changes.
+ *
+ * The atlas needs cubemap arrays, immutable storage and image copies (GL 4.3 or the
+ * ARB extensions, see isSupported()). Without them nothing is packed and the objects
+ * bind their cubemaps one by one.
+ */
+class CubeMapAtlas {
+public:
+	/** location of a cubemap in the atlas */
+	typedef struct Entry_t {
+		int sizeClass; //!< size class (-1 = not in the atlas)
+		int layer;     //!< layer in the cubemap array of the size class
+	} Entry;
+
+	CubeMapAtlas();
+	~CubeMapAtlas();
+
+	static bool isSupported();
+
+	void setResolutionLimits(int minResolution, int maxResolution);
+	int add(GLuint cubeMap);
+	bool build(GPUResources& resources);
+	void release(GPUResources& resources);
+
+	const Entry& entry(int id) const { return entries[id]; }
+	int numClasses() const { return static_cast<int>(classes.size()); }
+	GLuint classTexture(int sizeClass) const { return classes[sizeClass].texture; }
+	int classResolution(int sizeClass) const { return classes[sizeClass].resolution; }
+
+private:
+	/** cubemap array of a size class */
+	typedef struct SizeClass_t {
+		int resolution;        //!< width and height of the faces
+		GLenum internalFormat; //!< format of all layers
+		int layers;            //!< number of cubemaps
+		GLuint texture;        //!< GL_TEXTURE_CUBE_MAP_ARRAY
+	} SizeClass;
+
+	/** cubemap added to the atlas */
+	typedef struct Source_t {
+		GLuint cubeMap;        //!< source texture (level 0 is copied)
+		int resolution;        //!< width and height of its faces
+		GLenum internalFormat; //!< its format
+	} Source;
+
+	int classResolutionFor(int resolution, GLenum internalFormat) const;
+	void resample(const Source& source, const SizeClass& sizeClass, int layer);
+
+	int minResolution, maxResolution;
+	std::vector<Source> sources;
+	std::vector<Entry> entries;     //!< entry of every source
+	std::vector<SizeClass> classes;
+	GLuint fboRead, fboDraw;        //!< framebuffers for resampling
+};
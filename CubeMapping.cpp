@@ -7,7 +7,20 @@
 #include "glm/gtc/constants.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "PngBitmapCodec.h"
+#include "SceneMath.h"
 #include "Defs.h"
+#include "HDRImage.h"
+#include "ThreadPool.h"
+#include "TextureCompression.h"
+#include "Trace.h"
+#include "SceneFile.h"
+#include "DynamicBVH.h"
+#include "MeshImport.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 // key codes
 #ifdef __linux__
@@ -19,6 +32,10 @@
 #define KEY_A 0x61
 #define KEY_F 0x66
 #define KEY_X 0x78
+#define KEY_T 0x74
+#define KEY_C 0x63
+#define KEY_V 0x76
+#define KEY_P 0x70
 #elif _WIN32
 #define KEY_L 0x4C
 #define KEY_S 0x53
@@ -28,10 +45,27 @@
 #define KEY_A 0x41
 #define KEY_F 0x46
 #define KEY_X 0x58
+#define KEY_T 0x54
+#define KEY_C 0x43
+#define KEY_V 0x56
+#define KEY_P 0x50
 #endif
 #define KEY_0 0x30
 #define KEY_1 0x31
 
+/** frames the probe key has to stay the same before the cache file of the baked reflection is looked up */
+static const int probeLookupFrames = 30;
+
+/** face resolutions of the reflection cubemaps (ascending) */
+static const int reflectionPoolResolutions[REFLECTION_POOL_SIZE] = {128, 256, 512, 1024};
+
+/** key of an object in the GPUResourceCache: its kind, its label and a hash of its contents */
+static std::string cacheKey(const char* kind, const char* label, uint64_t hash) {
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return std::string(kind) + ":" + label + ":" + hex;
+}
+
 /**
  * CubeMapping constructor
  */
@@ -43,17 +77,64 @@ CubeMapping::CubeMapping(COGL4CoreAPI *Api) : RenderPlugin(Api) {
 	wHeight = 300;
 	aspect = 1.0;
 	camHandle = 0;
+	for(int i = 0; i < MAX_CAMERAS-1; i++){
+		cameraViewMX[i] = glm::mat4(1.0f);
+		cameraHandles[i] = 0;
+	}
+	for(int i = 0; i < MAX_CAMERAS; i++){
+		cameraProjMX[i] = glm::mat4(1.0f);
+		cameraTiles[i] = glm::ivec4(0, 0, wWidth, wHeight);
+	}
+	numCameras = 1;
+	activeCamera = 0;
 
 	maxGeomOutVerts = 256;
 	maxGeomTotalOutComp = 1024;
-	cubeGeomMaxVerts = 73;
+	cubeGeomMaxVerts = 64;
 
 	texArrayColor = texArrayDepth = texArrayPicking = texReflectionCubeMap = texSky1 = texSky2 = texSky3 = texEarth = 0;
 	fbo = fbo_layers2Cube = 0;
+	colorTargetFormat = GL_RGB8;
+	reflectionFormat = GL_RGBA8;
+	reflectionResolution = reflectionPoolResolutions[REFLECTION_POOL_SIZE - 1];
+	reflectionLevel = REFLECTION_POOL_SIZE - 1;
+	reflectionBelowFrames = 0;
+	for(int i = 0; i < REFLECTION_POOL_SIZE; i++){
+		reflectionPoolFBOs[i] = reflectionPoolTextures[i] = 0;
+	}
+	layerWidth = layerHeight = 0;
+	viewportArrays = false;
+	atlasSupported = false;
+	virtualSkySelection = 0;
+	for(int i = 0; i < SCENE_TEXTURE_COUNT; i++){
+		textureAtlasIds[i] = -1;
+	}
 
 	pickedID = 0;
+	mirrorObject = -1;
+	meshViewMask = 0;
+	emittedVertices = 0;
+	objectLimit = 0;
 	pickingEnabled = false;
 	ignoreObjectVarUpdate = false;
+	lassoMode = false;
+	regionDragging = false;
+	dragStart = dragEnd = glm::ivec2(0);
+
+	objectDataOffset = objectDataStride = 0;
+
+	sceneRevision = 1;
+	renderedRevision = 0;
+	contentRevision = 1;
+	bakeRequested = reflectionBaked = false;
+	probeObjectsHash = 0;
+	probeHashRevision = probeMissingKey = probeLastKey = 0;
+	probeStableFrames = 0;
+	renderScale = 1.0f;
+	reflectionInterval = 1;
+	reflectionAge = reflectionInterval;
+	reflectionReused = false;
+	feedbackFramesLeft = 0;
 }
 
 /**
@@ -61,6 +142,8 @@ CubeMapping::CubeMapping(COGL4CoreAPI *Api) : RenderPlugin(Api) {
  */
 CubeMapping::~CubeMapping() {
 	Deactivate();
+	// the parked programs and vertex arrays live in the members of the plugin
+	gpuResources.evictParked();
 }
 
 /**
@@ -80,14 +163,26 @@ bool CubeMapping::Init(void) {
  * Called when selecting the plugin, sets up everything.
  */
 bool CubeMapping::Activate(void) {
+	traceSetThreadName("main");
+	TRACE_SPAN(TRACE_LEVEL_INFO, "Activate");
 	// get path of plugin
 	std::string pathName = this->GetCurrentPluginPath();
+	pluginPath = pathName;
 	// lets find out what geometry shader limitations we have before creating shaders and apivars
 	glGetIntegerv(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS, &maxGeomTotalOutComp);
 	glGetIntegerv(GL_MAX_GEOMETRY_OUTPUT_VERTICES, &maxGeomOutVerts);
-	cubeGeomMaxVerts = std::min(maxGeomTotalOutComp/14, maxGeomOutVerts);
-	std::cout	<< "GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS=" << maxGeomTotalOutComp << std::endl
-				<< "GL_MAX_GEOMETRY_OUTPUT_VERTICES=" << maxGeomOutVerts << std::endl;
+	// 16 components per vertex of cube.geom.glsl and mirrorcube.geom.glsl
+	cubeGeomMaxVerts = std::min(maxGeomTotalOutComp/16, maxGeomOutVerts);
+	TRACE_INFO("GL", "GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS=%d GL_MAX_GEOMETRY_OUTPUT_VERTICES=%d",
+			maxGeomTotalOutComp, maxGeomOutVerts);
+	// backend of the layered passes, the shaders are created for it
+	layered.setBackend(LayeredRenderer::best());
+	TRACE_INFO("GL", "layered rendering: %s", LayeredRenderer::name(layered.backend()));
+	// the object shaders sample the atlas or a cubemap per object, the shaders are created for it
+	atlasSupported = CubeMapAtlas::isSupported();
+	if(!atlasSupported){
+		TRACE_INFO("GL", "no cubemap atlas, the objects bind their cubemaps");
+	}
 	
 	//--------------------//
 	// interaction things //
@@ -96,6 +191,19 @@ bool CubeMapping::Activate(void) {
 	this->SelectCurrentManipulator(camHandle);
 	this->SetManipulatorRotation(camHandle, glm::vec3(1,0,0), 50.0f);
 	this->SetManipulatorDolly(camHandle, -10.0f );
+	// the further cameras of the split layouts look at the scene from the other sides
+	for(int i = 0; i < MAX_CAMERAS-1; i++){
+		std::string name = std::string("camera ") + std::to_string(i + 2);
+		cameraHandles[i] = this->AddManipulator(name.c_str(), &this->cameraViewMX[i], Manipulator::MANIPULATOR_ORBIT_VIEW_3D);
+		this->SetManipulatorRotation(cameraHandles[i], glm::vec3(0,1,0), 90.0f*(i + 1));
+		this->SetManipulatorDolly(cameraHandles[i], -10.0f );
+	}
+	this->SelectCurrentManipulator(camHandle);
+
+	EnumPair splitSelection[] = {{SPLIT_SINGLE,"single"},{SPLIT_SIDE_BY_SIDE,"side by side"},{SPLIT_STACKED,"stacked"},{SPLIT_GRID,"2x2"}};
+	splitLayout.Set(this, "split", splitSelection, SPLIT_LAYOUT_COUNT, &CubeMapping::splitLayoutChanged);
+	splitLayout.Register();
+	splitLayout = SPLIT_SINGLE;
 
 	fovY.Set(this, "FoVy");
 	fovY.Register();
@@ -111,7 +219,7 @@ bool CubeMapping::Activate(void) {
 	zFar  = 200.0f;
 
 	EnumPair skyboxSelection[] = {{0,"checkerboard"},{1,"bridge"},{2,"space"},{3,"clouds"}};
-	skyboxTexturing.Set(this,"skybox",skyboxSelection, 4);
+	skyboxTexturing.Set(this,"skybox",skyboxSelection, 4, &CubeMapping::skyboxChanged);
 	skyboxTexturing.Register();
 	skyboxTexturing = 0;
 
@@ -142,6 +250,17 @@ bool CubeMapping::Activate(void) {
 	cube_warpFN.Register();
 	cube_warpFN = 0;
 
+	cube_roughness.Set(this, "roughness", &CubeMapping::pickedObjectModeChanged);
+	cube_roughness.Register();
+	cube_roughness.SetMinMax(0.0f, 1.0f);
+	cube_roughness.SetStep(0.05);
+	cube_roughness = 0.0f;
+
+	selectedObjectsVar.Set(this, "selected_objs");
+	selectedObjectsVar.Register();
+	selectedObjectsVar.SetReadonly(true);
+	selectedObjectsVar = 0;
+
 	pickedIDVar = 0;
 	pickedIDVar.SetVisible(pickingEnabled);
 	picked_x.SetVisible(pickingEnabled);
@@ -150,6 +269,8 @@ bool CubeMapping::Activate(void) {
 	cube_sphere_switch.SetVisible(pickingEnabled);
 	cube_texture_switch.SetVisible(pickingEnabled);
 	cube_warpFN.SetVisible(pickingEnabled);
+	cube_roughness.SetVisible(pickingEnabled);
+	selectedObjectsVar.SetVisible(pickingEnabled);
 
 	subDivLevel.Set(this, "subDivLvl");
 	subDivLevel.Register();
@@ -162,22 +283,185 @@ bool CubeMapping::Activate(void) {
 	// how many subdivlevels can we have given max numer of vertices?
 	// max/2 = x^2+x --> x^2+x-max/2 = 0 --> discr = 1+2*max (b^2-4ac)
 	// x = (-1 + sqrt(discr))/2
-	subDivLevel.SetMinMax(1, (std::sqrt(cubeGeomMaxVerts*2.0+1)-1)/2);
+	subDivLevel.SetMinMax(1, maxSubDivisionLevel());
 	subDivLevel = 1;
 
+	autoLOD.Set(this, "autoLOD");
+	autoLOD.Register();
+	autoLOD = true;
+	lodReflectionBias.Set(this, "lodReflBias");
+	lodReflectionBias.Register();
+	lodReflectionBias.SetMinMax(-4.0f, 2.0f);
+	lodReflectionBias.SetStep(0.25);
+	lodReflectionBias = -1.0f;
+	emittedVerticesVar.Set(this, "geom_verts_M");
+	emittedVerticesVar.Register();
+	emittedVerticesVar.SetReadonly(true);
+
 	parallaxCorrection.Set(this, "prllxCorr");
 	parallaxCorrection.Register();
 	parallaxCorrection.SetStep(0.001);
 	parallaxCorrection = 0;
 
+	frustumCulling.Set(this, "culling");
+	frustumCulling.Register();
+	frustumCulling = true;
+	visibleObjectsVar.Set(this, "visible_objs");
+	visibleObjectsVar.Register();
+	visibleObjectsVar.SetReadonly(true);
+	depthPrepass.Set(this, "depthPrepass");
+	depthPrepass.Register();
+	depthPrepass = false;
+	countOverdraw.Set(this, "countOverdraw", &CubeMapping::overdrawCountingChanged);
+	countOverdraw.Register();
+	countOverdraw = false;
+	overdrawCameraVar.Set(this, "overdraw_cam");
+	overdrawCameraVar.Register();
+	overdrawCameraVar.SetReadonly(true);
+	overdrawCameraVar.SetVisible(false);
+	overdrawReflVar.Set(this, "overdraw_refl");
+	overdrawReflVar.Register();
+	overdrawReflVar.SetReadonly(true);
+	overdrawReflVar.SetVisible(false);
+	EnumPair captureSelection[] = {{CAPTURE_RAW,"raw"},{CAPTURE_PNG,"png"}};
+	captureFormat.Set(this, "captureFormat", captureSelection, CAPTURE_FORMAT_COUNT);
+	captureFormat.Register();
+	captureFormat = CAPTURE_PNG;
+	captureFaces.Set(this, "captureFaces");
+	captureFaces.Register();
+	captureFaces = false;
+	captureVar.Set(this, "capture", &CubeMapping::captureChanged);
+	captureVar.Register();
+	captureVar = false;
+	captureFramesVar.Set(this, "cap_frames");
+	captureFramesVar.Register();
+	captureFramesVar.SetReadonly(true);
+	captureDroppedVar.Set(this, "cap_dropped");
+	captureDroppedVar.Register();
+	captureDroppedVar.SetReadonly(true);
+	EnumPair layeredSelection[] = {{LAYERED_GEOMETRY_SHADER,"geometry shader"},{LAYERED_VERTEX_SHADER,"vertex shader layer"},{LAYERED_MULTI_PASS,"multi pass"}};
+	layeredBackendVar.Set(this, "layered", layeredSelection, LAYERED_BACKEND_COUNT, &CubeMapping::layeredBackendChanged);
+	layeredBackendVar.Register();
+	layeredBackendVar = layered.backend();
+
+	EnumPair mipSelection[] = {{0,"off"},{1,"glGenerateMipmap"},{2,"single pass"}};
+	reflectionMips.Set(this, "reflMips", mipSelection, 3, &CubeMapping::reflectionMipsChanged);
+	reflectionMips.Register();
+	reflectionMips = 2;
+	reflectionGlossy.Set(this, "reflGlossy", &CubeMapping::reflectionMipsChanged);
+	reflectionGlossy.Register();
+	reflectionGlossy = false;
+
+	EnumPair reflResSelection[] = {{0,"auto"},{1,"128"},{2,"256"},{3,"512"},{4,"1024"}};
+	reflectionResMode.Set(this, "reflRes", reflResSelection, 1 + REFLECTION_POOL_SIZE, &CubeMapping::reflectionResChanged);
+	reflectionResMode.Register();
+	reflectionResMode = 0;
+	reflectionResVar.Set(this, "refl_res");
+	reflectionResVar.Register();
+	reflectionResVar.SetReadonly(true);
+	reflectionResVar = reflectionResolution;
+	bakedReflection.Set(this, "bakedRefl", &CubeMapping::bakedReflectionChanged);
+	bakedReflection.Register();
+	bakedReflection = true;
+	probeUsedVar.Set(this, "probe_used");
+	probeUsedVar.Register();
+	probeUsedVar.SetReadonly(true);
+	probeUsedVar = false;
+
+	governorVar.Set(this, "governor", &CubeMapping::governorChanged);
+	governorVar.Register();
+	targetFrameMs.Set(this, "targetMs");
+	targetFrameMs.Register();
+	targetFrameMs.SetMinMax(1.0f, 100.0f);
+	targetFrameMs.SetStep(0.5);
+	targetFrameMs = 16.0f;
+	govGpuMsVar.Set(this, "gov_gpu_ms");
+	govGpuMsVar.Register();
+	govGpuMsVar.SetReadonly(true);
+	govSubDivVar.Set(this, "gov_subdiv");
+	govSubDivVar.Register();
+	govSubDivVar.SetReadonly(true);
+	govScaleVar.Set(this, "gov_scale");
+	govScaleVar.Register();
+	govScaleVar.SetReadonly(true);
+	govReflIntervalVar.Set(this, "gov_refl_n");
+	govReflIntervalVar.Register();
+	govReflIntervalVar.SetReadonly(true);
+	governorVar = false;
+
+	EnumPair formatSelection[] = {{0,"RGB8 (LDR)"},{1,"RGB16F"},{2,"R11F_G11F_B10F"}};
+	colorFormat.Set(this, "colorFormat", formatSelection, 3, &CubeMapping::colorFormatChanged);
+	colorFormat.Register();
+	colorFormat = 0;
+
+	exposure.Set(this, "exposure");
+	exposure.Register();
+	exposure.SetStep(0.1);
+	exposure = 0.0f;
+
+	EnumPair toneMapSelection[] = {{0,"none"},{1,"Reinhard"},{2,"ACES"}};
+	toneMapping.Set(this, "toneMap", toneMapSelection, 3);
+	toneMapping.Register();
+	toneMapping = 0;
+
+	EnumPair compressionSelection[] = {{BLOCK_FORMAT_NONE,"none"},{BLOCK_FORMAT_BC1,"BC1"},{BLOCK_FORMAT_BC7,"BC7"}};
+	texCompression.Set(this, "texCompression", compressionSelection, 3, &CubeMapping::texCompressionChanged);
+	texCompression.Register();
+	texCompression = BLOCK_FORMAT_NONE;
+
+	virtualTexturing.Set(this, "virtualTex", &CubeMapping::virtualTexturingChanged);
+	virtualTexturing.Register();
+	virtualTexturing = false;
+	vtResidentPages.Set(this, "vt_pages");
+	vtResidentPages.Register();
+	vtResidentPages.SetReadonly(true);
+
+	vramTotal.Set(this, "vram_MB");
+	vramTotal.Register();
+	vramTotal.SetReadonly(true);
+	vramTextures.Set(this, "vram_tex_MB");
+	vramTextures.Register();
+	vramTextures.SetReadonly(true);
+	vramRenderTargets.Set(this, "vram_rt_MB");
+	vramRenderTargets.Register();
+	vramRenderTargets.SetReadonly(true);
+	vramBuffers.Set(this, "vram_buf_MB");
+	vramBuffers.Register();
+	vramBuffers.SetReadonly(true);
+	graphTargetsVar.Set(this, "rg_targets_MB");
+	graphTargetsVar.Register();
+	graphTargetsVar.SetReadonly(true);
+	graphBarriersVar.Set(this, "rg_barriers");
+	graphBarriersVar.Register();
+	graphBarriersVar.SetReadonly(true);
+	graphSkippedVar.Set(this, "rg_skipped");
+	graphSkippedVar.Register();
+	graphSkippedVar.SetReadonly(true);
+	// the resource cache outlives the plugin (see GPUResourceCache), the vars show its state
+	cacheVar.Set(this, "cache_MB");
+	cacheVar.Register();
+	cacheVar.SetReadonly(true);
+	cacheLimitVar.Set(this, "cache_limit_MB", &CubeMapping::cacheLimitChanged);
+	cacheLimitVar.Register();
+	cacheLimitVar.SetMinMax(0, 4096);
+	cacheLimitVar = static_cast<int>(GPUResourceCache::shared().limit()/(1024*1024));
+	cacheHitsVar.Set(this, "cache_hits");
+	cacheHitsVar.Register();
+	cacheHitsVar.SetReadonly(true);
+
 	//---------------//
 	// vertex arrays //
 	// --------------//
-	vaQuad.Create(4);
-	vaQuad.SetArrayBuffer(0, GL_FLOAT, 2, ogl4_2dQuadVerts);
+	// the vertex arrays are kept in the resource cache while the plugin is inactive,
+	// they are identified by a hash of the data they are built from
+	std::string quadKey = cacheKey("vertexarray", "quad", hashBytes(ogl4_2dQuadVerts, 4*2*sizeof(float)));
+	if(!gpuResources.restoreVertexArray(&vaQuad, quadKey)){
+		vaQuad.Create(4);
+		vaQuad.SetArrayBuffer(0, GL_FLOAT, 2, ogl4_2dQuadVerts);
+		gpuResources.addVertexArray(&vaQuad, "quad", 4*2*sizeof(float), quadKey);
+	}
 
 	// create vertex array for cube faces with quad coordinates and permutation matrices
-	vaSkybox.Create(4*6);
 	float quadVerts6X[8*6] = {
 		-.5,-.5,  .5,-.5,  -.5,.5,  .5,.5,
 		-.5,-.5,  .5,-.5,  -.5,.5,  .5,.5,
@@ -186,7 +470,6 @@ bool CubeMapping::Activate(void) {
 		-.5,-.5,  .5,-.5,  -.5,.5,  .5,.5,
 		-.5,-.5,  .5,-.5,  -.5,.5,  .5,.5
 	};
-	vaSkybox.SetArrayBuffer(0, GL_FLOAT, 2, quadVerts6X);
 	uint cubeFaces[6*6] = {
 		0+0*4, 1+0*4, 2+0*4 ,   3+0*4, 2+0*4, 1+0*4,
 		0+1*4, 1+1*4, 2+1*4 ,   3+1*4, 2+1*4, 1+1*4,
@@ -195,7 +478,6 @@ bool CubeMapping::Activate(void) {
 		0+4*4, 1+4*4, 2+4*4 ,   3+4*4, 2+4*4, 1+4*4,
 		0+5*4, 1+5*4, 2+5*4 ,   3+5*4, 2+5*4, 1+5*4
 	};
-	vaSkybox.SetElementBuffer(0, 6*6, cubeFaces);
 	// create the permutation matrices
 	// (written down in row major, so we need to transpose the matrices 
 	//  later or think about the columns as rows)
@@ -237,14 +519,26 @@ bool CubeMapping::Activate(void) {
 			}
 		}
 	}
-	vaSkybox.SetArrayBuffer(1,GL_FLOAT,3,permRowX);
-	vaSkybox.SetElementBuffer(1, 6*6, cubeFaces);
-	vaSkybox.SetArrayBuffer(2,GL_FLOAT,3,permRowY);
-	vaSkybox.SetElementBuffer(2, 6*6, cubeFaces);
-	vaSkybox.SetArrayBuffer(3,GL_FLOAT,3,permRowZ);
-	vaSkybox.SetElementBuffer(3, 6*6, cubeFaces);
+	uint64_t skyboxHash = hashBytes(quadVerts6X, sizeof(quadVerts6X));
+	skyboxHash = hashBytes(cubeFaces, sizeof(cubeFaces), skyboxHash);
+	skyboxHash = hashBytes(permRowX, sizeof(permRowX), skyboxHash);
+	skyboxHash = hashBytes(permRowY, sizeof(permRowY), skyboxHash);
+	skyboxHash = hashBytes(permRowZ, sizeof(permRowZ), skyboxHash);
+	std::string skyboxKey = cacheKey("vertexarray", "skybox", skyboxHash);
+	if(!gpuResources.restoreVertexArray(&vaSkybox, skyboxKey)){
+		vaSkybox.Create(4*6);
+		vaSkybox.SetArrayBuffer(0, GL_FLOAT, 2, quadVerts6X);
+		vaSkybox.SetElementBuffer(0, 6*6, cubeFaces);
+		vaSkybox.SetArrayBuffer(1,GL_FLOAT,3,permRowX);
+		vaSkybox.SetElementBuffer(1, 6*6, cubeFaces);
+		vaSkybox.SetArrayBuffer(2,GL_FLOAT,3,permRowY);
+		vaSkybox.SetElementBuffer(2, 6*6, cubeFaces);
+		vaSkybox.SetArrayBuffer(3,GL_FLOAT,3,permRowZ);
+		vaSkybox.SetElementBuffer(3, 6*6, cubeFaces);
+		gpuResources.addVertexArray(&vaSkybox, "skybox",
+				sizeof(quadVerts6X) + sizeof(permRowX)+sizeof(permRowY)+sizeof(permRowZ) + 4*sizeof(cubeFaces), skyboxKey);
+	}
 
-	vaCube.Create(6*4);
 	float subQuadCornerVerts6X[8*6] = {
 		-.5,-.5,  0,-.5,  -.5,0,  0,0,
 		-.5,-.5,  0,-.5,  -.5,0,  0,0,
@@ -254,18 +548,32 @@ bool CubeMapping::Activate(void) {
 		-.5,-.5,  0,-.5,  -.5,0,  0,0
 	};
 	uint indices[24] = {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23};
-	vaCube.SetArrayBuffer(0,GL_FLOAT,2,subQuadCornerVerts6X);
-	vaCube.SetElementBuffer(0,6*4,indices);
 	uint permMXindices[24] = {
 		0,0,0,0, 1,1,1,1, 2,2,2,2,
 		3,3,3,3, 4,4,4,4, 5,5,5,5
 	};
-	vaCube.SetArrayBuffer(1,GL_UNSIGNED_INT, 1, permMXindices);
-	vaCube.SetElementBuffer(1,6*4,indices);
+	uint64_t cubeHash = hashBytes(subQuadCornerVerts6X, sizeof(subQuadCornerVerts6X));
+	cubeHash = hashBytes(indices, sizeof(indices), cubeHash);
+	cubeHash = hashBytes(permMXindices, sizeof(permMXindices), cubeHash);
+	std::string cubeKey = cacheKey("vertexarray", "cube", cubeHash);
+	if(!gpuResources.restoreVertexArray(&vaCube, cubeKey)){
+		vaCube.Create(6*4);
+		vaCube.SetArrayBuffer(0,GL_FLOAT,2,subQuadCornerVerts6X);
+		vaCube.SetElementBuffer(0,6*4,indices);
+		vaCube.SetArrayBuffer(1,GL_UNSIGNED_INT, 1, permMXindices);
+		vaCube.SetElementBuffer(1,6*4,indices);
+		gpuResources.addVertexArray(&vaCube, "cube", sizeof(subQuadCornerVerts6X) + sizeof(permMXindices) + 2*sizeof(indices), cubeKey);
+	}
 
-	vaBox.Create(8);
-	vaBox.SetArrayBuffer(0, GL_FLOAT, 4, ogl4_4dBoxVerts);
-	vaBox.SetElementBuffer(0, ogl4_numBoxEdges*2, ogl4_BoxEdges);
+	uint64_t boxHash = hashBytes(ogl4_4dBoxVerts, 8*4*sizeof(float));
+	boxHash = hashBytes(ogl4_BoxEdges, ogl4_numBoxEdges*2*sizeof(uint), boxHash);
+	std::string boxKey = cacheKey("vertexarray", "box", boxHash);
+	if(!gpuResources.restoreVertexArray(&vaBox, boxKey)){
+		vaBox.Create(8);
+		vaBox.SetArrayBuffer(0, GL_FLOAT, 4, ogl4_4dBoxVerts);
+		vaBox.SetElementBuffer(0, ogl4_numBoxEdges*2, ogl4_BoxEdges);
+		gpuResources.addVertexArray(&vaBox, "box", 8*4*sizeof(float) + ogl4_numBoxEdges*2*sizeof(uint), boxKey);
+	}
 
 	//---------//
 	// shaders //
@@ -276,9 +584,15 @@ bool CubeMapping::Activate(void) {
 	skyboxVertShaderName = pathName + std::string("/resources/skybox.vert.glsl");
 	skyboxGeomShaderName = pathName + std::string("/resources/skybox.geom.glsl");
 	skyboxFragShaderName = pathName + std::string("/resources/skybox.frag.glsl");
+	skyboxLayeredVertShaderName = pathName + std::string("/resources/skybox_layered.vert.glsl");
+	skyboxFeedbackFragShaderName = pathName + std::string("/resources/skybox_feedback.frag.glsl");
 	cubeVertShaderName =  pathName + std::string("/resources/cube.vert.glsl");
 	cubeGeomShaderName =  pathName + std::string("/resources/cube.geom.glsl");
 	cubeFragShaderName =  pathName + std::string("/resources/cube.frag.glsl");
+	cubeLayeredVertShaderName =  pathName + std::string("/resources/cube_layered.vert.glsl");
+	meshLayeredVertShaderName =  pathName + std::string("/resources/mesh_layered.vert.glsl");
+	cubeFeedbackFragShaderName =  pathName + std::string("/resources/cube_feedback.frag.glsl");
+	depthFragShaderName =  pathName + std::string("/resources/depth.frag.glsl");
 	mirrorcubeGeomShaderName =  pathName + std::string("/resources/mirrorcube.geom.glsl");
 	mirrorcubeFragShaderName =  pathName + std::string("/resources/mirrorcube.frag.glsl");
 	boxVertShaderName = pathName + std::string("/resources/box.vert.glsl");
@@ -286,43 +600,45 @@ bool CubeMapping::Activate(void) {
 	layers2cubeVertShaderName = pathName + std::string("/resources/layers2cubemap.vert.glsl");
 	layers2cubeGeomShaderName = pathName + std::string("/resources/layers2cubemap.geom.glsl");
 	layers2cubeFragShaderName = pathName + std::string("/resources/layers2cubemap.frag.glsl");
+	layers2cubeLayeredVertShaderName = pathName + std::string("/resources/layers2cubemap_layered.vert.glsl");
+	pickRegionCompShaderName = pathName + std::string("/resources/pickregion.comp.glsl");
+	cubeMipsCompShaderName = pathName + std::string("/resources/cubemips.comp.glsl");
+	cubePrefilterCompShaderName = pathName + std::string("/resources/cubeprefilter.comp.glsl");
 	createShaders();
+	regionSelection.create(gpuResources);
 
 	//----------//
 	// textures //
 	//----------//
 
-	texSky1 = loadCubeMapTexture(pathName + std::string("/resources/skyboxes/bridge"), light1);
-	texSky2 = loadCubeMapTexture(pathName + std::string("/resources/skyboxes/space"),  light2);
-	texSky3 = loadCubeMapTexture(pathName + std::string("/resources/skyboxes/clouds"), light3);
-	texEarth= loadCubeMapTexture(pathName + std::string("/resources/skyboxes/earth"),  lightE);
+	loadTextures();
 
 	//----------------------//
 	// Frame Buffer Objects //
 	//----------------------//
+	// the reflection faces are rendered at their own resolution with viewport arrays
+	viewportArrays = gl3wIsSupported(4, 1) != 0;
 	initFBO();
+	updateMemoryVars();
 
 	//-------//
 	// scene //
 	//-------//
 	modelMX_sky = glm::scale(glm::mat4x4(1), glm::vec3(100));
-
-	cube1 = Object(1, glm::translate(glm::mat4x4(1), glm::vec3( 0)),&vaCube,GL_POINTS,4*6,&shaderMirrorcube,0);
-	objects.push_back(&cube1);
-	cube2 = Object(2, glm::translate(glm::mat4x4(1), glm::vec3( 2)),&vaCube,GL_POINTS,4*6,&shaderCube,0);
-	objects.push_back(&cube2);
-	cube3 = Object(3, glm::translate(glm::mat4x4(1), glm::vec3(-2)),&vaCube,GL_POINTS,4*6,&shaderCube,0);
-	objects.push_back(&cube3);
-
-	cube1.texID = texReflectionCubeMap;
-	cube2.texID = texSky1;
-	cube3.texID = texEarth;
-	cube1.useTexture = true;
+	loadDefaultScene();
 
 	//------//
 	// misc //
 	//------//
 	glEnable(GL_DEPTH_TEST);
+	// the skybox is drawn at the far plane after the objects (and the shading pass after a depth prepass)
+	glDepthFunc(GL_LEQUAL);
+	// the mip levels of the reflection are filtered across face edges
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	// render the first frame in any case
+	sceneRevision++;
+	TRACE_INFO("cache", "resource cache: %u hits, %u misses, %.2f MB parked", GPUResourceCache::shared().hits(),
+			GPUResourceCache::shared().misses(), GPUResourceCache::shared().bytes()/(1024.0*1024.0));
 
 	return true;
 }
@@ -335,55 +651,183 @@ std::string readCubeGeometryShaderAndSetupMaxVerts(std::string shaderFileName, u
 	std::ifstream ifs(shaderFileName.c_str());
 	std::string content( (std::istreambuf_iterator<char>(ifs) ),
 											 (std::istreambuf_iterator<char>()    ) );
-	std::string toReplace("max_vertices=73");
-	size_t idx = content.find(toReplace);
-	std::string replacement = std::string("max_vertices=") + std::to_string(maxVerts);
-	content.replace(idx, toReplace.length(), replacement);
-	return content;
+	return setupMaxVertices(content, maxVerts);
+}
+
+/**
+ * reads a shader source from file and inserts the preprocessor definitions
+ * of the layered backend after its #version line.
+ */
+static std::string readShaderAndInsertDefines(const std::string& shaderFileName, const std::string& defines){
+	std::ifstream ifs(shaderFileName.c_str());
+	std::string content( (std::istreambuf_iterator<char>(ifs) ),
+											 (std::istreambuf_iterator<char>()    ) );
+	return insertShaderDefines(content, defines);
+}
+
+/** uniform buffer binding points of the uniform blocks (see FrameDataRing) */
+static const GLuint frameDataBinding = 0;
+static const GLuint objectDataBinding = 1;
+
+/**
+ * Assigns the binding points to the FrameData and ObjectData blocks of a program
+ * (the shaders are GLSL 3.30, which has no binding layout qualifier).
+ */
+static void bindUniformBlocks(GLShader& shader) {
+	shader.Bind();
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	GLuint frameBlock = glGetUniformBlockIndex(program, "FrameData");
+	if(frameBlock != GL_INVALID_INDEX){
+		glUniformBlockBinding(program, frameBlock, frameDataBinding);
+	}
+	GLuint objectBlock = glGetUniformBlockIndex(program, "ObjectData");
+	if(objectBlock != GL_INVALID_INDEX){
+		glUniformBlockBinding(program, objectBlock, objectDataBinding);
+	}
+	shader.Release();
+}
+
+/** source of a shader stage */
+typedef struct ShaderStage_t {
+	GLenum type;        //!< GL_VERTEX_SHADER, ...
+	std::string source;
+} ShaderStage;
+
+/**
+ * Builds a program from the sources of its stages or takes it from the resource cache
+ * if it was built from the same sources before (the cache key is a hash of the sources).
+ */
+static void buildProgram(GPUResources& resources, GLShader& shader, const char* label, const std::vector<ShaderStage>& stages) {
+	uint64_t h = hashBasis;
+	for(size_t i = 0; i < stages.size(); i++){
+		h = hashBytes(&stages[i].type, sizeof(GLenum), h);
+		h = hashBytes(stages[i].source.data(), stages[i].source.size(), h);
+	}
+	std::string key = cacheKey("program", label, h);
+	if(resources.restoreProgram(&shader, key)){
+		return;
+	}
+	TRACE_DEBUG("shader", "building program %s", label);
+	shader.CreateEmptyProgram();
+	for(size_t i = 0; i < stages.size(); i++){
+		shader.AttachShaderFromString(stages[i].source.c_str(), stages[i].source.length(), stages[i].type);
+	}
+	shader.Link();
+	bindUniformBlocks(shader);
+	resources.addProgram(&shader, label, key);
 }
 
 /**
- * Creates all the shader programs from the previously set source file names
+ * Creates all the shader programs from the previously set source file names.
+ * Programs whose sources did not change since the plugin was deactivated are taken
+ * from the resource cache instead of being compiled again.
  */
 void CubeMapping::createShaders(){
-	shaderQuad.CreateProgramFromFile( quadVertShaderName.c_str(), quadFragShaderName.c_str() );
-	shaderSkybox.CreateProgramFromFile( skyboxVertShaderName.c_str(), skyboxGeomShaderName.c_str(), skyboxFragShaderName.c_str() );
-	shaderBox.CreateProgramFromFile(boxVertShaderName.c_str(), boxFragShaderName.c_str());
-	shaderLayers2Cube.CreateProgramFromFile(layers2cubeVertShaderName.c_str(), layers2cubeGeomShaderName.c_str(), layers2cubeFragShaderName.c_str());
+	TRACE_SPAN(TRACE_LEVEL_INFO, "createShaders");
+	std::string quadVertSrc = readShaderAndInsertDefines(quadVertShaderName, "");
+	std::string quadFragSrc = readShaderAndInsertDefines(quadFragShaderName, "");
+	std::string skyboxVertSrc = readShaderAndInsertDefines(skyboxVertShaderName, "");
+	std::string skyboxGeomSrc = readShaderAndInsertDefines(skyboxGeomShaderName, "");
+	std::string cubeVertSrc = readShaderAndInsertDefines(cubeVertShaderName, "");
+	std::string depthFragSrc = readShaderAndInsertDefines(depthFragShaderName, "");
+	buildProgram(gpuResources, shaderQuad, "quad", {{GL_VERTEX_SHADER, quadVertSrc}, {GL_FRAGMENT_SHADER, quadFragSrc}});
+	buildProgram(gpuResources, shaderSkyboxFeedback, "skybox feedback", {{GL_VERTEX_SHADER, skyboxVertSrc},
+			{GL_GEOMETRY_SHADER, skyboxGeomSrc}, {GL_FRAGMENT_SHADER, readShaderAndInsertDefines(skyboxFeedbackFragShaderName, "")}});
+	buildProgram(gpuResources, shaderBox, "box", {{GL_VERTEX_SHADER, readShaderAndInsertDefines(boxVertShaderName, "")},
+			{GL_FRAGMENT_SHADER, readShaderAndInsertDefines(boxFragShaderName, "")}});
 
 	// want to alter geometry shaders max_vertices declaration, so we cannot directly load it from file
-	shaderCube.CreateEmptyProgram();
-	shaderCube.AttachShaderFromFile(cubeVertShaderName.c_str(), GL_VERTEX_SHADER);
-	shaderCube.AttachShaderFromFile(cubeFragShaderName.c_str(), GL_FRAGMENT_SHADER);
 	std::string cubeGeomSrc = readCubeGeometryShaderAndSetupMaxVerts(cubeGeomShaderName, cubeGeomMaxVerts);
-	shaderCube.AttachShaderFromString(cubeGeomSrc.c_str(), cubeGeomSrc.length(), GL_GEOMETRY_SHADER);
-	shaderCube.Link();
-
-	shaderMirrorcube.CreateEmptyProgram();
-	shaderMirrorcube.AttachShaderFromFile(cubeVertShaderName.c_str(), GL_VERTEX_SHADER);
-	shaderMirrorcube.AttachShaderFromFile(mirrorcubeFragShaderName.c_str(), GL_FRAGMENT_SHADER);
-	std::string mirrorcubeGeomSrc = readCubeGeometryShaderAndSetupMaxVerts(mirrorcubeGeomShaderName, cubeGeomMaxVerts);
-	shaderMirrorcube.AttachShaderFromString(mirrorcubeGeomSrc.c_str(), mirrorcubeGeomSrc.length(), GL_GEOMETRY_SHADER);
-	shaderMirrorcube.Link();
+	// the layered passes render the views of all cameras (the feedback pass camera 0 and the reflection only)
+	std::string viewDefines = viewShaderDefines();
+	// the fragment shaders of the layered passes count the shaded fragments while countOverdraw is checked
+	std::string overdrawDefines = overdrawCounter.isCreated() ? OverdrawCounter::shaderDefines(layered.backend() == LAYERED_MULTI_PASS) : "";
+	std::string skyboxFragSrc = readShaderAndInsertDefines(skyboxFragShaderName, overdrawDefines);
+	std::string cubeFragSrc = readShaderAndInsertDefines(cubeFragShaderName,
+			overdrawDefines + (atlasSupported ? "#define CUBE_MAP_ATLAS\n" : ""));
+	// the depth prepass uses the vertex stages of the cube shader
+	std::vector<ShaderStage> cubeStages;
+	if(layered.usesGeometryShader()){
+		std::string cubeGeomViewsSrc = insertShaderDefines(cubeGeomSrc, viewDefines);
+		buildProgram(gpuResources, shaderSkybox, "skybox", {{GL_VERTEX_SHADER, skyboxVertSrc},
+				{GL_GEOMETRY_SHADER, insertShaderDefines(skyboxGeomSrc, viewDefines)}, {GL_FRAGMENT_SHADER, skyboxFragSrc}});
+		buildProgram(gpuResources, shaderLayers2Cube, "layers2cube", {
+				{GL_VERTEX_SHADER, readShaderAndInsertDefines(layers2cubeVertShaderName, "")},
+				{GL_GEOMETRY_SHADER, readShaderAndInsertDefines(layers2cubeGeomShaderName, "")},
+				{GL_FRAGMENT_SHADER, readShaderAndInsertDefines(layers2cubeFragShaderName, "")}});
+		cubeStages = {{GL_VERTEX_SHADER, cubeVertSrc}, {GL_GEOMETRY_SHADER, cubeGeomViewsSrc}};
+	} else {
+		// the vertex shaders select the view themselves (instance or pass, see LayeredRenderer.h)
+		std::string defines = layered.shaderDefines() + viewDefines;
+		buildProgram(gpuResources, shaderSkybox, "skybox", {
+				{GL_VERTEX_SHADER, readShaderAndInsertDefines(skyboxLayeredVertShaderName, defines)},
+				{GL_FRAGMENT_SHADER, skyboxFragSrc}});
+		buildProgram(gpuResources, shaderLayers2Cube, "layers2cube", {
+				{GL_VERTEX_SHADER, readShaderAndInsertDefines(layers2cubeLayeredVertShaderName, defines)},
+				{GL_FRAGMENT_SHADER, readShaderAndInsertDefines(layers2cubeFragShaderName, "")}});
+		cubeStages = {{GL_VERTEX_SHADER, readShaderAndInsertDefines(cubeLayeredVertShaderName, defines)}};
+	}
+	std::vector<ShaderStage> cubeDepthStages = cubeStages;
+	cubeStages.push_back({GL_FRAGMENT_SHADER, cubeFragSrc});
+	cubeDepthStages.push_back({GL_FRAGMENT_SHADER, depthFragSrc});
+	buildProgram(gpuResources, shaderCube, "cube", cubeStages);
+	buildProgram(gpuResources, shaderCubeDepth, "cube depth", cubeDepthStages);
+	// imported meshes select the view in the vertex shader with every backend (see LayeredRenderer.h),
+	// drawn per view they render into a single layer and count the overdraw of the view uniform
+	std::string meshVertSrc = readShaderAndInsertDefines(meshLayeredVertShaderName, layered.meshShaderDefines() + viewDefines);
+	std::string meshFragSrc = cubeFragSrc;
+	if(layered.meshesPerView() && overdrawCounter.isCreated()){
+		meshFragSrc = readShaderAndInsertDefines(cubeFragShaderName,
+				OverdrawCounter::shaderDefines(true) + (atlasSupported ? "#define CUBE_MAP_ATLAS\n" : ""));
+	}
+	buildProgram(gpuResources, shaderMesh, "mesh", {{GL_VERTEX_SHADER, meshVertSrc}, {GL_FRAGMENT_SHADER, meshFragSrc}});
+	buildProgram(gpuResources, shaderMeshDepth, "mesh depth", {{GL_VERTEX_SHADER, meshVertSrc}, {GL_FRAGMENT_SHADER, depthFragSrc}});
+
+	buildProgram(gpuResources, shaderCubeFeedback, "cube feedback", {{GL_VERTEX_SHADER, cubeVertSrc},
+			{GL_FRAGMENT_SHADER, readShaderAndInsertDefines(cubeFeedbackFragShaderName, "")}, {GL_GEOMETRY_SHADER, cubeGeomSrc}});
+
+	// the mirror pass always writes the layer from the geometry shader
+	std::string mirrorcubeFragSrc = readShaderAndInsertDefines(mirrorcubeFragShaderName,
+			overdrawCounter.isCreated() ? OverdrawCounter::shaderDefines(false) : "");
+	std::string mirrorcubeGeomSrc = insertShaderDefines(
+			readCubeGeometryShaderAndSetupMaxVerts(mirrorcubeGeomShaderName, cubeGeomMaxVerts), viewDefines);
+	buildProgram(gpuResources, shaderMirrorcube, "mirrorcube", {{GL_VERTEX_SHADER, cubeVertSrc},
+			{GL_FRAGMENT_SHADER, mirrorcubeFragSrc}, {GL_GEOMETRY_SHADER, mirrorcubeGeomSrc}});
+	buildProgram(gpuResources, shaderMirrorcubeDepth, "mirrorcube depth", {{GL_VERTEX_SHADER, cubeVertSrc},
+			{GL_FRAGMENT_SHADER, depthFragSrc}, {GL_GEOMETRY_SHADER, mirrorcubeGeomSrc}});
+
+	// rectangle and lasso selection reduce the picking buffer with a compute shader
+	if(gl3wIsSupported(4, 3)){
+		buildProgram(gpuResources, shaderPickRegion, "pick region",
+				{{GL_COMPUTE_SHADER, readShaderAndInsertDefines(pickRegionCompShaderName, "")}});
+		// mip chain of the reflection cubemap
+		buildProgram(gpuResources, shaderCubeMips, "cube mips",
+				{{GL_COMPUTE_SHADER, readShaderAndInsertDefines(cubeMipsCompShaderName, "")}});
+		buildProgram(gpuResources, shaderCubePrefilter, "cube prefilter",
+				{{GL_COMPUTE_SHADER, readShaderAndInsertDefines(cubePrefilterCompShaderName, "")}});
+	}
 }
 
 /**
  * Releases and deletes all shader programs
  */
 void CubeMapping::deleteShaders(){
-	shaderQuad.Release();
-	shaderSkybox.Release();
-	shaderCube.Release();
-	shaderMirrorcube.Release();
-	shaderBox.Release();
-	shaderLayers2Cube.Release();
-
-	shaderQuad.RemoveAllShaders();
-	shaderSkybox.RemoveAllShaders();
-	shaderCube.RemoveAllShaders();
-	shaderMirrorcube.RemoveAllShaders();
-	shaderBox.RemoveAllShaders();
-	shaderLayers2Cube.RemoveAllShaders();
+	gpuResources.releaseProgram(&shaderQuad);
+	gpuResources.releaseProgram(&shaderSkybox);
+	gpuResources.releaseProgram(&shaderCube);
+	gpuResources.releaseProgram(&shaderMirrorcube);
+	gpuResources.releaseProgram(&shaderBox);
+	gpuResources.releaseProgram(&shaderLayers2Cube);
+	gpuResources.releaseProgram(&shaderSkyboxFeedback);
+	gpuResources.releaseProgram(&shaderCubeFeedback);
+	gpuResources.releaseProgram(&shaderCubeDepth);
+	gpuResources.releaseProgram(&shaderMirrorcubeDepth);
+	gpuResources.releaseProgram(&shaderMesh);
+	gpuResources.releaseProgram(&shaderMeshDepth);
+	gpuResources.releaseProgram(&shaderPickRegion);
+	gpuResources.releaseProgram(&shaderCubeMips);
+	gpuResources.releaseProgram(&shaderCubePrefilter);
 }
 
 /** tries to read a uint from the specified file */
@@ -391,7 +835,7 @@ uint readResolutionFromFile(std::string filepath) {
 	std::ifstream in;
 	in.open(filepath);
 	if (!in.is_open()) {
-		std::fprintf(stderr, "could not load file, so sorry [%s]\n", filepath.c_str());
+		TRACE_ERROR("texture", "could not load file, so sorry [%s]", filepath.c_str());
 		return false;
 	}
 	uint resolution;
@@ -405,7 +849,7 @@ void readLightLocationFromFile(std::string filepath, glm::vec3 &lightLoc) {
 	std::ifstream in;
 	in.open(filepath);
 	if (!in.is_open()) {
-		std::fprintf(stderr, "could not load file, so sorry [%s]\n", filepath.c_str());
+		TRACE_ERROR("texture", "could not load file, so sorry [%s]", filepath.c_str());
 		return;
 	}
 	in >> lightLoc.x;
@@ -414,6 +858,47 @@ void readLightLocationFromFile(std::string filepath, glm::vec3 &lightLoc) {
 	in.close();
 }
 
+/** checks if the specified file exists (can be opened for reading) */
+bool fileExists(std::string filepath) {
+	std::ifstream in(filepath.c_str());
+	return in.is_open();
+}
+
+/**
+ * Decodes the 6 HDR face images in parallel and converts them to the
+ * specified upload format (GL_RGB16F -> half floats, GL_R11F_G11F_B10F -> packed uint).
+ * @return false if any face could not be decoded
+ */
+bool decodeHDRFaces(const std::string faceFiles[6], GLenum internalFormat,
+		std::vector<uint16_t> halfFaces[6], std::vector<uint32_t> packedFaces[6], int& resolution)
+{
+	FloatImage images[6];
+	bool ok[6];
+	ThreadPool::shared().parallelFor(6, [&](unsigned i){
+		ok[i] = loadHDRImage(faceFiles[i], images[i]);
+		if(!ok[i]){
+			return;
+		}
+		if(internalFormat == GL_RGB16F){
+			convertToHalf(images[i], halfFaces[i]);
+		} else {
+			convertToR11G11B10F(images[i], packedFaces[i]);
+		}
+	});
+	resolution = images[0].width;
+	for(uint i = 0; i < 6; i++){
+		if(!ok[i]){
+			return false;
+		}
+		if(images[i].width != resolution || images[i].height != resolution){
+			TRACE_ERROR("texture", "cubemap face has wrong size %dx%d (expected %dx%d) [%s]",
+					images[i].width, images[i].height, resolution, resolution, faceFiles[i].c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
 /**
  * Creates a cubemap texture and loads the individual images for the faces into it.
  * The cubemap images are expected to be in a directory that contains the files
@@ -422,33 +907,140 @@ void readLightLocationFromFile(std::string filepath, glm::vec3 &lightLoc) {
  * which states the width and height of the cubemap face images.
  * It also contains the text file lightloc.txt which contains 3 floats forming
  * a vec3 which defines the light direction associated with the cubemap (skybox) 
+ * Instead of the png files the directory may contain high dynamic range faces
+ * (negx.hdr, ... or negx.exr, ...) which are decoded in parallel and uploaded
+ * as RGB16F or R11F_G11F_B10F depending on the selected color format.
+ * When rendering in HDR, png faces are uploaded as sRGB so that all shading
+ * happens in linear space.
+ * A directory that only contains a tiled cubemap (tiles.vcm, see VirtualCubeMap.h) is
+ * loaded at the resolution of its coarsest level, the full resolution is only
+ * available through virtual texturing.
+ * If texture compression is selected, png faces are block compressed (BC1 or BC7).
+ * The compressed blocks are cached next to the faces (posx.png.bc7, ...) and only
+ * encoded again when the png file changes.
+ * The texture is kept in the resource cache while the plugin is inactive, it is identified
+ * by size and modification time of its sources and the settings that change the upload.
  */
 GLuint CubeMapping::loadCubeMapTexture(std::string directory, glm::vec3& light_location)
 {
-	std::string faceFileNames[6] = {
-		"negx.png","posx.png",
-		"negy.png","posy.png",
-		"negz.png","posz.png"
+	TRACE_SPAN_DETAIL(TRACE_LEVEL_INFO, "loadCubeMapTexture", directory.c_str());
+	std::string faceNames[6] = {
+		"negx","posx",
+		"negy","posy",
+		"negz","posz"
 	};
 	GLenum targets[6] = {
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_X, GL_TEXTURE_CUBE_MAP_POSITIVE_X,
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, GL_TEXTURE_CUBE_MAP_POSITIVE_Z
 	};
-	uint resolution = readResolutionFromFile(directory + std::string("/resolution.txt"));
+	// look for high dynamic range faces first
+	std::string hdrExtension;
+	if(fileExists(directory + "/posx.hdr")){
+		hdrExtension = ".hdr";
+	} else if(fileExists(directory + "/posx.exr")){
+		hdrExtension = ".exr";
+	}
+	bool tiled = hdrExtension.empty() && !fileExists(directory + "/posx.png") && fileExists(directory + "/tiles.vcm");
+	std::vector<std::string> sources;
+	if(tiled){
+		sources.push_back(directory + "/tiles.vcm");
+	} else {
+		for(uint i = 0; i < 6; i++){
+			sources.push_back(directory + std::string("/") + faceNames[i] + (hdrExtension.empty() ? std::string(".png") : hdrExtension));
+		}
+		sources.push_back(directory + std::string("/resolution.txt"));
+	}
+	uint32_t settings[3] = {static_cast<uint32_t>(colorTargetFormat), isHDRPipeline() ? 1u : 0u, static_cast<uint32_t>(texCompression.GetValue())};
+	uint64_t h = hashBytes(settings, sizeof(settings));
+	for(size_t i = 0; i < sources.size(); i++){
+		uint64_t size = 0;
+		int64_t time = 0;
+		sourceStamp(sources[i], size, time);
+		h = hashBytes(sources[i].data(), sources[i].size(), h);
+		h = hashBytes(&size, sizeof(size), h);
+		h = hashBytes(&time, sizeof(time), h);
+	}
+	std::string key = cacheKey("texture", directory.c_str(), h);
+	GLuint tex = gpuResources.restoreTexture(key);
+	if(tex){
+		TRACE_INFO("texture", "%s taken from the resource cache", directory.c_str());
+		readLightLocationFromFile(directory + std::string("/lightloc.txt"),light_location);
+		return tex;
+	}
 	// generate texture object
-	GLuint tex;
-	glGenTextures(1,&tex);
+	tex = gpuResources.createTexture(GPUResources::CAT_TEXTURE, directory.c_str(), key);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-	// load faces into texture from files
-	for(uint i = 0; i < 6; i++){
-		std::string file = directory + std::string("/") + faceFileNames[i];
-		std::cout << "loading file " << file.c_str() << std::endl;
-		PngBitmapCodec codec;
-		BitmapImage image(resolution,resolution,3,BitmapImage::ChannelType::CHANNELTYPE_BYTE);
-		codec.Image() = &image;
-		codec.LoadFromFile(file.c_str());
-		glTexImage2D(targets[i], 0, GL_RGB, resolution,resolution,0, GL_RGB, GL_UNSIGNED_BYTE, image.PeekDataAs<unsigned char>());
+	if(!hdrExtension.empty()){
+		std::string faceFiles[6];
+		for(uint i = 0; i < 6; i++){
+			faceFiles[i] = directory + std::string("/") + faceNames[i] + hdrExtension;
+		}
+		TRACE_INFO("texture", "loading hdr faces %s/*%s", directory.c_str(), hdrExtension.c_str());
+		GLenum internalFormat = colorTargetFormat == GL_RGBA16F ? GL_RGB16F : GL_R11F_G11F_B10F;
+		std::vector<uint16_t> halfFaces[6];
+		std::vector<uint32_t> packedFaces[6];
+		int resolution = 0;
+		if(decodeHDRFaces(faceFiles, internalFormat, halfFaces, packedFaces, resolution)){
+			for(uint i = 0; i < 6; i++){
+				if(internalFormat == GL_RGB16F){
+					glTexImage2D(targets[i], 0, GL_RGB16F, resolution,resolution,0, GL_RGB, GL_HALF_FLOAT, &halfFaces[i][0]);
+				} else {
+					glTexImage2D(targets[i], 0, GL_R11F_G11F_B10F, resolution,resolution,0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, &packedFaces[i][0]);
+				}
+			}
+			gpuResources.setTextureStorage(tex, internalFormat, resolution, resolution, 6, 1);
+		}
+	} else if(tiled){
+		TRACE_INFO("texture", "loading coarsest level of %s/tiles.vcm", directory.c_str());
+		std::vector<unsigned char> faces[6];
+		int resolution = 0;
+		if(readTiledCubeMapCoarsest(directory + "/tiles.vcm", faces, resolution)){
+			GLenum internalFormat = isHDRPipeline() ? GL_SRGB8 : GL_RGB;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for(uint i = 0; i < 6; i++){
+				glTexImage2D(targets[i], 0, internalFormat, resolution,resolution,0, GL_RGB, GL_UNSIGNED_BYTE, &faces[i][0]);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			gpuResources.setTextureStorage(tex, internalFormat, resolution, resolution, 6, 1);
+		}
+	} else {
+		uint resolution = readResolutionFromFile(directory + std::string("/resolution.txt"));
+		BlockFormat blockFormat = static_cast<BlockFormat>(texCompression.GetValue());
+		GLenum internalFormat = isHDRPipeline() ? GL_SRGB8 : GL_RGB;
+		if(blockFormat == BLOCK_FORMAT_BC1){
+			internalFormat = isHDRPipeline() ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		} else if(blockFormat == BLOCK_FORMAT_BC7){
+			internalFormat = isHDRPipeline() ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		}
+		gpuResources.setTextureStorage(tex, internalFormat, resolution, resolution, 6, 1);
+		BlockCompressionStats stats;
+		// load faces into texture from files
+		for(uint i = 0; i < 6; i++){
+			std::string file = directory + std::string("/") + faceNames[i] + std::string(".png");
+			std::vector<unsigned char> blocks;
+			std::string cacheFile = blockCacheFileName(file, blockFormat);
+			if(blockFormat != BLOCK_FORMAT_NONE && readBlockCache(cacheFile, file, blockFormat, resolution, resolution, blocks)){
+				TRACE_INFO("texture", "loading file %s", cacheFile.c_str());
+			} else {
+				TRACE_INFO("texture", "loading file %s", file.c_str());
+				PngBitmapCodec codec;
+				BitmapImage image(resolution,resolution,3,BitmapImage::ChannelType::CHANNELTYPE_BYTE);
+				codec.Image() = &image;
+				codec.LoadFromFile(file.c_str());
+				if(blockFormat == BLOCK_FORMAT_NONE){
+					glTexImage2D(targets[i], 0, internalFormat, resolution,resolution,0, GL_RGB, GL_UNSIGNED_BYTE, image.PeekDataAs<unsigned char>());
+					continue;
+				}
+				compressBlocks(blockFormat, image.PeekDataAs<unsigned char>(), resolution, resolution, blocks, &stats);
+				writeBlockCache(cacheFile, file, blockFormat, resolution, resolution, blocks);
+			}
+			glCompressedTexImage2D(targets[i], 0, internalFormat, resolution,resolution,0, static_cast<GLsizei>(blocks.size()), &blocks[0]);
+		}
+		if(stats.pixels > 0){
+			TRACE_INFO("texture", "encoded %s to %s: %.1f MPix/s, PSNR %.2f dB", directory.c_str(),
+				blockFormatName(blockFormat), stats.mpixPerSecond(), stats.psnr());
+		}
 	}
 	// set texture params
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -463,39 +1055,295 @@ GLuint CubeMapping::loadCubeMapTexture(std::string directory, glm::vec3& light_l
 	return tex;
 }
 
+/**
+ * Loads the cubemap textures of all skyboxes and assigns them to the objects.
+ */
+void CubeMapping::loadTextures() {
+	texSky1 = loadCubeMapTexture(pluginPath + std::string("/resources/skyboxes/bridge"), light1);
+	texSky2 = loadCubeMapTexture(pluginPath + std::string("/resources/skyboxes/space"),  light2);
+	texSky3 = loadCubeMapTexture(pluginPath + std::string("/resources/skyboxes/clouds"), light3);
+	texEarth= loadCubeMapTexture(pluginPath + std::string("/resources/skyboxes/earth"),  lightE);
+	// pack the textures the objects may use into the cubemap atlas (in the order of SceneTexture)
+	if(atlasSupported){
+		GLuint textures[SCENE_TEXTURE_COUNT] = {0, texSky1, texSky2, texSky3, texEarth};
+		for(int i = SCENE_TEXTURE_NONE+1; i < SCENE_TEXTURE_COUNT; i++){
+			textureAtlasIds[i] = textureAtlas.add(textures[i]);
+		}
+		textureAtlas.build(gpuResources);
+		// the names of the deleted resample framebuffers may be handed out again
+		targetState.invalidate();
+	}
+	updateVirtualTexture();
+}
+
+/** releases the cubemap textures of all skyboxes */
+void CubeMapping::releaseTextures() {
+	gpuResources.releaseTexture(texSky1);
+	gpuResources.releaseTexture(texSky2);
+	gpuResources.releaseTexture(texSky3);
+	gpuResources.releaseTexture(texEarth);
+	textureAtlas.release(gpuResources);
+	for(int i = 0; i < SCENE_TEXTURE_COUNT; i++){
+		textureAtlasIds[i] = -1;
+	}
+	virtualSky.close(gpuResources);
+	virtualSky.releaseFeedback(gpuResources);
+	virtualSkySelection = 0;
+}
+
+/**
+ * Loads a scene description into the object store, either a binary scene file
+ * (mapped into memory, see SceneFile.h) or a scene in text format (.txt).
+ * Objects that are flagged reflective are rendered with the mirror shader,
+ * the reflection is rendered from the center of the first of them.
+ * @return false if the file could not be loaded (the previous scene is kept)
+ */
+bool CubeMapping::loadScene(const std::string& file) {
+	TRACE_SPAN_DETAIL(TRACE_LEVEL_INFO, "loadScene", file.c_str());
+	uint64_t start = traceNow();
+	SceneFile sceneFile;
+	std::vector<SceneObjectRecord> textRecords;
+	std::vector<std::string> textMeshes;
+	const SceneObjectRecord* records = nullptr;
+	const std::vector<std::string>* meshNames = &textMeshes;
+	uint32_t count = 0;
+	if(file.size() > 4 && file.compare(file.size()-4, 4, ".txt") == 0){
+		if(!parseSceneText(file, textRecords, textMeshes)){
+			return false;
+		}
+		records = textRecords.empty() ? nullptr : &textRecords[0];
+		count = static_cast<uint32_t>(textRecords.size());
+	} else {
+		if(!sceneFile.open(file)){
+			return false;
+		}
+		records = sceneFile.objects();
+		meshNames = &sceneFile.meshes();
+		count = sceneFile.numObjects();
+	}
+	// the meshes are named relative to the scene file, the ones that fail to load are drawn as cubes
+	size_t slash = file.find_last_of("/\\");
+	std::string sceneDirectory = slash == std::string::npos ? std::string(".") : file.substr(0, slash);
+	meshLibrary.release(gpuResources);
+	std::vector<int> meshes(meshNames->size());
+	for(size_t i = 0; i < meshNames->size(); i++){
+		meshes[i] = meshLibrary.load(gpuResources, sceneDirectory + "/" + (*meshNames)[i]);
+	}
+	// the records are read straight from the mapping, no parsing per object
+	objects.clear();
+	objects.resize(count);
+	visibleObjects.clear();
+	bvh.clear();
+	mirrorObject = -1;
+	for(uint32_t i = 0; i < count; i++){
+		const SceneObjectRecord& r = records[i];
+		Object& o = objects[i];
+		o.id = i+1;
+		std::memcpy(glm::value_ptr(o.modelMX), r.modelMX, sizeof(r.modelMX));
+		o.va = &vaCube;
+		o.elementType = GL_POINTS;
+		o.numElements = 4*6;
+		o.reflective = (r.flags & SCENE_OBJECT_REFLECTIVE) != 0;
+		o.shader = o.reflective ? &shaderMirrorcube : &shaderCube;
+		o.texture = r.texture < SCENE_TEXTURE_COUNT ? r.texture : SCENE_TEXTURE_NONE;
+		o.useTexture = (r.flags & SCENE_OBJECT_TEXTURED) != 0;
+		o.renderAsSphere = (r.flags & SCENE_OBJECT_SPHERE) != 0;
+		o.warpFN = r.warpFN < 3 ? r.warpFN : 0;
+		if(r.mesh > 0 && static_cast<size_t>(r.mesh) <= meshes.size() && meshes[r.mesh-1] >= 0){
+			if(o.reflective){
+				TRACE_WARN("scene", "object %u: meshes cannot be reflective", o.id);
+				o.reflective = false;
+			}
+			o.mesh = meshes[r.mesh-1];
+			o.va = nullptr;
+			o.elementType = GL_TRIANGLES;
+			o.numElements = meshLibrary.numIndices(o.mesh);
+			o.shader = &shaderMesh;
+			o.renderAsSphere = false;
+		}
+		if(o.reflective && mirrorObject < 0){
+			mirrorObject = static_cast<int>(i);
+		}
+		updateObjectBounds(o);
+	}
+	assignTextures();
+	regionSelection.cancel();
+	pickedIDVar = 0;
+	pickedIDVar.SetMinMax(0, static_cast<int>(count));
+	invalidate();
+	TRACE_INFO("scene", "loaded %u objects from %s in %.2f ms (bvh height %d)", count, file.c_str(),
+			(traceNow()-start)*1e-6, bvh.getHeight());
+	return true;
+}
+
+/**
+ * Loads the scene given by the environment variable CUBEMAPPING_SCENE (for
+ * reproducible performance measurements) or else the default scene, preferring
+ * its binary version if it has been converted.
+ */
+void CubeMapping::loadDefaultScene() {
+	const char* sceneOverride = std::getenv("CUBEMAPPING_SCENE");
+	if(sceneOverride && loadScene(sceneOverride)){
+		return;
+	}
+	std::string scene = pluginPath + std::string("/resources/scenes/default");
+	if(!(fileExists(scene + ".scene") && loadScene(scene + ".scene"))){
+		loadScene(scene + ".txt");
+	}
+}
+
+/** sets the texture handles of the objects according to the textures they reference */
+void CubeMapping::assignTextures() {
+	GLuint textures[SCENE_TEXTURE_COUNT] = {0, texSky1, texSky2, texSky3, texEarth};
+	for(uint i = 0; i < objects.size(); i++){
+		Object& o = objects[i];
+		o.texID = o.reflective ? texReflectionCubeMap : textures[o.texture];
+		o.atlasClass = o.atlasLayer = -1;
+		if(!o.reflective && textureAtlasIds[o.texture] >= 0){
+			const CubeMapAtlas::Entry& e = textureAtlas.entry(textureAtlasIds[o.texture]);
+			o.atlasClass = e.sizeClass;
+			o.atlasLayer = e.layer;
+		}
+	}
+}
+
+/**
+ * Inserts the bounds of the object into the bounding volume hierarchy
+ * or updates them after the object was moved or changed its shape.
+ */
+void CubeMapping::updateObjectBounds(Object& o) {
+	// model space half extent of the cube (0.5) or the sphere it is projected to (0.69),
+	// meshes are scaled to the unit cube when they are imported
+	float halfExtent = o.renderAsSphere ? 0.69f : 0.5f;
+	glm::vec3 center = glm::vec3(o.modelMX[3]);
+	glm::vec3 extent;
+	for(int i = 0; i < 3; i++){
+		extent[i] = halfExtent*(std::abs(o.modelMX[0][i]) + std::abs(o.modelMX[1][i]) + std::abs(o.modelMX[2][i]));
+	}
+	AABB box(center - extent, center + extent);
+	float maxScale = std::max(glm::length(glm::vec3(o.modelMX[0])), std::max(glm::length(glm::vec3(o.modelMX[1])), glm::length(glm::vec3(o.modelMX[2]))));
+	float radius = o.mesh >= 0 ? meshLibrary.halfExtent(o.mesh) : (o.renderAsSphere ? 0.69f : 0.87f);
+	o.boundingRadius = radius*maxScale;
+	if(o.proxy < 0){
+		o.proxy = bvh.createProxy(box, static_cast<int>(o.id-1));
+	} else {
+		bvh.moveProxy(o.proxy, box);
+	}
+}
+
+/**
+ * Creates the tiled cubemap file used for virtual texturing from the png faces
+ * of a skybox directory.
+ */
+bool buildTiledCubeMap(const std::string& directory, const std::string& file) {
+	uint resolution = readResolutionFromFile(directory + std::string("/resolution.txt"));
+	if(!resolution || !createTiledCubeMap(file, resolution)){
+		return false;
+	}
+	TRACE_INFO("texture", "building tiled cubemap %s", file.c_str());
+	std::string faceNames[6] = {"negx","posx","negy","posy","negz","posz"};
+	for(uint i = 0; i < 6; i++){
+		std::string faceFile = directory + std::string("/") + faceNames[i] + std::string(".png");
+		PngBitmapCodec codec;
+		BitmapImage image(resolution,resolution,3,BitmapImage::ChannelType::CHANNELTYPE_BYTE);
+		codec.Image() = &image;
+		codec.LoadFromFile(faceFile.c_str());
+		if(!writeTiledCubeMapFace(file, i, image.PeekDataAs<unsigned char>())){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Opens the tiled cubemap of the selected skybox when virtual texturing is
+ * enabled (creating it from the png faces on first use) or closes it otherwise.
+ */
+void CubeMapping::updateVirtualTexture() {
+	int selection = virtualTexturing.GetValue() ? static_cast<int>(skyboxTexturing.GetValue()) : 0;
+	if(selection == virtualSkySelection){
+		return;
+	}
+	virtualSky.close(gpuResources);
+	virtualSky.releaseFeedback(gpuResources);
+	virtualSkySelection = 0;
+	if(selection){
+		const char* skyboxNames[] = {"", "bridge", "space", "clouds"};
+		std::string directory = pluginPath + std::string("/resources/skyboxes/") + skyboxNames[selection];
+		std::string file = directory + std::string("/tiles.vcm");
+		if((fileExists(file) || buildTiledCubeMap(directory, file))
+				&& virtualSky.open(file, gpuResources, isHDRPipeline() ? GL_SRGB8 : GL_RGB8)){
+			virtualSky.resizeFeedback(gpuResources, wWidth, wHeight);
+			virtualSkySelection = selection;
+		}
+	}
+	vtResidentPages = virtualSky.residentPages();
+	updateMemoryVars();
+}
+
+/**
+ * Callback function for the event of changing the skybox apivar.
+ * Switches the virtual texture to the new skybox.
+ */
+void CubeMapping::skyboxChanged(EnumVar<CubeMapping> &var) {
+	if(!texSky1){
+		return; // textures are not loaded yet
+	}
+	updateVirtualTexture();
+	invalidate();
+}
+
+/**
+ * Callback function for the event of switching virtual texturing on or off.
+ */
+void CubeMapping::virtualTexturingChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	if(!texSky1){
+		return; // textures are not loaded yet
+	}
+	updateVirtualTexture();
+	invalidate();
+}
+
 /**
  * Creates a cubemap texture of specified resolution (width=height=resolution)
- * internal format, format and datatype.
+ * internal format, format and datatype with the given number of mip levels.
  * It also sets the min and mag filter properties to the specified filter
+ * (trilinear for the minification of a mip chain)
  * and wrapping properties to GL_CLAMP_TO_EDGE.
  */
 void createCubeMapTexture(
+		GPUResources &resources, const char* label,
 		GLuint &outID, const GLenum internalFormat,
 		const GLenum format, const GLenum type,
-		GLint filter, int resolution)
+		GLint filter, int resolution, int levels = 1)
 {
 	GLenum targets[6] = {
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_X, GL_TEXTURE_CUBE_MAP_POSITIVE_X,
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
 		GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, GL_TEXTURE_CUBE_MAP_POSITIVE_Z
 	};
-	glGenTextures(1,&outID);
+	outID = resources.createTexture(GPUResources::CAT_RENDERTARGET, label);
+	resources.setTextureStorage(outID, internalFormat, resolution, resolution, 6, levels);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, outID);
-	for(uint i = 0; i < 6; i++){
-		glTexImage2D(
-				targets[i],     // target
-				0,              // level
-				internalFormat, // internal format
-				resolution,     // w
-				resolution,     // h
-				0,              // border
-				format,         // format
-				type,           // type
-				0               // data
-		);
+	for(int level = 0, size = resolution; level < levels; level++, size = std::max(1, size/2)){
+		for(uint i = 0; i < 6; i++){
+			glTexImage2D(
+					targets[i],     // target
+					level,          // level
+					internalFormat, // internal format
+					size,           // w
+					size,           // h
+					0,              // border
+					format,         // format
+					type,           // type
+					0               // data
+			);
+		}
 	}
 	// set texture params
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+			levels > 1 ? (filter == GL_NEAREST ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR) : filter);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, filter);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -509,9 +1357,11 @@ void createCubeMapTexture(
  * It also sets the min and mag filter properties to the specified filter
  * and wrapping properties to GL_CLAMP_TO_EDGE.
  */
-void createTextureArray( GLuint &outID, const GLenum internalFormat,
+void createTextureArray( GPUResources &resources, const char* label,
+							 GLuint &outID, const GLenum internalFormat,
 							 GLint filter, int width, int height , int numLayers) {
-	glGenTextures(1, &outID);
+	outID = resources.createTexture(GPUResources::CAT_RENDERTARGET, label);
+	resources.setTextureStorage(outID, internalFormat, width, height, numLayers, 1);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, outID);
 	glTexStorage3D(
 				GL_TEXTURE_2D_ARRAY, // target
@@ -533,27 +1383,27 @@ void checkFBOStatus() {
 	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
 	switch (status) {
 	case GL_FRAMEBUFFER_UNDEFINED: {
-		fprintf(stderr,"FBO: undefined.\n");
+		TRACE_ERROR("FBO", "undefined.");
 		break;
 	}
 	case GL_FRAMEBUFFER_COMPLETE: {
-		fprintf(stderr,"FBO: complete.\n");
+		TRACE_DEBUG("FBO", "complete.");
 		break;
 	}
 	case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT: {
-		fprintf(stderr,"FBO: incomplete attachment.\n");
+		TRACE_ERROR("FBO", "incomplete attachment.");
 		break;
 	}
 	case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT: {
-		fprintf(stderr,"FBO: no buffers are attached to the FBO.\n");
+		TRACE_ERROR("FBO", "no buffers are attached to the FBO.");
 		break;
 	}
 	case GL_FRAMEBUFFER_UNSUPPORTED: {
-		fprintf(stderr,"FBO: combination of internal buffer formats is not supported.\n");
+		TRACE_ERROR("FBO", "combination of internal buffer formats is not supported.");
 		break;
 	}
 	case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE: {
-		fprintf(stderr,"FBO: number of samples or the value for ... does not match.\n");
+		TRACE_ERROR("FBO", "number of samples or the value for ... does not match.");
 		break;
 	}
 	}
@@ -567,22 +1417,31 @@ void CubeMapping::initFBO() {
 		return;
 	}
 	if(fbo){
-		glDeleteFramebuffers(1, &fbo);
-		GLuint texturesToDelete[] = {texArrayColor, texArrayDepth, texArrayPicking};
-		glDeleteTextures(3, texturesToDelete);
-		texArrayColor = texArrayDepth = texArrayPicking = fbo = 0;
+		gpuResources.releaseFramebuffer(fbo);
+		gpuResources.releaseTexture(texArrayColor);
+		gpuResources.releaseTexture(texArrayDepth);
+		gpuResources.releaseTexture(texArrayPicking);
 	}
 
-	createTextureArray(texArrayColor, GL_RGB8, GL_LINEAR,
-										 wWidth, wHeight, 1+6);
-	createTextureArray(texArrayPicking, GL_RGB8, GL_LINEAR,
-										 wWidth, wHeight, 1+6);
-	createTextureArray(texArrayDepth, GL_DEPTH_COMPONENT32, GL_LINEAR,
-										 wWidth, wHeight, 1+6);
+	// the layers have to hold the camera view and the largest reflection face
+	layerWidth = wWidth;
+	layerHeight = wHeight;
+	if(viewportArrays){
+		layerWidth = std::max(wWidth, reflectionPoolResolutions[REFLECTION_POOL_SIZE - 1]);
+		layerHeight = std::max(wHeight, reflectionPoolResolutions[REFLECTION_POOL_SIZE - 1]);
+	}
+	// camera 0, the reflection faces and the further cameras of the split layout
+	int layers = numViews();
+	createTextureArray(gpuResources, "color layers", texArrayColor, colorTargetFormat, GL_LINEAR,
+										 layerWidth, layerHeight, layers);
+	createTextureArray(gpuResources, "picking layers", texArrayPicking, GL_RGB8, GL_LINEAR,
+										 layerWidth, layerHeight, layers);
+	createTextureArray(gpuResources, "depth layers", texArrayDepth, GL_DEPTH_COMPONENT32, GL_LINEAR,
+										 layerWidth, layerHeight, layers);
 
 
 	// generate fbo and attach textures
-	glGenFramebuffers(1,&fbo);
+	fbo = gpuResources.createFramebuffer("layers");
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glFramebufferTexture(
 				GL_FRAMEBUFFER,
@@ -604,196 +1463,1334 @@ void CubeMapping::initFBO() {
 				);
 	checkFBOStatus();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	// create the fbo for texture array to cubemap transfer (dont need to reinitialize on resize)
+	// framebuffers of the single layers (multi pass backend)
+	layered.createTargets(gpuResources, texArrayColor, texArrayPicking, texArrayDepth);
+	// create the fbos for texture array to cubemap transfer (dont need to reinitialize on resize)
 	if(!fbo_layers2Cube){
-		createCubeMapTexture(texReflectionCubeMap, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE, GL_LINEAR, 1024);
-		glGenFramebuffers(1, &fbo_layers2Cube);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo_layers2Cube);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texReflectionCubeMap, 0);
-		checkFBOStatus();
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		createReflectionTargets();
 	}
 
 }
 
 /**
- * Convert object ID to unique color
- * @param id   object ID.
- * @return color
+ * Creates the reflection cubemaps of all resolutions of the pool with their FBOs.
+ * They are allocated up front, so switching the resolution between frames costs nothing.
  */
-glm::vec3 CubeMapping::idToColor( unsigned int id ) {
-	id = id*111;
-	unsigned int r = (id>>16)& 0xff;
-	unsigned int g = (id>>8 )& 0xff;
-	unsigned int b = (id    )& 0xff;
-	float toFloat = 1.0f/255;
-	glm::vec3 col = glm::vec3(r*toFloat,g*toFloat,b*toFloat);
-	return col;
+void CubeMapping::createReflectionTargets() {
+	// reflection cubemap gets the same format as the color layers it is copied from,
+	// except for RGB8 which cannot be written as image by the mip chain passes
+	reflectionFormat = colorTargetFormat;
+	GLenum format = GL_RGB;
+	GLenum type = GL_UNSIGNED_BYTE;
+	if(colorTargetFormat == GL_RGB8){
+		reflectionFormat = GL_RGBA8;
+		format = GL_RGBA;
+	} else if(colorTargetFormat == GL_RGBA16F){
+		format = GL_RGBA;
+		type = GL_HALF_FLOAT;
+	} else if(colorTargetFormat == GL_R11F_G11F_B10F){
+		type = GL_UNSIGNED_INT_10F_11F_11F_REV;
+	}
+	for(int i = 0; i < REFLECTION_POOL_SIZE; i++){
+		int resolution = reflectionPoolResolutions[i];
+		std::string label = "reflection cubemap " + std::to_string(resolution);
+		createCubeMapTexture(gpuResources, label.c_str(), reflectionPoolTextures[i], reflectionFormat, format, type, GL_LINEAR,
+				resolution, CubeMipChain::numLevels(resolution));
+		reflectionPoolFBOs[i] = gpuResources.createFramebuffer("layers2cube");
+		glBindFramebuffer(GL_FRAMEBUFFER, reflectionPoolFBOs[i]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, reflectionPoolTextures[i], 0);
+		checkFBOStatus();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	fbo_layers2Cube = reflectionPoolFBOs[reflectionLevel];
+	texReflectionCubeMap = reflectionPoolTextures[reflectionLevel];
+	setReflectionMaxLevel();
+	// nothing to show again before the faces were rendered
+	reflectionAge = reflectionInterval;
 }
 
-/**
- * Convert color to object ID.
- * @param buf  color defined as 3-array [red,green,blue]
- * @return object ID
- */
-unsigned int CubeMapping::colorToId( unsigned char buf[3] ) {
-	unsigned int num = 0;
-	num = num | buf[0];
-	num = num << 8;
-	num = num | buf[1];
-	num = num << 8;
-	num = num | buf[2];
-	return num/111;
+/** deletes the reflection cubemaps and their FBOs */
+void CubeMapping::releaseReflectionTargets() {
+	for(int i = 0; i < REFLECTION_POOL_SIZE; i++){
+		gpuResources.releaseFramebuffer(reflectionPoolFBOs[i]);
+		gpuResources.releaseTexture(reflectionPoolTextures[i]);
+	}
+	fbo_layers2Cube = texReflectionCubeMap = 0;
 }
 
 /**
- * Callback function for the event of changing the picked object apivar.
- * This in turn sets several apivars which display the sate of the picked object
+ * Chooses the reflection cubemap for this frame from the screen area the visible
+ * reflective objects cover: the faces get about as many texels across as the largest
+ * of them has pixels across in any camera, a fixed resolution can be selected with reflRes.
+ * Has to be called after cullObjects.
  */
-void CubeMapping::objectPicked(APIVar<CubeMapping, IntVarPolicy> &id){
-	pickedID = static_cast<uint>(id);
-	ignoreObjectVarUpdate = true;
-	if(pickedID){
-		Object o = *objects[pickedID-1];
-		glm::vec4 pos = o.modelMX[3];
-		picked_x = pos.x;
-		picked_y = pos.y;
-		picked_z = pos.z;
-		cube_sphere_switch = o.renderAsSphere;
-		cube_texture_switch = o.useTexture;
-		cube_warpFN = o.warpFN;
-		picked_x.SetReadonly(false);
-		picked_y.SetReadonly(false);
-		picked_z.SetReadonly(false);
-		cube_sphere_switch.SetReadonly(false);
-		cube_texture_switch.SetReadonly(false);
-		cube_warpFN.SetReadonly(false);
+void CubeMapping::updateReflectionResolution() {
+	if(reflectionReused){
+		// the cubemap rendered last is shown again
+		return;
+	}
+	int level = reflectionLevel;
+	if(bakeRequested){
+		// the probe is baked at the largest resolution
+		level = REFLECTION_POOL_SIZE - 1;
+		reflectionBelowFrames = 0;
+	} else if(reflectionResMode.GetValue() > 0){
+		level = reflectionResMode.GetValue() - 1;
+		reflectionBelowFrames = 0;
 	} else {
-		picked_x = 0;
-		picked_y = 0;
-		picked_z = 0;
-		cube_sphere_switch = false;
-		cube_texture_switch = false;
-		cube_warpFN = 0;
-		picked_x.SetReadonly(true);
-		picked_y.SetReadonly(true);
-		picked_z.SetReadonly(true);
-		cube_sphere_switch.SetReadonly(true);
-		cube_texture_switch.SetReadonly(true);
-		cube_warpFN.SetReadonly(true);
+		// the reflection is shared by the cameras, the largest pixel area of a reflecting object decides
+		float area = 0.0f;
+		for(int camera = 0; camera < numCameras; camera++){
+			glm::mat4x4 viewProjMX = cameraProjMX[camera]*cameraView(camera);
+			uint viewBit = 1u << (camera ? 6 + camera : 0);
+			float tileArea = static_cast<float>(cameraTiles[camera].z)*cameraTiles[camera].w;
+			for(uint i = 0; i < visibleObjects.size(); i++){
+				const Object& o = objects[visibleObjects[i]];
+				if(o.reflective && (o.viewMask & viewBit)){
+					area = std::max(area, tileArea*projectedSphereCoverage(viewProjMX, glm::vec3(o.modelMX[3]), o.boundingRadius));
+				}
+			}
+		}
+		float required = std::sqrt(area);
+		// a smaller cubemap is used once the requirement stayed below 80% of its size for half a second (at 60 Hz)
+		level = selectResolutionLevel(required, reflectionPoolResolutions, REFLECTION_POOL_SIZE, reflectionLevel,
+				0.8f, 30, reflectionBelowFrames);
 	}
-	ignoreObjectVarUpdate = false;
+	if(level != reflectionLevel){
+		TRACE_DEBUG("reflection", "face resolution %d -> %d", reflectionPoolResolutions[reflectionLevel], reflectionPoolResolutions[level]);
+		reflectionLevel = level;
+	}
+	reflectionResolution = reflectionPoolResolutions[reflectionLevel];
+	fbo_layers2Cube = reflectionPoolFBOs[reflectionLevel];
+	texReflectionCubeMap = reflectionPoolTextures[reflectionLevel];
+	reflectionResVar = reflectionResolution;
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "reflection resolution", reflectionResolution);
 }
 
 /**
- * Callback function for the event of one of the coordinate apivars picked_x/y/z being changed.
- * This alters the picked object's translation.
+ * Callback function for the event of changing the reflection resolution apivar.
  */
-void CubeMapping::pickedObjectMoved(APIVar<CubeMapping, FloatVarPolicy> &var){
-	if(ignoreObjectVarUpdate){
-		return;
-	}
-	if(pickedID){
-		Object& o = *objects[pickedID-1];
-		glm::vec4& pos = o.modelMX[3];
-		pos.x = picked_x.GetValue();
-		pos.y = picked_y.GetValue();
-		pos.z = picked_z.GetValue();
-	}
+void CubeMapping::reflectionResChanged(EnumVar<CubeMapping> &var) {
+	invalidate();
 }
 
 /**
- * Callback function for the event of an enumvar (e.g. cube_warpFN) is changed.
- * This calls the other pickedObjectModeChanged callback function.
+ * Key of the state the reflection depends on: the objects (hashed again only after an
+ * invalidate(), which every change of them goes through), the skybox and the settings
+ * that change what the faces show.
  */
-void CubeMapping::pickedObjectModeChanged(EnumVar<CubeMapping> &var) {
-	// just call the other function, argument does not matter
-	pickedObjectModeChanged(cube_sphere_switch);
+uint64_t CubeMapping::reflectionProbeKey() {
+	if(probeHashRevision != contentRevision){
+		uint64_t h = hashBasis;
+		for(size_t i = 0; i < objects.size(); i++){
+			const Object& o = objects[i];
+			int properties[5] = {o.texture, o.useTexture, o.renderAsSphere, o.warpFN, o.reflective};
+			h = hashBytes(glm::value_ptr(o.modelMX), sizeof(o.modelMX), h);
+			h = hashBytes(properties, sizeof(properties), h);
+			if(o.mesh >= 0){
+				uint64_t mesh = meshLibrary.key(o.mesh);
+				h = hashBytes(&mesh, sizeof(mesh), h);
+			}
+		}
+		probeObjectsHash = h;
+		probeHashRevision = contentRevision;
+	}
+	// the level of detail of the reflection views depends on the layer height without viewport arrays
+	int settings[8] = {
+		static_cast<int>(skyboxTexturing), texCompression.GetValue(), virtualTexturing.GetValue(),
+		static_cast<int>(colorTargetFormat), subDivisionLevel(), autoLOD.GetValue(),
+		reflectionGlossy.GetValue(), viewportArrays ? 0 : wHeight
+	};
+	float bias = lodReflectionBias.GetValue();
+	uint64_t key = hashBytes(settings, sizeof(settings), probeObjectsHash);
+	return hashBytes(&bias, sizeof(bias), key);
 }
 
 /**
- * Callback function for the event of a switch var (e.g. cube_sphere_switch) is changed.
- * This updates the properties of the picked object except for coordinates.
+ * Loads a cache file baked for the current key in an earlier session (or before the scene
+ * was changed). The file is only looked up once the key stayed the same for probeLookupFrames
+ * frames, while objects move the key changes every frame and the file system is left alone.
+ * Switching bakedRefl on looks it up right away. A loaded probe redraws the scene.
+ * Is called every frame, also when the scene is not redrawn.
  */
-void CubeMapping::pickedObjectModeChanged(APIVar<CubeMapping, BoolVarPolicy> &var){
-	if(ignoreObjectVarUpdate){
+void CubeMapping::lookupReflectionProbe() {
+	if(mirrorObject < 0 || !bakedReflection.GetValue() || bakeRequested){
+		probeStableFrames = 0;
 		return;
 	}
-	if(pickedID){
-		Object& o = *objects[pickedID-1];
-		o.renderAsSphere = cube_sphere_switch.GetValue();
-		o.useTexture = cube_texture_switch.GetValue();
-		o.warpFN = cube_warpFN.GetValue();
+	uint64_t key = reflectionProbeKey();
+	if(key != probeLastKey){
+		probeLastKey = key;
+		probeStableFrames = 0;
+	}
+	if(reflectionProbe.key() == key || probeMissingKey == key || probeStableFrames++ < probeLookupFrames){
+		return;
+	}
+	if(reflectionProbe.load(gpuResources, ReflectionProbe::cacheFileName(pluginPath, key), key, reflectionFormat)){
+		sceneRevision++;
+	} else {
+		probeMissingKey = key;
 	}
 }
 
 /**
- * Called when changing from this plugin to another in OGL4Core.
- * Should reset all introduced GL states and delete GL objects created by this plugin.
+ * Decides whether this frame shows the baked reflection, which it does while the probe
+ * was baked for the current key (see lookupReflectionProbe() for the cache files).
+ * Has to be called before cullObjects.
  */
-bool CubeMapping::Deactivate(void) {
-	// clean up GL things
-	// shaders
-	deleteShaders();
+void CubeMapping::updateReflectionProbe() {
+	reflectionBaked = false;
+	if(mirrorObject >= 0 && bakedReflection.GetValue() && !bakeRequested){
+		uint64_t key = reflectionProbeKey();
+		reflectionBaked = reflectionProbe.isValid() && reflectionProbe.key() == key;
+	}
+	if(probeUsedVar.GetValue() != reflectionBaked){
+		probeUsedVar = reflectionBaked;
+		TRACE_INFO("probe", "%s reflection", reflectionBaked ? "baked" : "dynamic");
+	}
+}
+
+/**
+ * Callback function for the event of switching the baked reflection.
+ */
+void CubeMapping::bakedReflectionChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	// the cache file is looked up by the next frame
+	probeLastKey = reflectionProbeKey();
+	probeStableFrames = probeLookupFrames;
+	invalidate();
+}
+
+/** largest subdivision level the geometry shaders can emit (see Activate) */
+int CubeMapping::maxSubDivisionLevel() const {
+	return static_cast<int>((std::sqrt(cubeGeomMaxVerts*2.0+1)-1)/2);
+}
+
+/** subdivision level in use (chosen by the governor or subDivLvl) */
+int CubeMapping::subDivisionLevel() {
+	return governorVar.GetValue() ? governor.settings().subDivLevel : static_cast<int>(subDivLevel);
+}
+
+/**
+ * Callback function for the event of switching the frame time governor.
+ * The governor starts from the best settings, the manual settings apply again when it is switched off.
+ */
+void CubeMapping::governorChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	governor.reset(maxSubDivisionLevel());
+	govGpuMsVar.SetVisible(var.GetValue());
+	govSubDivVar.SetVisible(var.GetValue());
+	govScaleVar.SetVisible(var.GetValue());
+	govReflIntervalVar.SetVisible(var.GetValue());
+	applyQualitySettings();
+}
+
+/**
+ * Applies the settings of the governor (or the manual ones while it is off)
+ * and shows them.
+ */
+void CubeMapping::applyQualitySettings() {
+	bool governing = governorVar.GetValue();
+	const QualitySettings& s = governor.settings();
+	// the camera views can only be smaller than their layers with viewport arrays
+	renderScale = governing && viewportArrays ? s.renderScale : 1.0f;
+	reflectionInterval = governing ? s.reflectionInterval : 1;
+	govGpuMsVar = governor.gpuMs();
+	govSubDivVar = governing ? s.subDivLevel : static_cast<int>(subDivLevel);
+	govScaleVar = renderScale;
+	govReflIntervalVar = reflectionInterval;
+	invalidate();
+}
+
+/**
+ * Switches the backend of the layered passes, recreates the shaders and the
+ * framebuffers it needs.
+ * @return false if the backend is not supported by the context (nothing changed)
+ */
+bool CubeMapping::setLayeredBackend(LayeredBackend backend) {
+	if(!LayeredRenderer::isSupported(backend)){
+		TRACE_WARN("GL", "layered rendering: %s is not supported", LayeredRenderer::name(backend));
+		return false;
+	}
+	if(backend == layered.backend()){
+		return true;
+	}
+	layered.setBackend(backend);
+	deleteShaders();
+	createShaders();
+	if(fbo){
+		layered.createTargets(gpuResources, texArrayColor, texArrayPicking, texArrayDepth);
+	}
+	TRACE_INFO("GL", "layered rendering: %s", LayeredRenderer::name(backend));
+	invalidate();
+	return true;
+}
+
+/**
+ * Callback function for the event of changing the layered backend apivar,
+ * falls back to the backend in use if the selected one is not supported.
+ */
+void CubeMapping::layeredBackendChanged(EnumVar<CubeMapping> &var) {
+	if(!setLayeredBackend(static_cast<LayeredBackend>(var.GetValue()))){
+		var = layered.backend();
+	}
+}
+
+/**
+ * Starts the comparison of the supported layered backends: the scene is restricted
+ * to 1, 10, 100, ... objects up to all of them and rendered continuously until every
+ * backend was measured for every size (see Render()).
+ */
+void CubeMapping::startLayeredBenchmark() {
+	std::vector<LayeredBackend> backends;
+	for(int b = 0; b < LAYERED_BACKEND_COUNT; b++){
+		if(LayeredRenderer::isSupported(static_cast<LayeredBackend>(b))){
+			backends.push_back(static_cast<LayeredBackend>(b));
+		}
+	}
+	std::vector<size_t> sizes;
+	for(size_t n = 1; n < objects.size(); n *= 10){
+		sizes.push_back(n);
+	}
+	sizes.push_back(objects.size());
+	layeredBenchmark.start(backends, sizes, 5, 30);
+	PostRedisplay();
+}
+
+/**
+ * Writes the results of a finished benchmark and restores the selected backend.
+ */
+void CubeMapping::finishLayeredBenchmark() {
+	std::string csvFile = pluginPath + std::string("/layered_bench.csv");
+	if(layeredBenchmark.writeCSV(csvFile)){
+		std::fprintf(stdout, "wrote layered benchmark to %s\n", csvFile.c_str());
+	}
+	objectLimit = 0;
+	setLayeredBackend(static_cast<LayeredBackend>(layeredBackendVar.GetValue()));
+	invalidate();
+}
+
+/** bits of the camera views in the view masks (0 and 7 and up) */
+uint CubeMapping::cameraViewMask() const {
+	uint mask = 1;
+	for(int camera = 1; camera < numCameras; camera++){
+		mask |= 1u << (6 + camera);
+	}
+	return mask;
+}
+
+/**
+ * Size of the part of its layer a camera is rendered to: its tile with viewport
+ * arrays, the window otherwise (the image is scaled to the tile when presenting).
+ */
+glm::ivec2 CubeMapping::cameraViewport(int camera) const {
+	if(viewportArrays){
+		glm::vec2 size = glm::vec2(cameraTiles[camera].z, cameraTiles[camera].w)*renderScale;
+		return glm::max(glm::ivec2(size + 0.5f), glm::ivec2(1));
+	}
+	return glm::ivec2(wWidth, wHeight);
+}
+
+/**
+ * Maps GL window coordinates to pixel coordinates of the layer of camera 0
+ * (picking and region selection work in the tile of camera 0).
+ */
+glm::vec2 CubeMapping::windowToCameraLayer(const glm::vec2& p) const {
+	const glm::ivec4& tile = cameraTiles[0];
+	glm::vec2 scale = glm::vec2(cameraViewport(0))/glm::vec2(std::max(tile.z, 1), std::max(tile.w, 1));
+	return (p - glm::vec2(tile.x, tile.y))*scale;
+}
+
+/** preprocessor definitions of the number of views for the layered shaders */
+std::string CubeMapping::viewShaderDefines() const {
+	return std::string("#define NUM_VIEWS ") + std::to_string(numViews())
+		+ "\n#define NUM_CAMERAS " + std::to_string(numCameras) + "\n";
+}
+
+/**
+ * Divides the window among the cameras of the selected split layout.
+ * The projection of camera 0 uses the aspect ratio of its tile.
+ */
+void CubeMapping::updateCameraTiles() {
+	numCameras = splitViewports(splitLayout.GetValue(), wWidth, wHeight, cameraTiles);
+	layered.setViews(numViews());
+	aspect = static_cast<float>(cameraTiles[0].z)/std::max(cameraTiles[0].w, 1);
+}
+
+/** projections of the cameras for the frame (the aspect ratio of each tile) */
+void CubeMapping::updateCameraMatrices() {
+	for(int camera = 0; camera < numCameras; camera++){
+		const glm::ivec4& tile = cameraTiles[camera];
+		cameraProjMX[camera] = cameraProjection(static_cast<float>(fovY), static_cast<float>(tile.z)/std::max(tile.w, 1),
+				static_cast<float>(zNear), static_cast<float>(zFar));
+	}
+}
+
+/**
+ * Callback function for the event of changing the split layout apivar.
+ * A different number of cameras changes the number of layers and views,
+ * so the shaders and the layers are recreated.
+ */
+void CubeMapping::splitLayoutChanged(EnumVar<CubeMapping> &var) {
+	int previousCameras = numCameras;
+	updateCameraTiles();
+	if(activeCamera >= numCameras){
+		selectCamera(0);
+	}
+	if(numCameras != previousCameras && fbo){
+		deleteShaders();
+		createShaders();
+		initFBO();
+		updateMemoryVars();
+	}
+	TRACE_INFO("input", "%d camera(s)", numCameras);
+	invalidate();
+}
+
+/**
+ * Callback function for the event of switching the counting of the shaded fragments.
+ * The fragment shaders are recompiled with or without the counters.
+ */
+void CubeMapping::overdrawCountingChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	if(var.GetValue() == overdrawCounter.isCreated()){
+		return;
+	}
+	if(var.GetValue()){
+		if(!overdrawCounter.create(gpuResources, MAX_VIEWS)){
+			var = false;
+			return;
+		}
+	} else {
+		overdrawCounter.release(gpuResources);
+	}
+	overdrawCameraVar.SetVisible(overdrawCounter.isCreated());
+	overdrawReflVar.SetVisible(overdrawCounter.isCreated());
+	if(fbo){
+		deleteShaders();
+		createShaders();
+		updateMemoryVars();
+	}
+	invalidate();
+}
+
+/** hands the mouse to the manipulator of a camera */
+void CubeMapping::selectCamera(int camera) {
+	activeCamera = camera;
+	SelectCurrentManipulator(camera ? cameraHandles[camera-1] : camHandle);
+}
+
+/**
+ * Callback function for the event of changing the color format apivar.
+ * Recreates the color targets and reflection cubemap in the new format and
+ * reloads the skybox textures (png faces are sRGB in HDR and plain RGB in LDR).
+ */
+void CubeMapping::colorFormatChanged(EnumVar<CubeMapping> &var) {
+	GLenum formats[] = {GL_RGB8, GL_RGBA16F, GL_R11F_G11F_B10F};
+	GLenum newFormat = formats[var.GetValue()];
+	if(newFormat == colorTargetFormat){
+		return;
+	}
+	colorTargetFormat = newFormat;
+	// recreate render targets
+	releaseReflectionTargets();
+	initFBO();
+	// reload textures and reassign them to the objects
+	releaseTextures();
+	loadTextures();
+	assignTextures();
+	updateMemoryVars();
+	invalidate();
+}
+
+/**
+ * Callback function for the event of changing the texture compression apivar.
+ * Reloads the skybox textures in the selected block format.
+ */
+void CubeMapping::texCompressionChanged(EnumVar<CubeMapping> &var) {
+	if(!texSky1){
+		return; // textures are not loaded yet
+	}
+	releaseTextures();
+	loadTextures();
+	assignTextures();
+	updateMemoryVars();
+	invalidate();
+}
+
+/**
+ * Updates the read only apivars showing the estimated video memory usage.
+ */
+void CubeMapping::updateMemoryVars() {
+	const float toMB = 1.0f/(1024*1024);
+	vramTotal = gpuResources.totalBytes()*toMB;
+	vramTextures = gpuResources.bytes(GPUResources::CAT_TEXTURE)*toMB;
+	vramRenderTargets = gpuResources.bytes(GPUResources::CAT_RENDERTARGET)*toMB;
+	vramBuffers = gpuResources.bytes(GPUResources::CAT_BUFFER)*toMB;
+	cacheVar = GPUResourceCache::shared().bytes()*toMB;
+	cacheHitsVar = static_cast<int>(GPUResourceCache::shared().hits());
+}
+
+/**
+ * Callback function for the memory limit of the resource cache, objects beyond the
+ * limit are deleted right away.
+ */
+void CubeMapping::cacheLimitChanged(APIVar<CubeMapping, IntVarPolicy> &var) {
+	GPUResourceCache::shared().setLimit(static_cast<size_t>(var.GetValue())*1024*1024);
+	updateMemoryVars();
+}
+
+/**
+ * Convert object ID to unique color
+ * @param id   object ID.
+ * @return color
+ */
+glm::vec3 CubeMapping::idToColor( unsigned int id ) {
+	return pickIdToColor(id);
+}
+
+/**
+ * Convert color to object ID.
+ * @param buf  color defined as 3-array [red,green,blue]
+ * @return object ID
+ */
+unsigned int CubeMapping::colorToId( unsigned char buf[3] ) {
+	return pickColorToId(buf);
+}
+
+/**
+ * Callback function for the event of changing the picked object apivar.
+ * This in turn sets several apivars which display the sate of the picked object
+ */
+void CubeMapping::objectPicked(APIVar<CubeMapping, IntVarPolicy> &id){
+	pickedID = static_cast<uint>(id);
+	// picking a single object replaces the selection, unless it is part of it
+	if(std::find(selectedIDs.begin(), selectedIDs.end(), pickedID) == selectedIDs.end()){
+		selectedIDs.clear();
+		if(pickedID){
+			selectedIDs.push_back(pickedID);
+		}
+	}
+	selectedObjectsVar = static_cast<int>(selectedIDs.size());
+	ignoreObjectVarUpdate = true;
+	if(pickedID){
+		const Object& o = objects[pickedID-1];
+		glm::vec4 pos = o.modelMX[3];
+		picked_x = pos.x;
+		picked_y = pos.y;
+		picked_z = pos.z;
+		cube_sphere_switch = o.renderAsSphere;
+		cube_texture_switch = o.useTexture;
+		cube_warpFN = o.warpFN;
+		cube_roughness = o.roughness;
+		picked_x.SetReadonly(false);
+		picked_y.SetReadonly(false);
+		picked_z.SetReadonly(false);
+		cube_sphere_switch.SetReadonly(false);
+		cube_texture_switch.SetReadonly(false);
+		cube_warpFN.SetReadonly(false);
+		cube_roughness.SetReadonly(false);
+	} else {
+		picked_x = 0;
+		picked_y = 0;
+		picked_z = 0;
+		cube_sphere_switch = false;
+		cube_texture_switch = false;
+		cube_warpFN = 0;
+		cube_roughness = 0.0f;
+		picked_x.SetReadonly(true);
+		picked_y.SetReadonly(true);
+		picked_z.SetReadonly(true);
+		cube_sphere_switch.SetReadonly(true);
+		cube_texture_switch.SetReadonly(true);
+		cube_warpFN.SetReadonly(true);
+		cube_roughness.SetReadonly(true);
+	}
+	ignoreObjectVarUpdate = false;
+	// the picked object is highlighted
+	invalidate();
+}
+
+/**
+ * Callback function for the event of one of the coordinate apivars picked_x/y/z being changed.
+ * This alters the picked object's translation, the other selected objects are moved along.
+ */
+void CubeMapping::pickedObjectMoved(APIVar<CubeMapping, FloatVarPolicy> &var){
+	if(ignoreObjectVarUpdate){
+		return;
+	}
+	if(pickedID){
+		glm::vec4 pos = objects[pickedID-1].modelMX[3];
+		glm::vec4 translation = glm::vec4(picked_x.GetValue(), picked_y.GetValue(), picked_z.GetValue(), pos.w) - pos;
+		for(size_t i = 0; i < selectedIDs.size(); i++){
+			Object& o = objects[selectedIDs[i]-1];
+			o.modelMX[3] += translation;
+			updateObjectBounds(o);
+		}
+		invalidate();
+	}
+}
+
+/**
+ * Callback function for the event of an enumvar (e.g. cube_warpFN) is changed.
+ * This calls the other pickedObjectModeChanged callback function.
+ */
+void CubeMapping::pickedObjectModeChanged(EnumVar<CubeMapping> &var) {
+	// just call the other function, argument does not matter
+	pickedObjectModeChanged(cube_sphere_switch);
+}
+
+/**
+ * Callback function for the event of a float var (e.g. cube_roughness) is changed.
+ * This calls the other pickedObjectModeChanged callback function.
+ */
+void CubeMapping::pickedObjectModeChanged(APIVar<CubeMapping, FloatVarPolicy> &var) {
+	pickedObjectModeChanged(cube_sphere_switch);
+}
+
+/**
+ * Callback function for the event of a switch var (e.g. cube_sphere_switch) is changed.
+ * This updates the properties of the picked object except for coordinates.
+ */
+void CubeMapping::pickedObjectModeChanged(APIVar<CubeMapping, BoolVarPolicy> &var){
+	if(ignoreObjectVarUpdate){
+		return;
+	}
+	if(pickedID){
+		Object& o = objects[pickedID-1];
+		// meshes keep their shape
+		o.renderAsSphere = o.mesh < 0 && cube_sphere_switch.GetValue();
+		o.useTexture = cube_texture_switch.GetValue();
+		o.warpFN = cube_warpFN.GetValue();
+		o.roughness = cube_roughness.GetValue();
+		updateObjectBounds(o);
+		invalidate();
+	}
+}
+
+/**
+ * Starts the selection of the objects inside the dragged rectangle (or the lasso)
+ * on the GPU, Render collects the ids once the pass has finished.
+ * A click without movement keeps the single picked object.
+ */
+void CubeMapping::startRegionSelection() {
+	// region in GL window coordinates (y up)
+	glm::vec2 lo, hi;
+	if(lassoMode){
+		if(lassoPath.size() < 3){
+			return;
+		}
+		lo = hi = lassoPath[0];
+		for(size_t i = 1; i < lassoPath.size(); i++){
+			lo = glm::min(lo, lassoPath[i]);
+			hi = glm::max(hi, lassoPath[i]);
+		}
+	} else {
+		lo = glm::vec2(std::min(dragStart.x, dragEnd.x), wHeight - 1 - std::max(dragStart.y, dragEnd.y));
+		hi = glm::vec2(std::max(dragStart.x, dragEnd.x) + 1, wHeight - std::min(dragStart.y, dragEnd.y));
+	}
+	if(hi.x - lo.x < 3 && hi.y - lo.y < 3){
+		return;
+	}
+	// the ids are read from the layer of camera 0, limited to its part of the layer
+	lo = windowToCameraLayer(lo);
+	hi = windowToCameraLayer(hi);
+	std::vector<glm::vec2> path;
+	if(lassoMode){
+		for(size_t i = 0; i < lassoPath.size(); i++){
+			path.push_back(windowToCameraLayer(lassoPath[i]));
+		}
+	}
+	glm::ivec2 size = cameraViewport(0);
+	int x0 = std::max(static_cast<int>(std::floor(lo.x)), 0);
+	int y0 = std::max(static_cast<int>(std::floor(lo.y)), 0);
+	int x1 = std::min(static_cast<int>(std::ceil(hi.x)), size.x);
+	int y1 = std::min(static_cast<int>(std::ceil(hi.y)), size.y);
+	if(x1 <= x0 || y1 <= y0){
+		return;
+	}
+	regionSelection.select(gpuResources, shaderPickRegion, texArrayPicking, x0, y0, x1, y1,
+			path, objects.size());
+}
+
+/**
+ * Replaces the selection by the objects found by a region selection.
+ * The object with the smallest id becomes the picked object shown by the apivars,
+ * moving it moves the whole selection.
+ */
+void CubeMapping::applySelection(const std::vector<uint>& ids) {
+	selectedIDs.clear();
+	for(size_t i = 0; i < ids.size(); i++){
+		if(ids[i] >= 1 && ids[i] <= objects.size()){
+			selectedIDs.push_back(ids[i]);
+		}
+	}
+	std::sort(selectedIDs.begin(), selectedIDs.end());
+	TRACE_INFO("selection", "%u objects selected", static_cast<uint>(selectedIDs.size()));
+	uint primary = selectedIDs.empty() ? 0 : selectedIDs[0];
+	if(static_cast<uint>(pickedIDVar.GetValue()) == primary){
+		// the callback only fires for a changed value
+		objectPicked(pickedIDVar);
+	} else {
+		pickedIDVar = static_cast<int>(primary);
+	}
+}
+
+/** draws the outline of the dragged selection rectangle over the presented image */
+void CubeMapping::drawSelectionRectangle() {
+	// window coordinates to normalized device coordinates
+	glm::vec2 a(dragStart.x*2.0f/wWidth - 1.0f, 1.0f - dragStart.y*2.0f/wHeight);
+	glm::vec2 b(dragEnd.x*2.0f/wWidth - 1.0f, 1.0f - dragEnd.y*2.0f/wHeight);
+	// the box is flattened to the rectangle, its front and back edges coincide
+	glm::mat4 rectMX = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f*(a + b), 0.0f)),
+			glm::vec3(b.x - a.x, b.y - a.y, 0.0f));
+	glm::mat4 identity(1.0f);
+	glDisable(GL_DEPTH_TEST);
+	shaderBox.Bind();
+	glUniformMatrix4fv( shaderBox.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(identity) );
+	glUniformMatrix4fv( shaderBox.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(identity) );
+	glUniformMatrix4fv( shaderBox.GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(rectMX) );
+	vaBox.Bind();
+	glDrawElements(GL_LINES, ogl4_numBoxEdges*2, GL_UNSIGNED_INT, 0);
+	vaBox.Release();
+	shaderBox.Release();
+	glEnable(GL_DEPTH_TEST);
+}
+
+/**
+ * Called when changing from this plugin to another in OGL4Core.
+ * Should reset all introduced GL states and delete GL objects created by this plugin.
+ */
+bool CubeMapping::Deactivate(void) {
+	// textures, programs and vertex arrays with a cache key go to the resource cache,
+	// releasing them below only clears the handles
+	gpuResources.park();
+	// clean up GL things
+	// shaders
+	deleteShaders();
 	// framebuffers
-	glDeleteFramebuffers(1, &fbo);
-	glDeleteFramebuffers(1, &fbo_layers2Cube);
-	fbo = fbo_layers2Cube = 0;
+	gpuResources.releaseFramebuffer(fbo);
+	releaseReflectionTargets();
+	layered.release(gpuResources);
 	// textures
-	GLuint textures[] = {
-		texSky1,texSky2,texSky3,texEarth,
-		texArrayColor,texArrayDepth,texArrayPicking,
-		texReflectionCubeMap
-	};
-	glDeleteTextures(7, textures);
-	texSky1=texSky2=texSky3=texEarth=texArrayColor=texArrayDepth=texArrayPicking=texReflectionCubeMap = 0;
+	releaseTextures();
+	gpuResources.releaseTexture(texArrayColor);
+	gpuResources.releaseTexture(texArrayDepth);
+	gpuResources.releaseTexture(texArrayPicking);
 	// vertex arrays
-	vaBox.Delete();
-	vaCube.Delete();
-	vaQuad.Delete();
-	vaSkybox.Delete();
+	gpuResources.releaseVertexArray(&vaBox);
+	gpuResources.releaseVertexArray(&vaCube);
+	gpuResources.releaseVertexArray(&vaQuad);
+	gpuResources.releaseVertexArray(&vaSkybox);
+	// uniform buffer (waits for the frames in flight)
+	frameData.release(gpuResources);
+	regionSelection.release(gpuResources);
+	reflectionMipChain.release(gpuResources);
+	overdrawCounter.release(gpuResources);
+	reflectionProbe.release(gpuResources);
+	bakeRequested = reflectionBaked = false;
+	probeMissingKey = probeLastKey = 0;
+	probeStableFrames = 0;
+	// writes the frames still in flight
+	frameCapture.stop(gpuResources);
+	captureVar = false;
+	layeredBenchmark.release();
+	governor.release();
+	objectLimit = 0;
+	// scene (objects refer to the vertex arrays, meshes and shaders)
+	meshLibrary.release(gpuResources);
+	objects.clear();
+	visibleObjects.clear();
+	bvh.clear();
+	mirrorObject = -1;
+	pickedID = 0;
+	selectedIDs.clear();
+	regionDragging = false;
+	// anything still registered at this point has leaked, report and release it
+	gpuResources.releaseAll(stderr);
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDisable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	return true;
+}
+
+/**
+ * Sets framebuffer, drawbuffers and corresponding viewport dimensions
+ * (the ones that are set already are skipped, see RenderTargetState).
+ */
+void CubeMapping::setRenderTargets(GLuint fbo, uint numBuffers, const GLenum* buffers, int vWidth, int vHeight){
+	targetState.bindTargets(fbo, numBuffers, buffers, vWidth, vHeight);
+}
+
+/**
+ * Binds the layered FBO for drawing. The camera layers (0 and 7 and up) cover the window,
+ * the reflection layers 1-6 only the face resolution in use if viewport arrays are available,
+ * the camera layers the tile of their camera then
+ * (the geometry shaders select the viewport of a layer with gl_ViewportIndex).
+ * @param pass  pass of the multi pass backend, which binds the framebuffer of that layer only
+ *              (-1 = all layers)
+ */
+void CubeMapping::setLayerTargets(uint numBuffers, const GLenum* buffers, int pass){
+	if(pass >= 0 && layered.numPasses() > 1){
+		setViewTargets(numBuffers, buffers, pass);
+		return;
+	}
+	setRenderTargets(fbo, numBuffers, buffers, wWidth, wHeight);
+	if(viewportArrays){
+		float faceSize = static_cast<float>(reflectionResolution);
+		for(GLuint view = 1; view < 7; view++){
+			glViewportIndexedf(view, 0.0f, 0.0f, faceSize, faceSize);
+		}
+		for(int camera = 0; camera < numCameras; camera++){
+			glm::vec2 size = glm::vec2(cameraViewport(camera));
+			glViewportIndexedf(camera ? 6 + camera : 0, 0.0f, 0.0f, size.x, size.y);
+		}
+		// viewport 0 is the one of camera 0 now
+		targetState.invalidateViewport();
+	}
+}
+
+/**
+ * Binds the framebuffer of a single layer for drawing the view of that layer only
+ * (the passes of the multi pass backend and the meshes drawn per view).
+ */
+void CubeMapping::setViewTargets(uint numBuffers, const GLenum* buffers, int view){
+	glm::ivec2 size(wWidth, wHeight);
+	if(view == 0 || view > 6){
+		size = cameraViewport(view ? view - 6 : 0);
+	} else if(viewportArrays){
+		size = glm::ivec2(reflectionResolution);
+	}
+	setRenderTargets(layered.passFramebuffer(view), numBuffers, buffers, size.x, size.y);
+}
+
+/**
+ * renders the last 6 layers of the texture array onto the cubemap texture
+ * (transfering from array texture to cubemap)
+ * this changes framebuffer and viewport
+ */
+void CubeMapping::transferArrayTexture2CubeMap(){
+	TRACE_SPAN(TRACE_LEVEL_INFO, "layers2cube pass");
+	// draw quad
+	glm::mat4 pmx = glm::ortho(0.0f,1.0f,0.0f,1.0f);
+	// part of the layers the faces were rendered to
+	glm::vec2 faceSize = viewportArrays ? glm::vec2(static_cast<float>(reflectionResolution)) : glm::vec2(wWidth, wHeight);
+	shaderLayers2Cube.Bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayColor);
+	glUniform1i( shaderLayers2Cube.GetUniformLocation("tex"), 0);
+	glUniform2f( shaderLayers2Cube.GetUniformLocation("faceScale"), faceSize.x/layerWidth, faceSize.y/layerHeight);
+	glUniformMatrix4fv( shaderLayers2Cube.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(pmx) );
+	// binds and clears the cubemap FBO (or its faces one by one)
+	layered.transfer(shaderLayers2Cube, vaQuad, fbo_layers2Cube, texReflectionCubeMap, reflectionResolution);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	shaderLayers2Cube.Release();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/**
+ * Builds the mip levels of the reflection cubemap from the freshly rendered level 0,
+ * so rough objects and minified reflections read filtered levels.
+ * Falls back to glGenerateMipmap if the compute passes are not available.
+ */
+void CubeMapping::updateReflectionMips(){
+	// the probe is baked with the full mip chain
+	int mode = bakeRequested ? std::max(reflectionMips.GetValue(), 1) : reflectionMips.GetValue();
+	if(!mode){
+		return;
+	}
+	if(reflectionGlossy.GetValue() && reflectionMipChain.prefilter(shaderCubePrefilter, texReflectionCubeMap, reflectionFormat, reflectionResolution, 1.0f)){
+		return;
+	}
+	if(mode == 2 && reflectionMipChain.downsample(gpuResources, shaderCubeMips, texReflectionCubeMap, reflectionFormat, reflectionResolution)){
+		return;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "cube mips (driver)");
+	CubeMipChain::generate(texReflectionCubeMap);
+}
+
+/** restricts sampling of the reflection cubemaps to level 0 while the mip chain is off */
+void CubeMapping::setReflectionMaxLevel(){
+	for(int i = 0; i < REFLECTION_POOL_SIZE; i++){
+		if(!reflectionPoolTextures[i]){
+			continue;
+		}
+		int maxLevel = reflectionMips.GetValue() ? CubeMipChain::numLevels(reflectionPoolResolutions[i]) - 1 : 0;
+		glBindTexture(GL_TEXTURE_CUBE_MAP, reflectionPoolTextures[i]);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, maxLevel);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
 
-	glDisable(GL_DEPTH_TEST);
+/**
+ * Callback function for the event of changing the reflection mip chain apivars.
+ */
+void CubeMapping::reflectionMipsChanged(EnumVar<CubeMapping> &var) {
+	setReflectionMaxLevel();
+	invalidate();
+}
+
+void CubeMapping::reflectionMipsChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	setReflectionMaxLevel();
+	invalidate();
+}
+
+/**
+ * view matrices for pointing the camera to each of a cube's faces from its center
+ * (same as boxViewMX in cube.geom.glsl, layers 1-6)
+ */
+static const glm::mat4 boxViewMX[6] = {
+	glm::mat4(glm::vec4( 0, 0,-1,0),glm::vec4(0, 1, 0,0),glm::vec4( 1, 0, 0,0),glm::vec4(0,0,0,1)), // y+90 (POSX)
+	glm::mat4(glm::vec4( 0, 0, 1,0),glm::vec4(0, 1, 0,0),glm::vec4(-1, 0, 0,0),glm::vec4(0,0,0,1)), // y-90 (NEGX)
+	glm::mat4(glm::vec4(-1, 0, 0,0),glm::vec4(0, 0,-1,0),glm::vec4( 0,-1, 0,0),glm::vec4(0,0,0,1)), // x-90 (POSY)
+	glm::mat4(glm::vec4(-1, 0, 0,0),glm::vec4(0, 0, 1,0),glm::vec4( 0, 1, 0,0),glm::vec4(0,0,0,1)), // x+90 (NEGY)
+	glm::mat4(glm::vec4(-1, 0, 0,0),glm::vec4(0, 1, 0,0),glm::vec4( 0, 0,-1,0),glm::vec4(0,0,0,1)), // y180 (POSZ)
+	glm::mat4(glm::vec4( 1, 0, 0,0),glm::vec4(0, 1, 0,0),glm::vec4( 0, 0, 1,0),glm::vec4(0,0,0,1))  // 0    (NEGZ)
+};
+
+/**
+ * Determines the objects visible in the camera views and the 6 views of the
+ * reflection cubemap by querying the bounding volume hierarchy with each view
+ * frustum (in parallel). Sets the view masks of the objects and collects the
+ * objects visible in any view in visibleObjects.
+ */
+void CubeMapping::cullObjects(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX, const glm::mat4x4& boxTranslMX) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "culling");
+	// reset the objects of the last frame
+	for(uint i = 0; i < visibleObjects.size(); i++){
+		objects[visibleObjects[i]].viewMask = 0;
+	}
+	visibleObjects.clear();
+	// the reflection faces are not rendered while the baked reflection or the one of an earlier frame is shown
+	uint faceMask = reflectionBaked || reflectionReused ? 0x7Eu : 0u;
+	if(!frustumCulling.GetValue()){
+		for(uint i = 0; i < objects.size(); i++){
+			objects[i].viewMask = ((1u << numViews()) - 1) & ~faceMask;
+			visibleObjects.push_back(i);
+		}
+		return;
+	}
+	Frustum frustums[MAX_VIEWS];
+	frustums[0] = Frustum::fromViewProjection(projMX*viewMX);
+	for(int face = 0; face < 6; face++){
+		frustums[1+face] = Frustum::fromViewProjection(boxProjMX*boxViewMX[face]*boxTranslMX);
+	}
+	for(int camera = 1; camera < numCameras; camera++){
+		frustums[6+camera] = Frustum::fromViewProjection(cameraProjMX[camera]*cameraViewMX[camera-1]);
+	}
+	int views = numViews();
+	ThreadPool::shared().parallelFor(views, [&](unsigned view){
+		viewQueryResults[view].clear();
+		if(!(faceMask & (1u << view))){
+			bvh.queryFrustum(frustums[view], viewQueryResults[view]);
+		}
+	});
+	for(int view = 0; view < views; view++){
+		const std::vector<int>& result = viewQueryResults[view];
+		for(size_t i = 0; i < result.size(); i++){
+			Object& o = objects[result[i]];
+			if(!o.viewMask){
+				visibleObjects.push_back(static_cast<uint>(result[i]));
+			}
+			o.viewMask |= 1u << view;
+		}
+	}
+	// keep the draw order of the scene
+	std::sort(visibleObjects.begin(), visibleObjects.end());
+}
+
+/**
+ * Chooses the subdivision level of every visible object for each view it is visible in.
+ * A cube face is made of 2x2 quads of subdivision level n, so a great circle of a sphere
+ * (crossing 4 faces) has 8n segments. The level is chosen so that the segments of the
+ * silhouette are about 8 pixels long in the respective view, the detail in the reflection
+ * views is scaled by 2^lodReflBias. Cubes are flat and always use level 1.
+ * Without automatic LOD all objects use subDivLvl, which is the maximum level otherwise.
+ * Also counts the vertices emitted by the geometry shaders.
+ */
+void CubeMapping::selectLevelsOfDetail(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "level of detail");
+	const float pixelsPerSegment = 8.0f;
+	int maxLevel = subDivisionLevel();
+	bool automatic = autoLOD.GetValue();
+	// diameter in pixels of a sphere with radius r at distance d is r/d*pixelScale
+	float pixelScale[MAX_VIEWS];
+	for(int view = 1; view < 7; view++){
+		pixelScale[view] = boxProjMX[1][1]*(viewportArrays ? reflectionResolution : wHeight)*std::pow(2.0f, lodReflectionBias.GetValue());
+	}
+	// the cameras by the height of their tile
+	int views = numViews();
+	for(int camera = 0; camera < numCameras; camera++){
+		const glm::mat4x4& cameraProj = camera ? cameraProjMX[camera] : projMX;
+		pixelScale[camera ? 6 + camera : 0] = cameraProj[1][1]*cameraTiles[camera].w;
+	}
+	uint cameraMask = cameraViewMask();
+	glm::vec3 boxCenter = mirrorObject >= 0 ? glm::vec3(objects[mirrorObject].modelMX[3]) : glm::vec3(0);
+	const unsigned chunkSize = 1024;
+	unsigned numChunks = static_cast<unsigned>((visibleObjects.size() + chunkSize-1)/chunkSize);
+	std::vector<double> chunkVertices(numChunks, 0.0);
+	ThreadPool::shared().parallelFor(numChunks, [&](unsigned chunk){
+		size_t end = std::min(visibleObjects.size(), static_cast<size_t>(chunk+1)*chunkSize);
+		for(size_t i = chunk*chunkSize; i < end; i++){
+			Object& o = objects[visibleObjects[i]];
+			glm::vec3 center = glm::vec3(o.modelMX[3]);
+			// reflective objects are only rendered into the camera views
+			uint mask = o.reflective ? (o.viewMask & cameraMask) : o.viewMask;
+			for(int view = 0; view < views; view++){
+				if(!(mask & (1u << view))){
+					continue;
+				}
+				if(o.mesh >= 0){
+					// meshes are drawn as they are, the geometry shaders emit nothing for them
+					o.subDivLevels[view] = 1;
+					continue;
+				}
+				int level = maxLevel;
+				if(automatic && !o.renderAsSphere){
+					level = 1;
+				} else if(automatic){
+					float distance = glm::length(center - boxCenter);
+					if(view == 0 || view > 6){
+						distance = -(cameraView(view ? view - 6 : 0)*glm::vec4(center,1)).z;
+					}
+					if(distance > o.boundingRadius){
+						float diameter = o.boundingRadius/distance*pixelScale[view];
+						level = static_cast<int>(std::ceil(glm::pi<float>()*diameter/(8.0f*pixelsPerSegment)));
+						level = std::max(1, std::min(level, maxLevel));
+					}
+				}
+				o.subDivLevels[view] = level;
+				// 24 input points, each emitting level strips of 2*level+2 vertices
+				chunkVertices[chunk] += 24.0*level*(2*level+2);
+			}
+		}
+	});
+	emittedVertices = 0;
+	for(unsigned chunk = 0; chunk < numChunks; chunk++){
+		emittedVertices += chunkVertices[chunk];
+	}
+}
+
+/**
+ * Writes the uniform blocks of this frame into the next slot of the frame data ring:
+ * the frame block followed by an object block for every visible object (in the order of
+ * visibleObjects). The object blocks are filled by the thread pool, so the passes only
+ * have to bind ranges of the ring. Binds the frame block.
+ * @return false if the ring could not be allocated
+ */
+bool CubeMapping::writeFrameData(const FrameUniforms& frame) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "frame data");
+	objectDataOffset = frameData.align(sizeof(FrameUniforms));
+	objectDataStride = frameData.align(sizeof(ObjectUniforms));
+	size_t bytes = objectDataOffset + visibleObjects.size()*objectDataStride;
+	size_t previousBytes = frameData.getSlotBytes();
+	if(!frameData.reserve(gpuResources, bytes)){
+		return false;
+	}
+	if(frameData.getSlotBytes() != previousBytes){
+		updateMemoryVars();
+	}
+	unsigned char* slot = frameData.beginFrame();
+	std::memcpy(slot, &frame, sizeof(FrameUniforms));
+	const unsigned chunkSize = 1024;
+	unsigned numChunks = static_cast<unsigned>((visibleObjects.size() + chunkSize-1)/chunkSize);
+	ThreadPool::shared().parallelFor(numChunks, [&](unsigned chunk){
+		size_t end = std::min(visibleObjects.size(), static_cast<size_t>(chunk+1)*chunkSize);
+		for(size_t i = chunk*chunkSize; i < end; i++){
+			const Object& o = objects[visibleObjects[i]];
+			ObjectUniforms u;
+			u.modelMX = o.modelMX;
+			u.pickColor = idToColor(o.id);
+			u.roughness = o.roughness;
+			u.cubeCenterWorldCoords = glm::vec3(o.modelMX[3]);
+			u.useTexture = o.useTexture;
+			u.doSphereProjection = o.renderAsSphere;
+			u.warpFN = o.warpFN;
+			u.viewMask = static_cast<int>(o.viewMask);
+			u.textureLayer = std::max(o.atlasLayer, 0);
+			for(int view = 0; view < MAX_VIEWS; view++){
+				u.subDivisionLevels[view] = o.subDivLevels[view];
+			}
+			for(int view = MAX_VIEWS; view < 12; view++){
+				u.subDivisionLevels[view] = 1;
+			}
+			// write the block at once (the mapping may be write combined)
+			std::memcpy(slot + objectDataOffset + i*objectDataStride, &u, sizeof(ObjectUniforms));
+		}
+	});
+	frameData.flush(bytes);
+	frameData.bindRange(frameDataBinding, 0, sizeof(FrameUniforms));
 	return true;
 }
 
 /**
- * Sets framebuffer, drawbuffers and corresponding viewport dimensions.
+ * Orders the draws of the objects pass by the size class of their texture in the cubemap atlas
+ * (objects without texture first), so the atlas is only rebound when the class changes.
+ * Counting sort, as there are only a few classes. Reflective objects are drawn by the mirror pass,
+ * meshes are moved to meshDrawOrder (in the same order) if the backend draws them per view
+ * (see LayeredRenderer::meshesPerView()).
  */
-void setRenderTargets(GLuint fbo, uint numBuffers, const GLenum* buffers, int vWidth, int vHeight){
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	if(numBuffers > 1){
-		glDrawBuffers(numBuffers, buffers);
-	}else{
-		glDrawBuffer(buffers[0]);
+void CubeMapping::sortObjectDraws() {
+	int numClasses = textureAtlas.numClasses();
+	std::vector<uint> first(numClasses+2, 0);
+	for(uint i = 0; i < visibleObjects.size(); i++){
+		const Object& o = objects[visibleObjects[i]];
+		if(!o.reflective){
+			first[o.atlasClass+2]++;
+		}
+	}
+	for(int c = 1; c < numClasses+2; c++){
+		first[c] += first[c-1];
+	}
+	objectDrawOrder.resize(first[numClasses+1]);
+	for(uint i = 0; i < visibleObjects.size(); i++){
+		const Object& o = objects[visibleObjects[i]];
+		if(!o.reflective){
+			objectDrawOrder[first[o.atlasClass+1]++] = i;
+		}
+	}
+	meshDrawOrder.clear();
+	meshViewMask = 0;
+	if(!layered.meshesPerView()){
+		return;
+	}
+	uint numDraws = 0;
+	for(uint k = 0; k < objectDrawOrder.size(); k++){
+		uint i = objectDrawOrder[k];
+		const Object& o = objects[visibleObjects[i]];
+		if(o.mesh >= 0){
+			meshDrawOrder.push_back(i);
+			meshViewMask |= o.viewMask;
+		} else {
+			objectDrawOrder[numDraws++] = i;
+		}
 	}
-	glViewport(0,0,vWidth, vHeight);
+	objectDrawOrder.resize(numDraws);
+}
+
+/** binds the object block of the visible object with the specified index in visibleObjects */
+void CubeMapping::bindObjectData(uint visibleIndex) {
+	frameData.bindRange(objectDataBinding, objectDataOffset + visibleIndex*objectDataStride, sizeof(ObjectUniforms));
 }
 
 /**
- * renders the last 6 layers of the texture array onto the cubemap texture
- * (transfering from array texture to cubemap)
+ * Draws a non-reflective object into the views of a layered pass with the bound program,
+ * a cube or sphere from the corner points of its quads or a mesh from its vertex array.
+ */
+void CubeMapping::drawObject(const Object& obj, GLShader& shader, int pass) {
+	if(obj.mesh >= 0){
+		meshLibrary.bind(shader, obj.mesh);
+		layered.drawMesh(pass, meshLibrary.indexType(obj.mesh), obj.numElements, obj.viewMask);
+		meshLibrary.unbind();
+	} else {
+		obj.va->Bind();
+		layered.drawCube(pass, obj.elementType, obj.numElements, obj.viewMask, obj.subDivLevels);
+		obj.va->Release();
+	}
+}
+
+/**
+ * Depth prepass of the non-reflective objects into the views of a pass.
+ * Only their depth is written (color writes masked), so the objects pass that follows
+ * with depth writes off shades one fragment per pixel and the skybox fills the rest.
+ * The meshes in meshDrawOrder follow view by view into the framebuffers of the single layers.
+ */
+void CubeMapping::drawDepthPrepass(int pass) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "depth prepass");
+	GLenum buffersColAndPick[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	GLShader* shader = nullptr;
+	// view -1 draws objectDrawOrder into the views of the pass
+	for(int view = -1; view < numViews(); view++){
+		if(view >= 0){
+			if(!(meshViewMask & (1u << view))){
+				continue;
+			}
+			setViewTargets(2, buffersColAndPick, view);
+			if(shader){
+				shader->Release();
+				shader = nullptr;
+			}
+		}
+		const std::vector<uint>& order = view < 0 ? objectDrawOrder : meshDrawOrder;
+		int drawPass = view < 0 ? pass : view;
+		for(uint k = 0; k < order.size(); k++){
+			uint i = order[k];
+			const Object& obj = objects[visibleObjects[i]];
+			// meshes use the depth program with their vertex shader
+			GLShader* objShader = obj.mesh >= 0 ? &shaderMeshDepth : &shaderCubeDepth;
+			if(objShader != shader){
+				if(shader){
+					shader->Release();
+				}
+				shader = objShader;
+				shader->Bind();
+				layered.beginPass(*shader, drawPass);
+			}
+			bindObjectData(i);
+			drawObject(obj, *shader, drawPass);
+		}
+	}
+	if(shader){
+		shader->Release();
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+/**
+ * Depth prepass of the reflective objects into the camera views (the layered framebuffer
+ * has to be bound), they are shaded after the reflection was rendered.
+ */
+void CubeMapping::drawMirrorDepthPrepass() {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "mirror depth prepass");
+	GLenum buffersColAndPick[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	setLayerTargets(2, buffersColAndPick);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	shaderMirrorcubeDepth.Bind();
+	uint cameraMask = cameraViewMask();
+	for(uint i = 0; i < visibleObjects.size(); i++){
+		const Object& obj = objects[visibleObjects[i]];
+		if(!obj.reflective || !(obj.viewMask & cameraMask)){
+			continue;
+		}
+		bindObjectData(i);
+		obj.va->Bind();
+		glDrawElements(obj.elementType, obj.numElements, GL_UNSIGNED_INT, 0);
+		obj.va->Release();
+	}
+	shaderMirrorcubeDepth.Release();
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+/**
+ * Shows the fragments shaded per pixel in the last frame, averaged over the camera views
+ * and over the reflection faces (every layer is in the trace at debug level).
+ */
+void CubeMapping::updateOverdrawVars() {
+	if(!overdrawCounter.isCreated()){
+		return;
+	}
+	// the part of the layers the views were rendered to (see setLayerTargets)
+	glm::ivec2 faceSize = viewportArrays ? glm::ivec2(reflectionResolution) : glm::ivec2(wWidth, wHeight);
+	double cameraFragments = 0.0, cameraPixels = 0.0;
+	double reflFragments = 0.0, reflPixels = 0.0;
+	for(int view = 0; view < numViews(); view++){
+		bool cameraView = view == 0 || view > 6;
+		glm::ivec2 size = cameraView ? cameraViewport(view ? view - 6 : 0) : faceSize;
+		double pixels = std::max(static_cast<double>(size.x)*size.y, 1.0);
+		double fragments = overdrawCounter.fragments(view);
+		TRACE_DEBUG("overdraw", "layer %d: %.2f fragments per pixel", view, fragments/pixels);
+		if(cameraView){
+			cameraFragments += fragments;
+			cameraPixels += pixels;
+		} else {
+			reflFragments += fragments;
+			reflPixels += pixels;
+		}
+	}
+	overdrawCameraVar = static_cast<float>(cameraFragments/cameraPixels);
+	overdrawReflVar = static_cast<float>(reflFragments/reflPixels);
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "overdraw camera", overdrawCameraVar.GetValue());
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "overdraw reflection", overdrawReflVar.GetValue());
+}
+
+/**
+ * Callback function for the event of switching the frame capture.
+ * Every run writes to a new directory capture/<date_time> in the plugin directory.
+ */
+void CubeMapping::captureChanged(APIVar<CubeMapping, BoolVarPolicy> &var) {
+	if(var.GetValue() == frameCapture.isRunning()){
+		return;
+	}
+	if(!var.GetValue()){
+		frameCapture.stop(gpuResources);
+		captureFramesVar = static_cast<int>(frameCapture.framesWritten());
+		captureDroppedVar = static_cast<int>(frameCapture.framesDropped());
+		return;
+	}
+	char stamp[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+	// raw captures of HDR targets keep the float values
+	if(!fbo || !frameCapture.start(gpuResources, pluginPath + std::string("/capture/") + stamp,
+			static_cast<CaptureFormat>(captureFormat.GetValue()), isHDRPipeline())){
+		var = false;
+		return;
+	}
+	captureFramesVar = 0;
+	captureDroppedVar = 0;
+	PostRedisplay();
+}
+
+/**
+ * Queues the readback of the presented camera view (and the reflection faces) while
+ * capturing, and keeps rendering so that every frame is captured.
+ */
+void CubeMapping::captureRenderedFrame() {
+	if(!frameCapture.isRunning()){
+		return;
+	}
+	glm::ivec2 size = cameraViewport(0);
+	GLuint faces = captureFaces && mirrorObject >= 0 ? (reflectionBaked ? reflectionProbe.cubeMap() : texReflectionCubeMap) : 0;
+	int faceResolution = reflectionBaked ? reflectionProbe.resolution() : reflectionResolution;
+	frameCapture.captureFrame(gpuResources, texArrayColor, size.x, size.y, faces, faceResolution);
+	if(captureFramesVar.GetValue() != static_cast<int>(frameCapture.framesWritten())){
+		captureFramesVar = static_cast<int>(frameCapture.framesWritten());
+	}
+	if(captureDroppedVar.GetValue() != static_cast<int>(frameCapture.framesDropped())){
+		captureDroppedVar = static_cast<int>(frameCapture.framesDropped());
+	}
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "capture written", static_cast<double>(frameCapture.framesWritten()));
+	PostRedisplay();
+}
+
+/**
+ * Feedback pass of the virtual skybox. Renders the skybox and the objects textured
+ * with it into the (low resolution) feedback targets, writing the ids of the tiles
+ * they sample instead of colors, and starts the readback of the result.
+ * The objects use the frame data written by writeFrameData().
  * this changes framebuffer and viewport
  */
-void CubeMapping::transferArrayTexture2CubeMap(){
+void CubeMapping::drawFeedback(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "feedback pass");
 	GLenum drawbuffer = GL_COLOR_ATTACHMENT0;
-	setRenderTargets(fbo_layers2Cube, 1, &drawbuffer, 1024, 1024);
-	// clear
-	glClearColor( 0.0, 0.0, 0.0, 1.0 );
-	glClear( GL_COLOR_BUFFER_BIT );
-	// draw quad
-	glm::mat4 pmx = glm::ortho(0.0f,1.0f,0.0f,1.0f);
-	shaderLayers2Cube.Bind();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayColor);
-	glUniform1i( shaderLayers2Cube.GetUniformLocation("tex"), 0);
-	glUniformMatrix4fv( shaderLayers2Cube.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(pmx) );
-	vaQuad.Bind();
-	glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
-	vaQuad.Release();
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-	shaderLayers2Cube.Release();
+	setRenderTargets(virtualSky.feedbackFramebuffer(), 1, &drawbuffer, virtualSky.feedbackWidth(), virtualSky.feedbackHeight());
+	// clear (0 = no tile)
+	GLuint noTile[4] = {0, 0, 0, 0};
+	glClearBufferuiv(GL_COLOR, 0, noTile);
+	glClear( GL_DEPTH_BUFFER_BIT );
+	float lodBias = virtualSky.feedbackLodBias();
+	// draw skybox
+	{
+		shaderSkyboxFeedback.Bind();
+		virtualSky.bind(shaderSkyboxFeedback, 1, 2, lodBias);
+		glUniformMatrix4fv( shaderSkyboxFeedback.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
+		glUniformMatrix4fv( shaderSkyboxFeedback.GetUniformLocation("boxProjMX"), 1, GL_FALSE, glm::value_ptr(boxProjMX) );
+		glm::mat4 skyboxViewMX = viewMX; skyboxViewMX[3] = glm::vec4(0,0,0,1);
+		glUniformMatrix4fv( shaderSkyboxFeedback.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(skyboxViewMX) );
+		glUniformMatrix4fv( shaderSkyboxFeedback.GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(modelMX_sky) );
+		vaSkybox.Bind();
+		glDrawElements(GL_TRIANGLES, 6*6, GL_UNSIGNED_INT, 0);
+		vaSkybox.Release();
+		shaderSkyboxFeedback.Release();
+	}
+	// draw objects that are textured with the skybox (not the reflective ones)
+	GLuint skyboxTextures[] = {0, texSky1, texSky2, texSky3};
+	shaderCubeFeedback.Bind();
+	virtualSky.bind(shaderCubeFeedback, 1, 2, lodBias);
+	for(uint i=0; i < visibleObjects.size(); i++){
+		const Object& obj = objects[visibleObjects[i]];
+		// meshes have no geometry shader path, they request no tiles of their own
+		if(obj.reflective || obj.mesh >= 0 || !obj.useTexture || obj.texID != skyboxTextures[virtualSkySelection]){
+			continue;
+		}
+		bindObjectData(i);
+		obj.va->Bind();
+		glDrawElements(obj.elementType, obj.numElements, GL_UNSIGNED_INT, 0);
+		obj.va->Release();
+	}
+	virtualSky.unbind(1, 2);
+	shaderCubeFeedback.Release();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	virtualSky.readFeedback();
 }
 
 /**
@@ -801,158 +2798,529 @@ void CubeMapping::transferArrayTexture2CubeMap(){
  * be drawn to q quad.
  */
 void CubeMapping::drawToFBO() {
-	// set fbo and drawbuffers
+	TRACE_SPAN(TRACE_LEVEL_INFO, "drawToFBO");
+	// upload the tiles the streamer loaded since the last frame
+	bool useVirtual = virtualSky.isOpen();
+	if(useVirtual){
+		TRACE_SPAN(TRACE_LEVEL_INFO, "tile upload");
+		virtualSky.update();
+	}
+	// drawbuffers of the passes
 	GLenum buffersColAndPick[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
 	GLenum buffersColOnly[] = {GL_COLOR_ATTACHMENT0};
-	setRenderTargets(fbo, 2, buffersColAndPick, wWidth, wHeight);
-	// clear
-	glClearColor( 0.0, 0.0, 0.0, 1.0 );
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-	// matrices
-	glm::mat4x4 projMX = glm::perspective(
-				glm::radians(static_cast<float>(fovY)),
-				aspect,
-				static_cast<float>(zNear),
-				static_cast<float>(zFar)
-	);
-	glm::mat4x4 invViewMX = glm::inverse(viewMX);
-	glm::mat4x4 boxProjMX = glm::perspective(
-				glm::radians(90.0f),
-				1.0f,
-				static_cast<float>(zNear),
-				static_cast<float>(zFar)
-	);
-	glm::vec4 boxTransl = objects[0]->modelMX*glm::vec4(0,0,0,1);
-	glm::mat4x4 boxTranslMX = glm::translate(glm::mat4x4(1), -glm::vec3(boxTransl));
+	// matrices, the reflection is rendered from the center of the mirror object
+	glm::vec4 boxTransl = mirrorObject >= 0 ? objects[mirrorObject].modelMX*glm::vec4(0,0,0,1) : glm::vec4(0,0,0,1);
+	FrameMatrices matrices;
+	computeFrameMatrices(viewMX, static_cast<float>(fovY), aspect, static_cast<float>(zNear), static_cast<float>(zFar),
+			glm::vec3(boxTransl), matrices);
+	const glm::mat4x4& projMX = matrices.projMX;
+	const glm::mat4x4& invViewMX = matrices.invViewMX;
+	const glm::mat4x4& boxProjMX = matrices.boxProjMX;
+	const glm::mat4x4& boxTranslMX = matrices.boxTranslMX;
+	updateCameraMatrices();
 
 	// light direction (depending on used skybox)
 	glm::vec3 lights[] = {glm::vec3(1,0,0),light1,light2,light3};
 	uint skyboxSelection = static_cast<uint>(skyboxTexturing);
 	glm::vec3 lightDir = -lights[skyboxSelection];
-
-	setRenderTargets(fbo, 1, buffersColOnly, wWidth, wHeight);
-	// draw skybox
-	{
-		shaderSkybox.Bind();
-		glActiveTexture(GL_TEXTURE0);
-		GLuint skyboxTextures[] = {0, texSky1, texSky2, texSky3};
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextures[skyboxSelection]);
-		glUniform1i( shaderSkybox.GetUniformLocation("tex"), 0);
-		glUniform1i( shaderSkybox.GetUniformLocation("useTexture"), skyboxSelection != 0);
-		glUniformMatrix4fv( shaderSkybox.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
-		glUniformMatrix4fv( shaderSkybox.GetUniformLocation("boxProjMX"), 1, GL_FALSE, glm::value_ptr(boxProjMX) );
-		// use untranslated camera for skybox so that it is centered
-		glm::mat4 skyboxViewMX = viewMX; skyboxViewMX[3] = glm::vec4(0,0,0,1);
-		glUniformMatrix4fv( shaderSkybox.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(skyboxViewMX) );
-		glUniformMatrix4fv( shaderSkybox.GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(modelMX_sky) );
-		vaSkybox.Bind();
-		glDrawElements(GL_TRIANGLES, 6*6, GL_UNSIGNED_INT, 0);
-		vaSkybox.Release();
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		shaderSkybox.Release();
-	}
-	setRenderTargets(fbo, 2, buffersColAndPick, wWidth, wHeight);
-	// draw objects (not the first which is the mirror object)
-	for(uint i=1; i < objects.size(); i++){
-		Object obj = *objects[i];
-		obj.shader->Bind();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, obj.texID);
-		glUniform1i( obj.shader->GetUniformLocation("tex"), 0 );
-		glUniform1i( obj.shader->GetUniformLocation("useTexture"), obj.useTexture );
-		glUniform1i( obj.shader->GetUniformLocation("doSphereProjection"), obj.renderAsSphere );
-		glUniform1i( obj.shader->GetUniformLocation("warpFN"), obj.warpFN );
-		glUniform1i( obj.shader->GetUniformLocation("subDivisionLevel"), static_cast<int>(subDivLevel));
-		glUniform1f( obj.shader->GetUniformLocation("k_exp"), 10.0f );
-		glUniform1f( obj.shader->GetUniformLocation("totalQuadSize"), 0.5f );
-		glUniform3fv( obj.shader->GetUniformLocation("pickColor"),1, glm::value_ptr(idToColor(obj.id)) );
-		glUniform3fv( obj.shader->GetUniformLocation("lightDir"), 1, glm::value_ptr(lightDir) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(viewMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(obj.modelMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("invViewMX"), 1, GL_FALSE, glm::value_ptr(invViewMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("boxProjMX"), 1, GL_FALSE, glm::value_ptr(boxProjMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("boxTransMX"), 1, GL_FALSE, glm::value_ptr(boxTranslMX) );
-
-		obj.va->Bind();
-		glDrawElements(obj.elementType, obj.numElements, GL_UNSIGNED_INT, 0);
-		obj.va->Release();
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		obj.shader->Release();
+	GLuint skyboxTextures[] = {0, texSky1, texSky2, texSky3};
+
+	updateReflectionProbe();
+	// while the governor lowers the refresh rate the faces of an earlier frame are shown again
+	reflectionReused = !reflectionBaked && !bakeRequested && reflectionAge + 1 < reflectionInterval;
+	if(reflectionBaked){
+		// the dynamic reflection is outdated once the baked one is no longer shown
+		reflectionAge = reflectionInterval;
+	} else {
+		reflectionAge = reflectionReused ? reflectionAge + 1 : 0;
+	}
+	cullObjects(projMX, boxProjMX, boxTranslMX);
+	if(objectLimit && visibleObjects.size() > objectLimit){
+		// the benchmark restricts the scene to the first objects
+		for(size_t i = objectLimit; i < visibleObjects.size(); i++){
+			objects[visibleObjects[i]].viewMask = 0;
+		}
+		visibleObjects.resize(objectLimit);
+	}
+	updateReflectionResolution();
+	selectLevelsOfDetail(projMX, boxProjMX);
+
+	// uniform blocks of the frame and the visible objects
+	FrameUniforms frame;
+	frame.projMX = projMX;
+	frame.viewMX = viewMX;
+	frame.invViewMX = invViewMX;
+	frame.boxProjMX = boxProjMX;
+	frame.boxTransMX = boxTranslMX;
+	frame.lightDir = lightDir;
+	frame.k_exp = 10.0f;
+	frame.totalQuadSize = 0.5f;
+	frame.parallaxCorrectionFactor = parallaxCorrection.GetValue();
+	frame.reflectionMaxLod = reflectionMips.GetValue() ? static_cast<float>(CubeMipChain::numLevels(reflectionResolution) - 1) : 0.0f;
+	if(reflectionBaked){
+		frame.reflectionMaxLod = static_cast<float>(reflectionProbe.levels() - 1);
+	}
+	frame.pad = 0.0f;
+	for(int camera = 0; camera < MAX_CAMERAS; camera++){
+		if(camera > 0){
+			frame.cameraViewProjMX[camera-1] = camera < numCameras ? cameraProjMX[camera]*cameraViewMX[camera-1] : glm::mat4(1.0f);
+		}
+		frame.cameraPos[camera] = camera < numCameras ? glm::inverse(cameraView(camera))[3] : glm::vec4(0,0,0,1);
+	}
+	if(!writeFrameData(frame)){
+		return;
+	}
+	sortObjectDraws();
+
+	// the passes of the scene, culled, ordered and run by the graph
+	frameGraph.reset();
+	GLuint reflectionTexture = reflectionBaked ? reflectionProbe.cubeMap() : texReflectionCubeMap;
+	RenderGraph::Target colorLayers = frameGraph.importTarget("color layers", gpuResources.textureBytes(texArrayColor));
+	RenderGraph::Target pickingLayers = frameGraph.importTarget("picking layers", gpuResources.textureBytes(texArrayPicking));
+	// the depth is only needed while the layers are rendered
+	RenderGraph::Target depthLayers = frameGraph.transientTarget("depth layers", gpuResources.textureBytes(texArrayDepth));
+	RenderGraph::Target reflection = frameGraph.importTarget("reflection", gpuResources.textureBytes(reflectionTexture));
+	int pass;
+
+	// clear depth and picking ids only, the skybox covers every pixel of the views no object covers
+	pass = frameGraph.addPass("clear", [&](){
+		setLayerTargets(2, buffersColAndPick);
+		GLfloat noId[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		GLfloat farDepth = 1.0f;
+		glClearBufferfv(GL_COLOR, 1, noId);
+		glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	});
+	frameGraph.writes(pass, pickingLayers);
+	frameGraph.writes(pass, depthLayers);
+
+	// record the tiles of the virtual skybox needed for this frame
+	if(useVirtual){
+		pass = frameGraph.addPass("feedback", [&](){ drawFeedback(projMX, boxProjMX); }, true);
+		frameGraph.writes(pass, frameGraph.importTarget("vt feedback", gpuResources.textureBytes(virtualSky.feedbackTexture())));
+		frameGraph.writes(pass, frameGraph.transientTarget("vt feedback depth",
+				gpuResources.textureBytes(virtualSky.feedbackDepthTexture())));
 	}
 
-	// transfer the rendered faces to the cubemap texture
-	transferArrayTexture2CubeMap();
-	setRenderTargets(fbo, 2, buffersColAndPick, wWidth, wHeight);
+	bool prepass = depthPrepass.GetValue();
+	if(prepass && mirrorObject >= 0){
+		// the reflective objects hide what is behind them in the camera views as well
+		pass = frameGraph.addPass("mirror depth prepass", [&](){ drawMirrorDepthPrepass(); });
+		frameGraph.modifies(pass, depthLayers);
+	}
+	// the multi pass backend renders the views one after the other
+	bool skipFaces = reflectionBaked || reflectionReused;
+	for(int layeredPass = 0; layeredPass < layered.numPasses(); layeredPass++){
+		if(skipFaces && layeredPass >= 1 && layeredPass <= 6){
+			continue;
+		}
+		if(prepass){
+			// the objects pass only shades the fragments that end up visible
+			pass = frameGraph.addPass("depth prepass", [&, layeredPass](){
+				setLayerTargets(2, buffersColAndPick, layeredPass);
+				drawDepthPrepass(layeredPass);
+			});
+			frameGraph.modifies(pass, depthLayers);
+		}
+		// draw objects (not the reflective ones, they show the result of this pass)
+		pass = frameGraph.addPass("objects", [&, layeredPass](){
+			TRACE_SPAN(TRACE_LEVEL_INFO, "objects pass");
+			setLayerTargets(2, buffersColAndPick, layeredPass);
+			glDepthMask(prepass ? GL_FALSE : GL_TRUE);
+			GLShader* shader = nullptr;
+			int boundClass = -1;
+			GLuint boundTexture = 0;
+			int boundVirtual = -1;
+			int textureBinds = 0;
+			// view -1 draws objectDrawOrder into the views of the pass, the meshes the backend
+			// cannot draw into all layers at once follow view by view (see LayeredRenderer.h)
+			for(int view = -1; view < numViews(); view++){
+				if(view >= 0){
+					if(!(meshViewMask & (1u << view))){
+						continue;
+					}
+					setViewTargets(2, buffersColAndPick, view);
+					if(shader){
+						shader->Release();
+						shader = nullptr;
+					}
+				}
+				const std::vector<uint>& order = view < 0 ? objectDrawOrder : meshDrawOrder;
+				int drawPass = view < 0 ? layeredPass : view;
+				for(uint k=0; k < order.size(); k++){
+					uint i = order[k];
+					const Object& obj = objects[visibleObjects[i]];
+					if(obj.shader != shader){
+						if(shader){
+							shader->Release();
+						}
+						shader = obj.shader;
+						shader->Bind();
+						layered.beginPass(*shader, drawPass);
+						glUniform1i( shader->GetUniformLocation(atlasSupported ? "texAtlas" : "tex"), 0 );
+						if(useVirtual){
+							virtualSky.bind(*shader, 1, 2, 0.0f);
+						}
+						boundVirtual = -1;
+					}
+					// the objects are sorted by size class, the texture is selected by the layer in the object data
+					if(obj.atlasClass >= 0 && obj.atlasClass != boundClass){
+						glActiveTexture(GL_TEXTURE0);
+						glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, textureAtlas.classTexture(obj.atlasClass));
+						boundClass = obj.atlasClass;
+						textureBinds++;
+					} else if(!atlasSupported && obj.texID && obj.texID != boundTexture){
+						glActiveTexture(GL_TEXTURE0);
+						glBindTexture(GL_TEXTURE_CUBE_MAP, obj.texID);
+						boundTexture = obj.texID;
+						textureBinds++;
+					}
+					// objects textured with the skybox sample the virtual texture as well
+					int objUsesVirtual = useVirtual && obj.texID == skyboxTextures[skyboxSelection];
+					if(objUsesVirtual != boundVirtual){
+						glUniform1i( shader->GetUniformLocation("useVirtual"), objUsesVirtual );
+						boundVirtual = objUsesVirtual;
+					}
+					// the remaining uniforms were written to the frame data ring
+					bindObjectData(i);
+
+					drawObject(obj, *shader, drawPass);
+				}
+			}
+			if(shader){
+				if(useVirtual){
+					virtualSky.unbind(1, 2);
+				}
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(atlasSupported ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP, 0);
+				shader->Release();
+			}
+			glDepthMask(GL_TRUE);
+			TRACE_COUNTER(TRACE_LEVEL_INFO, "atlas binds", textureBinds);
+		});
+		frameGraph.writes(pass, colorLayers);
+		frameGraph.modifies(pass, pickingLayers);
+		frameGraph.modifies(pass, depthLayers);
+		// draw the skybox last, only where no object covers the far plane
+		pass = frameGraph.addPass("skybox", [&, layeredPass](){
+			TRACE_SPAN(TRACE_LEVEL_INFO, "skybox pass");
+			setLayerTargets(1, buffersColOnly, layeredPass);
+			glDepthMask(GL_FALSE);
+			shaderSkybox.Bind();
+			layered.beginPass(shaderSkybox, layeredPass);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextures[skyboxSelection]);
+			glUniform1i( shaderSkybox.GetUniformLocation("tex"), 0);
+			glUniform1i( shaderSkybox.GetUniformLocation("useTexture"), skyboxSelection != 0);
+			glUniform1i( shaderSkybox.GetUniformLocation("useVirtual"), useVirtual);
+			if(useVirtual){
+				virtualSky.bind(shaderSkybox, 1, 2, 0.0f);
+			}
+			glUniformMatrix4fv( shaderSkybox.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
+			glUniformMatrix4fv( shaderSkybox.GetUniformLocation("boxProjMX"), 1, GL_FALSE, glm::value_ptr(boxProjMX) );
+			// use untranslated camera for skybox so that it is centered
+			glm::mat4 skyboxViewMX = viewMX; skyboxViewMX[3] = glm::vec4(0,0,0,1);
+			glUniformMatrix4fv( shaderSkybox.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(skyboxViewMX) );
+			glm::mat4 skyboxCameraMX[MAX_CAMERAS-1];
+			for(int camera = 1; camera < numCameras; camera++){
+				glm::mat4 cameraSkyboxViewMX = cameraViewMX[camera-1]; cameraSkyboxViewMX[3] = glm::vec4(0,0,0,1);
+				skyboxCameraMX[camera-1] = cameraProjMX[camera]*cameraSkyboxViewMX;
+			}
+			if(numCameras > 1){
+				glUniformMatrix4fv( shaderSkybox.GetUniformLocation("cameraViewProjMX"), numCameras-1, GL_FALSE, glm::value_ptr(skyboxCameraMX[0]) );
+			}
+			glUniformMatrix4fv( shaderSkybox.GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(modelMX_sky) );
+			vaSkybox.Bind();
+			layered.drawSkybox(6*6);
+			vaSkybox.Release();
+			if(useVirtual){
+				virtualSky.unbind(1, 2);
+			}
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			shaderSkybox.Release();
+			glDepthMask(GL_TRUE);
+		});
+		frameGraph.modifies(pass, colorLayers);
+		frameGraph.modifies(pass, depthLayers);
+	}
 
-	// draw the mirror object
-	{
-		Object obj = *objects[0];
-		obj.shader->Bind();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, obj.texID);
-		glUniform1i( obj.shader->GetUniformLocation("tex"), 0 );
-		glUniform1i( obj.shader->GetUniformLocation("useTexture"), obj.useTexture );
-		glUniform1i( obj.shader->GetUniformLocation("doSphereProjection"), obj.renderAsSphere );
-		glUniform1i( obj.shader->GetUniformLocation("warpFN"), obj.warpFN );
-		glUniform1i( obj.shader->GetUniformLocation("subDivisionLevel"), static_cast<int>(subDivLevel));
-		glUniform1f( obj.shader->GetUniformLocation("k_exp"), 10.0f );
-		glUniform1f( obj.shader->GetUniformLocation("totalQuadSize"), 0.5f );
-		glUniform1f( obj.shader->GetUniformLocation("parallaxCorrectionFactor"), parallaxCorrection.GetValue() );
-		glUniform3fv( obj.shader->GetUniformLocation("pickColor"),1, glm::value_ptr(idToColor(obj.id)) );
-		glUniform3fv( obj.shader->GetUniformLocation("lightDir"), 1, glm::value_ptr(lightDir) );
-		glUniform3fv( obj.shader->GetUniformLocation("cubeCenterWorldCoords"), 1, glm::value_ptr(glm::vec3(obj.modelMX*glm::vec4(0,0,0,1))) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(viewMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(obj.modelMX) );
-		glUniformMatrix4fv( obj.shader->GetUniformLocation("invViewMX"), 1, GL_FALSE, glm::value_ptr(invViewMX) );
+	if(mirrorObject >= 0 && !skipFaces){
+		// transfer the rendered faces to the cubemap texture
+		pass = frameGraph.addPass("reflection capture", [&](){
+			transferArrayTexture2CubeMap();
+			if(bakeRequested){
+				// glGenerateMipmap stops at the max level, which is 0 while the mips are off
+				glBindTexture(GL_TEXTURE_CUBE_MAP, texReflectionCubeMap);
+				glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, CubeMipChain::numLevels(reflectionResolution) - 1);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			}
+			updateReflectionMips();
+			if(bakeRequested){
+				uint64_t key = reflectionProbeKey();
+				reflectionProbe.bake(gpuResources, texReflectionCubeMap, reflectionFormat, reflectionResolution,
+						key, ReflectionProbe::cacheFileName(pluginPath, key));
+				bakeRequested = false;
+				setReflectionMaxLevel();
+			}
+		}, true);
+		frameGraph.reads(pass, colorLayers);
+		frameGraph.writes(pass, reflection);
+	}
+	if(mirrorObject >= 0){
+		// draw the reflective objects (all of them show the reflection rendered from the center of the first)
+		pass = frameGraph.addPass("mirror", [&](){
+			TRACE_SPAN(TRACE_LEVEL_INFO, "mirror pass");
+			setLayerTargets(2, buffersColAndPick);
+			uint cameraMask = cameraViewMask();
+			glDepthMask(prepass ? GL_FALSE : GL_TRUE);
+			for(uint i=0; i < visibleObjects.size(); i++){
+				const Object& obj = objects[visibleObjects[i]];
+				// reflective objects are only rendered into the camera views
+				if(!obj.reflective || !(obj.viewMask & cameraMask)){
+					continue;
+				}
+				obj.shader->Bind();
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, reflectionTexture);
+				glUniform1i( obj.shader->GetUniformLocation("tex"), 0 );
+				bindObjectData(i);
+
+				obj.va->Bind();
+				glDrawElements(obj.elementType, obj.numElements, GL_UNSIGNED_INT, 0);
+				obj.va->Release();
+				glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+				obj.shader->Release();
+			}
+			glDepthMask(GL_TRUE);
+		});
+		frameGraph.reads(pass, reflection);
+		frameGraph.modifies(pass, colorLayers);
+		frameGraph.modifies(pass, pickingLayers);
+		frameGraph.modifies(pass, depthLayers);
+	}
 
-		obj.va->Bind();
-		glDrawElements(obj.elementType, obj.numElements, GL_UNSIGNED_INT, 0);
-		obj.va->Release();
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		obj.shader->Release();
+	if(pickingEnabled && !selectedIDs.empty()){
+		// draw boxes around the selected objects
+		pass = frameGraph.addPass("box", [&](){
+			TRACE_SPAN(TRACE_LEVEL_INFO, "box pass");
+			setLayerTargets(1, buffersColOnly);
+			glm::mat4x4 scaleMX = glm::scale(glm::mat4(1),glm::vec3(1.1f, 1.1f, 1.1f));
+			shaderBox.Bind();
+			glUniformMatrix4fv( shaderBox.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
+			glUniformMatrix4fv( shaderBox.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(viewMX) );
+			GLint modelLocation = shaderBox.GetUniformLocation("modelMX");
+			vaBox.Bind();
+			for(size_t i = 0; i < selectedIDs.size(); i++){
+				const Object& obj = objects[selectedIDs[i]-1];
+				glUniformMatrix4fv( modelLocation, 1, GL_FALSE, glm::value_ptr(obj.modelMX*scaleMX) );
+				glDrawElements(GL_LINES, ogl4_numBoxEdges*2, GL_UNSIGNED_INT, 0);
+			}
+			vaBox.Release();
+			shaderBox.Release();
+		});
+		frameGraph.modifies(pass, colorLayers);
+		frameGraph.modifies(pass, depthLayers);
 	}
 
-	setRenderTargets(fbo, 1, buffersColOnly, wWidth, wHeight);
-	if(pickingEnabled && pickedID){
-		// draw box around picked object
-		Object& obj = *objects[pickedID-1];
-		glm::mat4x4 scaleMX = glm::scale(glm::mat4(1),glm::vec3(1.1f, 1.1f, 1.1f));
-		shaderBox.Bind();
-		glUniformMatrix4fv( shaderBox.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(projMX) );
-		glUniformMatrix4fv( shaderBox.GetUniformLocation("viewMX"), 1, GL_FALSE, glm::value_ptr(viewMX) );
-		glUniformMatrix4fv( shaderBox.GetUniformLocation("modelMX"), 1, GL_FALSE, glm::value_ptr(obj.modelMX*scaleMX) );
-		vaBox.Bind();
-		glDrawElements(GL_LINES, ogl4_numBoxEdges*2, GL_UNSIGNED_INT, 0);
-		vaBox.Release();
-		shaderBox.Release();
+	frameGraph.compile();
+	overdrawCounter.begin();
+	frameGraph.execute(targetState);
+	overdrawCounter.end();
+	updateOverdrawVars();
+	// the slot of the frame data may be reused once the GPU is done with this frame
+	frameData.endFrame();
+
+	frameGraph.report("scene");
+	const float toMB = 1.0f/(1024*1024);
+	if(graphTargetsVar.GetValue() != frameGraph.targetBytes()*toMB){
+		graphTargetsVar = frameGraph.targetBytes()*toMB;
 	}
+	if(graphBarriersVar.GetValue() != frameGraph.barriers()){
+		graphBarriersVar = frameGraph.barriers();
+	}
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "graph barriers", frameGraph.barriers());
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "graph targets MB", graphTargetsVar.GetValue());
+}
 
-	GLenum windowBuffer = GL_BACK;
-	setRenderTargets(0, 1, &windowBuffer, wWidth, wHeight);
+/**
+ * Marks the rendered scene as outdated and requests a redisplay.
+ * Has to be called for every change that is not covered by currentRenderState().
+ */
+void CubeMapping::invalidate() {
+	sceneRevision++;
+	contentRevision++;
+	PostRedisplay();
+}
+
+/**
+ * Collects the state that is changed without notifying the plugin
+ * (the camera manipulator and apivars without callback).
+ */
+RenderState CubeMapping::currentRenderState() {
+	RenderState s;
+	s.viewMX = viewMX;
+	s.fovY = fovY.GetValue();
+	s.zNear = zNear.GetValue();
+	s.zFar = zFar.GetValue();
+	s.parallaxCorrection = parallaxCorrection.GetValue();
+	s.lodReflectionBias = lodReflectionBias.GetValue();
+	s.skybox = skyboxTexturing.GetValue();
+	s.subDivLevel = subDivLevel.GetValue();
+	s.width = wWidth;
+	s.height = wHeight;
+	s.culling = frustumCulling.GetValue();
+	s.autoLOD = autoLOD.GetValue();
+	s.depthPrepass = depthPrepass.GetValue();
+	for(int i = 0; i < MAX_CAMERAS-1; i++){
+		s.cameraViewMX[i] = cameraViewMX[i];
+	}
+	s.numCameras = numCameras;
+	return s;
 }
 
 /**
  * Render method (is called by OGL4Core)
+ * The layers are only rendered again when the scene revision changed since the
+ * last frame (or while the virtual skybox is streaming), otherwise the previous
+ * contents of the color target are presented again.
  */
 bool CubeMapping::Render(void) {
-	drawToFBO();
-	glClearColor( 0.0, 0.0, 0.0, 1.0 );
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
-	// draw quad
-	glm::mat4 pmx = glm::ortho(0.0f,1.0f,0.0f,1.0f);
-	shaderQuad.Bind();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayColor);
-	glUniform1i( shaderQuad.GetUniformLocation("tex"), 0);
-	glUniformMatrix4fv( shaderQuad.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(pmx) );
-	glUniform1i( shaderQuad.GetUniformLocation("useTexture"), true );
-	vaQuad.Bind();
-	glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
-	vaQuad.Release();
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-	shaderQuad.Release();
+	TRACE_SPAN(TRACE_LEVEL_INFO, "Render");
+	// the framebuffers may have been bound outside of the passes since the last frame
+	targetState.invalidate();
+	targetState.resetCounters();
+	RenderState state = currentRenderState();
+	if(state != renderedState){
+		renderedState = state;
+		sceneRevision++;
+	}
+	lookupReflectionProbe();
+	bool changed = sceneRevision != renderedRevision;
+	if(changed && virtualSky.isOpen()){
+		// the feedback of a frame is read back two frames later
+		feedbackFramesLeft = 3;
+	}
+	// a frame that showed an earlier reflection is followed by one that renders it
+	bool redraw = changed || bakeRequested || reflectionReused || feedbackFramesLeft > 0 || (virtualSky.isOpen() && virtualSky.pendingTiles() > 0);
+	bool benchmarking = layeredBenchmark.running();
+	if(benchmarking){
+		// every frame of the benchmark renders the scene with the backend and size of the run
+		setLayeredBackend(layeredBenchmark.backend());
+		objectLimit = layeredBenchmark.numObjects();
+		redraw = true;
+	}
+	if(redraw){
+		bool governing = governorVar.GetValue() && !benchmarking;
+		if(governing){
+			governor.beginFrame();
+		}
+		layeredBenchmark.beginFrame();
+		drawToFBO();
+		layeredBenchmark.endFrame();
+		if(governing){
+			governor.endFrame();
+		}
+		renderedRevision = sceneRevision;
+		if(feedbackFramesLeft > 0){
+			feedbackFramesLeft--;
+		}
+	}
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "scene redrawn", redraw ? 1 : 0);
+	if(governorVar.GetValue() && !benchmarking){
+		if(governor.update(targetFrameMs.GetValue(), maxSubDivisionLevel())){
+			applyQualitySettings();
+		}
+		if(govGpuMsVar.GetValue() != governor.gpuMs()){
+			govGpuMsVar = governor.gpuMs();
+		}
+	}
+	// the passes presenting the camera layers (the scene graph has run already)
+	frameGraph.reset();
+	RenderGraph::Target colorLayers = frameGraph.importTarget("color layers", gpuResources.textureBytes(texArrayColor));
+	int pass = frameGraph.addPass("present", [&](){
+		GLenum windowBuffer = GL_BACK;
+		setRenderTargets(0, 1, &windowBuffer, wWidth, wHeight);
+		glClearColor( 0.0, 0.0, 0.0, 1.0 );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+		// draw quad
+		glm::mat4 pmx = glm::ortho(0.0f,1.0f,0.0f,1.0f);
+		shaderQuad.Bind();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayColor);
+		glUniform1i( shaderQuad.GetUniformLocation("tex"), 0);
+		glUniformMatrix4fv( shaderQuad.GetUniformLocation("projMX"), 1, GL_FALSE, glm::value_ptr(pmx) );
+		glUniform1i( shaderQuad.GetUniformLocation("useTexture"), true );
+		// exposure and tone mapping are applied in the present pass
+		glUniform1f( shaderQuad.GetUniformLocation("exposure"), std::pow(2.0f, exposure.GetValue()) );
+		glUniform1i( shaderQuad.GetUniformLocation("toneMapping"), toneMapping.GetValue() );
+		glUniform1i( shaderQuad.GetUniformLocation("linearInput"), isHDRPipeline() );
+		// every camera's layer is shown in its tile of the split layout
+		GLint texScaleLocation = shaderQuad.GetUniformLocation("texScale");
+		GLint layerLocation = shaderQuad.GetUniformLocation("layer");
+		vaQuad.Bind();
+		for(int camera = 0; camera < numCameras; camera++){
+			const glm::ivec4& tile = cameraTiles[camera];
+			glm::vec2 size = glm::vec2(cameraViewport(camera));
+			glViewport(tile.x, tile.y, tile.z, tile.w);
+			glUniform1i( layerLocation, camera ? 6 + camera : 0 );
+			glUniform2f( texScaleLocation, size.x/layerWidth, size.y/layerHeight );
+			glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+		}
+		glViewport(0, 0, wWidth, wHeight);
+		vaQuad.Release();
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		shaderQuad.Release();
+		if(regionDragging && !lassoMode){
+			drawSelectionRectangle();
+		}
+	}, true);
+	frameGraph.reads(pass, colorLayers);
+	frameGraph.writes(pass, frameGraph.importTarget("window", 0));
+	if(frameCapture.isRunning()){
+		pass = frameGraph.addPass("capture", [&](){ captureRenderedFrame(); }, true);
+		frameGraph.reads(pass, colorLayers);
+		// the pixel buffers of the capture ring
+		frameGraph.writes(pass, frameGraph.importTarget("capture", 0));
+	}
+	frameGraph.compile();
+	frameGraph.execute(targetState);
+	frameGraph.report("present");
+	if(graphSkippedVar.GetValue() != static_cast<int>(targetState.skippedChanges())){
+		graphSkippedVar = static_cast<int>(targetState.skippedChanges());
+	}
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "target changes skipped", targetState.skippedChanges());
+	// the ids of a region selection arrive a frame or two after the selection was started
+	if(regionSelection.pending()){
+		std::vector<uint> ids;
+		if(regionSelection.poll(ids)){
+			applySelection(ids);
+		} else {
+			PostRedisplay();
+		}
+	}
+	if(visibleObjectsVar.GetValue() != static_cast<int>(visibleObjects.size())){
+		visibleObjectsVar = static_cast<int>(visibleObjects.size());
+	}
+	if(emittedVerticesVar.GetValue() != static_cast<float>(emittedVertices*1e-6)){
+		emittedVerticesVar = static_cast<float>(emittedVertices*1e-6);
+	}
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "emitted vertices", emittedVertices);
+	if(virtualSky.isOpen()){
+		if(vtResidentPages.GetValue() != virtualSky.residentPages()){
+			vtResidentPages = virtualSky.residentPages();
+		}
+		TRACE_COUNTER(TRACE_LEVEL_INFO, "vt pending tiles", virtualSky.pendingTiles());
+		// keep rendering until the feedback settled and the streamer has delivered all requested tiles
+		if(virtualSky.pendingTiles() > 0 || feedbackFramesLeft > 0){
+			PostRedisplay();
+		}
+	}
+	if(benchmarking){
+		if(layeredBenchmark.running()){
+			PostRedisplay();
+		} else {
+			finishLayeredBenchmark();
+		}
+	}
 	return false;
 }
 
@@ -963,8 +3331,14 @@ bool CubeMapping::Render(void) {
 bool CubeMapping::Resize(int w, int h){
 	wWidth = w;
 	wHeight = h;
-	aspect = wWidth*1.0f/wHeight;
+	updateCameraTiles();
 	initFBO();
+	if(virtualSky.isOpen()){
+		virtualSky.resizeFeedback(gpuResources, wWidth, wHeight);
+	}
+	updateMemoryVars();
+	// the targets were recreated, their contents are undefined
+	invalidate();
 	return false;
 }
 
@@ -973,16 +3347,25 @@ bool CubeMapping::Keyboard(uchar key, int x, int y) { return this->Keyboard(key,
 
 /** keyboard event callback function */
 bool CubeMapping::Keyboard(int key, int action, int mods, int x, int y) {
-	std::fprintf(stdout, "key:%X action:%d mods:%X\n",key,action,mods);
-	std::flush(std::cout);
+	TRACE_SPAN(TRACE_LEVEL_INFO, "Keyboard");
+	TRACE_DEBUG("input", "key:%X action:%d mods:%X", key, action, mods);
 	switch (key) {
 		case KEY_R:
 			if(action*action == 1){
 				// reload shaders
 				deleteShaders();
 				createShaders();
-				std::cout << "reloaded shaders" << std::endl;
-				PostRedisplay();
+				TRACE_INFO("input", "reloaded shaders");
+				invalidate();
+			}
+			break;
+		case KEY_T:
+			if(action*action == 1){
+				// export the events recorded so far
+				std::string traceFile = pluginPath + std::string("/trace.json");
+				if(traceWriteChromeJSON(traceFile)){
+					std::fprintf(stdout, "wrote trace to %s\n", traceFile.c_str());
+				}
 			}
 			break;
 		case KEY_S:
@@ -997,17 +3380,54 @@ bool CubeMapping::Keyboard(int key, int action, int mods, int x, int y) {
 				cube_sphere_switch.SetVisible(pickingEnabled);
 				cube_texture_switch.SetVisible(pickingEnabled);
 				cube_warpFN.SetVisible(pickingEnabled);
+				cube_roughness.SetVisible(pickingEnabled);
+				selectedObjectsVar.SetVisible(pickingEnabled);
+				int handle = activeCamera ? cameraHandles[activeCamera-1] : camHandle;
 				if(pickingEnabled){
-					DisableManipulator(camHandle);
+					DisableManipulator(handle);
 				} else {
-					EnableManipulator(camHandle);
+					EnableManipulator(handle);
 				}
+				// the picked object is only highlighted while picking
+				invalidate();
+			}
+			break;
+		case KEY_B:
+			// compare the layered backends over the scene size
+			if(action*action == 1 && !layeredBenchmark.running()){
+				startLayeredBenchmark();
+			}
+			break;
+		case KEY_C:
+			// the mouse moves the next camera of the split layout
+			if(action*action == 1 && !pickingEnabled && numCameras > 1){
+				selectCamera((activeCamera + 1) % numCameras);
+				TRACE_INFO("input", "camera %d", activeCamera + 1);
+			}
+			break;
+		case KEY_P:
+			// bake the reflection of the current scene (used until the scene changes)
+			if(action*action == 1 && mirrorObject >= 0){
+				bakeRequested = true;
+				PostRedisplay();
+			}
+			break;
+		case KEY_V:
+			// start/stop capturing the frames
+			if(action*action == 1){
+				captureVar = !captureVar.GetValue();
+			}
+			break;
+		case KEY_L:
+			// switch between rectangle and lasso selection
+			if(action*action == 1){
+				lassoMode = !lassoMode;
+				TRACE_INFO("input", "%s selection", lassoMode ? "lasso" : "rectangle");
 			}
 			break;
 		default:
 			break;
 	}
-	PostRedisplay();
 	return false;
 }
 
@@ -1016,64 +3436,66 @@ bool CubeMapping::Mouse(int button, int state, int x, int y) { return this->Mous
 
 /** mouse button event callback function */
 bool CubeMapping::Mouse(int button, int state, int mods, int x, int y) {
-	std::fprintf(stdout, "mouse: %d %d btn:%d stt:%d\n", x,y, button,state);
-	std::flush(std::cout);
-	if(pickingEnabled){
+	TRACE_SPAN(TRACE_LEVEL_INFO, "Mouse");
+	TRACE_DEBUG("input", "mouse: %d %d btn:%d stt:%d", x, y, button, state);
+	if(pickingEnabled && button == 0){
 		// on left click, poll pixel color to find out which object was picked
-		if(button==0 && state == 0){
-			glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
-			glReadBuffer(GL_COLOR_ATTACHMENT1);
-			unsigned char pickedColor[3];
-			glReadPixels(x,wHeight-1-y,1,1,GL_RGB, GL_UNSIGNED_BYTE, pickedColor);
-			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-			uint id = colorToId(pickedColor);
+		if(state == 0){
+			// objects are picked in the tile of camera 0
+			glm::vec2 p = windowToCameraLayer(glm::vec2(x + 0.5f, wHeight - y - 0.5f));
+			glm::ivec2 size = cameraViewport(0);
+			uint id = 0;
+			if(p.x >= 0.0f && p.y >= 0.0f && p.x < size.x && p.y < size.y){
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+				glReadBuffer(GL_COLOR_ATTACHMENT1);
+				unsigned char pickedColor[3];
+				glReadPixels(static_cast<int>(p.x), static_cast<int>(p.y), 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pickedColor);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+				id = colorToId(pickedColor);
+			}
 			pickedIDVar = id;
+			// dragging with the left button selects a region
+			regionDragging = regionSelection.isCreated();
+			dragStart = dragEnd = glm::ivec2(x, y);
+			lassoPath.clear();
+			lassoPath.push_back(glm::vec2(x + 0.5f, wHeight - y - 0.5f));
+		} else if(regionDragging){
+			regionDragging = false;
+			startRegionSelection();
+			PostRedisplay();
 		}
 	}
-	PostRedisplay();
 	return false;
 }
 
 /** mouse movement callback function */
 bool CubeMapping::Motion(int x, int y) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "Motion");
+	if(pickingEnabled && regionDragging && IsLeftButtonPressed()){
+		dragEnd = glm::ivec2(x, y);
+		// the lasso follows the mouse path, points closer than 2 pixels are dropped
+		glm::vec2 p(x + 0.5f, wHeight - y - 0.5f);
+		if(glm::length(p - lassoPath.back()) >= 2.0f && lassoPath.size() < static_cast<size_t>(RegionSelection::maxLassoPoints)){
+			lassoPath.push_back(p);
+		}
+		if(!lassoMode){
+			PostRedisplay();
+		}
+	}
 	if(pickingEnabled && pickedID){
 		glm::ivec2 last = GetLastMousePos();
 		int dx = x-last.x;
 		int dy = y-last.y;
 
 		if(IsRightButtonPressed() || IsMidButtonPressed()){
-			// projection matrix
-			glm::mat4x4 projMX = glm::perspective(
-						glm::radians(static_cast<float>(fovY)),
-						aspect,
-						static_cast<float>(zNear),
-						static_cast<float>(zFar)
-			);
+			glm::mat4x4 projMX = cameraProjection(static_cast<float>(fovY), aspect, static_cast<float>(zNear), static_cast<float>(zFar));
 			// obtain point translation from model transformation (dont want the scaling and rotation part)
-			Object& obj = *objects[pickedID-1];
-			glm::mat4x4 modelMX = obj.modelMX;
-			glm::vec4 modelTransl = modelMX*glm::vec4(0,0,0,1);
-			glm::mat4 translMX = glm::translate(glm::mat4(1.0f),glm::vec3(modelTransl));
-			// obtain obj position in screen space
-			glm::mat4 forward = projMX*viewMX*translMX;
-			glm::vec4 objpos = forward*glm::vec4(0,0,0,1);
-			std::cout << "objpos:" << objpos.x << " " << objpos.y << " " << objpos.z << " " << objpos.w << std::endl;
+			Object& obj = objects[pickedID-1];
+			glm::vec4 modelTransl = obj.modelMX*glm::vec4(0,0,0,1);
 			// translate either in x-y or z
-			if(IsRightButtonPressed()){
-				// projection to image plane
-				float w = objpos.w;
-				objpos = (1.0f/w)*objpos;
-				// translate obj in screen space according to mouse movement (x-y-plane)
-				objpos = objpos + glm::vec4(dx*2.0f/wWidth,-dy*2.0f/wHeight,0,0);
-				// un-projection
-				objpos = w*objpos;
-			} else if(IsMidButtonPressed()){
-				// translate obj in (pre-)screen space according to mouse-y movement (z direction)
-				objpos = objpos + glm::vec4(0,0,-dy*0.02f/wHeight,0);
-			}
-			// do backwards transformation to obtain translation in object space
-			glm::vec4 translation = glm::inverse(forward)*objpos;
-			std::cout << "transl:" << translation.x << " " << translation.y << " " << translation.z << " " << translation.w << std::endl;
+			glm::vec3 translation = dragTranslation(projMX, viewMX, glm::vec3(modelTransl), dx, dy,
+					cameraTiles[0].z, cameraTiles[0].w, !IsRightButtonPressed());
+			TRACE_DEBUG("input", "transl: %f %f %f", translation.x, translation.y, translation.z);
 			// translate picked object (this is the actual translation)
 			// ignore first two coordinate updates, so only the last will trigger updating the objects position
 			ignoreObjectVarUpdate = true;
@@ -4,6 +4,21 @@
 #include "FramebufferObject.h"
 #include "GLShader.h"
 #include "VertexArray.h"
+#include "GPUResources.h"
+#include "VirtualCubeMap.h"
+#include "SceneFile.h"
+#include "DynamicBVH.h"
+#include "FrameDataRing.h"
+#include "CubeMapAtlas.h"
+#include "RegionSelection.h"
+#include "CubeMipChain.h"
+#include "LayeredRenderer.h"
+#include "OverdrawCounter.h"
+#include "FrameCapture.h"
+#include "ReflectionProbe.h"
+#include "FrameGovernor.h"
+#include "RenderGraph.h"
+#include "MeshLibrary.h"
 
 #define GLM_FORCE_RADIANS 1
 
@@ -17,6 +32,14 @@
 #define uchar unsigned char
 #endif
 
+/** number of reflection cubemaps of different resolution (128 to 1024) */
+#define REFLECTION_POOL_SIZE 4
+
+/** cameras of the largest split screen layout (the shaders declare arrays of this size) */
+#define MAX_CAMERAS 4
+/** views rendered into the layers: camera 0, the 6 reflection faces and the cameras 1 to MAX_CAMERAS-1 */
+#define MAX_VIEWS (6 + MAX_CAMERAS)
+
 /** The Object struct stores state information of scene objects
  * as well as handles to vertex arrays and shaders
  */
@@ -28,40 +51,144 @@ typedef struct Object_t {
 	uint id;
 	glm::mat4    modelMX;     //!< model matrix
 	VertexArray* va;          //!< vertex array
+	int          mesh;        //!< mesh in the mesh library instead of the cube (-1 = cube or sphere)
 	GLenum       elementType; //!< element type (GL_TRIANGLES)
 	uint         numElements; //!< number of vertices to be drawn
 	GLShader*    shader;      //!< shader for the object
 	GLuint       texID;       //!< texture handle (cubemap texture)
+	int atlasClass;           //!< size class of the texture in the cubemap atlas (-1 = not in the atlas)
+	int atlasLayer;           //!< layer of the texture in the cubemap array of its size class
 	bool useTexture;          //!< flag wether to use texture
 	bool renderAsSphere;      //!< flag wether to render as speher or as cube
 	int warpFN;               //!< warping function to be used (0,1,2)
+	int texture;              //!< texture referenced in the scene description (SceneTexture)
+	bool reflective;          //!< flag wether the object shows the reflection cubemap
+	int proxy;                //!< leaf of the object in the bounding volume hierarchy
+	uint viewMask;            //!< views the object is visible in this frame (bit 0 camera, bits 1-6 cube faces, 7 and up further cameras)
+	int subDivLevels[MAX_VIEWS]; //!< subdivision level of each view this frame (level of detail)
+	float boundingRadius;     //!< radius of the bounding sphere in world space
+	float roughness;          //!< selects the level of the reflection cubemap (0 = mirror, 1 = last level)
 
 	Object_t() {
 		id = 0;
 		modelMX = glm::mat4(1.0f);
 		va = nullptr;
+		mesh = -1;
 		elementType = GL_POINTS;
 		numElements = 0;
 		shader = nullptr;
 		texID = 0;
+		atlasClass = atlasLayer = -1;
 		useTexture = false;
 		renderAsSphere = false;
 		warpFN = 0;
+		texture = SCENE_TEXTURE_NONE;
+		reflective = false;
+		proxy = -1;
+		viewMask = 0;
+		for(int i = 0; i < MAX_VIEWS; i++){
+			subDivLevels[i] = 1;
+		}
+		boundingRadius = 0.0f;
+		roughness = 0.0f;
 	}
 	Object_t( uint id, glm::mat4 modelMX, VertexArray* va, GLenum elementType, uint numElements, GLShader* shader, GLuint texID ) {
 		this->id = id;
 		this->modelMX = modelMX;
 		this->va = va;
+		mesh = -1;
 		this->elementType = elementType;
 		this->numElements = numElements;
 		this->shader = shader;
 		this->texID = texID;
+		atlasClass = atlasLayer = -1;
 		useTexture = false;
 		renderAsSphere = false;
 		warpFN = 0;
+		texture = SCENE_TEXTURE_NONE;
+		reflective = false;
+		proxy = -1;
+		viewMask = 0;
+		for(int i = 0; i < MAX_VIEWS; i++){
+			subDivLevels[i] = 1;
+		}
+		boundingRadius = 0.0f;
+		roughness = 0.0f;
 	}
 } Object;
 
+/**
+ * Per frame uniform block (FrameData in the cube and mirrorcube shaders), std140 layout.
+ */
+typedef struct FrameUniforms_t {
+	glm::mat4 projMX;                //!< camera projection
+	glm::mat4 viewMX;                //!< camera view
+	glm::mat4 invViewMX;             //!< inverse camera view
+	glm::mat4 boxProjMX;             //!< 90 degree projection of the reflection views
+	glm::mat4 boxTransMX;            //!< translation to the center of the reflection
+	glm::vec3 lightDir;              //!< light direction (depending on the skybox)
+	float k_exp;                     //!< specular exponent
+	float totalQuadSize;             //!< size of the quads of the cube faces
+	float parallaxCorrectionFactor;  //!< parallax correction of the reflection
+	float reflectionMaxLod;          //!< last level of the reflection cubemap (0 = no mip chain)
+	float pad;
+	glm::mat4 cameraViewProjMX[MAX_CAMERAS-1]; //!< view projection of the cameras 1 and up (views 7 and up)
+	glm::vec4 cameraPos[MAX_CAMERAS];          //!< world position of each camera
+} FrameUniforms;
+static_assert(sizeof(FrameUniforms) == 608, "FrameUniforms does not match the std140 layout of FrameData");
+
+/**
+ * Per object uniform block (ObjectData in the cube and mirrorcube shaders), std140 layout.
+ * Written for every visible object into the frame data ring.
+ */
+typedef struct ObjectUniforms_t {
+	glm::mat4 modelMX;               //!< model matrix
+	glm::vec3 pickColor;             //!< color encoding the id for picking
+	float roughness;                 //!< selects the level of the reflection cubemap
+	glm::vec3 cubeCenterWorldCoords; //!< center of the object (reflective objects)
+	int useTexture;                  //!< bool in the shader
+	int doSphereProjection;          //!< bool in the shader
+	int warpFN;                      //!< warping function
+	int viewMask;                    //!< views the object is visible in
+	int textureLayer;                //!< layer of the texture in the cubemap atlas
+	int subDivisionLevels[12];       //!< subdivision level of each view (3 ivec4)
+} ObjectUniforms;
+static_assert(sizeof(ObjectUniforms) == 160, "ObjectUniforms does not match the std140 layout of ObjectData");
+
+/**
+ * Snapshot of the state that determines the rendered scene and is not
+ * changed through callbacks (camera, apivars without callback, window size).
+ * Compared every frame to detect changes (see CubeMapping::Render).
+ */
+typedef struct RenderState_t {
+	glm::mat4 viewMX;
+	glm::mat4 cameraViewMX[MAX_CAMERAS-1];
+	int numCameras;
+	float fovY, zNear, zFar;
+	float parallaxCorrection;
+	float lodReflectionBias;
+	int skybox;
+	int subDivLevel;
+	int width, height;
+	bool culling, autoLOD, depthPrepass;
+
+	bool operator==(const RenderState_t& o) const {
+		if(numCameras != o.numCameras){
+			return false;
+		}
+		for(int i = 0; i < numCameras - 1; i++){
+			if(cameraViewMX[i] != o.cameraViewMX[i]){
+				return false;
+			}
+		}
+		return viewMX == o.viewMX && fovY == o.fovY && zNear == o.zNear && zFar == o.zFar
+			&& parallaxCorrection == o.parallaxCorrection && lodReflectionBias == o.lodReflectionBias
+			&& skybox == o.skybox && subDivLevel == o.subDivLevel && width == o.width && height == o.height
+			&& culling == o.culling && autoLOD == o.autoLOD && depthPrepass == o.depthPrepass;
+	}
+	bool operator!=(const RenderState_t& o) const { return !(*this == o); }
+} RenderState;
+
 /**
  * CubeMapping RenderPlugin - a demo of cubemapping applications 
  */
@@ -86,7 +213,15 @@ private:
 	int camHandle;    //!< handle to the manipulator controlling the cam
 	int wWidth;       //!< window width
 	int wHeight;      //!< window height
-	float aspect;     //!< aspect ratio
+	float aspect;     //!< aspect ratio (of the tile of camera 0)
+
+	// split screen cameras
+	glm::mat4 cameraViewMX[MAX_CAMERAS-1];  //!< view matrices of the cameras 1 and up
+	int cameraHandles[MAX_CAMERAS-1];       //!< manipulators of the cameras 1 and up
+	glm::mat4 cameraProjMX[MAX_CAMERAS];    //!< projection of each camera this frame (aspect of its tile)
+	glm::ivec4 cameraTiles[MAX_CAMERAS];    //!< window area of each camera (x, y, width, height, GL window coordinates)
+	int numCameras;                         //!< cameras of the split layout
+	int activeCamera;                       //!< camera the mouse controls
 
 	GLint maxGeomTotalOutComp; //!< current context's max number of output comps in geometry shaders
 	GLint maxGeomOutVerts;     //!< current context's max number of output verts in geometry shaders
@@ -106,9 +241,63 @@ private:
 	APIVar<CubeMapping, BoolVarPolicy> cube_sphere_switch;  //!< switch for cube/sphere rendering
 	APIVar<CubeMapping, BoolVarPolicy> cube_texture_switch; //!< switch for cubemap texture / checkerboard
 	EnumVar<CubeMapping> cube_warpFN;                       //!< selector for warping function
+	APIVar<CubeMapping, FloatVarPolicy> cube_roughness;     //!< roughness of the picked object's reflection
+	APIVar<CubeMapping, IntVarPolicy> selectedObjectsVar;   //!< shows the number of selected objects
 
-	APIVar<CubeMapping, IntVarPolicy> subDivLevel;          //!< subdivision level for cube face 
+	APIVar<CubeMapping, IntVarPolicy> subDivLevel;          //!< subdivision level for cube face (maximum level with automatic LOD)
+	APIVar<CubeMapping, BoolVarPolicy> autoLOD;             //!< switch for choosing the subdivision level per object and view
+	APIVar<CubeMapping, FloatVarPolicy> lodReflectionBias;  //!< log2 scale of the detail in the reflection views
+	APIVar<CubeMapping, FloatVarPolicy> emittedVerticesVar; //!< shows the vertices emitted by the geometry shaders (millions)
 	APIVar<CubeMapping, FloatVarPolicy> parallaxCorrection; //!< parallax correction factor (0 = none)
+	APIVar<CubeMapping, BoolVarPolicy> frustumCulling;      //!< switch for culling objects against the 7 view frustums
+	EnumVar<CubeMapping> reflectionMips;                    //!< generation of the reflection cubemap's mip chain (off, glGenerateMipmap, single pass)
+	APIVar<CubeMapping, BoolVarPolicy> reflectionGlossy;    //!< switch for prefiltering the reflection mips for glossy reflection
+	EnumVar<CubeMapping> reflectionResMode;                 //!< face resolution of the reflection (automatic or fixed)
+	APIVar<CubeMapping, IntVarPolicy> reflectionResVar;     //!< shows the face resolution of the reflection in use
+	APIVar<CubeMapping, BoolVarPolicy> bakedReflection;     //!< switch for showing the baked reflection while the scene matches it
+	APIVar<CubeMapping, BoolVarPolicy> probeUsedVar;        //!< shows whether the baked reflection is shown
+	APIVar<CubeMapping, BoolVarPolicy> governorVar;         //!< switch for adjusting the quality to the target frame time
+	APIVar<CubeMapping, FloatVarPolicy> targetFrameMs;      //!< GPU time per frame the governor aims at
+	APIVar<CubeMapping, FloatVarPolicy> govGpuMsVar;        //!< shows the last measured GPU time per frame
+	APIVar<CubeMapping, IntVarPolicy> govSubDivVar;         //!< shows the subdivision level chosen by the governor
+	APIVar<CubeMapping, FloatVarPolicy> govScaleVar;        //!< shows the render scale of the camera views chosen by the governor
+	APIVar<CubeMapping, IntVarPolicy> govReflIntervalVar;   //!< shows every how many frames the reflection is rendered
+	APIVar<CubeMapping, IntVarPolicy> visibleObjectsVar;    //!< shows the number of objects visible in any view
+	EnumVar<CubeMapping> layeredBackendVar;                 //!< how the views are rendered (geometry shader, vertex shader layer, multi pass)
+	EnumVar<CubeMapping> splitLayout;                       //!< split screen layout of the cameras
+	APIVar<CubeMapping, BoolVarPolicy> depthPrepass;        //!< switch for writing the depth of the objects before shading them
+	APIVar<CubeMapping, BoolVarPolicy> countOverdraw;       //!< switch for counting the fragments shaded per layer
+	APIVar<CubeMapping, FloatVarPolicy> overdrawCameraVar;  //!< shows the fragments shaded per pixel of the camera views
+	APIVar<CubeMapping, FloatVarPolicy> overdrawReflVar;    //!< shows the fragments shaded per pixel of the reflection faces
+	APIVar<CubeMapping, BoolVarPolicy> captureVar;          //!< switch for capturing the presented frames to files
+	EnumVar<CubeMapping> captureFormat;                     //!< file format of the captured frames (raw or png)
+	APIVar<CubeMapping, BoolVarPolicy> captureFaces;        //!< switch for capturing the reflection faces as well
+	APIVar<CubeMapping, IntVarPolicy> captureFramesVar;     //!< shows the number of frames written
+	APIVar<CubeMapping, IntVarPolicy> captureDroppedVar;    //!< shows the number of frames dropped
+
+	EnumVar<CubeMapping> colorFormat;              //!< selection of the color target format (LDR or HDR)
+	APIVar<CubeMapping, FloatVarPolicy> exposure;  //!< exposure in stops applied when presenting
+	EnumVar<CubeMapping> toneMapping;              //!< tone mapping operator applied when presenting
+	EnumVar<CubeMapping> texCompression;           //!< block compression of the skybox textures (none, BC1, BC7)
+	APIVar<CubeMapping, BoolVarPolicy> virtualTexturing; //!< switch for streaming the skybox from a tiled cubemap
+	APIVar<CubeMapping, IntVarPolicy> vtResidentPages;   //!< shows the number of resident tiles of the virtual skybox
+
+	APIVar<CubeMapping, FloatVarPolicy> vramTotal;         //!< shows estimated video memory of all GL objects (MB)
+	APIVar<CubeMapping, FloatVarPolicy> vramTextures;      //!< shows estimated video memory of textures (MB)
+	APIVar<CubeMapping, FloatVarPolicy> vramRenderTargets; //!< shows estimated video memory of render targets (MB)
+	APIVar<CubeMapping, FloatVarPolicy> vramBuffers;       //!< shows estimated video memory of buffers (MB)
+	APIVar<CubeMapping, FloatVarPolicy> graphTargetsVar;   //!< shows the memory of the targets the passes of the frame use (MB)
+	APIVar<CubeMapping, IntVarPolicy> graphBarriersVar;    //!< shows the barriers between the passes of the frame
+	APIVar<CubeMapping, IntVarPolicy> graphSkippedVar;     //!< shows the framebuffer, draw buffer and viewport changes skipped per frame
+	APIVar<CubeMapping, FloatVarPolicy> cacheVar;          //!< shows the memory of the objects in the resource cache (MB)
+	APIVar<CubeMapping, IntVarPolicy> cacheLimitVar;       //!< memory limit of the resource cache (MB)
+	APIVar<CubeMapping, IntVarPolicy> cacheHitsVar;        //!< shows the objects taken from the resource cache
+
+	GPUResources gpuResources; //!< registry owning all GL objects created by the plugin
+
+	FrameDataRing frameData;   //!< uniform blocks of the frames in flight
+	size_t objectDataOffset;   //!< offset of the object blocks in a slot of frameData
+	size_t objectDataStride;   //!< distance of the object blocks (aligned ObjectUniforms)
 
 	VertexArray vaQuad;             //!< vertex array for a quad
 	std::string quadVertShaderName; //!< quad vertex shader filename 
@@ -118,67 +307,211 @@ private:
 	std::string layers2cubeVertShaderName; //!< layers2cube vertex shader filename
 	std::string layers2cubeGeomShaderName; //!< layers2cube geometry shader filename
 	std::string layers2cubeFragShaderName; //!< layers2cube fragment shader filename
+	std::string layers2cubeLayeredVertShaderName; //!< layers2cube vertex shader filename (backends without geometry shader)
 	GLShader shaderLayers2Cube;            //!< layers2cube shader
 
 	VertexArray vaSkybox;             //!< vertex array for skybox
 	std::string skyboxVertShaderName; //!< skybox vertex shader filename
 	std::string skyboxGeomShaderName; //!< skybox geometry shader filename
 	std::string skyboxFragShaderName; //!< skybox fragment shader filename
+	std::string skyboxLayeredVertShaderName; //!< skybox vertex shader filename (backends without geometry shader)
 	GLShader shaderSkybox;            //!< skybox shader
+	std::string skyboxFeedbackFragShaderName; //!< skybox feedback fragment shader filename
+	GLShader shaderSkyboxFeedback;            //!< skybox shader writing virtual texture feedback
 
 	VertexArray vaCube;                   //!< vertex array for cube
 	std::string cubeVertShaderName;       //!< cube vertex shader filename
 	std::string cubeGeomShaderName;       //!< cube geometry shader filename
 	std::string cubeFragShaderName;       //!< cube fragment shader filename
+	std::string cubeLayeredVertShaderName; //!< cube vertex shader filename (backends without geometry shader)
 	GLShader shaderCube;                  //!< cube shader
 	std::string mirrorcubeGeomShaderName; //!< mirror cube geometry shader filename
 	std::string mirrorcubeFragShaderName; //!< mirror cube fragment shader filename
 	GLShader shaderMirrorcube;            //!< mirror cube shader
+	std::string cubeFeedbackFragShaderName; //!< cube feedback fragment shader filename
+	GLShader shaderCubeFeedback;            //!< cube shader writing virtual texture feedback
+	std::string depthFragShaderName;        //!< depth prepass fragment shader filename
+	GLShader shaderCubeDepth;               //!< cube shader writing depth only (prepass)
+	GLShader shaderMirrorcubeDepth;         //!< mirror cube shader writing depth only (prepass)
+	std::string meshLayeredVertShaderName;  //!< mesh vertex shader filename (see LayeredRenderer::meshShaderDefines)
+	GLShader shaderMesh;                    //!< shader of the imported meshes (cube fragment shader)
+	GLShader shaderMeshDepth;               //!< mesh shader writing depth only (prepass)
 
 	VertexArray vaBox;             //!< vertex array for box 
 	std::string boxVertShaderName; //!< box vertex shader filename
 	std::string boxFragShaderName; //!< box fragment shader filename
 	GLShader shaderBox;            //!< box shader
 
+	std::string pickRegionCompShaderName; //!< region selection compute shader filename
+	GLShader shaderPickRegion;            //!< region selection compute shader (GL 4.3)
+	std::string cubeMipsCompShaderName;      //!< single pass cubemap downsampler filename
+	GLShader shaderCubeMips;                 //!< single pass cubemap downsampler (GL 4.3)
+	std::string cubePrefilterCompShaderName; //!< glossy cubemap prefilter filename
+	GLShader shaderCubePrefilter;            //!< glossy cubemap prefilter (GL 4.3)
+
 	GLuint texSky1;   //!< skybox cubemap texture 1
 	GLuint texSky2;   //!< skybox cubemap texture 2
 	GLuint texSky3;   //!< skybox cubemap texture 3
 	GLuint texEarth;  //!< cubemap texture earth
+	CubeMapAtlas textureAtlas; //!< cubemap arrays holding the textures sampled by the objects
+	int textureAtlasIds[SCENE_TEXTURE_COUNT]; //!< atlas entry of each scene texture (-1 = none)
+	GLenum colorTargetFormat; //!< internal format of color targets (GL_RGB8, GL_RGBA16F or GL_R11F_G11F_B10F)
+	std::string pluginPath;   //!< path of the plugin (for reloading resources)
 	glm::vec3 light1; //!< light direction for skybox 1
 	glm::vec3 light2; //!< light direction for skybox 2
 	glm::vec3 light3; //!< light direction for skybox 3
 	glm::vec3 lightE; //!< light direction for earth cubemap (when used as skybox)
 
 	GLuint fbo;                  //!< handle for FBO
-	GLuint texArrayColor;        //!< handle for 'standard' color attachment (1+6 layers)
+	GLuint texArrayColor;        //!< handle for 'standard' color attachment (1+6 layers and 1 per further camera)
 	GLuint texArrayPicking;      //!< handle for picking color attachment (1 layer)
-	GLuint texArrayDepth;        //!< handle for depth attachment (1+6 layers)
-	GLuint fbo_layers2Cube;      //!< handle for the cubemap FBO (used to transfer contents from layers to cubemap)
-	GLuint texReflectionCubeMap; //!< handle for the cubemap where the reflection is rendered to
+	GLuint texArrayDepth;        //!< handle for depth attachment (as many layers as the color attachment)
+	int layerWidth;              //!< width of the layers (window width, at least the largest reflection with viewport arrays)
+	int layerHeight;             //!< height of the layers
+	bool viewportArrays;         //!< the reflection layers are rendered with their own viewport (GL 4.1)
+	bool atlasSupported;         //!< the objects sample the cubemap atlas, otherwise their own cubemap (GL 4.3)
+	GLuint fbo_layers2Cube;      //!< handle for the cubemap FBO in use (used to transfer contents from layers to cubemap)
+	GLuint texReflectionCubeMap; //!< handle for the cubemap in use where the reflection is rendered to
+	GLuint reflectionPoolFBOs[REFLECTION_POOL_SIZE];     //!< cubemap FBOs of all reflection resolutions
+	GLuint reflectionPoolTextures[REFLECTION_POOL_SIZE]; //!< reflection cubemaps of all resolutions (ascending)
+	int reflectionLevel;         //!< index of the reflection cubemap in use
+	int reflectionBelowFrames;   //!< frames the required resolution stayed below the next smaller cubemap
+	GLenum reflectionFormat;     //!< internal format of texReflectionCubeMap
+	int reflectionResolution;    //!< width and height of the faces of texReflectionCubeMap
+	CubeMipChain reflectionMipChain; //!< builds the mip chain of texReflectionCubeMap every frame
+	LayeredRenderer layered;         //!< issues the draws of the layered passes for the selected backend
+	LayeredBenchmark layeredBenchmark; //!< GPU times of the backends over the scene size (KEY_B)
+	size_t objectLimit;              //!< only the first visible objects are drawn (0 = all, set by the benchmark)
+	OverdrawCounter overdrawCounter; //!< fragments shaded per layer (while countOverdraw is checked)
+	FrameCapture frameCapture;       //!< asynchronous readback and encoding of the presented frames (KEY_V)
+	ReflectionProbe reflectionProbe; //!< baked reflection of the static scene (KEY_P)
+	bool bakeRequested;              //!< the next frame renders the reflection at full resolution and bakes it
+	bool reflectionBaked;            //!< this frame shows the baked reflection instead of rendering the faces
+	uint64_t probeObjectsHash;       //!< hash of the objects for the probe key
+	uint64_t probeHashRevision;      //!< contentRevision probeObjectsHash was computed for
+	uint64_t probeMissingKey;        //!< last key no cache file was found for
+	uint64_t probeLastKey;           //!< probe key of the last frame
+	int probeStableFrames;           //!< frames the probe key did not change
+	FrameGovernor governor;          //!< quality settings for the target frame time (while governorVar is checked)
+	float renderScale;               //!< size of the camera views relative to their tiles (needs viewport arrays)
+	int reflectionInterval;          //!< the reflection faces are rendered every n-th drawn frame
+	int reflectionAge;               //!< drawn frames since the reflection faces were last rendered
+	bool reflectionReused;           //!< this frame shows the reflection of an earlier frame
+	RenderGraph frameGraph;          //!< passes of the scene (drawToFBO) and of the presentation (Render)
+	RenderTargetState targetState;   //!< framebuffer, draw buffers and viewport set through setRenderTargets()
 
-	Object cube1;                 //!< 1st scene object
-	Object cube2;                 //!< 2nd scene object
-	Object cube3;                 //!< 3rd scene object
-	std::vector<Object*> objects; //!< all scene objects (for lookup from picking using id-1)
+	VirtualCubeMap virtualSky; //!< tiled cubemap streamed for the selected skybox
+	int virtualSkySelection;   //!< skybox selection virtualSky was opened for (0 = none)
+
+	std::vector<Object> objects; //!< all scene objects (for lookup from picking using id-1)
+	int mirrorObject;            //!< index of the reflective object the reflection is rendered from (-1 = none)
+	DynamicBVH bvh;              //!< bounding volume hierarchy over the object bounds
+	MeshLibrary meshLibrary;     //!< triangle meshes of the scene objects
+	std::vector<uint> visibleObjects;      //!< indices of the objects visible in any view this frame (ascending)
+	std::vector<int> viewQueryResults[MAX_VIEWS]; //!< objects intersecting each view frustum this frame
+	std::vector<uint> objectDrawOrder;     //!< indices into visibleObjects of the non-reflective objects sorted by atlas size class
+	std::vector<uint> meshDrawOrder;       //!< the meshes left out of objectDrawOrder as they are drawn per view (LayeredRenderer::meshesPerView())
+	uint meshViewMask;                     //!< views any of the meshes in meshDrawOrder is visible in
+	double emittedVertices;                //!< vertices emitted by the geometry shaders this frame
 
 	// picking things
 	uint pickedID;              //!< currently picked object's id (0=none picked)
 	bool pickingEnabled;        //!< wether picking is enabled or not
 	bool ignoreObjectVarUpdate; //!< flag for ignoring updates posted to the methods pickedObjectModeChanged(..) and pickedObjectMoved(..)
+	std::vector<uint> selectedIDs;     //!< ids of all selected objects (pickedID is one of them)
+	RegionSelection regionSelection;   //!< reduction of the picking buffer inside a rectangle or lasso
+	bool lassoMode;                    //!< drag selects the objects inside the mouse path instead of a rectangle
+	bool regionDragging;               //!< left button drag in progress
+	glm::ivec2 dragStart;              //!< mouse position the drag started at (window coordinates)
+	glm::ivec2 dragEnd;                //!< current mouse position of the drag
+	std::vector<glm::vec2> lassoPath;  //!< mouse path of the drag (GL window coordinates)
+
+	// on demand rendering
+	uint64_t sceneRevision;    //!< incremented for every change of the rendered scene
+	uint64_t renderedRevision; //!< revision the color layers were last rendered for
+	uint64_t contentRevision;  //!< incremented by invalidate() only (not by the polled state)
+	RenderState renderedState; //!< polled state the color layers were last rendered for
+	int feedbackFramesLeft;    //!< frames to render after a change so the virtual texture feedback can settle
 
 private:
 	void createShaders();
+	void invalidate();
+	RenderState currentRenderState();
 	void deleteShaders();
 	void drawToFBO();
 	void transferArrayTexture2CubeMap();
+	void updateReflectionMips();
+	void setReflectionMaxLevel();
+	void createReflectionTargets();
+	void releaseReflectionTargets();
+	void updateReflectionResolution();
+	uint64_t reflectionProbeKey();
+	void lookupReflectionProbe();
+	void updateReflectionProbe();
+	void bakedReflectionChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
+	int maxSubDivisionLevel() const;
+	int subDivisionLevel();
+	void governorChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
+	void applyQualitySettings();
+	void setRenderTargets(GLuint fbo, uint numBuffers, const GLenum* buffers, int vWidth, int vHeight);
+	void setLayerTargets(uint numBuffers, const GLenum* buffers, int pass = -1);
+	void setViewTargets(uint numBuffers, const GLenum* buffers, int view);
+	bool setLayeredBackend(LayeredBackend backend);
+	int numViews() const { return 6 + numCameras; }
+	uint cameraViewMask() const;
+	const glm::mat4& cameraView(int camera) const { return camera ? cameraViewMX[camera-1] : viewMX; }
+	glm::ivec2 cameraViewport(int camera) const;
+	glm::vec2 windowToCameraLayer(const glm::vec2& p) const;
+	std::string viewShaderDefines() const;
+	void updateCameraTiles();
+	void updateCameraMatrices();
+	void splitLayoutChanged(EnumVar<CubeMapping> &var);
+	void selectCamera(int camera);
+	void layeredBackendChanged(EnumVar<CubeMapping> &var);
+	void startLayeredBenchmark();
+	void finishLayeredBenchmark();
+	void reflectionResChanged(EnumVar<CubeMapping> &var);
+	void reflectionMipsChanged(EnumVar<CubeMapping> &var);
+	void reflectionMipsChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
 	void initFBO();
+	void updateMemoryVars();
+	void cacheLimitChanged(APIVar<CubeMapping, IntVarPolicy> &var);
 	GLuint loadCubeMapTexture(std::string directory, glm::vec3& light_location);
+	void loadTextures();
+	void releaseTextures();
+	bool loadScene(const std::string& file);
+	void loadDefaultScene();
+	void assignTextures();
+	void updateObjectBounds(Object& o);
+	void cullObjects(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX, const glm::mat4x4& boxTranslMX);
+	void selectLevelsOfDetail(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX);
+	bool writeFrameData(const FrameUniforms& frame);
+	void bindObjectData(uint visibleIndex);
+	void sortObjectDraws();
+	void drawObject(const Object& obj, GLShader& shader, int pass);
+	void drawDepthPrepass(int pass);
+	void drawMirrorDepthPrepass();
+	void overdrawCountingChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
+	void updateOverdrawVars();
+	void captureChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
+	void captureRenderedFrame();
+	bool isHDRPipeline() const { return colorTargetFormat != GL_RGB8; }
+	void colorFormatChanged(EnumVar<CubeMapping> &var);
+	void texCompressionChanged(EnumVar<CubeMapping> &var);
+	void updateVirtualTexture();
+	void drawFeedback(const glm::mat4x4& projMX, const glm::mat4x4& boxProjMX);
+	void skyboxChanged(EnumVar<CubeMapping> &var);
+	void virtualTexturingChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
 	glm::vec3 idToColor( uint id );
 	uint colorToId( uchar buf[3] );
 	void objectPicked(APIVar<CubeMapping, IntVarPolicy> &id);
 	void pickedObjectMoved(APIVar<CubeMapping, FloatVarPolicy> &var);
 	void pickedObjectModeChanged(APIVar<CubeMapping, BoolVarPolicy> &var);
 	void pickedObjectModeChanged(EnumVar<CubeMapping> &var);
+	void pickedObjectModeChanged(APIVar<CubeMapping, FloatVarPolicy> &var);
+	void startRegionSelection();
+	void applySelection(const std::vector<uint>& ids);
+	void drawSelectionRectangle();
 };
 
 extern "C" OGL4COREPLUGIN_API RenderPlugin* OGL4COREPLUGIN_CALL CreateInstance(COGL4CoreAPI *Api) {
@@ -9,22 +9,71 @@ INCLUDEPATH += ../../datraw/
 INCLUDEPATH += ../../OGL4CoreAPI/
 INCLUDEPATH += ../../zlib/
 
-HEADERS +=  CubeMapping.h
+HEADERS +=  CubeMapping.h \
+            GPUResources.h \
+            ThreadPool.h \
+            HDRImage.h \
+            TextureCompression.h \
+            VirtualCubeMap.h \
+            Trace.h \
+            SceneFile.h \
+            DynamicBVH.h \
+            FrameDataRing.h \
+            CubeMapAtlas.h \
+            SceneMath.h \
+            RegionSelection.h \
+            CubeMipChain.h \
+            LayeredRenderer.h \
+            OverdrawCounter.h \
+            FrameCapture.h \
+            ReflectionProbe.h \
+            FrameGovernor.h \
+            RenderGraph.h \
+            MeshImport.h \
+            MeshLibrary.h
 SOURCES +=  CubeMapping.cpp \
+            GPUResources.cpp \
+            ThreadPool.cpp \
+            HDRImage.cpp \
+            TextureCompression.cpp \
+            VirtualCubeMap.cpp \
+            Trace.cpp \
+            SceneFile.cpp \
+            DynamicBVH.cpp \
+            FrameDataRing.cpp \
+            CubeMapAtlas.cpp \
+            SceneMath.cpp \
+            RegionSelection.cpp \
+            CubeMipChain.cpp \
+            LayeredRenderer.cpp \
+            OverdrawCounter.cpp \
+            FrameCapture.cpp \
+            ReflectionProbe.cpp \
+            FrameGovernor.cpp \
+            RenderGraph.cpp \
+            MeshImport.cpp \
+            MeshLibrary.cpp \
             resources/box.frag.glsl \
             resources/box.vert.glsl \
             resources/cube.frag.glsl \
+            resources/cube_feedback.frag.glsl \
             resources/cube.geom.glsl \
             resources/cube.vert.glsl \
+            resources/cube_layered.vert.glsl \
+            resources/depth.frag.glsl \
             resources/layers2cubemap.frag.glsl \
             resources/layers2cubemap.geom.glsl \
             resources/layers2cubemap.vert.glsl \
+            resources/layers2cubemap_layered.vert.glsl \
+            resources/mesh_layered.vert.glsl \
             resources/mirrorcube.frag.glsl \
             resources/mirrorcube.geom.glsl \
             resources/quad.frag.glsl \
             resources/quad.vert.glsl \
             resources/skybox.frag.glsl \
+            resources/skybox_feedback.frag.glsl \
             resources/skybox.geom.glsl \
-            resources/skybox.vert.glsl
+            resources/skybox.vert.glsl \
+            resources/skybox_layered.vert.glsl
 
 
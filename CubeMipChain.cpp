@@ -0,0 +1,158 @@
+// CubeMipChain.cpp
+//
+
+#include "CubeMipChain.h"
+#include "Trace.h"
+
+/** level written by every work group last (64x64 tiles) */
+static const int tileLevel = 6;
+
+CubeMipChain::CubeMipChain() {
+	tailBuffer = 0;
+	tailBytes = 0;
+}
+
+CubeMipChain::~CubeMipChain() {
+	// GL objects are owned by the registry, see release()
+}
+
+/** deletes the storage buffer */
+void CubeMipChain::release(GPUResources& resources) {
+	resources.releaseBuffer(tailBuffer);
+	tailBytes = 0;
+}
+
+/** number of levels of a full mip chain */
+int CubeMipChain::numLevels(int resolution) {
+	int levels = 1;
+	while(resolution > 1){
+		resolution /= 2;
+		levels++;
+	}
+	return levels;
+}
+
+/**
+ * Format to bind a cubemap of the given internal format as image with,
+ * GL_NONE if the format cannot be written through images (e.g. GL_RGB8).
+ */
+GLenum CubeMipChain::imageFormat(GLenum internalFormat) {
+	switch(internalFormat){
+		case GL_RGBA8:
+		case GL_RGBA16F:
+		case GL_RGBA32F:
+		case GL_R11F_G11F_B10F:
+			return internalFormat;
+		default:
+			return GL_NONE;
+	}
+}
+
+/** builds the mip chain with the driver (box filter, no seam handling) */
+void CubeMipChain::generate(GLuint cubeMap) {
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+/**
+ * Builds levels 1 to the last of a cubemap from level 0 in a single dispatch.
+ * @param resolution  width and height of level 0, a power of two >= 64
+ * @return false if the cubemap cannot be processed (nothing was done)
+ */
+bool CubeMipChain::downsample(GPUResources& resources, GLShader& shader, GLuint cubeMap, GLenum internalFormat, int resolution) {
+	GLenum format = imageFormat(internalFormat);
+	int levels = numLevels(resolution);
+	if(format == GL_NONE || resolution < 64 || (resolution & (resolution - 1)) || !gl3wIsSupported(4, 3)){
+		return false;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "cube mips");
+	// counter (padded to 16 bytes) and levels 6 to the last
+	size_t bytes = 16;
+	for(int level = tileLevel, side = resolution >> tileLevel; level < levels; level++, side /= 2){
+		bytes += 6*side*side*4*sizeof(float);
+	}
+	if(bytes > tailBytes){
+		resources.releaseBuffer(tailBuffer);
+		tailBuffer = resources.createBuffer("cube mips tail");
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, tailBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+		GLuint zero = 0;
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		resources.setBufferSize(tailBuffer, bytes);
+		tailBytes = bytes;
+	}
+
+	int tilesPerSide = resolution/64;
+	GLuint numGroups = static_cast<GLuint>(6*tilesPerSide*tilesPerSide);
+	shader.Bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	glUniform1i(shader.GetUniformLocation("src"), 0);
+	glUniform1i(shader.GetUniformLocation("resolution"), resolution);
+	glUniform1i(shader.GetUniformLocation("numLevels"), levels);
+	glUniform1ui(shader.GetUniformLocation("numGroups"), numGroups);
+	for(int level = 1; level <= tileLevel; level++){
+		glBindImageTexture(level - 1, cubeMap, level, GL_TRUE, 0, GL_WRITE_ONLY, format);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, tailBuffer);
+	glDispatchCompute(numGroups, 1, 1);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	for(int level = 1; level <= tileLevel; level++){
+		glBindImageTexture(level - 1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+	}
+	shader.Release();
+
+	// copy the last levels from the storage buffer (GPU side, nothing is read back)
+	glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	if(levels > tileLevel + 1){
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tailBuffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		size_t offset = 16 + 6*(resolution >> tileLevel)*(resolution >> tileLevel)*4*sizeof(float);
+		for(int level = tileLevel + 1, side = resolution >> (tileLevel + 1); level < levels; level++, side /= 2){
+			for(int face = 0; face < 6; face++){
+				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, side, side, GL_RGBA, GL_FLOAT,
+						reinterpret_cast<const void*>(offset));
+				offset += side*side*4*sizeof(float);
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	return true;
+}
+
+/**
+ * Builds levels 1 to the last of a cubemap as successively blurred versions of level 0
+ * (one dispatch per level).
+ * @param spread  distance of the filter taps in texels of the previous level
+ * @return false if the cubemap cannot be processed (nothing was done)
+ */
+bool CubeMipChain::prefilter(GLShader& shader, GLuint cubeMap, GLenum internalFormat, int resolution, float spread) {
+	GLenum format = imageFormat(internalFormat);
+	if(format == GL_NONE || !gl3wIsSupported(4, 3)){
+		return false;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "cube prefilter");
+	int levels = numLevels(resolution);
+	shader.Bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	glUniform1i(shader.GetUniformLocation("src"), 0);
+	glUniform1f(shader.GetUniformLocation("spread"), spread);
+	GLint levelLocation = shader.GetUniformLocation("level");
+	GLint sizeLocation = shader.GetUniformLocation("size");
+	for(int level = 1, side = resolution/2; level < levels; level++, side /= 2){
+		glUniform1i(levelLocation, level);
+		glUniform1i(sizeLocation, side);
+		glBindImageTexture(0, cubeMap, level, GL_TRUE, 0, GL_WRITE_ONLY, format);
+		glDispatchCompute((side + 7)/8, (side + 7)/8, 6);
+		// the next level reads this one
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	shader.Release();
+	return true;
+}
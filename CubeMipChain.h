@@ -0,0 +1,41 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "GPUResources.h"
+
+/*
+ * Mip chain generation for cubemaps that are rendered to every frame (the reflection).
+ *
+ * downsample() builds all levels below level 0 with a 2x2 box filter in a single compute
+ * dispatch (resources/cubemips.comp.glsl): every work group reduces a 64x64 tile of a face
+ * to levels 1-6 in shared memory, the last work group reduces the level 6 texels of all
+ * tiles further. Those last levels (at most 16x16 for a 1024 cubemap) go through a storage
+ * buffer and are copied into the cubemap on the GPU, as the levels written through images
+ * are limited to the 8 image units every implementation has.
+ *
+ * prefilter() replaces the box filter by a cheap approximation of glossy reflection: every
+ * level is blurred from the previous one (resources/cubeprefilter.comp.glsl) with taps
+ * spread in the tangent plane, so the blur crosses face edges through seamless filtering.
+ *
+ * Both need GL 4.3 and a cubemap in a format that can be bound as an image (imageFormat()),
+ * glGenerateMipmap is the fallback.
+ */
+class CubeMipChain {
+public:
+	CubeMipChain();
+	~CubeMipChain();
+
+	void release(GPUResources& resources);
+
+	bool downsample(GPUResources& resources, GLShader& shader, GLuint cubeMap, GLenum internalFormat, int resolution);
+	bool prefilter(GLShader& shader, GLuint cubeMap, GLenum internalFormat, int resolution, float spread);
+	static void generate(GLuint cubeMap);
+
+	static int numLevels(int resolution);
+	static GLenum imageFormat(GLenum internalFormat);
+
+private:
+	GLuint tailBuffer;  //!< finished group counter and the texels of level 6 and below
+	size_t tailBytes;   //!< size of tailBuffer
+};
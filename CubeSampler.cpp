@@ -0,0 +1,311 @@
+// CubeSampler.cpp
+//
+
+#include "CubeSampler.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CUBESAMPLER_AVX 1
+#endif
+
+/**
+ * Selects the face a direction points to and computes the face coordinates in [0,1]^2
+ * (major axis and sc/tc as in the GL specification).
+ * @return face index (CubeFace)
+ */
+int cubeFaceOf(float x, float y, float z, float& s, float& t) {
+	float ax = std::fabs(x), ay = std::fabs(y), az = std::fabs(z);
+	int face;
+	float ma, sc, tc;
+	if(ax >= ay && ax >= az){
+		ma = ax;
+		face = x < 0 ? CUBE_FACE_NEGX : CUBE_FACE_POSX;
+		sc = x < 0 ? z : -z;
+		tc = -y;
+	} else if(ay >= az){
+		ma = ay;
+		face = y < 0 ? CUBE_FACE_NEGY : CUBE_FACE_POSY;
+		sc = x;
+		tc = y < 0 ? -z : z;
+	} else {
+		ma = az;
+		face = z < 0 ? CUBE_FACE_NEGZ : CUBE_FACE_POSZ;
+		sc = z < 0 ? -x : x;
+		tc = -y;
+	}
+	s = 0.5f*(sc/ma + 1.0f);
+	t = 0.5f*(tc/ma + 1.0f);
+	return face;
+}
+
+/**
+ * Inverse of cubeFaceOf: direction (not normalized, major axis component +-1) through
+ * the face coordinates (s,t) of a face. Coordinates outside [0,1] extend the face plane.
+ */
+void cubeFaceDirection(int face, float s, float t, float& x, float& y, float& z) {
+	float sc = 2.0f*s - 1.0f;
+	float tc = 2.0f*t - 1.0f;
+	switch(face){
+		case CUBE_FACE_NEGX: x = -1; y = -tc; z =  sc; break;
+		case CUBE_FACE_POSX: x =  1; y = -tc; z = -sc; break;
+		case CUBE_FACE_NEGY: x = sc; y =  -1; z = -tc; break;
+		case CUBE_FACE_POSY: x = sc; y =   1; z =  tc; break;
+		case CUBE_FACE_NEGZ: x = -sc; y = -tc; z = -1; break;
+		default:             x = sc; y = -tc; z =   1; break;
+	}
+}
+
+/** name of the face file (without extension) */
+const char* cubeFaceName(int face) {
+	static const char* names[6] = {"negx", "posx", "negy", "posy", "negz", "posz"};
+	return face >= 0 && face < 6 ? names[face] : "";
+}
+
+CubeMapSampler::CubeMapSampler() {
+}
+
+/** sets level 0 from 8 bit RGB faces (values are scaled to [0,1], no color space conversion) */
+void CubeMapSampler::setFaces(const unsigned char* const faces[6], int resolution) {
+	levels.assign(6, std::vector<float>());
+	levelResolution.assign(1, resolution);
+	size_t n = static_cast<size_t>(resolution)*resolution*3;
+	for(int f = 0; f < 6; f++){
+		levels[f].resize(n);
+		for(size_t i = 0; i < n; i++){
+			levels[f][i] = faces[f][i]*(1.0f/255.0f);
+		}
+	}
+}
+
+/** sets level 0 from float RGB faces */
+void CubeMapSampler::setFaces(const float* const faces[6], int resolution) {
+	levels.assign(6, std::vector<float>());
+	levelResolution.assign(1, resolution);
+	size_t n = static_cast<size_t>(resolution)*resolution*3;
+	for(int f = 0; f < 6; f++){
+		levels[f].assign(faces[f], faces[f] + n);
+	}
+}
+
+/** (re)builds the mip chain down to 1x1 with a 2x2 box filter */
+void CubeMapSampler::buildMipChain() {
+	levels.resize(6);
+	levelResolution.resize(1);
+	int res = levelResolution[0];
+	while(res > 1){
+		int src = static_cast<int>(levelResolution.size())-1;
+		int next = std::max(res/2, 1);
+		for(int f = 0; f < 6; f++){
+			const std::vector<float>& in = levels[src*6 + f];
+			std::vector<float> out(static_cast<size_t>(next)*next*3);
+			for(int j = 0; j < next; j++){
+				for(int i = 0; i < next; i++){
+					int i0 = std::min(2*i, res-1), i1 = std::min(2*i+1, res-1);
+					int j0 = std::min(2*j, res-1), j1 = std::min(2*j+1, res-1);
+					for(int c = 0; c < 3; c++){
+						out[(j*next + i)*3 + c] = 0.25f*(in[(j0*res + i0)*3 + c] + in[(j0*res + i1)*3 + c]
+								+ in[(j1*res + i0)*3 + c] + in[(j1*res + i1)*3 + c]);
+					}
+				}
+			}
+			levels.push_back(out);
+		}
+		levelResolution.push_back(next);
+		res = next;
+	}
+}
+
+/** texel of a face (i,j have to be inside the face) */
+const float* CubeMapSampler::texel(int level, int face, int i, int j) const {
+	int res = levelResolution[level];
+	return &levels[level*6 + face][(static_cast<size_t>(j)*res + i)*3];
+}
+
+/**
+ * Texel at (i,j) of a face, where i or j may be one texel outside of it.
+ * The center of such a texel is projected onto the adjacent face it lies over.
+ */
+const float* CubeMapSampler::seamTexel(int level, int face, int i, int j) const {
+	int res = levelResolution[level];
+	if(i >= 0 && j >= 0 && i < res && j < res){
+		return texel(level, face, i, j);
+	}
+	float x, y, z, s, t;
+	cubeFaceDirection(face, (i + 0.5f)/res, (j + 0.5f)/res, x, y, z);
+	int f = cubeFaceOf(x, y, z, s, t);
+	int i2 = std::min(std::max(static_cast<int>(s*res), 0), res-1);
+	int j2 = std::min(std::max(static_cast<int>(t*res), 0), res-1);
+	return texel(level, f, i2, j2);
+}
+
+/** bilinear filter at the texel space position (u,v) of a face (texel centers at integers) */
+void CubeMapSampler::bilinearTaps(int level, int face, float u, float v, float rgb[3]) const {
+	int res = levelResolution[level];
+	float fi = std::floor(u), fj = std::floor(v);
+	int i0 = static_cast<int>(fi), j0 = static_cast<int>(fj);
+	float wu = u - fi, wv = v - fj;
+	const float *t00, *t10, *t01, *t11;
+	if(i0 >= 0 && j0 >= 0 && i0+1 < res && j0+1 < res){
+		t00 = texel(level, face, i0, j0);
+		t10 = t00 + 3;
+		t01 = t00 + res*3;
+		t11 = t01 + 3;
+	} else {
+		t00 = seamTexel(level, face, i0, j0);
+		t10 = seamTexel(level, face, i0+1, j0);
+		t01 = seamTexel(level, face, i0, j0+1);
+		t11 = seamTexel(level, face, i0+1, j0+1);
+	}
+	for(int c = 0; c < 3; c++){
+		float a = t00[c] + (t10[c] - t00[c])*wu;
+		float b = t01[c] + (t11[c] - t01[c])*wu;
+		rgb[c] = a + (b - a)*wv;
+	}
+}
+
+/** nearest texel of a level in the specified direction */
+void CubeMapSampler::sampleNearest(float x, float y, float z, int level, float rgb[3]) const {
+	float s, t;
+	int face = cubeFaceOf(x, y, z, s, t);
+	int res = levelResolution[level];
+	int i = std::min(std::max(static_cast<int>(s*res), 0), res-1);
+	int j = std::min(std::max(static_cast<int>(t*res), 0), res-1);
+	const float* p = texel(level, face, i, j);
+	rgb[0] = p[0];
+	rgb[1] = p[1];
+	rgb[2] = p[2];
+}
+
+/** seam aware bilinear lookup of a level in the specified direction */
+void CubeMapSampler::sampleBilinear(float x, float y, float z, int level, float rgb[3]) const {
+	float s, t;
+	int face = cubeFaceOf(x, y, z, s, t);
+	float res = static_cast<float>(levelResolution[level]);
+	bilinearTaps(level, face, s*res - 0.5f, t*res - 0.5f, rgb);
+}
+
+/** seam aware trilinear lookup, lod is clamped to the mip chain */
+void CubeMapSampler::sampleTrilinear(float x, float y, float z, float lod, float rgb[3]) const {
+	lod = std::min(std::max(lod, 0.0f), static_cast<float>(numLevels()-1));
+	int l0 = static_cast<int>(lod);
+	int l1 = std::min(l0+1, numLevels()-1);
+	float w = lod - l0;
+	float a[3], b[3];
+	sampleBilinear(x, y, z, l0, a);
+	if(w <= 0.0f || l1 == l0){
+		rgb[0] = a[0]; rgb[1] = a[1]; rgb[2] = a[2];
+		return;
+	}
+	sampleBilinear(x, y, z, l1, b);
+	for(int c = 0; c < 3; c++){
+		rgb[c] = a[c] + (b[c] - a[c])*w;
+	}
+}
+
+#ifdef CUBESAMPLER_AVX
+/**
+ * Face selection and texel space coordinates of 8 directions (the branches of
+ * cubeFaceOf turned into blends). u,v are relative to the texel centers of a face
+ * of the specified resolution.
+ */
+static void addressBatch8(const float* x, const float* y, const float* z, float res,
+		int face[8], float u[8], float v[8]) {
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 vx = _mm256_loadu_ps(x);
+	__m256 vy = _mm256_loadu_ps(y);
+	__m256 vz = _mm256_loadu_ps(z);
+	__m256 ax = _mm256_andnot_ps(signMask, vx);
+	__m256 ay = _mm256_andnot_ps(signMask, vy);
+	__m256 az = _mm256_andnot_ps(signMask, vz);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 xNeg = _mm256_cmp_ps(vx, zero, _CMP_LT_OQ);
+	__m256 yNeg = _mm256_cmp_ps(vy, zero, _CMP_LT_OQ);
+	__m256 zNeg = _mm256_cmp_ps(vz, zero, _CMP_LT_OQ);
+	__m256 xMajor = _mm256_and_ps(_mm256_cmp_ps(ax, ay, _CMP_GE_OQ), _mm256_cmp_ps(ax, az, _CMP_GE_OQ));
+	__m256 yMajor = _mm256_andnot_ps(xMajor, _mm256_cmp_ps(ay, az, _CMP_GE_OQ));
+	__m256 negX = _mm256_xor_ps(vx, signMask);
+	__m256 negY = _mm256_xor_ps(vy, signMask);
+	__m256 negZ = _mm256_xor_ps(vz, signMask);
+	// z major (default), then overwritten by y major and x major lanes
+	__m256 ma = az;
+	__m256 sc = _mm256_blendv_ps(vx, negX, zNeg);
+	__m256 tc = negY;
+	__m256 f = _mm256_blendv_ps(_mm256_set1_ps(5.0f), _mm256_set1_ps(4.0f), zNeg);
+	ma = _mm256_blendv_ps(ma, ay, yMajor);
+	sc = _mm256_blendv_ps(sc, vx, yMajor);
+	tc = _mm256_blendv_ps(tc, _mm256_blendv_ps(vz, negZ, yNeg), yMajor);
+	f = _mm256_blendv_ps(f, _mm256_blendv_ps(_mm256_set1_ps(3.0f), _mm256_set1_ps(2.0f), yNeg), yMajor);
+	ma = _mm256_blendv_ps(ma, ax, xMajor);
+	sc = _mm256_blendv_ps(sc, _mm256_blendv_ps(negZ, vz, xNeg), xMajor);
+	tc = _mm256_blendv_ps(tc, negY, xMajor);
+	f = _mm256_blendv_ps(f, _mm256_blendv_ps(_mm256_set1_ps(1.0f), zero, xNeg), xMajor);
+	// s = 0.5*(sc/ma+1), u = s*res-0.5
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 vres = _mm256_set1_ps(res);
+	__m256 s = _mm256_mul_ps(half, _mm256_add_ps(_mm256_div_ps(sc, ma), one));
+	__m256 t = _mm256_mul_ps(half, _mm256_add_ps(_mm256_div_ps(tc, ma), one));
+	_mm256_storeu_ps(u, _mm256_sub_ps(_mm256_mul_ps(s, vres), half));
+	_mm256_storeu_ps(v, _mm256_sub_ps(_mm256_mul_ps(t, vres), half));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(face), _mm256_cvttps_epi32(f));
+}
+#endif
+
+/**
+ * Seam aware bilinear lookups of count directions (x,y,z arrays), rgb receives 3 floats per direction.
+ */
+void CubeMapSampler::sampleBilinearBatch(const float* x, const float* y, const float* z, size_t count, int level, float* rgb) const {
+	float res = static_cast<float>(levelResolution[level]);
+	size_t i = 0;
+#ifdef CUBESAMPLER_AVX
+	int face[8];
+	float u[8], v[8];
+	for(; i + 8 <= count; i += 8){
+		addressBatch8(x+i, y+i, z+i, res, face, u, v);
+		for(int k = 0; k < 8; k++){
+			bilinearTaps(level, face[k], u[k], v[k], rgb + (i+k)*3);
+		}
+	}
+#endif
+	for(; i < count; i++){
+		float s, t;
+		int f = cubeFaceOf(x[i], y[i], z[i], s, t);
+		bilinearTaps(level, f, s*res - 0.5f, t*res - 0.5f, rgb + i*3);
+	}
+}
+
+/**
+ * Seam aware trilinear lookups of count directions at a common lod.
+ */
+void CubeMapSampler::sampleTrilinearBatch(const float* x, const float* y, const float* z, size_t count, float lod, float* rgb) const {
+	lod = std::min(std::max(lod, 0.0f), static_cast<float>(numLevels()-1));
+	int l0 = static_cast<int>(lod);
+	int l1 = std::min(l0+1, numLevels()-1);
+	float w = lod - l0;
+	sampleBilinearBatch(x, y, z, count, l0, rgb);
+	if(w <= 0.0f || l1 == l0){
+		return;
+	}
+	// second level in blocks, blended into the result
+	const size_t block = 256;
+	float second[block*3];
+	for(size_t i = 0; i < count; i += block){
+		size_t n = std::min(block, count - i);
+		sampleBilinearBatch(x+i, y+i, z+i, n, l1, second);
+		float* out = rgb + i*3;
+		for(size_t k = 0; k < n*3; k++){
+			out[k] += (second[k] - out[k])*w;
+		}
+	}
+}
+
+/** whether the batch functions were compiled with the AVX kernel */
+bool CubeMapSampler::usesAVX() {
+#ifdef CUBESAMPLER_AVX
+	return true;
+#else
+	return false;
+#endif
+}
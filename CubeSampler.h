@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * CPU reference implementation of cubemap lookups.
+ *
+ * Uses the conventions of the GPU side: faces are ordered like the face files loaded by
+ * CubeMapping::loadCubeMapTexture (negx, posx, negy, posy, negz, posz), face images are
+ * stored row by row starting at t = 0 like they are uploaded by glTexImage2D, and the face
+ * coordinates (s,t) of a direction are computed as in the GL specification (and cubeFace()
+ * in the shaders).
+ *
+ * Bilinear filtering is seam aware: taps that fall outside a face are taken from the
+ * adjacent face (like GL_TEXTURE_CUBE_MAP_SEAMLESS), trilinear filtering blends two levels
+ * of a box filtered mip chain. The batch functions compute the face addressing of 8
+ * directions at once with AVX when the file is compiled with AVX enabled (-mavx or
+ * /arch:AVX), otherwise a scalar loop is used.
+ * Nothing in here depends on GL so it can be used offline as well.
+ */
+
+/** cube faces in the order of the face files */
+enum CubeFace {
+	CUBE_FACE_NEGX = 0,
+	CUBE_FACE_POSX,
+	CUBE_FACE_NEGY,
+	CUBE_FACE_POSY,
+	CUBE_FACE_NEGZ,
+	CUBE_FACE_POSZ
+};
+
+int cubeFaceOf(float x, float y, float z, float& s, float& t);
+void cubeFaceDirection(int face, float s, float t, float& x, float& y, float& z);
+const char* cubeFaceName(int face);
+
+/**
+ * RGB cubemap with mip chain (float texels) and the filtering functions.
+ */
+class CubeMapSampler {
+public:
+	CubeMapSampler();
+
+	void setFaces(const unsigned char* const faces[6], int resolution);
+	void setFaces(const float* const faces[6], int resolution);
+	void buildMipChain();
+
+	int numLevels() const { return static_cast<int>(levels.size()/6); }
+	int resolution(int level) const { return levelResolution[level]; }
+	const float* texel(int level, int face, int i, int j) const;
+
+	void sampleNearest(float x, float y, float z, int level, float rgb[3]) const;
+	void sampleBilinear(float x, float y, float z, int level, float rgb[3]) const;
+	void sampleTrilinear(float x, float y, float z, float lod, float rgb[3]) const;
+
+	void sampleBilinearBatch(const float* x, const float* y, const float* z, size_t count, int level, float* rgb) const;
+	void sampleTrilinearBatch(const float* x, const float* y, const float* z, size_t count, float lod, float* rgb) const;
+
+	static bool usesAVX();
+
+private:
+	void bilinearTaps(int level, int face, float u, float v, float rgb[3]) const;
+	const float* seamTexel(int level, int face, int i, int j) const;
+
+	std::vector<std::vector<float> > levels; //!< RGB texels of every level and face (index level*6+face)
+	std::vector<int> levelResolution;         //!< width and height of the faces of every level
+};
@@ -0,0 +1,338 @@
+// DynamicBVH.cpp
+//
+
+#include "DynamicBVH.h"
+#include <algorithm>
+
+/**
+ * Extracts the planes of the frustum from a view projection matrix
+ * (a point p is inside if dot(plane.xyz, p) + plane.w >= 0 for all planes).
+ */
+Frustum Frustum::fromViewProjection(const glm::mat4& vp) {
+	// rows of the (column major) matrix
+	glm::vec4 row0(vp[0][0], vp[1][0], vp[2][0], vp[3][0]);
+	glm::vec4 row1(vp[0][1], vp[1][1], vp[2][1], vp[3][1]);
+	glm::vec4 row2(vp[0][2], vp[1][2], vp[2][2], vp[3][2]);
+	glm::vec4 row3(vp[0][3], vp[1][3], vp[2][3], vp[3][3]);
+	Frustum f;
+	f.planes[0] = row3 + row0; // left
+	f.planes[1] = row3 - row0; // right
+	f.planes[2] = row3 + row1; // bottom
+	f.planes[3] = row3 - row1; // top
+	f.planes[4] = row3 + row2; // near
+	f.planes[5] = row3 - row2; // far
+	return f;
+}
+
+DynamicBVH::DynamicBVH(float margin) : margin(margin) {
+	clear();
+}
+
+/** removes all proxies */
+void DynamicBVH::clear() {
+	nodes.clear();
+	root = -1;
+	freeList = -1;
+	proxyCount = 0;
+}
+
+int DynamicBVH::allocateNode() {
+	int node;
+	if(freeList >= 0){
+		node = freeList;
+		freeList = nodes[node].parent;
+	} else {
+		node = static_cast<int>(nodes.size());
+		nodes.push_back(Node());
+	}
+	Node& n = nodes[node];
+	n.parent = n.child1 = n.child2 = -1;
+	n.height = 0;
+	n.userData = -1;
+	return node;
+}
+
+void DynamicBVH::freeNode(int node) {
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+/**
+ * Inserts an object with the specified bounds.
+ * @return proxy id used to move or remove the object
+ */
+int DynamicBVH::createProxy(const AABB& box, int userData) {
+	int proxy = allocateNode();
+	nodes[proxy].box = AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+	nodes[proxy].userData = userData;
+	insertLeaf(proxy);
+	proxyCount++;
+	return proxy;
+}
+
+/** removes an object */
+void DynamicBVH::destroyProxy(int proxy) {
+	removeLeaf(proxy);
+	freeNode(proxy);
+	proxyCount--;
+}
+
+/**
+ * Updates the bounds of an object. The tree is only changed when the
+ * new bounds are not contained in the fat box of the leaf.
+ * @return true if the leaf was reinserted
+ */
+bool DynamicBVH::moveProxy(int proxy, const AABB& box) {
+	if(nodes[proxy].box.contains(box)){
+		return false;
+	}
+	removeLeaf(proxy);
+	nodes[proxy].box = AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+	insertLeaf(proxy);
+	return true;
+}
+
+void DynamicBVH::insertLeaf(int leaf) {
+	if(root < 0){
+		root = leaf;
+		nodes[root].parent = -1;
+		return;
+	}
+	// descend to the sibling with the lowest cost (surface area heuristic)
+	AABB leafBox = nodes[leaf].box;
+	int index = root;
+	while(!nodes[index].isLeaf()){
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+		float area = nodes[index].box.surfaceArea();
+		float combinedArea = AABB::combine(nodes[index].box, leafBox).surfaceArea();
+		// cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f*combinedArea;
+		// minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f*(combinedArea - area);
+		float childCost[2];
+		int children[2] = {child1, child2};
+		for(int c = 0; c < 2; c++){
+			const Node& child = nodes[children[c]];
+			float newArea = AABB::combine(leafBox, child.box).surfaceArea();
+			childCost[c] = child.isLeaf() ? newArea + inheritanceCost : newArea - child.box.surfaceArea() + inheritanceCost;
+		}
+		if(cost < childCost[0] && cost < childCost[1]){
+			break;
+		}
+		index = childCost[0] < childCost[1] ? child1 : child2;
+	}
+	int sibling = index;
+
+	// create a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = AABB::combine(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if(oldParent >= 0){
+		if(nodes[oldParent].child1 == sibling){
+			nodes[oldParent].child1 = newParent;
+		} else {
+			nodes[oldParent].child2 = newParent;
+		}
+	} else {
+		root = newParent;
+	}
+
+	// walk back up fixing heights and boxes
+	index = nodes[leaf].parent;
+	while(index >= 0){
+		index = balance(index);
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+		nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+		nodes[index].box = AABB::combine(nodes[child1].box, nodes[child2].box);
+		index = nodes[index].parent;
+	}
+}
+
+void DynamicBVH::removeLeaf(int leaf) {
+	if(leaf == root){
+		root = -1;
+		return;
+	}
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+	if(grandParent >= 0){
+		// replace the parent by the sibling
+		if(nodes[grandParent].child1 == parent){
+			nodes[grandParent].child1 = sibling;
+		} else {
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		int index = grandParent;
+		while(index >= 0){
+			index = balance(index);
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+			nodes[index].box = AABB::combine(nodes[child1].box, nodes[child2].box);
+			nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+			index = nodes[index].parent;
+		}
+	} else {
+		root = sibling;
+		nodes[sibling].parent = -1;
+		freeNode(parent);
+	}
+}
+
+/**
+ * Performs a left or right rotation if the subtree at node a is imbalanced.
+ * @return the root of the (rotated) subtree
+ */
+int DynamicBVH::balance(int a) {
+	Node& A = nodes[a];
+	if(A.isLeaf() || A.height < 2){
+		return a;
+	}
+	int b = A.child1;
+	int c = A.child2;
+	int heightDiff = nodes[c].height - nodes[b].height;
+	if(heightDiff > 1){
+		// rotate c up
+		int f = nodes[c].child1;
+		int g = nodes[c].child2;
+		nodes[c].child1 = a;
+		nodes[c].parent = A.parent;
+		A.parent = c;
+		if(nodes[c].parent >= 0){
+			if(nodes[nodes[c].parent].child1 == a){
+				nodes[nodes[c].parent].child1 = c;
+			} else {
+				nodes[nodes[c].parent].child2 = c;
+			}
+		} else {
+			root = c;
+		}
+		// the higher child of c stays, the other one becomes a child of a
+		if(nodes[f].height > nodes[g].height){
+			nodes[c].child2 = f;
+			A.child2 = g;
+			nodes[g].parent = a;
+		} else {
+			nodes[c].child2 = g;
+			A.child2 = f;
+			nodes[f].parent = a;
+		}
+		A.box = AABB::combine(nodes[b].box, nodes[A.child2].box);
+		A.height = 1 + std::max(nodes[b].height, nodes[A.child2].height);
+		nodes[c].box = AABB::combine(A.box, nodes[nodes[c].child2].box);
+		nodes[c].height = 1 + std::max(A.height, nodes[nodes[c].child2].height);
+		return c;
+	}
+	if(heightDiff < -1){
+		// rotate b up
+		int d = nodes[b].child1;
+		int e = nodes[b].child2;
+		nodes[b].child1 = a;
+		nodes[b].parent = A.parent;
+		A.parent = b;
+		if(nodes[b].parent >= 0){
+			if(nodes[nodes[b].parent].child1 == a){
+				nodes[nodes[b].parent].child1 = b;
+			} else {
+				nodes[nodes[b].parent].child2 = b;
+			}
+		} else {
+			root = b;
+		}
+		if(nodes[d].height > nodes[e].height){
+			nodes[b].child2 = d;
+			A.child1 = e;
+			nodes[e].parent = a;
+		} else {
+			nodes[b].child2 = e;
+			A.child1 = d;
+			nodes[d].parent = a;
+		}
+		A.box = AABB::combine(nodes[c].box, nodes[A.child1].box);
+		A.height = 1 + std::max(nodes[c].height, nodes[A.child1].height);
+		nodes[b].box = AABB::combine(A.box, nodes[nodes[b].child2].box);
+		nodes[b].height = 1 + std::max(A.height, nodes[nodes[b].child2].height);
+		return b;
+	}
+	return a;
+}
+
+void DynamicBVH::collectLeaves(int node, std::vector<int>& userData) const {
+	const Node& n = nodes[node];
+	if(n.isLeaf()){
+		userData.push_back(n.userData);
+	} else {
+		collectLeaves(n.child1, userData);
+		collectLeaves(n.child2, userData);
+	}
+}
+
+/**
+ * Appends the user data of all leaves whose (fat) box intersects the frustum.
+ * Planes a subtree is completely in front of are not tested again below it,
+ * subtrees inside all planes are reported without further tests.
+ * Queries are read only and may run concurrently.
+ */
+void DynamicBVH::queryFrustum(const Frustum& frustum, std::vector<int>& userData) const {
+	if(root < 0){
+		return;
+	}
+	typedef struct StackEntry_t {
+		int node;
+		int planeMask; //!< planes that still have to be tested
+	} StackEntry;
+	StackEntry stack[128];
+	int stackSize = 0;
+	stack[stackSize].node = root;
+	stack[stackSize].planeMask = 0x3f;
+	stackSize++;
+	while(stackSize > 0){
+		stackSize--;
+		int index = stack[stackSize].node;
+		int planeMask = stack[stackSize].planeMask;
+		const Node& n = nodes[index];
+		glm::vec3 center = 0.5f*(n.box.min + n.box.max);
+		glm::vec3 extent = 0.5f*(n.box.max - n.box.min);
+		bool outside = false;
+		for(int p = 0; p < 6 && !outside; p++){
+			if(!(planeMask & (1 << p))){
+				continue;
+			}
+			const glm::vec4& plane = frustum.planes[p];
+			float d = glm::dot(glm::vec3(plane), center) + plane.w;
+			float r = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if(d + r < 0.0f){
+				outside = true;
+			} else if(d - r >= 0.0f){
+				planeMask &= ~(1 << p);
+			}
+		}
+		if(outside){
+			continue;
+		}
+		if(planeMask == 0 || n.isLeaf()){
+			collectLeaves(index, userData);
+		} else if(stackSize + 2 <= 128){
+			stack[stackSize].node = n.child1;
+			stack[stackSize].planeMask = planeMask;
+			stackSize++;
+			stack[stackSize].node = n.child2;
+			stack[stackSize].planeMask = planeMask;
+			stackSize++;
+		} else {
+			// cannot happen for a balanced tree, report conservatively
+			collectLeaves(index, userData);
+		}
+	}
+}
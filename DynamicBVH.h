@@ -0,0 +1,82 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <vector>
+
+/** axis aligned bounding box */
+typedef struct AABB_t {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB_t() : min(0.0f), max(0.0f) {}
+	AABB_t(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+	bool contains(const AABB_t& b) const {
+		return min.x <= b.min.x && min.y <= b.min.y && min.z <= b.min.z
+			&& max.x >= b.max.x && max.y >= b.max.y && max.z >= b.max.z;
+	}
+	float surfaceArea() const {
+		glm::vec3 d = max - min;
+		return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+	static AABB_t combine(const AABB_t& a, const AABB_t& b) {
+		return AABB_t(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+} AABB;
+
+/** view frustum given by 6 planes (xyz = inward normal, w = offset, not normalized) */
+typedef struct Frustum_t {
+	glm::vec4 planes[6];
+
+	static Frustum_t fromViewProjection(const glm::mat4& vp);
+} Frustum;
+
+/**
+ * Dynamic bounding volume hierarchy (AABB tree) over object bounds.
+ * Leaves store 'fat' boxes enlarged by a margin, so objects can move
+ * a little without changing the tree. When an object leaves its fat box
+ * the leaf is removed and reinserted, the tree is kept balanced by
+ * rotations on the way up (like an AVL tree), so queries stay logarithmic
+ * as objects are moved around. Inserting uses the surface area heuristic
+ * to find the best sibling.
+ */
+class DynamicBVH {
+public:
+	explicit DynamicBVH(float margin = 0.1f);
+
+	int createProxy(const AABB& box, int userData);
+	void destroyProxy(int proxy);
+	bool moveProxy(int proxy, const AABB& box);
+	void clear();
+
+	void queryFrustum(const Frustum& frustum, std::vector<int>& userData) const;
+
+	int getUserData(int proxy) const { return nodes[proxy].userData; }
+	const AABB& getFatAABB(int proxy) const { return nodes[proxy].box; }
+	int getHeight() const { return root < 0 ? 0 : nodes[root].height; }
+	int numProxies() const { return proxyCount; }
+
+private:
+	/** node of the tree (leaves have child1 = -1) */
+	typedef struct Node_t {
+		AABB box;
+		int parent;   //!< parent node, or next free node while the node is unused
+		int child1;
+		int child2;
+		int height;   //!< 0 for leaves, -1 for free nodes
+		int userData; //!< object of the leaf
+		bool isLeaf() const { return child1 < 0; }
+	} Node;
+
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void collectLeaves(int node, std::vector<int>& userData) const;
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	int proxyCount;
+	float margin; //!< enlargement of the leaf boxes
+};
@@ -0,0 +1,335 @@
+// FrameCapture.cpp
+//
+
+#include "FrameCapture.h"
+#include "PngBitmapCodec.h"
+#include "Trace.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/** face file suffixes in GL face order */
+static const char* faceSuffixes[6] = {"posx", "negx", "posy", "negy", "posz", "negz"};
+
+/** creates a directory and its missing parents, existing ones are fine */
+static bool makeDirectory(const std::string& path) {
+	size_t separator = path.find_last_of("/\\");
+	if(separator != std::string::npos && separator > 0){
+		makeDirectory(path.substr(0, separator));
+	}
+#ifdef _WIN32
+	int result = _mkdir(path.c_str());
+#else
+	int result = mkdir(path.c_str(), 0755);
+#endif
+	return result == 0 || errno == EEXIST;
+}
+
+FrameCapture::FrameCapture() {
+	format = CAPTURE_RAW;
+	floatPixels = false;
+	readFBO = 0;
+	nextSlot = 0;
+	frame = captured = written = failed = dropped = 0;
+	stopEncoder = false;
+}
+
+FrameCapture::~FrameCapture() {
+	// GL objects are owned by the registry, see stop(), only the encoder needs to go
+	if(encoder.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopEncoder = true;
+		}
+		wakeEncoder.notify_all();
+		encoder.join();
+	}
+}
+
+/**
+ * Starts a capture run into a new directory (created if necessary).
+ * @param floatPixels  read back as float and write PFM files (raw format only)
+ * @param numSlots     frames that may be read back or encoded at the same time
+ */
+bool FrameCapture::start(GPUResources& resources, const std::string& dir, CaptureFormat fmt, bool floats, int numSlots) {
+	stop(resources);
+	if(!makeDirectory(dir)){
+		TRACE_ERROR("capture", "could not create directory [%s]", dir.c_str());
+		return false;
+	}
+	directory = dir;
+	format = fmt;
+	floatPixels = floats && fmt == CAPTURE_RAW;
+	readFBO = resources.createFramebuffer("capture read");
+	Slot empty = {0, 0, 0, nullptr, 0, 0, 0, 0, SLOT_FREE, true};
+	slots.assign(numSlots, empty);
+	for(size_t i = 0; i < slots.size(); i++){
+		slots[i].pbo = resources.createBuffer("capture ring");
+	}
+	nextSlot = 0;
+	frame = captured = written = failed = dropped = 0;
+	stopEncoder = false;
+	encoder = std::thread(&FrameCapture::encoderLoop, this);
+	TRACE_INFO("capture", "capturing to %s", directory.c_str());
+	return true;
+}
+
+/**
+ * Ends the capture run. The frames still being read back are waited for and written
+ * as well (this is the only place that waits for the GPU).
+ */
+void FrameCapture::stop(GPUResources& resources) {
+	if(isRunning()){
+		TRACE_SPAN(TRACE_LEVEL_INFO, "capture stop");
+		for(size_t i = 0; i < slots.size(); i++){
+			Slot& slot = slots[i];
+			if(slot.state == SLOT_READING){
+				glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				finishReadback(slot);
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.state = SLOT_ENCODING;
+				encodeQueue.push_back(i);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopEncoder = true;
+		}
+		wakeEncoder.notify_all();
+		encoder.join();
+		for(size_t i = 0; i < slots.size(); i++){
+			Slot& slot = slots[i];
+			if(slot.pixels){
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				slot.pixels = nullptr;
+				if(slot.ok){
+					written++;
+				} else {
+					failed++;
+				}
+			}
+		}
+		TRACE_INFO("capture", "%llu frames written to %s, %llu dropped, %llu failed",
+				static_cast<unsigned long long>(written), directory.c_str(),
+				static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(failed));
+	}
+	for(size_t i = 0; i < slots.size(); i++){
+		if(slots[i].fence){
+			glDeleteSync(slots[i].fence);
+		}
+		resources.releaseBuffer(slots[i].pbo);
+	}
+	slots.clear();
+	encodeQueue.clear();
+	resources.releaseFramebuffer(readFBO);
+}
+
+/**
+ * Queues the readback of a frame into the next slot of the ring, or drops the frame
+ * if that slot is still in use. Never waits for the GPU or the encoder.
+ * @param width,height    part of layer 0 of colorLayers holding the camera view
+ * @param cubeMap         cubemap whose faces are captured as well (0 = none)
+ * @param faceResolution  width and height of its level 0
+ */
+void FrameCapture::captureFrame(GPUResources& resources, GLuint colorLayers, int width, int height, GLuint cubeMap, int faceResolution) {
+	if(!isRunning()){
+		return;
+	}
+	update();
+	uint64_t number = frame++;
+	Slot& slot = slots[nextSlot];
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(slot.state != SLOT_FREE){
+			dropped++;
+			if(dropped % 100 == 1){
+				TRACE_WARN("capture", "encoder falls behind, dropped frame %llu (%llu in total)",
+						static_cast<unsigned long long>(number), static_cast<unsigned long long>(dropped));
+			}
+			TRACE_COUNTER(TRACE_LEVEL_INFO, "capture dropped", static_cast<double>(dropped));
+			return;
+		}
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "capture readback");
+	size_t pixelBytes = floatPixels ? 3*sizeof(float) : 3;
+	size_t viewBytes = static_cast<size_t>(width)*height*pixelBytes;
+	size_t faceBytes = cubeMap ? static_cast<size_t>(faceResolution)*faceResolution*pixelBytes : 0;
+	size_t bytes = viewBytes + 6*faceBytes;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if(bytes > slot.capacity){
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		resources.setBufferSize(slot.pbo, bytes);
+		slot.capacity = bytes;
+	}
+	// the copies into the buffer are only queued, the fence tells when they are done
+	GLenum type = floatPixels ? GL_FLOAT : GL_UNSIGNED_BYTE;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorLayers, 0, 0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, width, height, GL_RGB, type, 0);
+	if(cubeMap){
+		for(int face = 0; face < 6; face++){
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeMap, 0);
+			glReadPixels(0, 0, faceResolution, faceResolution, GL_RGB, type, reinterpret_cast<void*>(viewBytes + face*faceBytes));
+		}
+	}
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = number;
+	slot.width = width;
+	slot.height = height;
+	slot.faceResolution = cubeMap ? faceResolution : 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slot.state = SLOT_READING;
+	}
+	nextSlot = (nextSlot + 1) % slots.size();
+	captured++;
+}
+
+/**
+ * Hands the slots whose readback has finished to the encoder and recycles the ones
+ * it has written. Called every frame, does not wait.
+ */
+void FrameCapture::update() {
+	if(!isRunning()){
+		return;
+	}
+	bool queued = false;
+	for(size_t i = 0; i < slots.size(); i++){
+		Slot& slot = slots[i];
+		SlotState state;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			state = slot.state;
+		}
+		if(state == SLOT_READING){
+			GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+				continue;
+			}
+			finishReadback(slot);
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.state = SLOT_ENCODING;
+			encodeQueue.push_back(i);
+			queued = true;
+		} else if(state == SLOT_DONE){
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			slot.pixels = nullptr;
+			std::lock_guard<std::mutex> lock(mutex);
+			if(slot.ok){
+				written++;
+			} else {
+				failed++;
+			}
+			slot.state = SLOT_FREE;
+		}
+	}
+	if(queued){
+		wakeEncoder.notify_one();
+	}
+}
+
+/** maps the buffer of a slot whose fence has signaled (the encoder reads from it) */
+void FrameCapture::finishReadback(Slot& slot) {
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	size_t pixelBytes = floatPixels ? 3*sizeof(float) : 3;
+	size_t bytes = (static_cast<size_t>(slot.width)*slot.height + 6*static_cast<size_t>(slot.faceResolution)*slot.faceResolution)*pixelBytes;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	slot.pixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/** loop of the encoder thread: writes the queued slots, finishes the queue before exiting */
+void FrameCapture::encoderLoop() {
+	traceSetThreadName("capture encoder");
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		wakeEncoder.wait(lock, [this]{ return stopEncoder || !encodeQueue.empty(); });
+		if(encodeQueue.empty()){
+			break;
+		}
+		size_t index = encodeQueue.front();
+		encodeQueue.pop_front();
+		Slot slot = slots[index];
+		lock.unlock();
+		bool ok = slot.pixels && writeSlot(slot);
+		lock.lock();
+		slots[index].ok = ok;
+		slots[index].state = SLOT_DONE;
+	}
+}
+
+/** writes the images of a frame */
+bool FrameCapture::writeSlot(const Slot& slot) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "encode frame");
+	char name[32];
+	std::snprintf(name, sizeof(name), "frame_%06llu", static_cast<unsigned long long>(slot.frame));
+	std::string base = directory + "/" + name;
+	const char* extension = format == CAPTURE_PNG ? ".png" : (floatPixels ? ".pfm" : ".ppm");
+	// the camera view was read bottom row first, the faces in the order of their images
+	bool ok = writeImage(base + extension, slot.pixels, slot.width, slot.height, true);
+	if(slot.faceResolution > 0){
+		size_t pixelBytes = floatPixels ? 3*sizeof(float) : 3;
+		size_t faceBytes = static_cast<size_t>(slot.faceResolution)*slot.faceResolution*pixelBytes;
+		const unsigned char* faces = slot.pixels + static_cast<size_t>(slot.width)*slot.height*pixelBytes;
+		for(int face = 0; face < 6; face++){
+			std::string file = base + "_" + faceSuffixes[face] + extension;
+			ok = writeImage(file, faces + face*faceBytes, slot.faceResolution, slot.faceResolution, false) && ok;
+		}
+	}
+	if(!ok){
+		TRACE_ERROR("capture", "could not write frame %llu to %s", static_cast<unsigned long long>(slot.frame), directory.c_str());
+	}
+	return ok;
+}
+
+/**
+ * Writes an image in the capture format.
+ * @param bottomUp  the first row of pixels is the bottom row of the image
+ */
+bool FrameCapture::writeImage(const std::string& file, const unsigned char* pixels, int width, int height, bool bottomUp) {
+	size_t rowBytes = static_cast<size_t>(width)*(floatPixels ? 3*sizeof(float) : 3);
+	if(format == CAPTURE_PNG){
+		BitmapImage image(width, height, 3, BitmapImage::ChannelType::CHANNELTYPE_BYTE);
+		unsigned char* dst = image.PeekDataAs<unsigned char>();
+		for(int y = 0; y < height; y++){
+			int row = bottomUp ? height - 1 - y : y;
+			std::memcpy(dst + y*rowBytes, pixels + row*rowBytes, rowBytes);
+		}
+		PngBitmapCodec codec;
+		codec.Image() = &image;
+		return codec.SaveToFile(file.c_str());
+	}
+	FILE* f = std::fopen(file.c_str(), "wb");
+	if(!f){
+		return false;
+	}
+	// PPM rows go from top to bottom, PFM rows from bottom to top (negative scale = little endian)
+	bool fileBottomUp = floatPixels;
+	if(floatPixels){
+		std::fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+	} else {
+		std::fprintf(f, "P6\n%d %d\n255\n", width, height);
+	}
+	bool ok = true;
+	for(int y = 0; y < height && ok; y++){
+		int row = bottomUp == fileBottomUp ? y : height - 1 - y;
+		ok = std::fwrite(pixels + row*rowBytes, 1, rowBytes, f) == rowBytes;
+	}
+	return std::fclose(f) == 0 && ok;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GPUResources.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** file format of the captured images */
+enum CaptureFormat {
+	CAPTURE_RAW = 0, //!< binary PPM (8 bit) or PFM (float, HDR color targets), written as read back
+	CAPTURE_PNG,     //!< 8 bit PNG (HDR values are clamped, not tone mapped)
+	CAPTURE_FORMAT_COUNT
+};
+
+/*
+ * Capture of the rendered frames (layer 0 of the color layers and optionally the 6 faces
+ * of the reflection cubemap) to image sequences without stalling the render loop.
+ *
+ * Every frame the images are read into a slot of a ring of pixel pack buffers with
+ * glReadPixels, which only queues the copy, and a fence is inserted. update() maps the
+ * buffers of the slots whose fence has signaled and hands them to the encoder thread,
+ * which writes the files straight from the mapped memory. Once a slot is written it is
+ * unmapped and reused. When all slots are still being read back or encoded, the frame
+ * is dropped (its number is skipped in the file names) and counted.
+ *
+ * The files are written to a directory per run: frame_000042.png for the camera view and
+ * frame_000042_posx.png, ... for the reflection faces (GL face order).
+ */
+class FrameCapture {
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	bool start(GPUResources& resources, const std::string& directory, CaptureFormat format, bool floatPixels, int numSlots = 4);
+	void stop(GPUResources& resources);
+	bool isRunning() const { return encoder.joinable(); }
+	const std::string& outputDirectory() const { return directory; }
+
+	void captureFrame(GPUResources& resources, GLuint colorLayers, int width, int height, GLuint cubeMap, int faceResolution);
+	void update();
+
+	uint64_t framesCaptured() const { return captured; }
+	uint64_t framesWritten() const { return written; }
+	uint64_t framesDropped() const { return dropped; }
+
+private:
+	enum SlotState {
+		SLOT_FREE = 0,  //!< may be read into
+		SLOT_READING,   //!< the readback was queued, waiting for the fence
+		SLOT_ENCODING,  //!< mapped, queued for or being written by the encoder
+		SLOT_DONE       //!< written, waiting to be unmapped
+	};
+
+	/** one frame of the ring */
+	typedef struct Slot_t {
+		GLuint pbo;             //!< pixel pack buffer of the camera view followed by the faces
+		size_t capacity;        //!< size of pbo
+		GLsync fence;           //!< signaled when the readback has finished
+		const unsigned char* pixels; //!< mapped pbo (while encoding)
+		uint64_t frame;         //!< number of the frame
+		int width, height;      //!< size of the camera view
+		int faceResolution;     //!< size of the faces (0 = no faces)
+		SlotState state;        //!< guarded by mutex
+		bool ok;                //!< files written without error (guarded by mutex)
+	} Slot;
+
+	void encoderLoop();
+	bool writeSlot(const Slot& slot);
+	bool writeImage(const std::string& file, const unsigned char* pixels, int width, int height, bool bottomUp);
+	void finishReadback(Slot& slot);
+
+	std::string directory;
+	CaptureFormat format;
+	bool floatPixels;   //!< read back as float (raw HDR), 8 bit otherwise
+	GLuint readFBO;     //!< framebuffer the layer or face to read is attached to
+	std::vector<Slot> slots;
+	size_t nextSlot;    //!< slot the next frame is read into if free
+	uint64_t frame;     //!< number of the next frame (counts dropped frames as well)
+	uint64_t captured;  //!< frames read back
+	uint64_t written;   //!< frames written (updated by update())
+	uint64_t failed;    //!< frames that could not be written (updated by update())
+	uint64_t dropped;   //!< frames dropped because no slot was free
+
+	std::thread encoder;
+	std::mutex mutex;
+	std::condition_variable wakeEncoder;
+	std::deque<size_t> encodeQueue;  //!< slots to write (guarded by mutex)
+	bool stopEncoder;                //!< finish the queue and exit (guarded by mutex)
+};
@@ -0,0 +1,139 @@
+// FrameDataRing.cpp
+//
+
+#include "FrameDataRing.h"
+#include "Trace.h"
+
+FrameDataRing::FrameDataRing() {
+	buffer = 0;
+	slotBytes = 0;
+	numSlots = 0;
+	slot = 0;
+	alignment = 256;
+	persistent = false;
+	mapped = nullptr;
+	for(int i = 0; i < maxSlots; i++){
+		fences[i] = 0;
+	}
+}
+
+FrameDataRing::~FrameDataRing() {
+	// GL objects are owned by the registry, see release()
+}
+
+/**
+ * Creates the uniform buffer with numSlots slots of at least slotBytes each.
+ * @return false if the buffer could not be mapped
+ */
+bool FrameDataRing::create(GPUResources& resources, size_t slotBytes, int numSlots) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "frame data create");
+	GLint align = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	alignment = align > 0 ? static_cast<size_t>(align) : 256;
+	this->numSlots = numSlots < 1 ? 1 : (numSlots > maxSlots ? maxSlots : numSlots);
+	this->slotBytes = this->align(slotBytes);
+	slot = 0;
+	size_t totalBytes = this->slotBytes*this->numSlots;
+
+	buffer = resources.createBuffer("frame data ring");
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	persistent = gl3wIsSupported(4, 4) || GPUResources::hasExtension("GL_ARB_buffer_storage");
+	if(persistent){
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, totalBytes, nullptr, flags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, totalBytes, flags));
+		if(!mapped){
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			resources.releaseBuffer(buffer);
+			TRACE_ERROR("frame data", "could not map %zu bytes persistently", totalBytes);
+			return false;
+		}
+	} else {
+		// written through a CPU copy of a slot and uploaded in flush()
+		glBufferData(GL_UNIFORM_BUFFER, totalBytes, nullptr, GL_STREAM_DRAW);
+		staging.resize(this->slotBytes);
+		TRACE_WARN("frame data", "persistent mapping not supported, uploading frame data");
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	resources.setBufferSize(buffer, totalBytes);
+	TRACE_INFO("frame data", "%d slots of %zu bytes (%s)", this->numSlots, this->slotBytes,
+			persistent ? "persistent" : "staged");
+	return true;
+}
+
+/** waits for the GPU to finish all frames in flight and deletes the buffer */
+void FrameDataRing::release(GPUResources& resources) {
+	for(int i = 0; i < maxSlots; i++){
+		if(fences[i]){
+			waitForSlot(i);
+		}
+	}
+	if(buffer && mapped){
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	mapped = nullptr;
+	resources.releaseBuffer(buffer);
+	staging.clear();
+	slotBytes = 0;
+}
+
+/**
+ * Makes sure that the slots hold at least slotBytes, growing the buffer by half
+ * of the requested size to avoid reallocating every frame while a scene grows.
+ * Has to be called before beginFrame().
+ */
+bool FrameDataRing::reserve(GPUResources& resources, size_t slotBytes) {
+	if(buffer && slotBytes <= this->slotBytes){
+		return true;
+	}
+	int slots = numSlots ? numSlots : 3;
+	release(resources);
+	return create(resources, slotBytes + slotBytes/2, slots);
+}
+
+/** blocks until the GPU has consumed the frame that used the slot last */
+void FrameDataRing::waitForSlot(int s) {
+	TRACE_SPAN(TRACE_LEVEL_INFO, "frame data wait");
+	GLenum status = glClientWaitSync(fences[s], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	while(status == GL_TIMEOUT_EXPIRED){
+		status = glClientWaitSync(fences[s], 0, 1000000000ull);
+	}
+	glDeleteSync(fences[s]);
+	fences[s] = 0;
+}
+
+/**
+ * Advances to the next slot and returns its memory for writing the frame data
+ * (slotBytes, offsets are relative to the slot). The memory may be written from
+ * any thread until flush() is called.
+ */
+unsigned char* FrameDataRing::beginFrame() {
+	slot = (slot + 1) % numSlots;
+	if(fences[slot]){
+		waitForSlot(slot);
+	}
+	return persistent ? mapped + slot*slotBytes : &staging[0];
+}
+
+/** makes the first bytes of the slot written since beginFrame() visible to the GPU */
+void FrameDataRing::flush(size_t bytes) {
+	if(persistent){
+		// coherent mapping, nothing to do
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, slot*slotBytes, bytes < slotBytes ? bytes : slotBytes, &staging[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/** fences the slot after the last command reading it has been issued */
+void FrameDataRing::endFrame() {
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/** binds a range of the current slot to a uniform block binding point (offset has to be aligned) */
+void FrameDataRing::bindRange(GLuint binding, size_t offset, size_t size) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, slot*slotBytes + offset, size);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GPUResources.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * Ring of per frame uniform data.
+ *
+ * A single uniform buffer is split into slots (3 by default), one per frame in flight.
+ * The data of a frame (uniform blocks in std140 layout) is written by the CPU into the
+ * slot of the frame, possibly from several threads, while the GPU still reads the slots
+ * of the previous frames. A fence is inserted after the last draw of a frame, before a
+ * slot is reused the CPU waits for the fence of the frame that used it last.
+ *
+ * With GL 4.4 (or ARB_buffer_storage) the buffer is allocated immutably and stays
+ * persistently and coherently mapped, so writing to the slot is all it takes. Otherwise
+ * the data is written to a CPU copy and uploaded with glBufferSubData by flush().
+ */
+class FrameDataRing {
+public:
+	FrameDataRing();
+	~FrameDataRing();
+
+	bool create(GPUResources& resources, size_t slotBytes, int numSlots = 3);
+	void release(GPUResources& resources);
+	bool isCreated() const { return buffer != 0; }
+	bool reserve(GPUResources& resources, size_t slotBytes);
+
+	unsigned char* beginFrame();
+	void flush(size_t bytes);
+	void endFrame();
+	void bindRange(GLuint binding, size_t offset, size_t size);
+
+	size_t align(size_t bytes) const { return (bytes + alignment - 1)/alignment*alignment; }
+	size_t getSlotBytes() const { return slotBytes; }
+	bool isPersistent() const { return persistent; }
+
+	static const int maxSlots = 4;
+
+private:
+	void waitForSlot(int s);
+
+	GLuint buffer;                    //!< uniform buffer holding all slots
+	size_t slotBytes;                 //!< size of a slot (multiple of the offset alignment)
+	int numSlots;                     //!< number of frames in flight
+	int slot;                         //!< slot of the current frame
+	size_t alignment;                 //!< GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	bool persistent;                  //!< buffer is persistently mapped (else written through staging)
+	unsigned char* mapped;            //!< persistent mapping of the whole buffer
+	std::vector<unsigned char> staging; //!< CPU copy of the current slot (without persistent mapping)
+	GLsync fences[maxSlots];          //!< fence of the last frame that used a slot
+};
@@ -0,0 +1,98 @@
+// FrameGovernor.cpp
+//
+
+#include "FrameGovernor.h"
+#include "Trace.h"
+
+FrameGovernor::FrameGovernor() {
+	for(int i = 0; i < numQueries; i++){
+		queries[i] = 0;
+		pending[i] = false;
+	}
+	next = 0;
+	active = false;
+	current = qualitySettings(1.0f, 1);
+	lastMs = 0.0f;
+}
+
+FrameGovernor::~FrameGovernor() {
+	// the queries are deleted in release() (needs the context)
+}
+
+/** starts timing a frame, the frame is not timed while all queries are still pending */
+void FrameGovernor::beginFrame() {
+	if(!queries[0]){
+		glGenQueries(numQueries, queries);
+	}
+	if(pending[next]){
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+	active = true;
+}
+
+/** ends timing the frame */
+void FrameGovernor::endFrame() {
+	if(!active){
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	active = false;
+	pending[next] = true;
+	next = (next + 1) % numQueries;
+}
+
+/**
+ * Reads the queries that have finished (oldest first, without waiting) and runs the
+ * controller for each of them.
+ * @param maxSubDivLevel  largest subdivision level the geometry shaders can emit
+ * @return true if the settings changed
+ */
+bool FrameGovernor::update(float targetMs, int maxSubDivLevel) {
+	QualitySettings previous = current;
+	for(int i = 0; i < numQueries; i++){
+		int query = (next + i) % numQueries;
+		if(!pending[query]){
+			continue;
+		}
+		GLint available = 0;
+		glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available){
+			break;
+		}
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &ns);
+		pending[query] = false;
+		lastMs = static_cast<float>(ns*1e-6);
+		governFrameTime(lastMs, targetMs, state);
+		TRACE_COUNTER(TRACE_LEVEL_INFO, "governor gpu ms", lastMs);
+		TRACE_COUNTER(TRACE_LEVEL_INFO, "governor quality", state.quality);
+	}
+	current = qualitySettings(state.quality, maxSubDivLevel);
+	if(current != previous){
+		TRACE_DEBUG("governor", "%.2f ms: subdivision %d, render scale %.3f, reflection every %d frame(s)",
+				lastMs, current.subDivLevel, current.renderScale, current.reflectionInterval);
+		return true;
+	}
+	return false;
+}
+
+/** starts again from the best settings */
+void FrameGovernor::reset(int maxSubDivLevel) {
+	state = GovernorState();
+	current = qualitySettings(state.quality, maxSubDivLevel);
+	lastMs = 0.0f;
+}
+
+/** deletes the queries */
+void FrameGovernor::release() {
+	if(queries[0]){
+		glDeleteQueries(numQueries, queries);
+	}
+	for(int i = 0; i < numQueries; i++){
+		queries[i] = 0;
+		pending[i] = false;
+	}
+	next = 0;
+	active = false;
+}
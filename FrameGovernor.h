@@ -0,0 +1,40 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "SceneMath.h"
+
+/*
+ * Frame time governor: measures the GPU time of the rendered frames and adjusts the
+ * quality settings (subdivision, render scale of the camera views, refresh interval of
+ * the reflection) to hold a target frame time.
+ *
+ * The frames are timed with GL_TIME_ELAPSED queries in a small ring, a query is read
+ * once its result is available (a few frames later), so measuring never waits for the
+ * GPU. Every new measurement runs the PI controller (governFrameTime) and maps its
+ * quality to the settings (qualitySettings).
+ */
+class FrameGovernor {
+public:
+	FrameGovernor();
+	~FrameGovernor();
+
+	void beginFrame();
+	void endFrame();
+	bool update(float targetMs, int maxSubDivLevel);
+	void reset(int maxSubDivLevel);
+	void release();
+
+	const QualitySettings& settings() const { return current; }
+	float gpuMs() const { return lastMs; }
+	float quality() const { return state.quality; }
+
+private:
+	static const int numQueries = 4;
+	GLuint queries[numQueries];  //!< timer queries of the last frames
+	bool pending[numQueries];    //!< query was ended and its result not read yet
+	int next;                    //!< query of the next frame
+	bool active;                 //!< a query of this frame is open
+	GovernorState state;
+	QualitySettings current;     //!< settings of the last update
+	float lastMs;                //!< last measured GPU time
+};
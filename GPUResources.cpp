@@ -0,0 +1,587 @@
+// GPUResources.cpp
+//
+
+#include "GPUResources.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+GPUResources::GPUResources() {
+	for(int i = 0; i < NUM_CATEGORIES; i++){
+		categoryBytes[i] = 0;
+	}
+}
+
+/**
+ * Destroying the registry releases everything that is still alive
+ * and deletes the programs and vertex arrays it parked.
+ */
+GPUResources::~GPUResources() {
+	releaseAll();
+	evictParked();
+}
+
+/**
+ * Generates a texture name and registers it (storage is accounted by setTextureStorage).
+ * @param cacheKey  identity of the contents, park() keeps the texture in the cache
+ */
+GLuint GPUResources::createTexture(Category category, const char* label, const std::string& cacheKey) {
+	GLuint tex = 0;
+	glGenTextures(1, &tex);
+	insert(KIND_TEXTURE, category, label, tex, nullptr, nullptr, 0, cacheKey);
+	return tex;
+}
+
+/** generates a framebuffer name and registers it */
+GLuint GPUResources::createFramebuffer(const char* label) {
+	GLuint fbo = 0;
+	glGenFramebuffers(1, &fbo);
+	insert(KIND_FRAMEBUFFER, CAT_FRAMEBUFFER, label, fbo, nullptr, nullptr, 0);
+	return fbo;
+}
+
+/** generates a buffer name and registers it (size is accounted by setBufferSize) */
+GLuint GPUResources::createBuffer(const char* label) {
+	GLuint buf = 0;
+	glGenBuffers(1, &buf);
+	insert(KIND_BUFFER, CAT_BUFFER, label, buf, nullptr, nullptr, 0);
+	return buf;
+}
+
+/** generates a vertex array name and registers it (the memory is the one of its buffers) */
+GLuint GPUResources::createVertexArray(const char* label) {
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	insert(KIND_VERTEXARRAY_NAME, CAT_BUFFER, label, vao, nullptr, nullptr, 0);
+	return vao;
+}
+
+/** registers a shader program, the registry will remove its shaders on release */
+void GPUResources::addProgram(GLShader* shader, const char* label, const std::string& cacheKey) {
+	insert(KIND_PROGRAM, CAT_PROGRAM, label, 0, shader, nullptr, 0, cacheKey);
+}
+
+/** registers a vertex array with the accumulated size of its buffers */
+void GPUResources::addVertexArray(VertexArray* va, const char* label, size_t bytes, const std::string& cacheKey) {
+	insert(KIND_VERTEXARRAY, CAT_BUFFER, label, 0, nullptr, va, bytes, cacheKey);
+}
+
+/**
+ * Takes a texture with the specified cache key from the GPUResourceCache and registers it again.
+ * @return the texture or 0 if it is not cached (create it with the key then)
+ */
+GLuint GPUResources::restoreTexture(const std::string& cacheKey) {
+	Entry e;
+	if(!GPUResourceCache::shared().take(cacheKey, nullptr, e)){
+		return 0;
+	}
+	insert(e);
+	return e.name;
+}
+
+/**
+ * Takes the program of the shader object from the GPUResourceCache if it was parked with
+ * the specified cache key and registers it again.
+ * @return false if the program has to be built (a program parked with another key is deleted)
+ */
+bool GPUResources::restoreProgram(GLShader* shader, const std::string& cacheKey) {
+	Entry e;
+	if(!GPUResourceCache::shared().take(cacheKey, shader, e)){
+		return false;
+	}
+	insert(e);
+	return true;
+}
+
+/**
+ * Takes the vertex array from the GPUResourceCache if it was parked with the specified
+ * cache key and registers it again.
+ * @return false if the vertex array has to be built (one parked with another key is deleted)
+ */
+bool GPUResources::restoreVertexArray(VertexArray* va, const std::string& cacheKey) {
+	Entry e;
+	if(!GPUResourceCache::shared().take(cacheKey, va, e)){
+		return false;
+	}
+	insert(e);
+	return true;
+}
+
+/**
+ * Hands every object registered with a cache key to the GPUResourceCache instead of
+ * deleting it, the other objects stay registered. Releasing a parked object through
+ * the registry does nothing (besides clearing the handle).
+ * @return number of parked objects
+ */
+size_t GPUResources::park() {
+	GPUResourceCache& cache = GPUResourceCache::shared();
+	size_t numParked = 0;
+	size_t parkedBytes = 0;
+	std::map<Key, Entry>::iterator it = entries.begin();
+	while(it != entries.end()){
+		const Entry& e = it->second;
+		if(e.cacheKey.empty()){
+			++it;
+			continue;
+		}
+		cache.put(this, e);
+		categoryBytes[e.category] -= e.bytes;
+		parkedBytes += e.bytes;
+		numParked++;
+		it = entries.erase(it);
+	}
+	TRACE_INFO("cache", "parked %u objects (%.2f MB), cache holds %.2f MB", static_cast<unsigned>(numParked),
+			parkedBytes/(1024.0*1024.0), cache.bytes()/(1024.0*1024.0));
+	return numParked;
+}
+
+/**
+ * Deletes the programs and vertex arrays this registry parked, has to be called before
+ * the shader and vertex array objects are destroyed.
+ */
+void GPUResources::evictParked() {
+	GPUResourceCache::shared().evictOwner(this);
+}
+
+/**
+ * Sets the memory estimate of a registered texture from its storage description.
+ * For cubemaps layers has to be 6.
+ */
+void GPUResources::setTextureStorage(GLuint tex, GLenum internalFormat, int width, int height, int layers, int levels) {
+	std::map<Key, Entry>::iterator it = entries.find(keyOf(KIND_TEXTURE, tex));
+	if(it == entries.end()){
+		return;
+	}
+	Entry& e = it->second;
+	categoryBytes[e.category] -= e.bytes;
+	e.bytes = estimateTextureBytes(internalFormat, width, height, layers, levels);
+	categoryBytes[e.category] += e.bytes;
+}
+
+/** sets the memory estimate of a registered buffer */
+void GPUResources::setBufferSize(GLuint buf, size_t bytes) {
+	std::map<Key, Entry>::iterator it = entries.find(keyOf(KIND_BUFFER, buf));
+	if(it == entries.end()){
+		return;
+	}
+	Entry& e = it->second;
+	categoryBytes[e.category] -= e.bytes;
+	e.bytes = bytes;
+	categoryBytes[e.category] += e.bytes;
+}
+
+/** deletes the texture and sets the handle to 0 */
+void GPUResources::releaseTexture(GLuint& tex) {
+	if(tex){
+		release(keyOf(KIND_TEXTURE, tex));
+		tex = 0;
+	}
+}
+
+/** deletes the framebuffer and sets the handle to 0 */
+void GPUResources::releaseFramebuffer(GLuint& fbo) {
+	if(fbo){
+		release(keyOf(KIND_FRAMEBUFFER, fbo));
+		fbo = 0;
+	}
+}
+
+/** deletes the buffer and sets the handle to 0 */
+void GPUResources::releaseBuffer(GLuint& buf) {
+	if(buf){
+		release(keyOf(KIND_BUFFER, buf));
+		buf = 0;
+	}
+}
+
+/** releases the program and removes all its shaders */
+void GPUResources::releaseProgram(GLShader* shader) {
+	release(keyOf(KIND_PROGRAM, shader));
+}
+
+/** deletes the vertex array and its buffers */
+void GPUResources::releaseVertexArray(VertexArray* va) {
+	release(keyOf(KIND_VERTEXARRAY, va));
+}
+
+/** deletes the vertex array (not its buffers) and sets the handle to 0 */
+void GPUResources::releaseVertexArray(GLuint& vao) {
+	if(vao){
+		release(keyOf(KIND_VERTEXARRAY_NAME, vao));
+		vao = 0;
+	}
+}
+
+/**
+ * Releases every object that is still registered and reports each of them
+ * (objects still alive at this point were not released by their owner).
+ * @return number of objects that were still alive
+ */
+size_t GPUResources::releaseAll(FILE* report) {
+	size_t numAlive = entries.size();
+	if(numAlive && report){
+		std::fprintf(report, "GPUResources: %u object(s) still alive:\n", static_cast<unsigned>(numAlive));
+	}
+	for(std::map<Key, Entry>::iterator it = entries.begin(); it != entries.end(); ++it){
+		const Entry& e = it->second;
+		if(report){
+			std::fprintf(report, "  %-13s '%s' (name %u, %.2f MB)\n",
+					categoryName(e.category), e.label.c_str(), e.name, e.bytes/(1024.0*1024.0));
+		}
+		destroy(e);
+	}
+	entries.clear();
+	for(int i = 0; i < NUM_CATEGORIES; i++){
+		categoryBytes[i] = 0;
+	}
+	return numAlive;
+}
+
+/** estimated memory of all living objects of the specified category */
+size_t GPUResources::bytes(Category category) const {
+	return categoryBytes[category];
+}
+
+/** estimated memory of a registered texture (0 if it is not registered) */
+size_t GPUResources::textureBytes(GLuint tex) const {
+	std::map<Key, Entry>::const_iterator it = entries.find(keyOf(KIND_TEXTURE, tex));
+	return it == entries.end() ? 0 : it->second.bytes;
+}
+
+/** estimated memory of all living objects */
+size_t GPUResources::totalBytes() const {
+	size_t sum = 0;
+	for(int i = 0; i < NUM_CATEGORIES; i++){
+		sum += categoryBytes[i];
+	}
+	return sum;
+}
+
+/** number of living objects of the specified category */
+size_t GPUResources::count(Category category) const {
+	size_t n = 0;
+	for(std::map<Key, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it){
+		if(it->second.category == category){
+			n++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Returns the number of bytes a single texel of the specified internal format
+ * occupies in video memory. 3 component formats are assumed to be padded to 4
+ * components as most drivers do.
+ */
+size_t GPUResources::bytesPerTexel(GLenum internalFormat) {
+	switch(internalFormat){
+		case GL_R8:
+		case GL_STENCIL_INDEX8:
+			return 1;
+		case GL_R16F:
+		case GL_RG8:
+		case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RGB:
+		case GL_RGB8:
+		case GL_RGBA:
+		case GL_RGBA8:
+		case GL_R32F:
+		case GL_R32UI:
+		case GL_RG16F:
+		case GL_R11F_G11F_B10F:
+		case GL_RGB10_A2:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:
+			return 4;
+		case GL_RGB16F:
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGB32F:
+		case GL_RGBA32F:
+			return 16;
+		default:
+			return 4;
+	}
+}
+
+/** bytes per 4x4 block of a block compressed format (0 for uncompressed formats) */
+size_t GPUResources::bytesPerBlock(GLenum internalFormat) {
+	switch(internalFormat){
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			return 8;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Estimates the memory footprint of a texture with the specified storage.
+ * The mip chain is accumulated over the number of levels, each level
+ * being half the size of the previous one. Block compressed levels
+ * are rounded up to whole 4x4 blocks.
+ */
+size_t GPUResources::estimateTextureBytes(GLenum internalFormat, int width, int height, int layers, int levels) {
+	size_t bpb = bytesPerBlock(internalFormat);
+	size_t bpt = bytesPerTexel(internalFormat);
+	size_t sum = 0;
+	for(int level = 0; level < levels; level++){
+		size_t w = static_cast<size_t>(std::max(1, width >> level));
+		size_t h = static_cast<size_t>(std::max(1, height >> level));
+		if(bpb){
+			sum += ((w+3)/4)*((h+3)/4)*layers*bpb;
+		} else {
+			sum += w*h*layers*bpt;
+		}
+	}
+	return sum;
+}
+
+/** checks the extension list of the current context */
+bool GPUResources::hasExtension(const char* extension) {
+	GLint numExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+	for(GLint i = 0; i < numExtensions; i++){
+		const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if(name && std::strcmp(name, extension) == 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+/** human readable name of a category */
+const char* GPUResources::categoryName(Category category) {
+	switch(category){
+		case CAT_TEXTURE:      return "texture";
+		case CAT_RENDERTARGET: return "render target";
+		case CAT_BUFFER:       return "buffer";
+		case CAT_FRAMEBUFFER:  return "framebuffer";
+		case CAT_PROGRAM:      return "program";
+		default:               return "unknown";
+	}
+}
+
+/** key of the object described by the entry */
+GPUResources::Key GPUResources::keyOf(const Entry& e) {
+	switch(e.kind){
+		case KIND_PROGRAM:     return keyOf(e.kind, e.shader);
+		case KIND_VERTEXARRAY: return keyOf(e.kind, e.va);
+		default:               return keyOf(e.kind, e.name);
+	}
+}
+
+void GPUResources::insert(Kind kind, Category category, const char* label, GLuint name, GLShader* shader, VertexArray* va, size_t bytes,
+		const std::string& cacheKey) {
+	Entry e;
+	e.kind = kind;
+	e.category = category;
+	e.label = label;
+	e.bytes = bytes;
+	e.name = name;
+	e.shader = shader;
+	e.va = va;
+	e.cacheKey = cacheKey;
+	insert(e);
+}
+
+void GPUResources::insert(const Entry& e) {
+	// re-registering an object replaces the old entry (e.g. reloaded shaders)
+	Key key = keyOf(e);
+	std::map<Key, Entry>::iterator it = entries.find(key);
+	if(it != entries.end()){
+		categoryBytes[it->second.category] -= it->second.bytes;
+		entries.erase(it);
+	}
+	entries[key] = e;
+	categoryBytes[e.category] += e.bytes;
+}
+
+/** deletes the GL object described by the entry */
+void GPUResources::destroy(const Entry& e) {
+	switch(e.kind){
+		case KIND_TEXTURE:
+			glDeleteTextures(1, &e.name);
+			break;
+		case KIND_FRAMEBUFFER:
+			glDeleteFramebuffers(1, &e.name);
+			break;
+		case KIND_BUFFER:
+			glDeleteBuffers(1, &e.name);
+			break;
+		case KIND_PROGRAM:
+			e.shader->Release();
+			e.shader->RemoveAllShaders();
+			break;
+		case KIND_VERTEXARRAY:
+			e.va->Delete();
+			break;
+		case KIND_VERTEXARRAY_NAME:
+			glDeleteVertexArrays(1, &e.name);
+			break;
+	}
+}
+
+void GPUResources::release(const Key& key) {
+	std::map<Key, Entry>::iterator it = entries.find(key);
+	if(it == entries.end()){
+		return;
+	}
+	categoryBytes[it->second.category] -= it->second.bytes;
+	destroy(it->second);
+	entries.erase(it);
+}
+
+/** the cache shared by all plugins of the process */
+GPUResourceCache& GPUResourceCache::shared() {
+	static GPUResourceCache cache;
+	return cache;
+}
+
+GPUResourceCache::GPUResourceCache() {
+	parkedBytes = 0;
+	maxBytes = 256*1024*1024;
+	maxIdle = 600.0;
+	numHits = numMisses = 0;
+}
+
+/** sets the memory limit and deletes the objects parked first until the cache is within it */
+void GPUResourceCache::setLimit(size_t bytes) {
+	maxBytes = bytes;
+	trim(maxBytes);
+}
+
+/** sets the time an object stays parked */
+void GPUResourceCache::setIdleSeconds(double seconds) {
+	maxIdle = seconds;
+	evictIdle();
+}
+
+/** deletes the objects that were parked longer than idleSeconds() */
+void GPUResourceCache::evictIdle() {
+	double limit = now() - maxIdle;
+	std::map<std::string, Parked>::iterator it = parked.begin();
+	while(it != parked.end()){
+		std::map<std::string, Parked>::iterator next = it;
+		++next;
+		if(it->second.time < limit){
+			TRACE_DEBUG("cache", "evicting idle %s", it->first.c_str());
+			erase(it);
+		}
+		it = next;
+	}
+}
+
+/** deletes all parked objects */
+void GPUResourceCache::clear() {
+	while(!parked.empty()){
+		erase(parked.begin());
+	}
+}
+
+/** parks an object, an object parked with the same key before is deleted */
+void GPUResourceCache::put(const GPUResources* owner, const GPUResources::Entry& e) {
+	evictIdle();
+	std::map<std::string, Parked>::iterator it = parked.find(e.cacheKey);
+	if(it != parked.end()){
+		erase(it);
+	}
+	Parked p;
+	p.entry = e;
+	p.owner = owner;
+	p.time = now();
+	parked[e.cacheKey] = p;
+	parkedBytes += e.bytes;
+	trim(maxBytes);
+}
+
+/**
+ * Removes the object with the key from the cache.
+ * @param object  shader or vertex array object the entry has to belong to (nullptr for textures),
+ *                on a miss the object's parked entry is deleted
+ * @return false if there is no such object
+ */
+bool GPUResourceCache::take(const std::string& key, const void* object, GPUResources::Entry& e) {
+	evictIdle();
+	std::map<std::string, Parked>::iterator it = parked.find(key);
+	if(it != parked.end()){
+		const GPUResources::Entry& found = it->second.entry;
+		const void* foundObject = found.kind == GPUResources::KIND_PROGRAM ? static_cast<const void*>(found.shader)
+				: found.kind == GPUResources::KIND_VERTEXARRAY ? static_cast<const void*>(found.va) : nullptr;
+		if(foundObject == object){
+			e = found;
+			parkedBytes -= found.bytes;
+			parked.erase(it);
+			numHits++;
+			return true;
+		}
+	}
+	numMisses++;
+	if(object){
+		evictObject(object);
+	}
+	return false;
+}
+
+/** deletes the parked entry of a shader or vertex array object */
+void GPUResourceCache::evictObject(const void* object) {
+	std::map<std::string, Parked>::iterator it = parked.begin();
+	while(it != parked.end()){
+		std::map<std::string, Parked>::iterator next = it;
+		++next;
+		const GPUResources::Entry& e = it->second.entry;
+		if(e.shader == object || e.va == object){
+			erase(it);
+		}
+		it = next;
+	}
+}
+
+/** deletes the programs and vertex arrays parked by a registry */
+void GPUResourceCache::evictOwner(const GPUResources* owner) {
+	std::map<std::string, Parked>::iterator it = parked.begin();
+	while(it != parked.end()){
+		std::map<std::string, Parked>::iterator next = it;
+		++next;
+		const GPUResources::Entry& e = it->second.entry;
+		if(it->second.owner == owner && (e.shader || e.va)){
+			erase(it);
+		}
+		it = next;
+	}
+}
+
+/** deletes the objects parked first until the parked objects occupy at most the specified memory */
+void GPUResourceCache::trim(size_t bytes) {
+	while(parkedBytes > bytes){
+		std::map<std::string, Parked>::iterator oldest = parked.begin();
+		for(std::map<std::string, Parked>::iterator it = parked.begin(); it != parked.end(); ++it){
+			if(it->second.time < oldest->second.time){
+				oldest = it;
+			}
+		}
+		TRACE_DEBUG("cache", "evicting %s (%.2f MB over the limit)", oldest->first.c_str(),
+				(parkedBytes - bytes)/(1024.0*1024.0));
+		erase(oldest);
+	}
+}
+
+void GPUResourceCache::erase(std::map<std::string, Parked>::iterator it) {
+	parkedBytes -= it->second.entry.bytes;
+	GPUResources::destroy(it->second.entry);
+	parked.erase(it);
+}
+
+/** seconds of a monotonic clock */
+double GPUResourceCache::now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "VertexArray.h"
+#include <cstdio>
+#include <map>
+#include <string>
+
+// S3TC is an extension and not part of the core profile headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+
+/**
+ * Registry that owns the GL objects created by the plugin (textures, framebuffers,
+ * buffers, vertex arrays and shader programs).
+ * Every object is registered together with a label, a category and an estimate
+ * of the video memory it occupies, so that memory usage can be queried per category.
+ * Objects are released through the registry, anything that is still registered
+ * when releaseAll() is called (or the registry is destroyed) is reported as a leak.
+ * Objects registered with a cache key (the identity of their contents, e.g. file and
+ * modification time or a hash of the shader sources) are handed to the process wide
+ * GPUResourceCache by park() instead of being deleted, restoreTexture(), restoreProgram()
+ * and restoreVertexArray() take them back.
+ */
+class GPUResources {
+public:
+	/** memory accounting categories */
+	enum Category {
+		CAT_TEXTURE = 0,   //!< textures loaded from disk (skyboxes etc.)
+		CAT_RENDERTARGET,  //!< textures used as FBO attachments
+		CAT_BUFFER,        //!< buffer objects and vertex arrays
+		CAT_FRAMEBUFFER,   //!< framebuffer objects (no memory of their own)
+		CAT_PROGRAM,       //!< shader programs (memory not accounted)
+		NUM_CATEGORIES
+	};
+
+	GPUResources();
+	~GPUResources();
+
+	GLuint createTexture(Category category, const char* label, const std::string& cacheKey = std::string());
+	GLuint createFramebuffer(const char* label);
+	GLuint createBuffer(const char* label);
+	GLuint createVertexArray(const char* label);
+	void addProgram(GLShader* shader, const char* label, const std::string& cacheKey = std::string());
+	void addVertexArray(VertexArray* va, const char* label, size_t bytes, const std::string& cacheKey = std::string());
+
+	GLuint restoreTexture(const std::string& cacheKey);
+	bool restoreProgram(GLShader* shader, const std::string& cacheKey);
+	bool restoreVertexArray(VertexArray* va, const std::string& cacheKey);
+	size_t park();
+	void evictParked();
+
+	void setTextureStorage(GLuint tex, GLenum internalFormat, int width, int height, int layers, int levels);
+	void setBufferSize(GLuint buf, size_t bytes);
+
+	void releaseTexture(GLuint& tex);
+	void releaseFramebuffer(GLuint& fbo);
+	void releaseBuffer(GLuint& buf);
+	void releaseProgram(GLShader* shader);
+	void releaseVertexArray(VertexArray* va);
+	void releaseVertexArray(GLuint& vao);
+
+	size_t releaseAll(FILE* report = stderr);
+
+	size_t bytes(Category category) const;
+	size_t totalBytes() const;
+	size_t textureBytes(GLuint tex) const;
+	size_t count(Category category) const;
+
+	static size_t bytesPerTexel(GLenum internalFormat);
+	static size_t bytesPerBlock(GLenum internalFormat);
+	static size_t estimateTextureBytes(GLenum internalFormat, int width, int height, int layers, int levels);
+	static const char* categoryName(Category category);
+	static bool hasExtension(const char* extension);
+
+private:
+	friend class GPUResourceCache;
+
+	/** kind of GL object, determines how an entry is deleted */
+	enum Kind { KIND_TEXTURE, KIND_FRAMEBUFFER, KIND_BUFFER, KIND_PROGRAM, KIND_VERTEXARRAY, KIND_VERTEXARRAY_NAME };
+
+	/** registry entry describing a single GL object */
+	typedef struct Entry_t {
+		Kind kind;            //!< kind of object
+		Category category;    //!< accounting category
+		std::string label;    //!< human readable label for reports
+		size_t bytes;         //!< estimated memory footprint
+		GLuint name;          //!< GL name (0 for programs and VertexArray objects)
+		GLShader* shader;     //!< shader object (programs only)
+		VertexArray* va;      //!< vertex array object (vertex arrays only)
+		std::string cacheKey; //!< identity in the GPUResourceCache (empty = deleted on release)
+	} Entry;
+
+	typedef std::pair<int, const void*> Key;
+
+	static Key keyOf(Kind kind, GLuint name) { return Key(kind, reinterpret_cast<const void*>(static_cast<size_t>(name))); }
+	static Key keyOf(Kind kind, const void* ptr) { return Key(kind, ptr); }
+	static Key keyOf(const Entry& e);
+
+	void insert(Kind kind, Category category, const char* label, GLuint name, GLShader* shader, VertexArray* va, size_t bytes,
+			const std::string& cacheKey = std::string());
+	void insert(const Entry& e);
+	static void destroy(const Entry& e);
+	void release(const Key& key);
+
+	std::map<Key, Entry> entries; //!< all living objects
+	size_t categoryBytes[NUM_CATEGORIES]; //!< accumulated memory per category
+};
+
+/*
+ * Process wide cache of the GL objects parked by the registries (GPUResources::park()).
+ * OGL4Core keeps its GL context while the user switches between plugins, a plugin that
+ * parks its objects in Deactivate() finds them again in Activate() instead of decoding
+ * the textures, compiling the programs and uploading the geometry once more.
+ *
+ * Objects are identified by their cache key. Textures are plain GL names and can be taken
+ * by any registry, programs and vertex arrays live in an object of the plugin and are only
+ * handed back for that object (a miss deletes the parked one, the object is rebuilt).
+ * The cache holds at most limit() bytes, the objects parked first are deleted first, and
+ * deletes the objects that were parked longer than idleSeconds(). There is no timer, the
+ * idle objects are evicted whenever the cache is accessed.
+ * The cache is never destroyed explicitly, the GL context takes the remaining objects.
+ */
+class GPUResourceCache {
+public:
+	static GPUResourceCache& shared();
+
+	void setLimit(size_t bytes);
+	void setIdleSeconds(double seconds);
+	size_t limit() const { return maxBytes; }
+	double idleSeconds() const { return maxIdle; }
+
+	size_t bytes() const { return parkedBytes; }
+	size_t count() const { return parked.size(); }
+	unsigned int hits() const { return numHits; }
+	unsigned int misses() const { return numMisses; }
+
+	void evictIdle();
+	void clear();
+
+private:
+	friend class GPUResources;
+
+	/** object in the cache */
+	typedef struct Parked_t {
+		GPUResources::Entry entry;  //!< registry entry of the object
+		const GPUResources* owner;  //!< registry that parked it
+		double time;                //!< when it was parked (seconds)
+	} Parked;
+
+	GPUResourceCache();
+
+	void put(const GPUResources* owner, const GPUResources::Entry& e);
+	bool take(const std::string& key, const void* object, GPUResources::Entry& e);
+	void evictObject(const void* object);
+	void evictOwner(const GPUResources* owner);
+	void trim(size_t bytes);
+	void erase(std::map<std::string, Parked>::iterator it);
+	static double now();
+
+	std::map<std::string, Parked> parked; //!< objects by cache key
+	size_t parkedBytes;      //!< estimated memory of the parked objects
+	size_t maxBytes;         //!< memory limit
+	double maxIdle;          //!< seconds an object stays parked
+	unsigned int numHits;    //!< objects taken back
+	unsigned int numMisses;  //!< lookups that found nothing usable
+};
@@ -0,0 +1,497 @@
+// HDRImage.cpp
+//
+
+#include "HDRImage.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "zlib.h"
+
+/** reads a whole file into memory */
+static bool readFile(const std::string& filepath, std::vector<unsigned char>& data) {
+	std::ifstream in(filepath.c_str(), std::ios::binary);
+	if(!in.is_open()){
+		std::fprintf(stderr, "could not load file, so sorry [%s]\n", filepath.c_str());
+		return false;
+	}
+	in.seekg(0, std::ios::end);
+	std::streamoff size = in.tellg();
+	in.seekg(0, std::ios::beg);
+	data.resize(static_cast<size_t>(size));
+	if(size > 0){
+		in.read(reinterpret_cast<char*>(&data[0]), size);
+	}
+	return in.good() || in.eof();
+}
+
+/** converts a single RGBE pixel to linear float RGB */
+static void rgbeToFloat(const unsigned char rgbe[4], float* rgb) {
+	if(rgbe[3] == 0){
+		rgb[0] = rgb[1] = rgb[2] = 0.0f;
+		return;
+	}
+	float f = std::ldexp(1.0f, static_cast<int>(rgbe[3]) - (128+8));
+	rgb[0] = (rgbe[0]+0.5f)*f;
+	rgb[1] = (rgbe[1]+0.5f)*f;
+	rgb[2] = (rgbe[2]+0.5f)*f;
+}
+
+/**
+ * Decodes a Radiance RGBE (.hdr) file. Supports flat, old style and new style
+ * run length encoded scanlines in the standard -Y +X orientation (other
+ * orientations with +Y are flipped vertically).
+ */
+bool loadRadianceHDR(const std::string& filepath, FloatImage& image) {
+	std::vector<unsigned char> data;
+	if(!readFile(filepath, data)){
+		return false;
+	}
+	size_t pos = 0;
+	// header lines until an empty line
+	std::string line;
+	bool formatOK = true;
+	bool magicOK = false;
+	while(pos < data.size()){
+		size_t end = pos;
+		while(end < data.size() && data[end] != '\n'){
+			end++;
+		}
+		line.assign(reinterpret_cast<const char*>(&data[pos]), end-pos);
+		pos = end+1;
+		if(line.compare(0, 2, "#?") == 0){
+			magicOK = true;
+		}
+		if(line.compare(0, 7, "FORMAT=") == 0){
+			formatOK = line == "FORMAT=32-bit_rle_rgbe";
+		}
+		if(line.empty()){
+			break;
+		}
+	}
+	if(!magicOK || !formatOK){
+		std::fprintf(stderr, "not a RGBE radiance file [%s]\n", filepath.c_str());
+		return false;
+	}
+	// resolution line, e.g. "-Y 512 +X 512"
+	size_t end = pos;
+	while(end < data.size() && data[end] != '\n'){
+		end++;
+	}
+	line.assign(reinterpret_cast<const char*>(&data[pos]), end-pos);
+	pos = end+1;
+	char ySign, xSign, yAxis, xAxis;
+	int height, width;
+	if(std::sscanf(line.c_str(), "%c%c %d %c%c %d", &ySign, &yAxis, &height, &xSign, &xAxis, &width) != 6
+			|| yAxis != 'Y' || xAxis != 'X' || width <= 0 || height <= 0){
+		std::fprintf(stderr, "unsupported resolution line '%s' [%s]\n", line.c_str(), filepath.c_str());
+		return false;
+	}
+	bool flipY = ySign == '+';
+
+	image.width = width;
+	image.height = height;
+	image.rgb.resize(static_cast<size_t>(width)*height*3);
+	std::vector<unsigned char> scanline(static_cast<size_t>(width)*4);
+	for(int y = 0; y < height; y++){
+		if(pos+4 > data.size()){
+			std::fprintf(stderr, "unexpected end of file [%s]\n", filepath.c_str());
+			return false;
+		}
+		const unsigned char* p = &data[pos];
+		if(width >= 8 && width < 32768 && p[0] == 2 && p[1] == 2 && ((p[2]<<8)|p[3]) == width){
+			// new style RLE, each component stored separately
+			pos += 4;
+			for(int c = 0; c < 4; c++){
+				int x = 0;
+				while(x < width){
+					if(pos >= data.size()){
+						std::fprintf(stderr, "unexpected end of file [%s]\n", filepath.c_str());
+						return false;
+					}
+					int count = data[pos++];
+					if(count > 128){
+						// run
+						count -= 128;
+						if(count > width-x || pos >= data.size()){
+							std::fprintf(stderr, "bad scanline data [%s]\n", filepath.c_str());
+							return false;
+						}
+						unsigned char value = data[pos++];
+						for(int i = 0; i < count; i++){
+							scanline[(x++)*4+c] = value;
+						}
+					} else {
+						// literal
+						if(count == 0 || count > width-x || pos+count > data.size()){
+							std::fprintf(stderr, "bad scanline data [%s]\n", filepath.c_str());
+							return false;
+						}
+						for(int i = 0; i < count; i++){
+							scanline[(x++)*4+c] = data[pos++];
+						}
+					}
+				}
+			}
+		} else {
+			// flat pixels with old style run length encoding (1,1,1,count)
+			int x = 0;
+			int shift = 0;
+			while(x < width){
+				if(pos+4 > data.size()){
+					std::fprintf(stderr, "unexpected end of file [%s]\n", filepath.c_str());
+					return false;
+				}
+				const unsigned char* px = &data[pos];
+				pos += 4;
+				if(px[0] == 1 && px[1] == 1 && px[2] == 1 && x > 0){
+					int count = px[3] << shift;
+					for(int i = 0; i < count && x < width; i++, x++){
+						std::memcpy(&scanline[x*4], &scanline[(x-1)*4], 4);
+					}
+					shift += 8;
+				} else {
+					std::memcpy(&scanline[(x++)*4], px, 4);
+					shift = 0;
+				}
+			}
+		}
+		int row = flipY ? height-1-y : y;
+		float* dst = &image.rgb[static_cast<size_t>(row)*width*3];
+		for(int x = 0; x < width; x++){
+			rgbeToFloat(&scanline[x*4], dst + x*3);
+		}
+	}
+	return true;
+}
+
+/** little endian reads */
+static uint32_t readU32(const unsigned char* p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16) | (static_cast<uint32_t>(p[3])<<24);
+}
+static uint64_t readU64(const unsigned char* p) {
+	return readU32(p) | (static_cast<uint64_t>(readU32(p+4)) << 32);
+}
+
+/** EXR channel as declared in the 'channels' header attribute */
+typedef struct ExrChannel_t {
+	std::string name; //!< channel name
+	int pixelType;    //!< 0 = uint, 1 = half, 2 = float
+	int xSampling;    //!< horizontal subsampling (only 1 supported)
+	int ySampling;    //!< vertical subsampling (only 1 supported)
+} ExrChannel;
+
+/** undoes the byte delta predictor and interleaving used by ZIP and RLE compression */
+static void exrReconstruct(std::vector<unsigned char>& buf) {
+	size_t n = buf.size();
+	for(size_t i = 1; i < n; i++){
+		buf[i] = static_cast<unsigned char>(buf[i-1] + buf[i] - 128);
+	}
+	std::vector<unsigned char> tmp(n);
+	size_t half = (n+1)/2;
+	for(size_t i = 0; i < n; i++){
+		tmp[i] = (i%2 == 0) ? buf[i/2] : buf[half + i/2];
+	}
+	buf.swap(tmp);
+}
+
+/**
+ * Decodes a scanline OpenEXR file with NO, RLE, ZIPS or ZIP compression
+ * and HALF or FLOAT channels. R, G and B channels are read, a single
+ * Y channel is replicated to gray. Tiled and PIZ/PXR24/B44 compressed
+ * files are not supported.
+ */
+bool loadOpenEXR(const std::string& filepath, FloatImage& image) {
+	std::vector<unsigned char> data;
+	if(!readFile(filepath, data)){
+		return false;
+	}
+	if(data.size() < 8 || readU32(&data[0]) != 20000630){
+		std::fprintf(stderr, "not an OpenEXR file [%s]\n", filepath.c_str());
+		return false;
+	}
+	uint32_t version = readU32(&data[4]);
+	if((version & 0xff) != 2 || (version & 0x200) || (version & 0x1000)){
+		std::fprintf(stderr, "unsupported OpenEXR flavour (tiled/multipart/deep) [%s]\n", filepath.c_str());
+		return false;
+	}
+	// parse header attributes
+	size_t pos = 8;
+	std::vector<ExrChannel> channels;
+	int compression = -1;
+	int xMin = 0, yMin = 0, xMax = -1, yMax = -1;
+	while(pos < data.size() && data[pos] != 0){
+		std::string name(reinterpret_cast<const char*>(&data[pos]));
+		pos += name.size()+1;
+		if(pos >= data.size()) break;
+		std::string type(reinterpret_cast<const char*>(&data[pos]));
+		pos += type.size()+1;
+		if(pos+4 > data.size()) break;
+		uint32_t size = readU32(&data[pos]);
+		pos += 4;
+		if(pos+size > data.size()) break;
+		const unsigned char* value = &data[pos];
+		if(name == "channels" && type == "chlist"){
+			size_t p = 0;
+			while(p < size && value[p] != 0){
+				ExrChannel ch;
+				ch.name = std::string(reinterpret_cast<const char*>(value+p));
+				p += ch.name.size()+1;
+				ch.pixelType = static_cast<int>(readU32(value+p));
+				ch.xSampling = static_cast<int>(readU32(value+p+8));
+				ch.ySampling = static_cast<int>(readU32(value+p+12));
+				p += 16;
+				channels.push_back(ch);
+			}
+		} else if(name == "compression" && type == "compression"){
+			compression = value[0];
+		} else if(name == "dataWindow" && type == "box2i"){
+			xMin = static_cast<int>(readU32(value));
+			yMin = static_cast<int>(readU32(value+4));
+			xMax = static_cast<int>(readU32(value+8));
+			yMax = static_cast<int>(readU32(value+12));
+		}
+		pos += size;
+	}
+	pos++; // end of header
+	int width = xMax-xMin+1;
+	int height = yMax-yMin+1;
+	if(channels.empty() || width <= 0 || height <= 0){
+		std::fprintf(stderr, "incomplete OpenEXR header [%s]\n", filepath.c_str());
+		return false;
+	}
+	int linesPerBlock = 0;
+	switch(compression){
+		case 0: // NO_COMPRESSION
+		case 1: // RLE_COMPRESSION
+		case 2: // ZIPS_COMPRESSION
+			linesPerBlock = 1;
+			break;
+		case 3: // ZIP_COMPRESSION
+			linesPerBlock = 16;
+			break;
+		default:
+			std::fprintf(stderr, "unsupported OpenEXR compression %d [%s]\n", compression, filepath.c_str());
+			return false;
+	}
+	// byte offsets of the channels within a scanline, channels are stored alphabetically
+	int target[4] = {-1,-1,-1,-1}; // channel index for R,G,B,Y
+	size_t lineBytes = 0;
+	std::vector<size_t> channelOffset(channels.size());
+	for(size_t c = 0; c < channels.size(); c++){
+		if(channels[c].xSampling != 1 || channels[c].ySampling != 1){
+			std::fprintf(stderr, "subsampled OpenEXR channels are not supported [%s]\n", filepath.c_str());
+			return false;
+		}
+		channelOffset[c] = lineBytes;
+		lineBytes += static_cast<size_t>(width) * (channels[c].pixelType == 1 ? 2 : 4);
+		const std::string& n = channels[c].name;
+		if(n == "R") target[0] = static_cast<int>(c);
+		if(n == "G") target[1] = static_cast<int>(c);
+		if(n == "B") target[2] = static_cast<int>(c);
+		if(n == "Y") target[3] = static_cast<int>(c);
+	}
+	if(target[0] < 0 || target[1] < 0 || target[2] < 0){
+		if(target[3] < 0){
+			std::fprintf(stderr, "OpenEXR file has neither RGB nor Y channels [%s]\n", filepath.c_str());
+			return false;
+		}
+		target[0] = target[1] = target[2] = target[3];
+	}
+
+	image.width = width;
+	image.height = height;
+	image.rgb.assign(static_cast<size_t>(width)*height*3, 0.0f);
+	int numBlocks = (height + linesPerBlock-1)/linesPerBlock;
+	if(pos + numBlocks*8 > data.size()){
+		std::fprintf(stderr, "truncated OpenEXR offset table [%s]\n", filepath.c_str());
+		return false;
+	}
+	std::vector<unsigned char> block;
+	for(int b = 0; b < numBlocks; b++){
+		uint64_t offset = readU64(&data[pos + b*8]);
+		if(offset+8 > data.size()){
+			std::fprintf(stderr, "bad OpenEXR chunk offset [%s]\n", filepath.c_str());
+			return false;
+		}
+		int y0 = static_cast<int>(readU32(&data[offset])) - yMin;
+		uint32_t packedSize = readU32(&data[offset+4]);
+		const unsigned char* packed = &data[offset+8];
+		if(offset+8+packedSize > data.size() || y0 < 0 || y0 >= height){
+			std::fprintf(stderr, "bad OpenEXR chunk [%s]\n", filepath.c_str());
+			return false;
+		}
+		int numLines = std::min(linesPerBlock, height-y0);
+		size_t rawSize = lineBytes*numLines;
+		if(packedSize == rawSize || compression == 0){
+			// stored uncompressed (also allowed when compression does not pay off)
+			block.assign(packed, packed+std::min<size_t>(packedSize, rawSize));
+			block.resize(rawSize, 0);
+		} else if(compression == 1){
+			block.clear();
+			block.reserve(rawSize);
+			uint32_t p = 0;
+			while(p < packedSize && block.size() < rawSize){
+				int count = static_cast<signed char>(packed[p++]);
+				if(count < 0){
+					for(int i = 0; i < -count && p < packedSize; i++){
+						block.push_back(packed[p++]);
+					}
+				} else if(p < packedSize){
+					unsigned char v = packed[p++];
+					for(int i = 0; i < count+1; i++){
+						block.push_back(v);
+					}
+				}
+			}
+			block.resize(rawSize, 0);
+			exrReconstruct(block);
+		} else {
+			block.resize(rawSize);
+			uLongf destLen = static_cast<uLongf>(rawSize);
+			if(uncompress(&block[0], &destLen, packed, packedSize) != Z_OK || destLen != rawSize){
+				std::fprintf(stderr, "corrupt ZIP chunk in OpenEXR file [%s]\n", filepath.c_str());
+				return false;
+			}
+			exrReconstruct(block);
+		}
+		// distribute channel values to the RGB image
+		for(int l = 0; l < numLines; l++){
+			const unsigned char* line = &block[l*lineBytes];
+			float* dst = &image.rgb[static_cast<size_t>(y0+l)*width*3];
+			for(int c = 0; c < 3; c++){
+				const ExrChannel& ch = channels[target[c]];
+				const unsigned char* src = line + channelOffset[target[c]];
+				for(int x = 0; x < width; x++){
+					float v;
+					if(ch.pixelType == 1){
+						v = halfToFloat(static_cast<uint16_t>(src[x*2] | (src[x*2+1]<<8)));
+					} else if(ch.pixelType == 2){
+						uint32_t bits = readU32(src + x*4);
+						std::memcpy(&v, &bits, 4);
+					} else {
+						v = static_cast<float>(readU32(src + x*4));
+					}
+					dst[x*3+c] = v;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/** decodes .hdr or .exr file depending on the file extension */
+bool loadHDRImage(const std::string& filepath, FloatImage& image) {
+	std::string ext = filepath.size() > 4 ? filepath.substr(filepath.size()-4) : std::string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if(ext == ".exr"){
+		return loadOpenEXR(filepath, image);
+	}
+	return loadRadianceHDR(filepath, image);
+}
+
+/** converts a float to IEEE 754 half precision (round to nearest) */
+uint16_t floatToHalf(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, 4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t fexp = (x >> 23) & 0xff;
+	uint32_t mant = x & 0x7fffff;
+	if(fexp == 0xff){
+		// inf or nan
+		return static_cast<uint16_t>(sign | 0x7c00 | (mant ? 0x200 : 0));
+	}
+	int exp = static_cast<int>(fexp) - 127 + 15;
+	if(exp >= 31){
+		// overflow to inf
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if(exp <= 0){
+		// subnormal or zero
+		if(exp < -10){
+			return static_cast<uint16_t>(sign);
+		}
+		mant |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exp);
+		uint32_t h = mant >> shift;
+		if((mant >> (shift-1)) & 1){
+			h++;
+		}
+		return static_cast<uint16_t>(sign | h);
+	}
+	uint32_t h = (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+	if(mant & 0x1000){
+		// rounding may carry into the exponent which is the correct result
+		h++;
+	}
+	return static_cast<uint16_t>(sign | h);
+}
+
+/** converts IEEE 754 half precision to float */
+float halfToFloat(uint16_t h) {
+	uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+	uint32_t x;
+	if(exp == 0){
+		if(mant == 0){
+			x = sign;
+		} else {
+			// normalize subnormal
+			exp = 127-15+1;
+			while(!(mant & 0x400)){
+				mant <<= 1;
+				exp--;
+			}
+			mant &= 0x3ff;
+			x = sign | (exp << 23) | (mant << 13);
+		}
+	} else if(exp == 31){
+		x = sign | 0x7f800000 | (mant << 13);
+	} else {
+		x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+	}
+	float f;
+	std::memcpy(&f, &x, 4);
+	return f;
+}
+
+/**
+ * Packs an RGB triple into the GL_R11F_G11F_B10F layout
+ * (GL_UNSIGNED_INT_10F_11F_11F_REV: red in the lowest bits).
+ * Negative values are clamped to 0, values above the largest
+ * representable number are clamped to it.
+ */
+uint32_t packR11G11B10F(float r, float g, float b) {
+	const float maxValue = 65024.0f;
+	float c[3] = {r, g, b};
+	uint32_t packed[3];
+	for(int i = 0; i < 3; i++){
+		float v = c[i] > 0.0f ? std::min(c[i], maxValue) : 0.0f; // also maps nan to 0
+		uint32_t h = floatToHalf(v);
+		// drop mantissa bits with rounding: 6 bits for red/green, 5 for blue
+		int dropBits = i < 2 ? 4 : 5;
+		uint32_t rounded = (h + (1u << (dropBits-1))) >> dropBits;
+		uint32_t maxBits = i < 2 ? 0x7bf : 0x3df; // largest finite value
+		packed[i] = std::min(rounded, maxBits);
+	}
+	return packed[0] | (packed[1] << 11) | (packed[2] << 22);
+}
+
+/** converts the image to half floats (3 per pixel) */
+void convertToHalf(const FloatImage& image, std::vector<uint16_t>& out) {
+	out.resize(image.rgb.size());
+	for(size_t i = 0; i < image.rgb.size(); i++){
+		out[i] = floatToHalf(image.rgb[i]);
+	}
+}
+
+/** converts the image to packed R11F_G11F_B10F (1 uint per pixel) */
+void convertToR11G11B10F(const FloatImage& image, std::vector<uint32_t>& out) {
+	size_t numPixels = image.rgb.size()/3;
+	out.resize(numPixels);
+	for(size_t i = 0; i < numPixels; i++){
+		out[i] = packR11G11B10F(image.rgb[i*3], image.rgb[i*3+1], image.rgb[i*3+2]);
+	}
+}
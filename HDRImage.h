@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Floating point RGB image as decoded from a high dynamic range file.
+ * Rows are stored top to bottom (like the PNG faces of the cubemaps).
+ */
+typedef struct FloatImage_t {
+	int width;              //!< width in pixels
+	int height;             //!< height in pixels
+	std::vector<float> rgb; //!< interleaved linear RGB values (3 floats per pixel)
+
+	FloatImage_t() {
+		width = 0;
+		height = 0;
+	}
+} FloatImage;
+
+bool loadRadianceHDR(const std::string& filepath, FloatImage& image);
+bool loadOpenEXR(const std::string& filepath, FloatImage& image);
+bool loadHDRImage(const std::string& filepath, FloatImage& image);
+
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+uint32_t packR11G11B10F(float r, float g, float b);
+
+void convertToHalf(const FloatImage& image, std::vector<uint16_t>& out);
+void convertToR11G11B10F(const FloatImage& image, std::vector<uint32_t>& out);
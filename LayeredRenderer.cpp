@@ -0,0 +1,330 @@
+// LayeredRenderer.cpp
+//
+
+#include "LayeredRenderer.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+
+LayeredRenderer::LayeredRenderer() {
+	current = LAYERED_GEOMETRY_SHADER;
+	meshInstancing = false;
+	numViews = 7;
+	transferFBO = 0;
+	attributelessVAO = 0;
+	subDivLocation = -1;
+}
+
+LayeredRenderer::~LayeredRenderer() {
+	// GL objects are owned by the registry, see release()
+}
+
+/** whether the current context can run a backend */
+bool LayeredRenderer::isSupported(LayeredBackend backend) {
+	switch(backend){
+		case LAYERED_GEOMETRY_SHADER:
+			// instanced geometry shaders (ARB_gpu_shader5, the baseline of the plugin)
+			return gl3wIsSupported(4, 0) || GPUResources::hasExtension("GL_ARB_gpu_shader5");
+		case LAYERED_VERTEX_SHADER:
+			// gl_Layer and gl_ViewportIndex in the vertex shader, viewport arrays for the reflection resolution
+			return gl3wIsSupported(4, 1) && GPUResources::hasExtension("GL_ARB_shader_viewport_layer_array");
+		case LAYERED_MULTI_PASS:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Backend used by default: writing the layer from the vertex shader avoids the geometry
+ * shader, which is a slow path on many GPUs, otherwise geometry shader instancing
+ * (a single pass over the scene) is preferred over rendering the scene once per view.
+ */
+LayeredBackend LayeredRenderer::best() {
+	if(isSupported(LAYERED_VERTEX_SHADER)){
+		return LAYERED_VERTEX_SHADER;
+	}
+	if(isSupported(LAYERED_GEOMETRY_SHADER)){
+		return LAYERED_GEOMETRY_SHADER;
+	}
+	return LAYERED_MULTI_PASS;
+}
+
+const char* LayeredRenderer::name(LayeredBackend backend) {
+	switch(backend){
+		case LAYERED_GEOMETRY_SHADER: return "geometry shader";
+		case LAYERED_VERTEX_SHADER:   return "vertex shader layer";
+		case LAYERED_MULTI_PASS:      return "multi pass";
+		default:                      return "unknown";
+	}
+}
+
+/** preprocessor definitions inserted into the *_layered.vert.glsl sources */
+std::string LayeredRenderer::shaderDefines() const {
+	return current == LAYERED_VERTEX_SHADER ? "#define LAYER_FROM_VS\n" : "";
+}
+
+/** selects the backend, the context has to be current (checks whether meshes can be instanced) */
+void LayeredRenderer::setBackend(LayeredBackend b) {
+	current = b;
+	meshInstancing = current != LAYERED_MULTI_PASS && isSupported(LAYERED_VERTEX_SHADER);
+}
+
+/** preprocessor definitions inserted into mesh_layered.vert.glsl (instanced unless drawn per view) */
+std::string LayeredRenderer::meshShaderDefines() const {
+	return meshInstancing ? "#define LAYER_FROM_VS\n" : "";
+}
+
+/**
+ * Creates the framebuffers of the single layers for the multi pass backend and the
+ * vertex array the objects are drawn with by the backends without geometry shader.
+ * Has to be called again when the layers are recreated or the backend changes.
+ */
+void LayeredRenderer::createTargets(GPUResources& resources, GLuint colorLayers, GLuint pickingLayers, GLuint depthLayers) {
+	release(resources);
+	if(current != LAYERED_GEOMETRY_SHADER){
+		// the core profile needs a vertex array bound even if no attribute is read
+		attributelessVAO = resources.createVertexArray("attributeless");
+	}
+	if(current != LAYERED_MULTI_PASS && !meshesPerView()){
+		return;
+	}
+	passFBOs.resize(numViews);
+	for(int layer = 0; layer < numViews; layer++){
+		passFBOs[layer] = resources.createFramebuffer("layer pass");
+		glBindFramebuffer(GL_FRAMEBUFFER, passFBOs[layer]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorLayers, 0, layer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, pickingLayers, 0, layer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthLayers, 0, layer);
+	}
+	if(current == LAYERED_MULTI_PASS){
+		transferFBO = resources.createFramebuffer("layers2cube face");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/** deletes the framebuffers and the vertex array */
+void LayeredRenderer::release(GPUResources& resources) {
+	for(size_t i = 0; i < passFBOs.size(); i++){
+		resources.releaseFramebuffer(passFBOs[i]);
+	}
+	passFBOs.clear();
+	resources.releaseFramebuffer(transferFBO);
+	resources.releaseVertexArray(attributelessVAO);
+}
+
+/**
+ * Prepares a bound program of a layered pass for drawing
+ * (the view of the pass for the multi pass backend and for the meshes drawn per view).
+ */
+void LayeredRenderer::beginPass(GLShader& shader, int pass) {
+	subDivLocation = current == LAYERED_GEOMETRY_SHADER ? -1 : shader.GetUniformLocation("maxSubDivisions");
+	if(current == LAYERED_MULTI_PASS || meshesPerView()){
+		glUniform1i(shader.GetUniformLocation("view"), pass);
+	}
+}
+
+/**
+ * Draws an object from its quad corner points (vaCube), refined to the subdivision
+ * level of each view, with the program passed to beginPass(). The backends without
+ * geometry shader replace the bound vertex array (vaCube) by one without attributes.
+ * @param numElements  number of quads (corner points of the geometry shader path)
+ * @param viewMask     views the object is visible in (bit 0 camera, bits 1-6 cube faces, 7 and up further cameras)
+ */
+void LayeredRenderer::drawCube(int pass, GLenum elementType, GLsizei numElements,
+		unsigned int viewMask, const int* subDivLevels) {
+	switch(current){
+		case LAYERED_GEOMETRY_SHADER:
+			glDrawElements(elementType, numElements, GL_UNSIGNED_INT, 0);
+			break;
+		case LAYERED_VERTEX_SHADER: {
+			// all instances are sized for the finest view, the others collapse the surplus cells
+			int level = 1;
+			for(int view = 0; view < numViews; view++){
+				if(viewMask & (1u << view)){
+					level = std::max(level, subDivLevels[view]);
+				}
+			}
+			glUniform1i(subDivLocation, level);
+			glBindVertexArray(attributelessVAO);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, numElements*6*level*level, numViews);
+			break;
+		}
+		case LAYERED_MULTI_PASS: {
+			if(!(viewMask & (1u << pass))){
+				return;
+			}
+			int level = std::max(1, subDivLevels[pass]);
+			glUniform1i(subDivLocation, level);
+			glBindVertexArray(attributelessVAO);
+			glDrawArrays(GL_TRIANGLES, 0, numElements*6*level*level);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/** draws the skybox cube (vaSkybox) into the views of the pass */
+void LayeredRenderer::drawSkybox(GLsizei numElements) {
+	if(current == LAYERED_VERTEX_SHADER){
+		glDrawElementsInstanced(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0, numViews);
+	} else {
+		glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
+	}
+}
+
+/**
+ * Draws a mesh with its vertex array (MeshLibrary::bind()) bound and the mesh program
+ * passed to beginPass(): once per view as instances, or in the pass of the view for the
+ * multi pass backend and if the meshes are drawn per view (pass is the view then).
+ * @param viewMask  views the object is visible in
+ */
+void LayeredRenderer::drawMesh(int pass, GLenum indexType, GLsizei numIndices, unsigned int viewMask) {
+	if(!meshInstancing){
+		if(viewMask & (1u << pass)){
+			glDrawElements(GL_TRIANGLES, numIndices, indexType, 0);
+		}
+	} else {
+		glDrawElementsInstanced(GL_TRIANGLES, numIndices, indexType, 0, numViews);
+	}
+}
+
+/**
+ * Copies the reflection layers 1-6 to the faces of a cubemap with the bound program
+ * (layers2cubemap), binds the framebuffer, sets the viewport and clears it as well.
+ * @param cubeFBO  framebuffer the whole cubemap is attached to (layered backends)
+ */
+void LayeredRenderer::transfer(GLShader& shader, VertexArray& quad, GLuint cubeFBO, GLuint cubeMap, int resolution) {
+	GLenum drawbuffer = GL_COLOR_ATTACHMENT0;
+	glClearColor(0.0, 0.0, 0.0, 1.0);
+	quad.Bind();
+	if(current == LAYERED_MULTI_PASS){
+		glBindFramebuffer(GL_FRAMEBUFFER, transferFBO);
+		glDrawBuffer(drawbuffer);
+		glViewport(0, 0, resolution, resolution);
+		GLint faceLocation = shader.GetUniformLocation("face");
+		for(int face = 0; face < 6; face++){
+			// attaching a layer of a cubemap (not cubemap array) needs GL 4.5, the face target works everywhere
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeMap, 0);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glUniform1i(faceLocation, face);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, cubeFBO);
+		glDrawBuffer(drawbuffer);
+		glViewport(0, 0, resolution, resolution);
+		glClear(GL_COLOR_BUFFER_BIT);
+		if(current == LAYERED_VERTEX_SHADER){
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, 6);
+		} else {
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	quad.Release();
+}
+
+LayeredBenchmark::LayeredBenchmark() {
+	cell = 0;
+	frame = 0;
+	warmup = 0;
+	active = false;
+}
+
+LayeredBenchmark::~LayeredBenchmark() {
+	// the queries are deleted in release() (needs the context)
+}
+
+/**
+ * Starts a benchmark run over all combinations of backends and scene sizes.
+ * @param sizes   numbers of objects the scene is restricted to
+ * @param frames  measured frames per combination
+ */
+void LayeredBenchmark::start(const std::vector<LayeredBackend>& backends, const std::vector<size_t>& sizes, int warmupFrames, int frames) {
+	if(queries.size() != static_cast<size_t>(frames)){
+		release();
+		queries.resize(frames);
+		glGenQueries(frames, &queries[0]);
+	}
+	cells.clear();
+	timings.clear();
+	for(size_t s = 0; s < sizes.size(); s++){
+		for(size_t b = 0; b < backends.size(); b++){
+			LayeredTiming t;
+			t.backend = backends[b];
+			t.numObjects = sizes[s];
+			cells.push_back(t);
+		}
+	}
+	warmup = warmupFrames;
+	cell = 0;
+	frame = -warmup;
+	active = false;
+	TRACE_INFO("benchmark", "layered backends: %zu runs of %d frames", cells.size(), frames);
+}
+
+/** starts the timer query of a measured frame */
+void LayeredBenchmark::beginFrame() {
+	if(running() && frame >= 0){
+		glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+		active = true;
+	}
+}
+
+/** ends the frame, collects the times once all frames of a run are rendered */
+void LayeredBenchmark::endFrame() {
+	if(!running()){
+		return;
+	}
+	if(active){
+		glEndQuery(GL_TIME_ELAPSED);
+		active = false;
+	}
+	frame++;
+	if(frame < static_cast<int>(queries.size())){
+		return;
+	}
+	std::vector<double> times(queries.size());
+	for(size_t i = 0; i < queries.size(); i++){
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+		times[i] = ns*1e-6;
+	}
+	std::sort(times.begin(), times.end());
+	LayeredTiming t = cells[cell];
+	t.medianMs = times[times.size()/2];
+	t.minMs = times[0];
+	timings.push_back(t);
+	TRACE_INFO("benchmark", "%-20s %8zu objects: median %.3f ms, min %.3f ms",
+			LayeredRenderer::name(t.backend), t.numObjects, t.medianMs, t.minMs);
+	cell++;
+	frame = -warmup;
+}
+
+/** deletes the timer queries, a running benchmark is stopped */
+void LayeredBenchmark::release() {
+	if(!queries.empty()){
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), &queries[0]);
+		queries.clear();
+	}
+	cells.clear();
+	cell = 0;
+	active = false;
+}
+
+/** writes the results as comma separated values (one line per backend and size) */
+bool LayeredBenchmark::writeCSV(const std::string& file) const {
+	FILE* f = std::fopen(file.c_str(), "w");
+	if(!f){
+		TRACE_WARN("benchmark", "cannot write %s", file.c_str());
+		return false;
+	}
+	std::fprintf(f, "backend,objects,median_ms,min_ms\n");
+	for(size_t i = 0; i < timings.size(); i++){
+		const LayeredTiming& t = timings[i];
+		std::fprintf(f, "%s,%zu,%.4f,%.4f\n", LayeredRenderer::name(t.backend), t.numObjects, t.medianMs, t.minMs);
+	}
+	std::fclose(f);
+	return true;
+}
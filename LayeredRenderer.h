@@ -0,0 +1,131 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "GPUResources.h"
+#include "VertexArray.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** ways of rendering the camera views and the 6 reflection views into the layers */
+enum LayeredBackend {
+	LAYERED_GEOMETRY_SHADER = 0, //!< geometry shader instancing, an invocation per view writes gl_Layer (GL 4.0)
+	LAYERED_VERTEX_SHADER,       //!< instanced draws, the vertex shader writes gl_Layer (ARB_shader_viewport_layer_array)
+	LAYERED_MULTI_PASS,          //!< one pass per view into a framebuffer of that layer only (any GL)
+	LAYERED_BACKEND_COUNT
+};
+
+/*
+ * Backend for the layered passes (skybox, objects and the transfer of the reflection
+ * layers to the cubemap).
+ *
+ * The passes bind the shader programs created for the backend (shaderDefines() and the
+ * *_layered.vert.glsl sources for the ones without geometry shader) and draw through
+ * this class, which issues the draw calls the backend needs:
+ * - geometry shader: a single draw, the geometry shader amplifies it to all views and
+ *   refines the quads of the objects (today's path).
+ * - vertex shader: the refined quads are generated from gl_VertexID and the views
+ *   are the instances of one instanced draw.
+ * - multi pass: the passes are run once per view (numPasses()) into a framebuffer with
+ *   the single layer attached, objects culled from a view are not drawn at all.
+ * The feedback pass of the virtual texture and the mirror pass (camera view only)
+ * keep using the geometry shaders with every backend, so the multi pass backend is not
+ * a way around geometry shaders: all backends need instanced geometry shaders
+ * (ARB_gpu_shader5) for these passes. It exists for comparison (LayeredBenchmark) and
+ * for drivers whose layered paths are slow or broken.
+ * Imported meshes (MeshLibrary) have no geometry shader path: with the geometry shader
+ * backend they are drawn like with the vertex shader backend if the layer extension is
+ * available, otherwise once per view into the framebuffers of the single layers after
+ * the layered draws (see meshesPerView()).
+ *
+ * The views are camera 0 (layer 0), the 6 reflection faces (layers 1-6) and the
+ * additional cameras of a split screen layout (layers 7 and up), see setViews().
+ */
+class LayeredRenderer {
+public:
+	LayeredRenderer();
+	~LayeredRenderer();
+
+	static bool isSupported(LayeredBackend backend);
+	static LayeredBackend best();
+	static const char* name(LayeredBackend backend);
+
+	void setBackend(LayeredBackend b);
+	void setViews(int n) { numViews = n; }
+	int views() const { return numViews; }
+	LayeredBackend backend() const { return current; }
+	bool usesGeometryShader() const { return current == LAYERED_GEOMETRY_SHADER; }
+	std::string shaderDefines() const;
+	bool meshesPerView() const { return current != LAYERED_MULTI_PASS && !meshInstancing; }
+	std::string meshShaderDefines() const;
+
+	void createTargets(GPUResources& resources, GLuint colorLayers, GLuint pickingLayers, GLuint depthLayers);
+	void release(GPUResources& resources);
+
+	int numPasses() const { return current == LAYERED_MULTI_PASS ? numViews : 1; }
+	GLuint passFramebuffer(int pass) const { return passFBOs[pass]; }
+
+	void beginPass(GLShader& shader, int pass);
+	void drawCube(int pass, GLenum elementType, GLsizei numElements,
+			unsigned int viewMask, const int* subDivLevels);
+	void drawSkybox(GLsizei numElements);
+	void drawMesh(int pass, GLenum indexType, GLsizei numIndices, unsigned int viewMask);
+	void transfer(GLShader& shader, VertexArray& quad, GLuint cubeFBO, GLuint cubeMap, int resolution);
+
+private:
+	LayeredBackend current;
+	bool meshInstancing; //!< meshes are drawn as instances that write gl_Layer (ARB_shader_viewport_layer_array)
+	int numViews;        //!< layers rendered by the passes
+	std::vector<GLuint> passFBOs; //!< framebuffers with a single layer attached (multi pass, meshes drawn per view)
+	GLuint transferFBO;  //!< framebuffer a single cubemap face is attached to (multi pass)
+	GLuint attributelessVAO; //!< vertex array without attributes for the quads generated from gl_VertexID
+	GLint subDivLocation; //!< location of maxSubDivisions in the program of the pass
+};
+
+/** timing of one backend for one scene size */
+typedef struct LayeredTiming_t {
+	LayeredBackend backend;
+	size_t numObjects;
+	double medianMs;  //!< median GPU time of drawToFBO
+	double minMs;     //!< fastest frame
+
+	LayeredTiming_t() {
+		backend = LAYERED_GEOMETRY_SHADER;
+		numObjects = 0;
+		medianMs = minMs = 0.0;
+	}
+} LayeredTiming;
+
+/*
+ * Compares the layered backends: every supported backend renders the scene restricted
+ * to an increasing number of objects for a fixed number of frames, the GPU time of each
+ * frame is measured with a GL_TIME_ELAPSED query. The queries of a cell are read once
+ * it is complete (the benchmark waits for the GPU at that point, not every frame).
+ */
+class LayeredBenchmark {
+public:
+	LayeredBenchmark();
+	~LayeredBenchmark();
+
+	void start(const std::vector<LayeredBackend>& backends, const std::vector<size_t>& sizes, int warmupFrames, int frames);
+	bool running() const { return cell < cells.size(); }
+	LayeredBackend backend() const { return cells[cell].backend; }
+	size_t numObjects() const { return cells[cell].numObjects; }
+
+	void beginFrame();
+	void endFrame();
+	void release();
+
+	const std::vector<LayeredTiming>& results() const { return timings; }
+	bool writeCSV(const std::string& file) const;
+
+private:
+	std::vector<LayeredTiming> cells;   //!< backend and size of each cell
+	std::vector<LayeredTiming> timings; //!< results of the finished cells
+	std::vector<GLuint> queries;        //!< one timer query per measured frame
+	size_t cell;       //!< cell that is rendered (cells.size() when done)
+	int frame;         //!< frame of the cell, negative while warming up
+	int warmup;        //!< frames rendered before measuring a cell
+	bool active;       //!< a query of this frame is open
+};
@@ -0,0 +1,915 @@
+// MeshImport.cpp
+//
+
+#include "MeshImport.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/** position, texture coordinate and normal index of an OBJ face corner */
+typedef struct ObjCorner_t {
+	int p, t, n;
+	bool operator==(const ObjCorner_t& o) const { return p == o.p && t == o.t && n == o.n; }
+} ObjCorner;
+
+typedef struct ObjCornerHash_t {
+	size_t operator()(const ObjCorner& c) const {
+		return (static_cast<size_t>(c.p)*73856093u) ^ (static_cast<size_t>(c.t)*19349663u) ^ (static_cast<size_t>(c.n)*83492791u);
+	}
+} ObjCornerHash;
+
+/** adds the triangles of a polygon as fan, degenerate ones are dropped */
+static void addFan(const std::vector<uint32_t>& polygon, std::vector<uint32_t>& indices) {
+	for(size_t i = 2; i < polygon.size(); i++){
+		uint32_t a = polygon[0], b = polygon[i-1], c = polygon[i];
+		if(a != b && b != c && a != c){
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back(c);
+		}
+	}
+}
+
+/**
+ * Sets the normals of the vertices that have none to the area weighted average of
+ * the faces they belong to.
+ */
+static void computeMissingNormals(MeshData& mesh, const std::vector<bool>& hasNormal) {
+	size_t n = mesh.numVertices();
+	std::vector<float> sum(3*n, 0.0f);
+	const float* p = mesh.positions.data();
+	for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3){
+		const float* a = p + 3*mesh.indices[i];
+		const float* b = p + 3*mesh.indices[i+1];
+		const float* c = p + 3*mesh.indices[i+2];
+		float u[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+		float v[3] = {c[0]-a[0], c[1]-a[1], c[2]-a[2]};
+		float f[3] = {u[1]*v[2]-u[2]*v[1], u[2]*v[0]-u[0]*v[2], u[0]*v[1]-u[1]*v[0]};
+		for(int k = 0; k < 3; k++){
+			float* s = &sum[3*mesh.indices[i+k]];
+			s[0] += f[0];
+			s[1] += f[1];
+			s[2] += f[2];
+		}
+	}
+	for(size_t v = 0; v < n; v++){
+		if(hasNormal[v]){
+			continue;
+		}
+		float* s = &sum[3*v];
+		float len = std::sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+		for(int k = 0; k < 3; k++){
+			mesh.normals[3*v+k] = len > 0.0f ? s[k]/len : (k == 2 ? 1.0f : 0.0f);
+		}
+	}
+}
+
+/** centers the positions and scales them to a largest extent of 1 */
+static void normalizeMesh(MeshData& mesh) {
+	size_t n = mesh.numVertices();
+	if(!n){
+		return;
+	}
+	float lo[3], hi[3];
+	for(int k = 0; k < 3; k++){
+		lo[k] = hi[k] = mesh.positions[k];
+	}
+	for(size_t v = 0; v < n; v++){
+		for(int k = 0; k < 3; k++){
+			lo[k] = std::min(lo[k], mesh.positions[3*v+k]);
+			hi[k] = std::max(hi[k], mesh.positions[3*v+k]);
+		}
+	}
+	float size = std::max(hi[0]-lo[0], std::max(hi[1]-lo[1], hi[2]-lo[2]));
+	float scale = size > 0.0f ? 1.0f/size : 1.0f;
+	for(size_t v = 0; v < n; v++){
+		for(int k = 0; k < 3; k++){
+			mesh.positions[3*v+k] = (mesh.positions[3*v+k] - 0.5f*(lo[k]+hi[k]))*scale;
+		}
+	}
+}
+
+/** parses an OBJ index (1-based, negative counts from the end), @return 0-based index or -1 */
+static int objIndex(const char* s, size_t count) {
+	if(!*s){
+		return -1;
+	}
+	long i = std::strtol(s, nullptr, 10);
+	if(i < 0){
+		i += static_cast<long>(count);
+	} else {
+		i -= 1;
+	}
+	return i >= 0 && static_cast<size_t>(i) < count ? static_cast<int>(i) : -1;
+}
+
+/**
+ * Loads the polygons of a Wavefront OBJ file (v, vt, vn and f records, everything else is
+ * ignored, groups and materials included).
+ */
+bool loadOBJ(const std::string& file, MeshData& mesh) {
+	std::ifstream in(file.c_str());
+	if(!in.is_open()){
+		TRACE_ERROR("mesh", "could not open mesh [%s]", file.c_str());
+		return false;
+	}
+	std::vector<float> p, t, n;
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> corners;
+	std::vector<bool> hasNormal;
+	std::vector<uint32_t> polygon;
+	mesh = MeshData();
+	std::string line;
+	int lineNumber = 0;
+	while(std::getline(in, line)){
+		lineNumber++;
+		const char* s = line.c_str();
+		while(*s == ' ' || *s == '\t'){
+			s++;
+		}
+		char* end = nullptr;
+		if(s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')){
+			for(int k = 0; k < 3; k++){
+				p.push_back(std::strtof(s + (k ? 0 : 1), &end));
+				s = end;
+			}
+		} else if(s[0] == 'v' && s[1] == 't'){
+			s += 2;
+			t.push_back(std::strtof(s, &end));
+			t.push_back(std::strtof(end, &end));
+		} else if(s[0] == 'v' && s[1] == 'n'){
+			s += 2;
+			for(int k = 0; k < 3; k++){
+				n.push_back(std::strtof(s, &end));
+				s = end;
+			}
+		} else if(s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')){
+			std::istringstream tokens(s + 1);
+			std::string token;
+			polygon.clear();
+			while(tokens >> token){
+				// v, v/t, v//n or v/t/n
+				size_t slash1 = token.find('/');
+				size_t slash2 = slash1 == std::string::npos ? std::string::npos : token.find('/', slash1 + 1);
+				ObjCorner c;
+				c.p = objIndex(token.substr(0, slash1).c_str(), p.size()/3);
+				c.t = slash1 == std::string::npos ? -1 : objIndex(token.substr(slash1 + 1, slash2 - slash1 - 1).c_str(), t.size()/2);
+				c.n = slash2 == std::string::npos ? -1 : objIndex(token.substr(slash2 + 1).c_str(), n.size()/3);
+				if(c.p < 0){
+					TRACE_ERROR("mesh", "invalid face index [%s:%d]", file.c_str(), lineNumber);
+					return false;
+				}
+				std::unordered_map<ObjCorner, uint32_t, ObjCornerHash>::iterator it = corners.find(c);
+				if(it == corners.end()){
+					uint32_t index = static_cast<uint32_t>(mesh.numVertices());
+					it = corners.insert(std::make_pair(c, index)).first;
+					mesh.positions.insert(mesh.positions.end(), &p[3*c.p], &p[3*c.p] + 3);
+					if(c.n >= 0){
+						mesh.normals.insert(mesh.normals.end(), &n[3*c.n], &n[3*c.n] + 3);
+					} else {
+						mesh.normals.insert(mesh.normals.end(), 3, 0.0f);
+					}
+					if(c.t >= 0){
+						mesh.texCoords.insert(mesh.texCoords.end(), &t[2*c.t], &t[2*c.t] + 2);
+					} else {
+						mesh.texCoords.insert(mesh.texCoords.end(), 2, 0.0f);
+					}
+					hasNormal.push_back(c.n >= 0);
+				}
+				polygon.push_back(it->second);
+			}
+			addFan(polygon, mesh.indices);
+		}
+	}
+	if(mesh.indices.empty()){
+		TRACE_ERROR("mesh", "mesh has no faces [%s]", file.c_str());
+		return false;
+	}
+	computeMissingNormals(mesh, hasNormal);
+	return true;
+}
+
+/** scalar types of PLY properties */
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+/** bytes of the binary PLY types */
+static const int plyTypeSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+/** most vertices of a face, the limit of the usual uchar count of the vertex index list */
+static const double maxPlyFaceVertices = 255.0;
+
+static PlyType plyType(const std::string& name) {
+	static const char* names[] = {"char", "uchar", "short", "ushort", "int", "uint", "float", "double"};
+	static const char* sizedNames[] = {"int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64"};
+	for(int i = 0; i < PLY_INVALID; i++){
+		if(name == names[i] || name == sizedNames[i]){
+			return static_cast<PlyType>(i);
+		}
+	}
+	return PLY_INVALID;
+}
+
+typedef struct PlyProperty_t {
+	std::string name;
+	PlyType type;
+	PlyType countType;  //!< type of the element count of a list (PLY_INVALID = no list)
+} PlyProperty;
+
+typedef struct PlyElement_t {
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+} PlyElement;
+
+/** reads the values of PLY files in either encoding */
+class PlyReader {
+public:
+	PlyReader(std::istream& in, int format, std::streamoff size) : in(in), format(format), size(size) {}
+
+	bool read(PlyType type, double& value) {
+		if(format == 0){
+			return static_cast<bool>(in >> value);
+		}
+		unsigned char b[8];
+		int bytes = plyTypeSizes[type];
+		if(!in.read(reinterpret_cast<char*>(b), bytes)){
+			return false;
+		}
+		if(format == 2){
+			std::reverse(b, b + bytes);
+		}
+		switch(type){
+			case PLY_INT8:    value = static_cast<int8_t>(b[0]); break;
+			case PLY_UINT8:   value = b[0]; break;
+			case PLY_INT16:   { int16_t v; std::memcpy(&v, b, 2); value = v; break; }
+			case PLY_UINT16:  { uint16_t v; std::memcpy(&v, b, 2); value = v; break; }
+			case PLY_INT32:   { int32_t v; std::memcpy(&v, b, 4); value = v; break; }
+			case PLY_UINT32:  { uint32_t v; std::memcpy(&v, b, 4); value = v; break; }
+			case PLY_FLOAT32: { float v; std::memcpy(&v, b, 4); value = v; break; }
+			default:          { double v; std::memcpy(&v, b, 8); value = v; break; }
+		}
+		return true;
+	}
+
+	/** whether the rest of the file can hold count values of the type (an ascii value takes a digit and a separator) */
+	bool fits(PlyType type, double count) {
+		std::streamoff left = size - static_cast<std::streamoff>(in.tellg());
+		return count*(format == 0 ? 2 : plyTypeSizes[type]) <= static_cast<double>(left) + 1.0;
+	}
+
+private:
+	std::istream& in;
+	int format;          //!< 0 ascii, 1 binary little endian, 2 binary big endian
+	std::streamoff size; //!< bytes of the file
+};
+
+/**
+ * Loads the vertex and face elements of a PLY file (ascii or binary). The vertices may have
+ * normals (nx, ny, nz) and texture coordinates (s, t or u, v), other elements and
+ * properties are skipped.
+ */
+bool loadPLY(const std::string& file, MeshData& mesh) {
+	std::ifstream in(file.c_str(), std::ios::binary);
+	if(!in.is_open()){
+		TRACE_ERROR("mesh", "could not open mesh [%s]", file.c_str());
+		return false;
+	}
+	std::string line;
+	std::vector<PlyElement> elements;
+	int format = -1;
+	if(!std::getline(in, line) || line.compare(0, 3, "ply") != 0){
+		TRACE_ERROR("mesh", "not a ply file [%s]", file.c_str());
+		return false;
+	}
+	while(std::getline(in, line)){
+		if(!line.empty() && line[line.size()-1] == '\r'){
+			line.erase(line.size()-1);
+		}
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+		if(keyword == "format"){
+			std::string encoding;
+			tokens >> encoding;
+			format = encoding == "ascii" ? 0 : encoding == "binary_little_endian" ? 1 : encoding == "binary_big_endian" ? 2 : -1;
+		} else if(keyword == "element"){
+			PlyElement e;
+			tokens >> e.name >> e.count;
+			elements.push_back(e);
+		} else if(keyword == "property" && !elements.empty()){
+			PlyProperty prop;
+			std::string type;
+			tokens >> type;
+			if(type == "list"){
+				std::string countType, valueType;
+				tokens >> countType >> valueType >> prop.name;
+				prop.countType = plyType(countType);
+				prop.type = plyType(valueType);
+				if(prop.countType == PLY_INVALID){
+					prop.type = PLY_INVALID;
+				}
+			} else {
+				tokens >> prop.name;
+				prop.type = plyType(type);
+				prop.countType = PLY_INVALID;
+			}
+			if(prop.type == PLY_INVALID){
+				TRACE_ERROR("mesh", "unknown ply property type [%s]", file.c_str());
+				return false;
+			}
+			elements.back().properties.push_back(prop);
+		} else if(keyword == "end_header"){
+			break;
+		}
+	}
+	if(format < 0){
+		TRACE_ERROR("mesh", "unknown ply format [%s]", file.c_str());
+		return false;
+	}
+	mesh = MeshData();
+	std::vector<bool> hasNormal;
+	std::vector<uint32_t> polygon;
+	std::streamoff dataStart = in.tellg();
+	in.seekg(0, std::ios::end);
+	std::streamoff size = in.tellg();
+	in.seekg(dataStart);
+	PlyReader reader(in, format, size);
+	for(size_t e = 0; e < elements.size(); e++){
+		const PlyElement& element = elements[e];
+		bool isVertex = element.name == "vertex";
+		bool isFace = element.name == "face";
+		// offsets of the vertex attributes in the properties (-1 = missing)
+		int attribute[8];
+		static const char* attributeNames[8][2] = {{"x", "x"}, {"y", "y"}, {"z", "z"}, {"nx", "nx"}, {"ny", "ny"}, {"nz", "nz"},
+				{"s", "u"}, {"t", "v"}};
+		for(int a = 0; a < 8; a++){
+			attribute[a] = -1;
+			for(size_t i = 0; i < element.properties.size(); i++){
+				const std::string& name = element.properties[i].name;
+				if(name == attributeNames[a][0] || name == attributeNames[a][1] || (a >= 6 && name == std::string("texture_") + attributeNames[a][1])){
+					attribute[a] = static_cast<int>(i);
+				}
+			}
+		}
+		if(isVertex && (attribute[0] < 0 || attribute[1] < 0 || attribute[2] < 0)){
+			TRACE_ERROR("mesh", "ply vertices have no position [%s]", file.c_str());
+			return false;
+		}
+		std::vector<double> values(element.properties.size());
+		for(size_t item = 0; item < element.count; item++){
+			polygon.clear();
+			for(size_t i = 0; i < element.properties.size(); i++){
+				const PlyProperty& prop = element.properties[i];
+				if(prop.countType == PLY_INVALID){
+					if(!reader.read(prop.type, values[i])){
+						TRACE_ERROR("mesh", "ply file is truncated [%s]", file.c_str());
+						return false;
+					}
+					continue;
+				}
+				double count = 0.0;
+				bool ok = reader.read(prop.countType, count);
+				bool indices = isFace && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+				// the count drives the reads, a corrupt one must not run over the file: a face has at most
+				// maxPlyFaceVertices, the lists of other properties as many values as the rest of the file holds
+				bool countValid = count >= 0.0 && (count <= maxPlyFaceVertices || (!indices && reader.fits(prop.type, count)));
+				if(ok && !countValid){
+					TRACE_ERROR("mesh", "ply list has %g entries [%s]", count, file.c_str());
+					return false;
+				}
+				for(int k = 0; ok && k < static_cast<int>(count); k++){
+					double index = 0.0;
+					ok = reader.read(prop.type, index);
+					if(ok && indices){
+						// compare before the conversion, which is undefined out of the range of uint32_t
+						if(!(index >= 0.0 && index < static_cast<double>(mesh.numVertices()))){
+							TRACE_ERROR("mesh", "invalid face index [%s]", file.c_str());
+							return false;
+						}
+						polygon.push_back(static_cast<uint32_t>(index));
+					}
+				}
+				if(!ok){
+					TRACE_ERROR("mesh", "ply file is truncated [%s]", file.c_str());
+					return false;
+				}
+			}
+			if(isVertex){
+				for(int a = 0; a < 3; a++){
+					mesh.positions.push_back(static_cast<float>(values[attribute[a]]));
+				}
+				bool normal = attribute[3] >= 0 && attribute[4] >= 0 && attribute[5] >= 0;
+				for(int a = 3; a < 6; a++){
+					mesh.normals.push_back(normal ? static_cast<float>(values[attribute[a]]) : 0.0f);
+				}
+				for(int a = 6; a < 8; a++){
+					mesh.texCoords.push_back(attribute[a] >= 0 ? static_cast<float>(values[attribute[a]]) : 0.0f);
+				}
+				hasNormal.push_back(normal);
+			} else if(isFace){
+				addFan(polygon, mesh.indices);
+			}
+		}
+	}
+	if(mesh.indices.empty()){
+		TRACE_ERROR("mesh", "mesh has no faces [%s]", file.c_str());
+		return false;
+	}
+	computeMissingNormals(mesh, hasNormal);
+	return true;
+}
+
+/** loads an OBJ or PLY file (by extension) and normalizes its size */
+bool loadMesh(const std::string& file, MeshData& mesh) {
+	std::string extension = file.size() > 4 ? file.substr(file.size()-4) : "";
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	bool ok;
+	if(extension == ".obj"){
+		ok = loadOBJ(file, mesh);
+	} else if(extension == ".ply"){
+		ok = loadPLY(file, mesh);
+	} else {
+		TRACE_ERROR("mesh", "unknown mesh format [%s]", file.c_str());
+		return false;
+	}
+	if(ok){
+		normalizeMesh(mesh);
+	}
+	return ok;
+}
+
+/**
+ * Average number of vertices transformed per triangle with a FIFO post transform cache
+ * of the given size (0.5 is the optimum of a regular grid, 3 the worst case).
+ */
+float cacheMissRatio(const std::vector<uint32_t>& indices, size_t numVertices, unsigned int cacheSize) {
+	if(indices.size() < 3){
+		return 0.0f;
+	}
+	// a vertex is in the cache while less than cacheSize vertices were added after it
+	std::vector<uint32_t> added(numVertices, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	for(size_t i = 0; i < indices.size(); i++){
+		if(time - added[indices[i]] > cacheSize){
+			added[indices[i]] = time++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses)/static_cast<float>(indices.size()/3);
+}
+
+/** size of the LRU cache modelled by the vertex scores */
+static const int scoreCacheSize = 32;
+
+/**
+ * Forsyth's vertex score: vertices in the cache score by their position (the ones of the
+ * last triangle a bit less, so strips do not run back), vertices with few remaining
+ * triangles get a boost so that no single triangles are left behind.
+ */
+static float vertexScore(int cachePosition, uint32_t remaining) {
+	if(remaining == 0){
+		return -1.0f;
+	}
+	float score = 0.0f;
+	if(cachePosition >= 0){
+		if(cachePosition < 3){
+			score = 0.75f;
+		} else {
+			score = std::pow(1.0f - static_cast<float>(cachePosition - 3)/(scoreCacheSize - 3), 1.5f);
+		}
+	}
+	return score + 2.0f/std::sqrt(static_cast<float>(remaining));
+}
+
+/**
+ * Reorders the triangles for the post transform vertex cache: the next triangle is
+ * always the one with the highest score among those using a vertex in the (modelled)
+ * cache, so the triangles form compact strips that reuse the cached vertices.
+ */
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices) {
+	size_t numTriangles = indices.size()/3;
+	if(numTriangles < 2){
+		return;
+	}
+	// triangles of every vertex, the remaining ones are kept at the front of the lists
+	std::vector<uint32_t> first(numVertices + 1, 0);
+	for(size_t i = 0; i < indices.size(); i++){
+		first[indices[i] + 1]++;
+	}
+	for(size_t v = 0; v < numVertices; v++){
+		first[v + 1] += first[v];
+	}
+	std::vector<uint32_t> triangles(indices.size());
+	std::vector<uint32_t> remaining(numVertices, 0);
+	for(size_t i = 0; i < indices.size(); i++){
+		uint32_t v = indices[i];
+		triangles[first[v] + remaining[v]++] = static_cast<uint32_t>(i/3);
+	}
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> score(numVertices);
+	for(size_t v = 0; v < numVertices; v++){
+		score[v] = vertexScore(-1, remaining[v]);
+	}
+	std::vector<float> triangleScore(numTriangles);
+	std::vector<bool> emitted(numTriangles, false);
+	int best = 0;
+	for(size_t t = 0; t < numTriangles; t++){
+		triangleScore[t] = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+		if(triangleScore[t] > triangleScore[best]){
+			best = static_cast<int>(t);
+		}
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	uint32_t cache[scoreCacheSize + 3];
+	int cacheCount = 0;
+	size_t nextUnemitted = 0;
+	while(best >= 0){
+		emitted[best] = true;
+		const uint32_t* tri = &indices[3*best];
+		result.insert(result.end(), tri, tri + 3);
+		for(int k = 0; k < 3; k++){
+			uint32_t v = tri[k];
+			uint32_t* list = &triangles[first[v]];
+			for(uint32_t j = 0; j < remaining[v]; j++){
+				if(list[j] == static_cast<uint32_t>(best)){
+					list[j] = list[--remaining[v]];
+					break;
+				}
+			}
+		}
+		// the vertices of the triangle move to the front of the cache
+		uint32_t newCache[scoreCacheSize + 3];
+		int newCount = 0;
+		for(int k = 0; k < 3; k++){
+			newCache[newCount++] = tri[k];
+		}
+		for(int j = 0; j < cacheCount; j++){
+			if(cache[j] != tri[0] && cache[j] != tri[1] && cache[j] != tri[2]){
+				newCache[newCount++] = cache[j];
+			}
+		}
+		for(int j = 0; j < newCount; j++){
+			uint32_t v = newCache[j];
+			cachePosition[v] = j < scoreCacheSize ? j : -1;
+			score[v] = vertexScore(cachePosition[v], remaining[v]);
+		}
+		cacheCount = std::min(newCount, scoreCacheSize);
+		for(int j = 0; j < cacheCount; j++){
+			cache[j] = newCache[j];
+		}
+		// the best triangle using a cached vertex is next
+		best = -1;
+		float bestScore = -1.0f;
+		for(int j = 0; j < newCount; j++){
+			uint32_t v = newCache[j];
+			for(uint32_t k = 0; k < remaining[v]; k++){
+				uint32_t t = triangles[first[v] + k];
+				triangleScore[t] = score[indices[3*t]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+				if(triangleScore[t] > bestScore){
+					bestScore = triangleScore[t];
+					best = static_cast<int>(t);
+				}
+			}
+		}
+		if(best < 0){
+			// dead end (the cached vertices have no triangles left), continue with any triangle
+			while(nextUnemitted < numTriangles && emitted[nextUnemitted]){
+				nextUnemitted++;
+			}
+			best = nextUnemitted < numTriangles ? static_cast<int>(nextUnemitted) : -1;
+		}
+	}
+	indices.swap(result);
+}
+
+/**
+ * Reorders clusters of triangles for less overdraw. A cluster starts at a triangle whose
+ * vertices all miss the cache, so moving clusters keeps the cache efficiency within them.
+ * Clusters whose area weighted normal points away from the center of the mesh are drawn
+ * first, they are likely in front of the others for most view directions. The new order
+ * is kept if the cache miss ratio grows by less than the threshold.
+ */
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& positions, float threshold) {
+	size_t numTriangles = indices.size()/3;
+	size_t numVertices = positions.size()/3;
+	std::vector<size_t> clusterStart;
+	std::vector<uint32_t> added(numVertices, 0);
+	const uint32_t cacheSize = 16;
+	uint32_t time = cacheSize + 1;
+	for(size_t t = 0; t < numTriangles; t++){
+		int misses = 0;
+		for(int k = 0; k < 3; k++){
+			uint32_t v = indices[3*t+k];
+			if(time - added[v] > cacheSize){
+				added[v] = time++;
+				misses++;
+			}
+		}
+		if(t == 0 || misses == 3){
+			clusterStart.push_back(t);
+		}
+	}
+	if(clusterStart.size() < 2){
+		return;
+	}
+	clusterStart.push_back(numTriangles);
+	size_t numClusters = clusterStart.size() - 1;
+
+	// area weighted centroid and normal of every cluster
+	std::vector<float> clusterCenter(3*numClusters, 0.0f);
+	std::vector<float> clusterNormal(3*numClusters, 0.0f);
+	std::vector<float> clusterArea(numClusters, 0.0f);
+	float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+	float meshArea = 0.0f;
+	for(size_t c = 0; c < numClusters; c++){
+		for(size_t t = clusterStart[c]; t < clusterStart[c+1]; t++){
+			const float* a = &positions[3*indices[3*t]];
+			const float* b = &positions[3*indices[3*t+1]];
+			const float* d = &positions[3*indices[3*t+2]];
+			float u[3] = {b[0]-a[0], b[1]-a[1], b[2]-a[2]};
+			float v[3] = {d[0]-a[0], d[1]-a[1], d[2]-a[2]};
+			float n[3] = {u[1]*v[2]-u[2]*v[1], u[2]*v[0]-u[0]*v[2], u[0]*v[1]-u[1]*v[0]};
+			float area = 0.5f*std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			for(int k = 0; k < 3; k++){
+				float centroid = (a[k] + b[k] + d[k])/3.0f;
+				clusterCenter[3*c+k] += centroid*area;
+				clusterNormal[3*c+k] += n[k];
+				meshCenter[k] += centroid*area;
+			}
+			clusterArea[c] += area;
+			meshArea += area;
+		}
+	}
+	if(meshArea <= 0.0f){
+		return;
+	}
+	std::vector<float> key(numClusters, 0.0f);
+	for(size_t c = 0; c < numClusters; c++){
+		const float* n = &clusterNormal[3*c];
+		float len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(clusterArea[c] <= 0.0f || len <= 0.0f){
+			continue;
+		}
+		for(int k = 0; k < 3; k++){
+			key[c] += (clusterCenter[3*c+k]/clusterArea[c] - meshCenter[k]/meshArea)*n[k]/len;
+		}
+	}
+	std::vector<size_t> order(numClusters);
+	for(size_t c = 0; c < numClusters; c++){
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b){ return key[a] > key[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for(size_t i = 0; i < numClusters; i++){
+		size_t c = order[i];
+		result.insert(result.end(), indices.begin() + 3*clusterStart[c], indices.begin() + 3*clusterStart[c+1]);
+	}
+	if(cacheMissRatio(result, numVertices) <= threshold*cacheMissRatio(indices, numVertices)){
+		indices.swap(result);
+	}
+}
+
+/** renumbers the vertices in the order of their first use (unused vertices are dropped) */
+void optimizeVertexFetch(MeshData& mesh) {
+	size_t n = mesh.numVertices();
+	std::vector<uint32_t> remap(n, ~0u);
+	MeshData result;
+	result.indices.swap(mesh.indices);
+	for(size_t i = 0; i < result.indices.size(); i++){
+		uint32_t& index = result.indices[i];
+		if(remap[index] == ~0u){
+			remap[index] = static_cast<uint32_t>(result.numVertices());
+			result.positions.insert(result.positions.end(), &mesh.positions[3*index], &mesh.positions[3*index] + 3);
+			result.normals.insert(result.normals.end(), &mesh.normals[3*index], &mesh.normals[3*index] + 3);
+			result.texCoords.insert(result.texCoords.end(), &mesh.texCoords[2*index], &mesh.texCoords[2*index] + 2);
+		}
+		index = remap[index];
+	}
+	mesh.positions.swap(result.positions);
+	mesh.normals.swap(result.normals);
+	mesh.texCoords.swap(result.texCoords);
+	mesh.indices.swap(result.indices);
+}
+
+/** runs the optimizations in order, @param acmrSource, acmr  cache miss ratio before and after */
+void optimizeMesh(MeshData& mesh, float& acmrSource, float& acmr) {
+	acmrSource = cacheMissRatio(mesh.indices, mesh.numVertices());
+	optimizeVertexCache(mesh.indices, mesh.numVertices());
+	optimizeOverdraw(mesh.indices, mesh.positions);
+	optimizeVertexFetch(mesh);
+	acmr = cacheMissRatio(mesh.indices, mesh.numVertices());
+}
+
+static int16_t toSnorm16(float v) {
+	return static_cast<int16_t>(std::floor(std::max(-1.0f, std::min(1.0f, v))*32767.0f + 0.5f));
+}
+
+static uint32_t toSnorm10(float v) {
+	int i = static_cast<int>(std::floor(std::max(-1.0f, std::min(1.0f, v))*511.0f + 0.5f));
+	return static_cast<uint32_t>(i) & 0x3FFu;
+}
+
+static uint16_t toUnorm16(float v) {
+	return static_cast<uint16_t>(std::floor(std::max(0.0f, std::min(1.0f, v))*65535.0f + 0.5f));
+}
+
+/** packs the vertices and indices into the layout of the cache file (the source stamp is left 0) */
+void quantizeMesh(const MeshData& mesh, QuantizedMesh& q) {
+	size_t n = mesh.numVertices();
+	std::memset(&q.header, 0, sizeof(q.header));
+	std::memcpy(q.header.magic, "CMMS", 4);
+	q.header.version = MESH_CACHE_VERSION;
+	q.header.numVertices = static_cast<uint32_t>(n);
+	q.header.numIndices = static_cast<uint32_t>(mesh.indices.size());
+	q.header.indexSize = n <= 65536 ? 2 : 4;
+	float lo[5], hi[5];
+	for(int k = 0; k < 5; k++){
+		lo[k] = 1e30f;
+		hi[k] = -1e30f;
+	}
+	for(size_t v = 0; v < n; v++){
+		for(int k = 0; k < 3; k++){
+			lo[k] = std::min(lo[k], mesh.positions[3*v+k]);
+			hi[k] = std::max(hi[k], mesh.positions[3*v+k]);
+		}
+		for(int k = 0; k < 2; k++){
+			lo[3+k] = std::min(lo[3+k], mesh.texCoords[2*v+k]);
+			hi[3+k] = std::max(hi[3+k], mesh.texCoords[2*v+k]);
+		}
+	}
+	for(int k = 0; k < 3; k++){
+		q.header.center[k] = n ? 0.5f*(lo[k] + hi[k]) : 0.0f;
+		q.header.extent[k] = n && hi[k] > lo[k] ? 0.5f*(hi[k] - lo[k]) : 1.0f;
+	}
+	for(int k = 0; k < 2; k++){
+		q.header.uvOffset[k] = n ? lo[3+k] : 0.0f;
+		q.header.uvScale[k] = n && hi[3+k] > lo[3+k] ? hi[3+k] - lo[3+k] : 1.0f;
+	}
+	q.vertices.resize(n);
+	for(size_t v = 0; v < n; v++){
+		MeshVertex& out = q.vertices[v];
+		for(int k = 0; k < 3; k++){
+			out.position[k] = toSnorm16((mesh.positions[3*v+k] - q.header.center[k])/q.header.extent[k]);
+		}
+		out.position[3] = 0;
+		out.normal = toSnorm10(mesh.normals[3*v]) | (toSnorm10(mesh.normals[3*v+1]) << 10) | (toSnorm10(mesh.normals[3*v+2]) << 20);
+		for(int k = 0; k < 2; k++){
+			out.texCoord[k] = toUnorm16((mesh.texCoords[2*v+k] - q.header.uvOffset[k])/q.header.uvScale[k]);
+		}
+	}
+	q.indices.resize(mesh.indices.size()*q.header.indexSize);
+	for(size_t i = 0; i < mesh.indices.size(); i++){
+		if(q.header.indexSize == 2){
+			uint16_t index = static_cast<uint16_t>(mesh.indices[i]);
+			std::memcpy(&q.indices[2*i], &index, 2);
+		} else {
+			std::memcpy(&q.indices[4*i], &mesh.indices[i], 4);
+		}
+	}
+}
+
+/** size and modification time of a file, @return false if it does not exist */
+bool sourceStamp(const std::string& file, uint64_t& size, int64_t& time) {
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0){
+		return false;
+	}
+	size = static_cast<uint64_t>(st.st_size);
+	time = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+
+/** writes a quantized mesh as cache file */
+bool writeMeshCache(const std::string& file, const QuantizedMesh& q) {
+	FILE* f = std::fopen(file.c_str(), "wb");
+	if(!f){
+		TRACE_WARN("mesh", "could not write mesh cache [%s]", file.c_str());
+		return false;
+	}
+	bool ok = std::fwrite(&q.header, sizeof(q.header), 1, f) == 1;
+	if(ok && !q.vertices.empty()){
+		ok = std::fwrite(&q.vertices[0], sizeof(MeshVertex), q.vertices.size(), f) == q.vertices.size();
+	}
+	if(ok && !q.indices.empty()){
+		ok = std::fwrite(&q.indices[0], 1, q.indices.size(), f) == q.indices.size();
+	}
+	ok = std::fclose(f) == 0 && ok;
+	if(!ok){
+		TRACE_WARN("mesh", "could not write mesh cache [%s]", file.c_str());
+		std::remove(file.c_str());
+	}
+	return ok;
+}
+
+/**
+ * Maps a mesh cache file and validates it against the source it was built from.
+ * The indices are checked as well, they are uploaded as they are and a truncated or
+ * edited cache (or one of a source changed within the resolution of its time stamp)
+ * must not make the GPU fetch vertices out of bounds. A cache that fails is rebuilt.
+ * The data stays valid until the file is closed.
+ */
+bool MeshCacheFile::open(const std::string& file, uint64_t sourceSize, int64_t sourceTime) {
+	close();
+	if(!mapping.open(file)){
+		return false;
+	}
+	const MeshCacheHeader* h = reinterpret_cast<const MeshCacheHeader*>(mapping.data());
+	if(mapping.size() < sizeof(MeshCacheHeader) || std::memcmp(h->magic, "CMMS", 4) != 0
+			|| h->version != MESH_CACHE_VERSION || h->sourceSize != sourceSize || h->sourceTime != sourceTime
+			|| (h->indexSize != 2 && h->indexSize != 4)
+			|| mapping.size() < sizeof(MeshCacheHeader) + static_cast<size_t>(h->numVertices)*sizeof(MeshVertex)
+				+ static_cast<size_t>(h->numIndices)*h->indexSize){
+		close();
+		return false;
+	}
+	const unsigned char* indices = mapping.data() + sizeof(MeshCacheHeader) + static_cast<size_t>(h->numVertices)*sizeof(MeshVertex);
+	bool valid = h->numIndices % 3 == 0;
+	for(uint32_t i = 0; valid && i < h->numIndices; i++){
+		uint32_t index;
+		if(h->indexSize == 2){
+			uint16_t index16;
+			std::memcpy(&index16, indices + 2*static_cast<size_t>(i), 2);
+			index = index16;
+		} else {
+			std::memcpy(&index, indices + 4*static_cast<size_t>(i), 4);
+		}
+		valid = index < h->numVertices;
+	}
+	if(!valid){
+		TRACE_WARN("mesh", "mesh cache has invalid indices, rebuilding it [%s]", file.c_str());
+		close();
+		return false;
+	}
+	head = h;
+	return true;
+}
+
+void MeshCacheFile::close() {
+	mapping.close();
+	built = QuantizedMesh();
+	head = nullptr;
+}
+
+/**
+ * Opens the cache of a mesh, building it from the source first if it is missing or
+ * outdated. If the cache cannot be written the mesh is kept in memory.
+ */
+bool MeshCacheFile::import(const std::string& source) {
+	close();
+	uint64_t size;
+	int64_t time;
+	if(!sourceStamp(source, size, time)){
+		TRACE_ERROR("mesh", "could not open mesh [%s]", source.c_str());
+		return false;
+	}
+	std::string cacheFile = source + ".cmesh";
+	uint64_t cacheSize;
+	int64_t cacheTime;
+	if(sourceStamp(cacheFile, cacheSize, cacheTime) && open(cacheFile, size, time)){
+		return true;
+	}
+	MeshData mesh;
+	if(!loadMesh(source, mesh)){
+		return false;
+	}
+	QuantizedMesh q;
+	float acmrSource, acmr;
+	optimizeMesh(mesh, acmrSource, acmr);
+	quantizeMesh(mesh, q);
+	q.header.sourceSize = size;
+	q.header.sourceTime = time;
+	q.header.acmrSource = acmrSource;
+	q.header.acmr = acmr;
+	if(writeMeshCache(cacheFile, q) && open(cacheFile, size, time)){
+		return true;
+	}
+	built = q;
+	head = &built.header;
+	return true;
+}
+
+const MeshVertex* MeshCacheFile::vertices() const {
+	if(head == &built.header){
+		return built.vertices.empty() ? nullptr : &built.vertices[0];
+	}
+	return reinterpret_cast<const MeshVertex*>(mapping.data() + sizeof(MeshCacheHeader));
+}
+
+const void* MeshCacheFile::indices() const {
+	if(head == &built.header){
+		return built.indices.empty() ? nullptr : &built.indices[0];
+	}
+	return mapping.data() + sizeof(MeshCacheHeader) + head->numVertices*sizeof(MeshVertex);
+}
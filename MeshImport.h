@@ -0,0 +1,108 @@
+#pragma once
+
+#include "SceneFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Import of triangle meshes (Wavefront OBJ and PLY) for the scene objects.
+ *
+ * The loaders produce an indexed triangle list with a vertex per distinct combination of
+ * position, normal and texture coordinate. Polygons are split into fans, degenerate
+ * triangles are dropped and missing normals are computed from the faces. Positions are
+ * centered and scaled to a largest extent of 1, like the unit cube of the procedural
+ * objects, so a mesh replaces a cube of a scene without changing its model matrix.
+ *
+ * optimizeMesh() reorders the triangles for the post transform vertex cache (Forsyth's
+ * linear speed algorithm, which works for any cache size), then reorders the clusters of
+ * triangles that start with a cache flush so that the clusters facing outwards are drawn
+ * first (less overdraw from most directions) as long as the cache miss ratio stays within
+ * 5%, and last renumbers the vertices in the order the triangles use them.
+ *
+ * quantizeMesh() packs a vertex into 16 bytes (MeshVertex) and the indices into 16 bits
+ * when possible. The result is cached next to the source (<file>.cmesh) exactly as it is
+ * uploaded, MeshCacheFile maps it so the data goes to GL without parsing. The cache is
+ * rebuilt when size or modification time of the source changed.
+ */
+
+/** indexed triangle list as loaded */
+typedef struct MeshData_t {
+	std::vector<float> positions;  //!< xyz per vertex
+	std::vector<float> normals;    //!< xyz per vertex
+	std::vector<float> texCoords;  //!< st per vertex (0 if the source has none)
+	std::vector<uint32_t> indices; //!< 3 per triangle
+
+	size_t numVertices() const { return positions.size()/3; }
+} MeshData;
+
+/** vertex of a quantized mesh */
+typedef struct MeshVertex_t {
+	int16_t position[4];  //!< snorm relative to the bounds (center + extent*p), w is 0
+	uint32_t normal;      //!< snorm x, y, z in 10 bits each (GL_INT_2_10_10_10_REV)
+	uint16_t texCoord[2]; //!< unorm relative to the range of the texture coordinates
+} MeshVertex;
+
+#define MESH_CACHE_VERSION 1
+
+/** header of a mesh cache file, followed by the vertices and the indices */
+typedef struct MeshCacheHeader_t {
+	char magic[4];         //!< "CMMS"
+	uint32_t version;      //!< MESH_CACHE_VERSION
+	uint64_t sourceSize;   //!< size of the source file in bytes
+	int64_t sourceTime;    //!< modification time of the source file
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t indexSize;    //!< 2 or 4 bytes per index
+	uint32_t reserved;     //!< zero
+	float center[3];       //!< center of the bounds
+	float extent[3];       //!< half size of the bounds
+	float uvOffset[2];     //!< smallest texture coordinate
+	float uvScale[2];      //!< range of the texture coordinates
+	float acmrSource;      //!< cache misses per triangle (16 entry FIFO) in the order of the source
+	float acmr;            //!< cache misses per triangle after the optimization
+} MeshCacheHeader;
+
+static_assert(sizeof(MeshVertex) == 16, "mesh vertex must not be padded");
+static_assert(sizeof(MeshCacheHeader) == 88, "mesh cache header must not be padded");
+
+/** mesh in the layout of the cache file */
+typedef struct QuantizedMesh_t {
+	MeshCacheHeader header;
+	std::vector<MeshVertex> vertices;
+	std::vector<uint8_t> indices;  //!< header.indexSize bytes per index
+} QuantizedMesh;
+
+bool loadOBJ(const std::string& file, MeshData& mesh);
+bool loadPLY(const std::string& file, MeshData& mesh);
+bool loadMesh(const std::string& file, MeshData& mesh);
+
+float cacheMissRatio(const std::vector<uint32_t>& indices, size_t numVertices, unsigned int cacheSize = 16);
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices);
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& positions, float threshold = 1.05f);
+void optimizeVertexFetch(MeshData& mesh);
+void optimizeMesh(MeshData& mesh, float& acmrSource, float& acmr);
+void quantizeMesh(const MeshData& mesh, QuantizedMesh& q);
+
+bool sourceStamp(const std::string& file, uint64_t& size, int64_t& time);
+bool writeMeshCache(const std::string& file, const QuantizedMesh& q);
+
+/** quantized mesh mapped from its cache file (or built in memory if the cache cannot be written) */
+class MeshCacheFile {
+public:
+	MeshCacheFile() : head(nullptr) {}
+
+	bool import(const std::string& source);
+	bool open(const std::string& file, uint64_t sourceSize, int64_t sourceTime);
+	void close();
+
+	const MeshCacheHeader& header() const { return *head; }
+	const MeshVertex* vertices() const;
+	const void* indices() const;
+
+private:
+	MappedFile mapping;
+	QuantizedMesh built;          //!< used if the cache could not be written
+	const MeshCacheHeader* head;  //!< header in the mapping or of built (nullptr = none)
+};
@@ -0,0 +1,106 @@
+// MeshLibrary.cpp
+//
+
+#include "MeshLibrary.h"
+#include "MeshImport.h"
+#include "SceneMath.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+MeshLibrary::MeshLibrary() {
+}
+
+MeshLibrary::~MeshLibrary() {
+	// GL objects are owned by the registry, see release()
+}
+
+/**
+ * Loads a mesh (OBJ or PLY) through its cache file and uploads it.
+ * @return index of the mesh, -1 if it could not be loaded
+ */
+int MeshLibrary::load(GPUResources& resources, const std::string& file) {
+	for(size_t i = 0; i < meshes.size(); i++){
+		if(meshes[i].file == file){
+			return static_cast<int>(i);
+		}
+	}
+	TRACE_SPAN_DETAIL(TRACE_LEVEL_INFO, "loadMesh", file.c_str());
+	MeshCacheFile cache;
+	if(!cache.import(file)){
+		return -1;
+	}
+	const MeshCacheHeader& h = cache.header();
+	Mesh m;
+	m.file = file;
+	m.indexType = h.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	m.numIndices = static_cast<GLsizei>(h.numIndices);
+	std::copy(h.center, h.center + 3, m.center);
+	std::copy(h.extent, h.extent + 3, m.extent);
+	std::copy(h.uvOffset, h.uvOffset + 2, m.uvOffset);
+	std::copy(h.uvScale, h.uvScale + 2, m.uvScale);
+	float corner[3];
+	for(int k = 0; k < 3; k++){
+		corner[k] = std::fabs(h.center[k]) + std::fabs(h.extent[k]);
+	}
+	m.halfExtent = std::sqrt(corner[0]*corner[0] + corner[1]*corner[1] + corner[2]*corner[2]);
+	m.key = hashBytes(file.data(), file.size());
+	m.key = hashBytes(&h.sourceSize, sizeof(h.sourceSize), m.key);
+	m.key = hashBytes(&h.sourceTime, sizeof(h.sourceTime), m.key);
+	size_t vertexBytes = static_cast<size_t>(h.numVertices)*sizeof(MeshVertex);
+	size_t indexBytes = static_cast<size_t>(h.numIndices)*h.indexSize;
+	m.bytes = vertexBytes + indexBytes;
+
+	m.vao = resources.createVertexArray("mesh");
+	glBindVertexArray(m.vao);
+	m.vertexBuffer = resources.createBuffer("mesh vertices");
+	glBindBuffer(GL_ARRAY_BUFFER, m.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, cache.vertices(), GL_STATIC_DRAW);
+	resources.setBufferSize(m.vertexBuffer, vertexBytes);
+	m.indexBuffer = resources.createBuffer("mesh indices");
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, cache.indices(), GL_STATIC_DRAW);
+	resources.setBufferSize(m.indexBuffer, indexBytes);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(MeshVertex), reinterpret_cast<const void*>(offsetof(MeshVertex, position)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(MeshVertex), reinterpret_cast<const void*>(offsetof(MeshVertex, normal)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(MeshVertex), reinterpret_cast<const void*>(offsetof(MeshVertex, texCoord)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	TRACE_INFO("mesh", "%s: %u vertices, %u triangles, %.1f KB, cache misses per triangle %.2f (source order %.2f)",
+			file.c_str(), h.numVertices, h.numIndices/3, m.bytes/1024.0, h.acmr, h.acmrSource);
+	meshes.push_back(m);
+	return static_cast<int>(meshes.size() - 1);
+}
+
+/** deletes all meshes */
+void MeshLibrary::release(GPUResources& resources) {
+	for(size_t i = 0; i < meshes.size(); i++){
+		resources.releaseBuffer(meshes[i].vertexBuffer);
+		resources.releaseBuffer(meshes[i].indexBuffer);
+		resources.releaseVertexArray(meshes[i].vao);
+	}
+	meshes.clear();
+}
+
+/** binds the vertex array of a mesh and sets the ranges of its attributes in the bound program */
+void MeshLibrary::bind(GLShader& shader, int mesh) const {
+	const Mesh& m = meshes[mesh];
+	glUniform3fv(shader.GetUniformLocation("meshCenter"), 1, m.center);
+	glUniform3fv(shader.GetUniformLocation("meshExtent"), 1, m.extent);
+	glUniform2fv(shader.GetUniformLocation("meshUVOffset"), 1, m.uvOffset);
+	glUniform2fv(shader.GetUniformLocation("meshUVScale"), 1, m.uvScale);
+	glBindVertexArray(m.vao);
+}
+
+/** memory of the vertex and index buffers of all meshes */
+size_t MeshLibrary::bytes() const {
+	size_t total = 0;
+	for(size_t i = 0; i < meshes.size(); i++){
+		total += meshes[i].bytes;
+	}
+	return total;
+}
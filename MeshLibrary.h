@@ -0,0 +1,56 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "GPUResources.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Triangle meshes of the scene objects on the GPU.
+ *
+ * load() imports a mesh through its cache file (see MeshImport.h) and uploads the
+ * quantized vertices and the indices as they are mapped, without conversion. Every mesh
+ * has a vertex array with the attributes of mesh_layered.vert.glsl (position snorm16,
+ * normal 10_10_10_2, texture coordinate unorm16), the ranges the attributes are relative
+ * to are set as uniforms by bind(). A mesh used by several objects is loaded once.
+ */
+class MeshLibrary {
+public:
+	MeshLibrary();
+	~MeshLibrary();
+
+	int load(GPUResources& resources, const std::string& file);
+	void release(GPUResources& resources);
+
+	void bind(GLShader& shader, int mesh) const;
+	void unbind() const { glBindVertexArray(0); }
+
+	size_t size() const { return meshes.size(); }
+	GLenum indexType(int mesh) const { return meshes[mesh].indexType; }
+	GLsizei numIndices(int mesh) const { return meshes[mesh].numIndices; }
+	float halfExtent(int mesh) const { return meshes[mesh].halfExtent; }
+	uint64_t key(int mesh) const { return meshes[mesh].key; }
+	size_t bytes() const;
+
+private:
+	typedef struct Mesh_t {
+		std::string file;
+		GLuint vao;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		GLenum indexType;     //!< GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		GLsizei numIndices;
+		float center[3];      //!< bounds of the quantized positions
+		float extent[3];
+		float uvOffset[2];    //!< range of the quantized texture coordinates
+		float uvScale[2];
+		float halfExtent;     //!< largest distance of the bounds from the origin (object space)
+		uint64_t key;         //!< hash of file name and source stamp (reflection probe key)
+		size_t bytes;         //!< size of the buffers
+	} Mesh;
+
+	std::vector<Mesh> meshes;
+};
@@ -0,0 +1,87 @@
+// OverdrawCounter.cpp
+//
+
+#include "OverdrawCounter.h"
+#include "Trace.h"
+
+OverdrawCounter::OverdrawCounter() {
+	buffer = 0;
+}
+
+OverdrawCounter::~OverdrawCounter() {
+	// GL objects are owned by the registry, see release()
+}
+
+/**
+ * Creates the counters of the layers.
+ * @return false if shader storage buffers are not supported
+ */
+bool OverdrawCounter::create(GPUResources& resources, int numLayers) {
+	release(resources);
+	if(!gl3wIsSupported(4, 3)){
+		TRACE_WARN("overdraw", "counting the shaded fragments needs GL 4.3");
+		return false;
+	}
+	counts.assign(numLayers, 0);
+	size_t bytes = numLayers*sizeof(GLuint);
+	buffer = resources.createBuffer("overdraw counters");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	resources.setBufferSize(buffer, bytes);
+	return true;
+}
+
+/** deletes the counters */
+void OverdrawCounter::release(GPUResources& resources) {
+	resources.releaseBuffer(buffer);
+	counts.clear();
+}
+
+/**
+ * Preprocessor definitions enabling the counting in the fragment shaders: the extensions,
+ * OVERDRAW_DECLARATIONS (storage buffer and early fragment tests, so fragments rejected by
+ * the depth test are not shaded and not counted) and COUNT_FRAGMENT().
+ * @param layerFromPass  the layer is the view of the pass (multi pass backend,
+ *                       the fragment shader cannot read gl_Layer there)
+ */
+std::string OverdrawCounter::shaderDefines(bool layerFromPass) {
+	std::string defines = "#define COUNT_OVERDRAW\n"
+			"#extension GL_ARB_shader_storage_buffer_object : require\n"
+			"#extension GL_ARB_shader_image_load_store : require\n"
+			"#extension GL_ARB_shading_language_420pack : require\n";
+	std::string declarations = "layout(early_fragment_tests) in; layout(std430, binding = " + std::to_string(binding)
+			+ ") buffer OverdrawCounts { uint fragments[]; } overdraw;";
+	if(layerFromPass){
+		defines += "#define OVERDRAW_LAYER view\n";
+		declarations += " uniform int view;";
+	} else {
+		defines += "#extension GL_ARB_fragment_layer_viewport : require\n#define OVERDRAW_LAYER gl_Layer\n";
+	}
+	return defines + "#define OVERDRAW_DECLARATIONS " + declarations + "\n"
+			"#define COUNT_FRAGMENT() atomicAdd(overdraw.fragments[OVERDRAW_LAYER], 1u)\n";
+}
+
+/** clears the counters and binds them for the passes of the frame */
+void OverdrawCounter::begin() {
+	if(!isCreated()){
+		return;
+	}
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+/** unbinds the counters and reads them back (waits for the passes of the frame) */
+void OverdrawCounter::end() {
+	if(!isCreated()){
+		return;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counts.size()*sizeof(GLuint), &counts[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GPUResources.h"
+#include <string>
+#include <vector>
+
+/*
+ * Instrumentation counting the fragments shaded per layer.
+ *
+ * The fragment shaders of the skybox, object and mirror passes are compiled with the
+ * definitions of shaderDefines(), which makes them add 1 to the counter of their layer
+ * in a storage buffer (early fragment tests are forced, so fragments rejected by the
+ * depth test are not counted, as in the regular shaders). Dividing the counts by the
+ * pixels of the viewports gives the overdraw of each layer, 1.0 means every pixel was
+ * shaded exactly once.
+ *
+ * end() reads the counters back right away and waits for the GPU, so this is meant
+ * for measurements only. Needs GL 4.3 (shader storage buffers), create() fails otherwise.
+ */
+class OverdrawCounter {
+public:
+	OverdrawCounter();
+	~OverdrawCounter();
+
+	bool create(GPUResources& resources, int numLayers);
+	void release(GPUResources& resources);
+	bool isCreated() const { return buffer != 0; }
+
+	static std::string shaderDefines(bool layerFromPass);
+
+	void begin();
+	void end();
+	unsigned int fragments(int layer) const { return counts[layer]; }
+
+	static const GLuint binding = 3; //!< binding point of the storage buffer (see shaderDefines())
+
+private:
+	GLuint buffer;                     //!< one counter per layer
+	std::vector<unsigned int> counts;  //!< counters read back by end()
+};
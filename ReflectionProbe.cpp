@@ -0,0 +1,185 @@
+// ReflectionProbe.cpp
+//
+
+#include "ReflectionProbe.h"
+#include "CubeMipChain.h"
+#include "Trace.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char probeMagic[4] = {'C','M','R','P'};
+static const uint32_t probeVersion = 1;
+
+/** pixel transfer format and size of a texel of the internal formats the reflection can have */
+static bool probeTransferFormat(GLenum internalFormat, GLenum& format, GLenum& type, size_t& texelBytes) {
+	switch(internalFormat){
+		case GL_RGBA8:
+			format = GL_RGBA; type = GL_UNSIGNED_BYTE; texelBytes = 4;
+			return true;
+		case GL_RGBA16F:
+			format = GL_RGBA; type = GL_HALF_FLOAT; texelBytes = 8;
+			return true;
+		case GL_RGBA32F:
+			format = GL_RGBA; type = GL_FLOAT; texelBytes = 16;
+			return true;
+		case GL_R11F_G11F_B10F:
+			format = GL_RGB; type = GL_UNSIGNED_INT_10F_11F_11F_REV; texelBytes = 4;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** size of all levels of a cubemap */
+static size_t probeDataSize(size_t texelBytes, int resolution, int levels) {
+	size_t bytes = 0;
+	for(int level = 0, side = resolution; level < levels; level++, side = side > 1 ? side/2 : 1){
+		bytes += 6*static_cast<size_t>(side)*side*texelBytes;
+	}
+	return bytes;
+}
+
+ReflectionProbe::ReflectionProbe() {
+	texture = 0;
+	bakedKey = 0;
+	faceResolution = 0;
+	numLevels = 0;
+}
+
+ReflectionProbe::~ReflectionProbe() {
+	// GL objects are owned by the registry, see release()
+}
+
+/** name of the cache file of a key in the directory */
+std::string ReflectionProbe::cacheFileName(const std::string& directory, uint64_t key) {
+	char name[48];
+	std::snprintf(name, sizeof(name), "/reflection_%016" PRIx64 ".probe", key);
+	return directory + name;
+}
+
+/** deletes the baked cubemap (the cache file is kept) */
+void ReflectionProbe::release(GPUResources& resources) {
+	resources.releaseTexture(texture);
+	bakedKey = 0;
+	faceResolution = numLevels = 0;
+}
+
+/**
+ * Reads all levels of a cubemap back, writes them to the cache file and keeps them
+ * as the baked probe. Waits for the GPU.
+ * @param cubeMap  rendered reflection with its complete mip chain
+ */
+bool ReflectionProbe::bake(GPUResources& resources, GLuint cubeMap, GLenum internalFormat, int resolution,
+		uint64_t key, const std::string& file)
+{
+	GLenum format, type;
+	size_t texelBytes;
+	if(!probeTransferFormat(internalFormat, format, type, texelBytes)){
+		TRACE_ERROR("probe", "cannot bake cubemaps of format 0x%x", internalFormat);
+		return false;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "probe bake");
+	int levels = CubeMipChain::numLevels(resolution);
+	std::vector<unsigned char> data(probeDataSize(texelBytes, resolution, levels));
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	size_t offset = 0;
+	for(int level = 0, side = resolution; level < levels; level++, side = side > 1 ? side/2 : 1){
+		for(int face = 0; face < 6; face++){
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, format, type, &data[offset]);
+			offset += static_cast<size_t>(side)*side*texelBytes;
+		}
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	std::ofstream out(file.c_str(), std::ios::binary);
+	if(out.is_open()){
+		uint32_t header[4] = {probeVersion, static_cast<uint32_t>(internalFormat), static_cast<uint32_t>(resolution), static_cast<uint32_t>(levels)};
+		uint64_t dataSize = data.size();
+		out.write(probeMagic, 4);
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+		out.write(reinterpret_cast<const char*>(&dataSize), sizeof(dataSize));
+		out.write(reinterpret_cast<const char*>(&data[0]), static_cast<std::streamsize>(dataSize));
+	}
+	if(!out.good()){
+		// the probe is still used for this session
+		TRACE_ERROR("probe", "could not write cache file [%s]", file.c_str());
+	}
+	TRACE_INFO("probe", "baked %dx%d reflection (%d levels) to %s", resolution, resolution, levels, file.c_str());
+	return upload(resources, data, internalFormat, resolution, levels, key);
+}
+
+/**
+ * Restores the probe from a cache file. Fails if the file does not exist or was
+ * baked for another key or format.
+ */
+bool ReflectionProbe::load(GPUResources& resources, const std::string& file, uint64_t key, GLenum internalFormat) {
+	GLenum format, type;
+	size_t texelBytes;
+	if(!probeTransferFormat(internalFormat, format, type, texelBytes)){
+		return false;
+	}
+	std::ifstream in(file.c_str(), std::ios::binary);
+	if(!in.is_open()){
+		return false;
+	}
+	char magic[4];
+	uint32_t header[4];
+	uint64_t fileKey;
+	uint64_t dataSize;
+	in.read(magic, 4);
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	in.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+	in.read(reinterpret_cast<char*>(&dataSize), sizeof(dataSize));
+	int resolution = static_cast<int>(header[2]);
+	int levels = static_cast<int>(header[3]);
+	if(!in.good() || std::memcmp(magic, probeMagic, 4) != 0 || header[0] != probeVersion
+			|| header[1] != static_cast<uint32_t>(internalFormat) || fileKey != key || resolution <= 0
+			|| levels != CubeMipChain::numLevels(resolution) || dataSize != probeDataSize(texelBytes, resolution, levels)){
+		TRACE_WARN("probe", "ignoring cache file [%s] (other version, format or state)", file.c_str());
+		return false;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "probe load");
+	std::vector<unsigned char> data(static_cast<size_t>(dataSize));
+	in.read(reinterpret_cast<char*>(&data[0]), static_cast<std::streamsize>(dataSize));
+	if(!in.good()){
+		return false;
+	}
+	TRACE_INFO("probe", "loading file %s", file.c_str());
+	return upload(resources, data, internalFormat, resolution, levels, key);
+}
+
+/** replaces the baked cubemap by the given levels */
+bool ReflectionProbe::upload(GPUResources& resources, const std::vector<unsigned char>& data, GLenum internalFormat,
+		int resolution, int levels, uint64_t key)
+{
+	GLenum format, type;
+	size_t texelBytes;
+	probeTransferFormat(internalFormat, format, type, texelBytes);
+	release(resources);
+	texture = resources.createTexture(GPUResources::CAT_TEXTURE, "baked reflection");
+	resources.setTextureStorage(texture, internalFormat, resolution, resolution, 6, levels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	size_t offset = 0;
+	for(int level = 0, side = resolution; level < levels; level++, side = side > 1 ? side/2 : 1){
+		for(int face = 0; face < 6; face++){
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internalFormat, side, side, 0, format, type, &data[offset]);
+			offset += static_cast<size_t>(side)*side*texelBytes;
+		}
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	bakedKey = key;
+	faceResolution = resolution;
+	numLevels = levels;
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GPUResources.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Baked reflection cubemap of a static scene.
+ *
+ * bake() reads all levels of a rendered reflection cubemap back (once, so waiting for
+ * the GPU is fine), writes them to a cache file and uploads them into a texture of its
+ * own, load() restores that texture from the cache file of a later session. The probe
+ * carries the key of the state it was baked for (a 64 bit FNV-1a hash of the objects,
+ * the skybox and the settings that change the reflection, see hashBytes() in SceneMath.h):
+ * it is only used while the key of the current state matches, otherwise the reflection
+ * is rendered every frame as before.
+ *
+ * Cache files (reflection_<key>.probe) start with the magic "CMRP", the version, the
+ * internal format, the face resolution, the number of levels, the key and the size of
+ * the data, followed by the levels (faces in GL order) as read with glGetTexImage.
+ */
+class ReflectionProbe {
+public:
+	ReflectionProbe();
+	~ReflectionProbe();
+
+	static std::string cacheFileName(const std::string& directory, uint64_t key);
+
+	bool bake(GPUResources& resources, GLuint cubeMap, GLenum internalFormat, int resolution,
+			uint64_t key, const std::string& file);
+	bool load(GPUResources& resources, const std::string& file, uint64_t key, GLenum internalFormat);
+	void release(GPUResources& resources);
+
+	bool isValid() const { return texture != 0; }
+	uint64_t key() const { return bakedKey; }
+	GLuint cubeMap() const { return texture; }
+	int resolution() const { return faceResolution; }
+	int levels() const { return numLevels; }
+
+private:
+	bool upload(GPUResources& resources, const std::vector<unsigned char>& data, GLenum internalFormat,
+			int resolution, int levels, uint64_t key);
+
+	GLuint texture;        //!< the baked cubemap with its mip chain (0 = none)
+	uint64_t bakedKey;     //!< state the cubemap was baked for
+	int faceResolution;    //!< width and height of level 0
+	int numLevels;         //!< levels of texture
+};
@@ -0,0 +1,152 @@
+// RegionSelection.cpp
+//
+
+#include "RegionSelection.h"
+#include "Trace.h"
+#include <algorithm>
+
+/** largest id the 24 bit pick colors can encode (see pickIdToColor) */
+static const size_t maxPickId = 0xffffff/111;
+static const size_t bitsWords = maxPickId/32 + 1;
+
+/** binding points of the storage buffers in pickregion.comp.glsl */
+static const GLuint bitsBinding = 0;
+static const GLuint listBinding = 1;
+static const GLuint lassoBinding = 2;
+
+RegionSelection::RegionSelection() {
+	bitsBuffer = listBuffer = lassoBuffer = 0;
+	listCapacity = 0;
+	fence = 0;
+}
+
+RegionSelection::~RegionSelection() {
+	// GL objects are owned by the registry, see release()
+}
+
+/**
+ * Creates the bitset and the lasso buffer, the id list grows with the number
+ * of objects on the first select().
+ * @return false if compute shaders are not supported
+ */
+bool RegionSelection::create(GPUResources& resources) {
+	if(!gl3wIsSupported(4, 3)){
+		TRACE_WARN("selection", "region selection needs GL 4.3, only single objects can be picked");
+		return false;
+	}
+	bitsBuffer = resources.createBuffer("selection bitset");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bitsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bitsWords*sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	resources.setBufferSize(bitsBuffer, bitsWords*sizeof(GLuint));
+	lassoBuffer = resources.createBuffer("selection lasso");
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lassoBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, maxLassoPoints*sizeof(glm::vec2), nullptr, GL_DYNAMIC_DRAW);
+	resources.setBufferSize(lassoBuffer, maxLassoPoints*sizeof(glm::vec2));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return true;
+}
+
+/** deletes the buffers, a pending selection is dropped */
+void RegionSelection::release(GPUResources& resources) {
+	cancel();
+	resources.releaseBuffer(bitsBuffer);
+	resources.releaseBuffer(listBuffer);
+	resources.releaseBuffer(lassoBuffer);
+	listCapacity = 0;
+}
+
+/**
+ * Starts the selection of the objects in a region of layer 0 of the picking attachment.
+ * A selection that is still pending is replaced.
+ * @param x0,y0,x1,y1  pixel rectangle (GL window coordinates, x1/y1 exclusive)
+ * @param lasso        polygon in GL window coordinates, the rectangle has to be its
+ *                     bounding box (less than 3 points select the whole rectangle)
+ * @param maxIds       number of objects in the scene
+ */
+bool RegionSelection::select(GPUResources& resources, GLShader& shader, GLuint pickingTexture,
+		int x0, int y0, int x1, int y1, const std::vector<glm::vec2>& lasso, size_t maxIds) {
+	if(!isCreated() || x1 <= x0 || y1 <= y0){
+		return false;
+	}
+	TRACE_SPAN(TRACE_LEVEL_INFO, "region selection");
+	cancel();
+	if(maxIds + 1 > listCapacity){
+		resources.releaseBuffer(listBuffer);
+		listCapacity = std::min(maxIds, maxPickId) + 1;
+		size_t bytes = (1 + listCapacity)*sizeof(GLuint);
+		listBuffer = resources.createBuffer("selection list");
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, listBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_READ);
+		resources.setBufferSize(listBuffer, bytes);
+	}
+	// reset the bitset and the list length
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bitsBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, listBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	int numLassoPoints = lasso.size() >= 3 ? static_cast<int>(std::min<size_t>(lasso.size(), maxLassoPoints)) : 0;
+	if(numLassoPoints){
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lassoBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numLassoPoints*sizeof(glm::vec2), &lasso[0]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	shader.Bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, pickingTexture);
+	glUniform1i(shader.GetUniformLocation("pickTex"), 0);
+	glUniform4i(shader.GetUniformLocation("region"), x0, y0, x1, y1);
+	glUniform1i(shader.GetUniformLocation("numLassoPoints"), numLassoPoints);
+	glUniform1ui(shader.GetUniformLocation("maxIds"), static_cast<GLuint>(listCapacity));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bitsBinding, bitsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, listBinding, listBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, lassoBinding, lassoBuffer);
+	// 16x16 invocations per work group
+	glDispatchCompute((x1 - x0 + 15)/16, (y1 - y0 + 15)/16, 1);
+	// the list is read with glGetBufferSubData
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bitsBinding, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, listBinding, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, lassoBinding, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	shader.Release();
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	TRACE_DEBUG("selection", "region %d %d - %d %d, %d lasso points", x0, y0, x1, y1, numLassoPoints);
+	return true;
+}
+
+/**
+ * Reads the ids of the pending selection back if the GPU has finished it (never waits).
+ * @return true if ids holds the result (unordered, without duplicates)
+ */
+bool RegionSelection::poll(std::vector<unsigned int>& ids) {
+	if(!fence){
+		return false;
+	}
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+		return false;
+	}
+	glDeleteSync(fence);
+	fence = 0;
+	GLuint count = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, listBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+	count = static_cast<GLuint>(std::min<size_t>(count, listCapacity));
+	ids.resize(count);
+	if(count){
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), count*sizeof(GLuint), &ids[0]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	TRACE_COUNTER(TRACE_LEVEL_INFO, "selection readback bytes", (1 + count)*sizeof(GLuint));
+	return true;
+}
+
+/** drops the pending selection */
+void RegionSelection::cancel() {
+	if(fence){
+		glDeleteSync(fence);
+		fence = 0;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "GPUResources.h"
+#include "glm/glm.hpp"
+#include <cstddef>
+#include <vector>
+
+/*
+ * Selection of all objects visible inside a rectangle or lasso of the picking buffer.
+ *
+ * A compute pass (resources/pickregion.comp.glsl) runs over the pixels of the region
+ * in the picking attachment, decodes the object id of every pixel and sets its bit in
+ * an id bitset with atomicOr. The invocation that sets a bit first also appends the id
+ * to a compact list, so the list holds every id in the region exactly once.
+ * Only the length and the entries of that list are read back, once a fence tells the
+ * GPU has finished. The region is never read back as a whole, so selecting thousands of
+ * objects costs a few KB of readback.
+ *
+ * Needs GL 4.3 (compute shaders, shader storage buffers), create() fails otherwise.
+ */
+class RegionSelection {
+public:
+	RegionSelection();
+	~RegionSelection();
+
+	bool create(GPUResources& resources);
+	void release(GPUResources& resources);
+	bool isCreated() const { return bitsBuffer != 0; }
+
+	bool select(GPUResources& resources, GLShader& shader, GLuint pickingTexture,
+			int x0, int y0, int x1, int y1, const std::vector<glm::vec2>& lasso, size_t maxIds);
+	bool pending() const { return fence != 0; }
+	bool poll(std::vector<unsigned int>& ids);
+	void cancel();
+
+	static const int maxLassoPoints = 1024;
+
+private:
+	GLuint bitsBuffer;   //!< one bit per possible object id
+	GLuint listBuffer;   //!< count followed by the ids found in the region
+	GLuint lassoBuffer;  //!< lasso polygon in pixel coordinates
+	size_t listCapacity; //!< number of ids that fit into listBuffer
+	GLsync fence;        //!< signaled when the pass of the pending selection has finished
+};
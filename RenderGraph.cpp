@@ -0,0 +1,315 @@
+// RenderGraph.cpp
+//
+
+#include "RenderGraph.h"
+#include "Trace.h"
+#include <algorithm>
+
+RenderTargetState::RenderTargetState() {
+	issued = skipped = 0;
+	invalidate();
+}
+
+/**
+ * Sets framebuffer, draw buffers and viewport (0,0,width,height), only the ones that
+ * differ from the last call are passed to GL.
+ */
+void RenderTargetState::bindTargets(GLuint fbo, unsigned int numBuffers, const GLenum* buffers, int width, int height) {
+	if(!fboValid || boundFBO != fbo){
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		boundFBO = fbo;
+		fboValid = true;
+		issued++;
+	} else {
+		skipped++;
+	}
+	size_t i = 0;
+	while(i < drawBuffers.size() && drawBuffers[i].fbo != fbo){
+		i++;
+	}
+	bool same = i < drawBuffers.size() && drawBuffers[i].count == numBuffers
+			&& std::equal(buffers, buffers + numBuffers, drawBuffers[i].buffers);
+	if(same){
+		skipped++;
+	} else {
+		if(numBuffers > 1){
+			glDrawBuffers(numBuffers, buffers);
+		}else{
+			glDrawBuffer(buffers[0]);
+		}
+		issued++;
+		if(numBuffers <= 4){
+			if(i == drawBuffers.size()){
+				drawBuffers.push_back(DrawBuffers());
+			}
+			drawBuffers[i].fbo = fbo;
+			drawBuffers[i].count = numBuffers;
+			std::copy(buffers, buffers + numBuffers, drawBuffers[i].buffers);
+		}
+	}
+	if(!viewportValid || viewportWidth != width || viewportHeight != height){
+		glViewport(0, 0, width, height);
+		viewportWidth = width;
+		viewportHeight = height;
+		viewportValid = true;
+		issued++;
+	} else {
+		skipped++;
+	}
+}
+
+/** forgets all state, the next bindTargets() sets everything */
+void RenderTargetState::invalidate() {
+	fboValid = false;
+	boundFBO = 0;
+	viewportValid = false;
+	viewportWidth = viewportHeight = 0;
+	drawBuffers.clear();
+}
+
+RenderGraph::RenderGraph() {
+	usedBytes = 0;
+	totalBarriers = 0;
+}
+
+/** removes the passes and targets of the last frame */
+void RenderGraph::reset() {
+	targets.clear();
+	passes.clear();
+	passOrder.clear();
+	usedBytes = 0;
+	totalBarriers = 0;
+}
+
+/** adds a target that lives beyond the frame */
+RenderGraph::Target RenderGraph::importTarget(const char* name, size_t bytes) {
+	TargetInfo t;
+	t.name = name;
+	t.bytes = bytes;
+	t.imported = true;
+	t.firstUse = t.lastUse = -1;
+	targets.push_back(t);
+	return static_cast<Target>(targets.size() - 1);
+}
+
+/** adds a target whose contents are only used within the frame */
+RenderGraph::Target RenderGraph::transientTarget(const char* name, size_t bytes) {
+	Target t = importTarget(name, bytes);
+	targets[t].imported = false;
+	return t;
+}
+
+/**
+ * Adds a pass.
+ * @param bindsOwnTargets  the pass binds framebuffers or sets viewports directly, the
+ *                         RenderTargetState is invalidated after it
+ * @return index of the pass for reads(), writes() and modifies()
+ */
+int RenderGraph::addPass(const char* name, const std::function<void()>& run, bool bindsOwnTargets) {
+	PassInfo p;
+	p.name = name;
+	p.run = run;
+	p.bindsOwnTargets = bindsOwnTargets;
+	p.culled = false;
+	p.barriers = 0;
+	passes.push_back(p);
+	return static_cast<int>(passes.size() - 1);
+}
+
+void RenderGraph::reads(int pass, Target t) { access(pass, t, ACCESS_READ); }
+void RenderGraph::writes(int pass, Target t) { access(pass, t, ACCESS_WRITE); }
+void RenderGraph::modifies(int pass, Target t) { access(pass, t, ACCESS_MODIFY); }
+
+void RenderGraph::access(int pass, Target t, int kind) {
+	std::vector<PassAccess>& accesses = passes[pass].accesses;
+	for(size_t i = 0; i < accesses.size(); i++){
+		if(accesses[i].target == t){
+			accesses[i].access |= kind;
+			return;
+		}
+	}
+	PassAccess a;
+	a.target = t;
+	a.access = kind;
+	accesses.push_back(a);
+}
+
+/** whether two passes write the same targets (and can share the bound framebuffer) */
+bool RenderGraph::sameTargets(int a, int b) const {
+	std::vector<Target> wa, wb;
+	for(size_t i = 0; i < passes[a].accesses.size(); i++){
+		if(passes[a].accesses[i].access & ACCESS_WRITE){
+			wa.push_back(passes[a].accesses[i].target);
+		}
+	}
+	for(size_t i = 0; i < passes[b].accesses.size(); i++){
+		if(passes[b].accesses[i].access & ACCESS_WRITE){
+			wb.push_back(passes[b].accesses[i].target);
+		}
+	}
+	std::sort(wa.begin(), wa.end());
+	std::sort(wb.begin(), wb.end());
+	return wa == wb;
+}
+
+/** culls and orders the passes, computes the lifetimes of the targets and the barriers */
+void RenderGraph::compile() {
+	size_t numPasses = passes.size();
+	size_t numTargets = targets.size();
+
+	// culling, from the last pass to the first: a target is demanded while a kept pass
+	// reads the contents the passes before it wrote
+	std::vector<bool> demanded(numTargets, false);
+	for(size_t p = numPasses; p-- > 0;){
+		PassInfo& pass = passes[p];
+		bool needed = false;
+		for(size_t i = 0; i < pass.accesses.size(); i++){
+			const PassAccess& a = pass.accesses[i];
+			if((a.access & ACCESS_WRITE) && (targets[a.target].imported || demanded[a.target])){
+				needed = true;
+			}
+		}
+		pass.culled = !needed;
+		if(!needed){
+			continue;
+		}
+		for(size_t i = 0; i < pass.accesses.size(); i++){
+			const PassAccess& a = pass.accesses[i];
+			if(a.access & ACCESS_WRITE){
+				demanded[a.target] = false;
+			}
+		}
+		for(size_t i = 0; i < pass.accesses.size(); i++){
+			const PassAccess& a = pass.accesses[i];
+			if(a.access & ACCESS_READ){
+				demanded[a.target] = true;
+			}
+		}
+	}
+
+	// dependencies of the kept passes in the order they were added
+	std::vector<std::vector<int> > successors(numPasses);
+	std::vector<int> predecessors(numPasses, 0);
+	std::vector<int> lastWriter(numTargets, -1);
+	std::vector<std::vector<int> > readers(numTargets);
+	for(size_t p = 0; p < numPasses; p++){
+		const PassInfo& pass = passes[p];
+		if(pass.culled){
+			continue;
+		}
+		int self = static_cast<int>(p);
+		for(size_t i = 0; i < pass.accesses.size(); i++){
+			const PassAccess& a = pass.accesses[i];
+			std::vector<int> after;
+			after.push_back(lastWriter[a.target]);
+			if(a.access & ACCESS_WRITE){
+				after.insert(after.end(), readers[a.target].begin(), readers[a.target].end());
+			}
+			for(size_t j = 0; j < after.size(); j++){
+				if(after[j] >= 0 && after[j] != self){
+					successors[after[j]].push_back(self);
+					predecessors[p]++;
+				}
+			}
+			if(a.access & ACCESS_WRITE){
+				lastWriter[a.target] = self;
+				readers[a.target].clear();
+			} else {
+				readers[a.target].push_back(self);
+			}
+		}
+	}
+
+	// order, prefers the pass with the targets of the last one, then the pass added first
+	passOrder.clear();
+	std::vector<bool> scheduled(numPasses, false);
+	int last = -1;
+	for(;;){
+		int next = -1;
+		for(size_t p = 0; p < numPasses; p++){
+			if(passes[p].culled || scheduled[p] || predecessors[p] > 0){
+				continue;
+			}
+			if(next < 0){
+				next = static_cast<int>(p);
+			}
+			if(last >= 0 && sameTargets(static_cast<int>(p), last)){
+				next = static_cast<int>(p);
+				break;
+			}
+		}
+		if(next < 0){
+			break;
+		}
+		scheduled[next] = true;
+		passOrder.push_back(next);
+		for(size_t j = 0; j < successors[next].size(); j++){
+			predecessors[successors[next][j]]--;
+		}
+		last = next;
+	}
+
+	// lifetimes and barriers
+	std::vector<int> lastAccess(numTargets, 0);
+	totalBarriers = 0;
+	for(size_t i = 0; i < numTargets; i++){
+		targets[i].firstUse = targets[i].lastUse = -1;
+	}
+	for(size_t position = 0; position < passOrder.size(); position++){
+		PassInfo& pass = passes[passOrder[position]];
+		pass.barriers = 0;
+		for(size_t i = 0; i < pass.accesses.size(); i++){
+			const PassAccess& a = pass.accesses[i];
+			TargetInfo& t = targets[a.target];
+			if(t.firstUse < 0){
+				t.firstUse = static_cast<int>(position);
+			}
+			t.lastUse = static_cast<int>(position);
+			// sampling a rendered target or rendering to a sampled one
+			int before = lastAccess[a.target];
+			if((a.access == ACCESS_READ && (before & ACCESS_WRITE)) || ((a.access & ACCESS_WRITE) && before == ACCESS_READ)){
+				pass.barriers++;
+			}
+			lastAccess[a.target] = a.access;
+		}
+		totalBarriers += pass.barriers;
+	}
+
+	// memory of the targets the kept passes use
+	usedBytes = 0;
+	for(size_t i = 0; i < numTargets; i++){
+		if(targets[i].firstUse >= 0){
+			usedBytes += targets[i].bytes;
+		}
+	}
+}
+
+/** runs the kept passes in order */
+void RenderGraph::execute(RenderTargetState& state) {
+	for(size_t i = 0; i < passOrder.size(); i++){
+		const PassInfo& pass = passes[passOrder[i]];
+		pass.run();
+		if(pass.bindsOwnTargets){
+			state.invalidate();
+		}
+	}
+}
+
+/** traces order, barriers and memory of the compiled graph */
+void RenderGraph::report(const char* graphName) const {
+	for(size_t i = 0; i < passOrder.size(); i++){
+		const PassInfo& pass = passes[passOrder[i]];
+		TRACE_DEBUG("graph", "%s %d: %s (%d barriers)", graphName, static_cast<int>(i), pass.name.c_str(), pass.barriers);
+	}
+	for(size_t i = 0; i < passes.size(); i++){
+		if(passes[i].culled){
+			TRACE_DEBUG("graph", "%s: %s culled", graphName, passes[i].name.c_str());
+		}
+	}
+	for(size_t i = 0; i < targets.size(); i++){
+		if(!targets[i].imported && targets[i].firstUse >= 0){
+			TRACE_DEBUG("graph", "%s: %s transient, passes %d-%d", graphName, targets[i].name.c_str(),
+					targets[i].firstUse, targets[i].lastUse);
+		}
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Framebuffer, draw buffers and viewport last set through bindTargets().
+ * Binds that would not change anything are skipped. Code that binds framebuffers or sets
+ * viewports directly has to call invalidate() (or invalidateViewport()) afterwards.
+ */
+class RenderTargetState {
+public:
+	RenderTargetState();
+
+	void bindTargets(GLuint fbo, unsigned int numBuffers, const GLenum* buffers, int width, int height);
+	void invalidate();
+	void invalidateViewport() { viewportValid = false; }
+	void resetCounters() { issued = skipped = 0; }
+
+	unsigned int issuedChanges() const { return issued; }
+	unsigned int skippedChanges() const { return skipped; }
+
+private:
+	/** draw buffers of a framebuffer, they are state of the framebuffer object */
+	typedef struct DrawBuffers_t {
+		GLuint fbo;
+		unsigned int count;
+		GLenum buffers[4];
+	} DrawBuffers;
+
+	bool fboValid;       //!< boundFBO is known
+	GLuint boundFBO;
+	bool viewportValid;  //!< viewportWidth and viewportHeight are known
+	int viewportWidth;
+	int viewportHeight;
+	std::vector<DrawBuffers> drawBuffers; //!< known draw buffers per framebuffer
+	unsigned int issued;   //!< GL calls made since resetCounters()
+	unsigned int skipped;  //!< GL calls skipped since resetCounters()
+};
+
+/*
+ * Declarative description of the passes of a frame.
+ *
+ * The passes are added every frame together with the targets they sample (reads()),
+ * render to (writes()) or render to on top of the contents (modifies(), e.g. with the
+ * depth test). A pass sees what the passes added before it wrote. compile()
+ * - culls the passes whose results are not used: a pass is kept if it writes an imported
+ *   target or a transient target a kept pass reads later,
+ * - orders the kept passes: any order that keeps the dependencies (read after write,
+ *   write after write, write after read) is valid, of the passes that may run next the
+ *   one with the same targets as the last one is preferred (fewer framebuffer switches),
+ * - computes the lifetimes of the transient targets (used within the frame only, traced
+ *   by report()) and the memory of the targets the kept passes use,
+ * - counts the barriers of every pass, that is targets sampled after they were rendered
+ *   to or rendered to after they were sampled (GL inserts them implicitly).
+ * execute() runs the passes in that order.
+ *
+ * Imported targets outlive the frame (the color layers are presented by later frames,
+ * the picking layers are read on mouse events, the reflection is reused).
+ */
+class RenderGraph {
+public:
+	typedef int Target;
+
+	RenderGraph();
+
+	void reset();
+	Target importTarget(const char* name, size_t bytes);
+	Target transientTarget(const char* name, size_t bytes);
+	int addPass(const char* name, const std::function<void()>& run, bool bindsOwnTargets = false);
+	void reads(int pass, Target t);
+	void writes(int pass, Target t);
+	void modifies(int pass, Target t);
+
+	void compile();
+	void execute(RenderTargetState& targets);
+	void report(const char* graphName) const;
+
+	const std::vector<int>& order() const { return passOrder; }
+	size_t targetBytes() const { return usedBytes; }
+	int barriers() const { return totalBarriers; }
+	int culledPasses() const { return static_cast<int>(passes.size() - passOrder.size()); }
+
+private:
+	/** kinds of access, modify = read | write */
+	enum Access { ACCESS_READ = 1, ACCESS_WRITE = 2, ACCESS_MODIFY = 3 };
+
+	typedef struct TargetInfo_t {
+		std::string name;
+		size_t bytes;
+		bool imported;
+		int firstUse;          //!< position of the first pass using it in passOrder (-1 = unused)
+		int lastUse;           //!< position of the last pass using it
+	} TargetInfo;
+
+	typedef struct PassAccess_t {
+		Target target;
+		int access;
+	} PassAccess;
+
+	typedef struct PassInfo_t {
+		std::string name;
+		std::function<void()> run;
+		std::vector<PassAccess> accesses;
+		bool bindsOwnTargets;  //!< binds framebuffers or sets viewports without RenderTargetState
+		bool culled;
+		int barriers;          //!< barriers needed before the pass
+	} PassInfo;
+
+	void access(int pass, Target t, int kind);
+	bool sameTargets(int a, int b) const;
+
+	std::vector<TargetInfo> targets;
+	std::vector<PassInfo> passes;
+	std::vector<int> passOrder;  //!< kept passes in execution order
+	size_t usedBytes;            //!< targets used by the kept passes
+	int totalBarriers;
+};
@@ -0,0 +1,293 @@
+// SceneFile.cpp
+//
+
+#include "SceneFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char* textureNames[SCENE_TEXTURE_COUNT] = {"none", "bridge", "space", "clouds", "earth"};
+static const char* warpNames[3] = {"identity", "tangent", "COBE"};
+
+/** @return name of the texture as used in the text format */
+const char* sceneTextureName(int texture) {
+	return texture >= 0 && texture < SCENE_TEXTURE_COUNT ? textureNames[texture] : "none";
+}
+
+MappedFile::MappedFile() {
+	view = nullptr;
+	length = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+/**
+ * Maps the whole file read only into memory.
+ * @return false if the file could not be opened or mapped (or is empty)
+ */
+bool MappedFile::open(const std::string& file) {
+	close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(fileHandle == INVALID_HANDLE_VALUE){
+		std::fprintf(stderr, "could not open file [%s]\n", file.c_str());
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0){
+		std::fprintf(stderr, "could not map empty file [%s]\n", file.c_str());
+		close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mappingHandle){
+		view = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+	if(!view){
+		std::fprintf(stderr, "could not map file [%s]\n", file.c_str());
+		close();
+		return false;
+	}
+	length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if(fd < 0){
+		std::fprintf(stderr, "could not open file [%s]\n", file.c_str());
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		std::fprintf(stderr, "could not map empty file [%s]\n", file.c_str());
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps the file referenced
+	if(p == MAP_FAILED){
+		std::fprintf(stderr, "could not map file [%s]\n", file.c_str());
+		return false;
+	}
+	madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+	view = static_cast<const unsigned char*>(p);
+	length = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+/** unmaps the file */
+void MappedFile::close() {
+#ifdef _WIN32
+	if(view){
+		UnmapViewOfFile(view);
+	}
+	if(mappingHandle){
+		CloseHandle(mappingHandle);
+	}
+	if(fileHandle != INVALID_HANDLE_VALUE){
+		CloseHandle(fileHandle);
+	}
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if(view){
+		munmap(const_cast<unsigned char*>(view), length);
+	}
+#endif
+	view = nullptr;
+	length = 0;
+}
+
+/**
+ * Maps a binary scene file and validates its header.
+ * The records stay valid until the file is closed.
+ */
+bool SceneFile::open(const std::string& file) {
+	close();
+	if(!mapping.open(file)){
+		return false;
+	}
+	SceneFileHeader header;
+	if(mapping.size() < sizeof(header)){
+		std::fprintf(stderr, "scene file is truncated [%s]\n", file.c_str());
+		close();
+		return false;
+	}
+	std::memcpy(&header, mapping.data(), sizeof(header));
+	if(std::memcmp(header.magic, "CMSC", 4) != 0 || header.version < 1 || header.version > SCENE_FILE_VERSION
+			|| header.recordSize != sizeof(SceneObjectRecord)){
+		std::fprintf(stderr, "not a scene file of version %d [%s]\n", SCENE_FILE_VERSION, file.c_str());
+		close();
+		return false;
+	}
+	if((mapping.size() - sizeof(header))/sizeof(SceneObjectRecord) < header.numObjects){
+		std::fprintf(stderr, "scene file is truncated [%s]\n", file.c_str());
+		close();
+		return false;
+	}
+	size_t tableOffset = sizeof(header) + header.numObjects*sizeof(SceneObjectRecord);
+	if(header.version >= 2){
+		uint32_t numMeshes = 0;
+		if(mapping.size() >= tableOffset + sizeof(numMeshes)){
+			std::memcpy(&numMeshes, mapping.data() + tableOffset, sizeof(numMeshes));
+		}
+		if(mapping.size() < tableOffset + sizeof(numMeshes) || numMeshes > SCENE_MAX_MESHES
+				|| (mapping.size() - tableOffset - sizeof(numMeshes))/SCENE_MESH_NAME_SIZE < numMeshes){
+			std::fprintf(stderr, "scene file is truncated [%s]\n", file.c_str());
+			close();
+			return false;
+		}
+		const char* names = reinterpret_cast<const char*>(mapping.data() + tableOffset + sizeof(numMeshes));
+		for(uint32_t i = 0; i < numMeshes; i++){
+			const char* name = names + i*SCENE_MESH_NAME_SIZE;
+			meshNames.push_back(std::string(name, strnlen(name, SCENE_MESH_NAME_SIZE)));
+		}
+	}
+	// records start 16 bytes into the (page aligned) mapping, so they are aligned for floats
+	records = reinterpret_cast<const SceneObjectRecord*>(mapping.data() + sizeof(header));
+	count = header.numObjects;
+	return true;
+}
+
+/** writes the objects and the table of the meshes they use as binary scene file */
+bool writeSceneFile(const std::string& file, const std::vector<SceneObjectRecord>& objects,
+		const std::vector<std::string>& meshes) {
+	if(meshes.size() > SCENE_MAX_MESHES){
+		std::fprintf(stderr, "more than %d meshes [%s]\n", SCENE_MAX_MESHES, file.c_str());
+		return false;
+	}
+	FILE* f = std::fopen(file.c_str(), "wb");
+	if(!f){
+		std::fprintf(stderr, "could not write scene file [%s]\n", file.c_str());
+		return false;
+	}
+	SceneFileHeader header;
+	std::memcpy(header.magic, "CMSC", 4);
+	header.version = SCENE_FILE_VERSION;
+	header.recordSize = sizeof(SceneObjectRecord);
+	header.numObjects = static_cast<uint32_t>(objects.size());
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+	if(ok && !objects.empty()){
+		ok = std::fwrite(&objects[0], sizeof(SceneObjectRecord), objects.size(), f) == objects.size();
+	}
+	uint32_t numMeshes = static_cast<uint32_t>(meshes.size());
+	ok = ok && std::fwrite(&numMeshes, sizeof(numMeshes), 1, f) == 1;
+	for(size_t i = 0; ok && i < meshes.size(); i++){
+		char name[SCENE_MESH_NAME_SIZE];
+		std::memset(name, 0, sizeof(name));
+		std::strncpy(name, meshes[i].c_str(), sizeof(name) - 1);
+		ok = std::fwrite(name, sizeof(name), 1, f) == 1;
+	}
+	ok = std::fclose(f) == 0 && ok;
+	if(!ok){
+		std::fprintf(stderr, "could not write scene file [%s]\n", file.c_str());
+	}
+	return ok;
+}
+
+/** looks up a name in a table, @return its index or -1 */
+static int findName(const std::string& name, const char* const* names, int count) {
+	for(int i = 0; i < count; i++){
+		if(name == names[i]){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Parses the text format of scenes. Empty lines and lines starting with '#' are ignored,
+ * every other line describes an object:
+ *   object <x> <y> <z> <texture> <cube|sphere> <warpFN> [textured] [reflective] [scale=<s>] [mesh=<file>]
+ * with texture one of none, bridge, space, clouds, earth and warpFN one of identity, tangent, COBE.
+ * mesh replaces the cube or sphere by a triangle mesh (OBJ or PLY, relative to the scene file),
+ * meshes are collected in a table.
+ */
+bool parseSceneText(const std::string& file, std::vector<SceneObjectRecord>& objects, std::vector<std::string>& meshes) {
+	std::ifstream in(file.c_str());
+	if(!in.is_open()){
+		std::fprintf(stderr, "could not load file, so sorry [%s]\n", file.c_str());
+		return false;
+	}
+	objects.clear();
+	meshes.clear();
+	std::string line;
+	int lineNumber = 0;
+	while(std::getline(in, line)){
+		lineNumber++;
+		std::istringstream tokens(line);
+		std::string keyword, texture, shape, warp, option;
+		float x, y, z;
+		if(!(tokens >> keyword) || keyword[0] == '#'){
+			continue;
+		}
+		if(keyword != "object" || !(tokens >> x >> y >> z >> texture >> shape >> warp)){
+			std::fprintf(stderr, "malformed scene object [%s:%d]\n", file.c_str(), lineNumber);
+			return false;
+		}
+		SceneObjectRecord o;
+		std::memset(&o, 0, sizeof(o));
+		int textureIndex = findName(texture, textureNames, SCENE_TEXTURE_COUNT);
+		int warpIndex = findName(warp, warpNames, 3);
+		if(textureIndex < 0 || warpIndex < 0 || (shape != "cube" && shape != "sphere")){
+			std::fprintf(stderr, "unknown texture, shape or warp function [%s:%d]\n", file.c_str(), lineNumber);
+			return false;
+		}
+		float scale = 1.0f;
+		o.texture = static_cast<uint8_t>(textureIndex);
+		o.warpFN = static_cast<uint8_t>(warpIndex);
+		o.flags = shape == "sphere" ? SCENE_OBJECT_SPHERE : 0;
+		while(tokens >> option){
+			if(option == "textured"){
+				o.flags |= SCENE_OBJECT_TEXTURED;
+			} else if(option == "reflective"){
+				o.flags |= SCENE_OBJECT_REFLECTIVE;
+			} else if(option.compare(0, 6, "scale=") == 0){
+				scale = static_cast<float>(std::atof(option.c_str()+6));
+			} else if(option.compare(0, 5, "mesh=") == 0 && option.size() > 5 && option.size() - 5 < SCENE_MESH_NAME_SIZE){
+				std::string mesh = option.substr(5);
+				size_t index = 0;
+				while(index < meshes.size() && meshes[index] != mesh){
+					index++;
+				}
+				if(index == meshes.size()){
+					if(meshes.size() == SCENE_MAX_MESHES){
+						std::fprintf(stderr, "more than %d meshes [%s:%d]\n", SCENE_MAX_MESHES, file.c_str(), lineNumber);
+						return false;
+					}
+					meshes.push_back(mesh);
+				}
+				o.mesh = static_cast<uint8_t>(index + 1);
+			} else {
+				std::fprintf(stderr, "unknown option %s [%s:%d]\n", option.c_str(), file.c_str(), lineNumber);
+				return false;
+			}
+		}
+		o.modelMX[0] = o.modelMX[5] = o.modelMX[10] = scale;
+		o.modelMX[12] = x;
+		o.modelMX[13] = y;
+		o.modelMX[14] = z;
+		o.modelMX[15] = 1.0f;
+		objects.push_back(o);
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Binary scene description (.scene files).
+ *
+ * A scene file starts with a SceneFileHeader followed by numObjects records of
+ * type SceneObjectRecord, stored exactly as they are laid out in memory (little endian).
+ * The file is mapped into memory for loading, so the objects can be created by a
+ * single pass over the records without any parsing.
+ * Scenes can be written in a line based text format as well (see parseSceneText),
+ * which is converted to the binary format by tools/scenec.
+ *
+ * Since version 2 the records are followed by the table of the meshes the objects use
+ * (a uint32_t count and count names of SCENE_MESH_NAME_SIZE bytes, zero padded). Mesh
+ * files are named relative to the scene file. Version 1 files have no mesh table.
+ */
+
+/** texture referenced by a scene object */
+enum SceneTexture {
+	SCENE_TEXTURE_NONE = 0,
+	SCENE_TEXTURE_BRIDGE,
+	SCENE_TEXTURE_SPACE,
+	SCENE_TEXTURE_CLOUDS,
+	SCENE_TEXTURE_EARTH,
+	SCENE_TEXTURE_COUNT
+};
+
+/** bits of SceneObjectRecord::flags */
+enum SceneObjectFlags {
+	SCENE_OBJECT_TEXTURED   = 1, //!< uses its texture instead of the checkerboard pattern
+	SCENE_OBJECT_SPHERE     = 2, //!< rendered with cube to sphere projection
+	SCENE_OBJECT_REFLECTIVE = 4  //!< mirror object showing the reflection cubemap
+};
+
+#define SCENE_FILE_VERSION 2
+#define SCENE_MESH_NAME_SIZE 128
+#define SCENE_MAX_MESHES 255
+
+/** header of a binary scene file */
+typedef struct SceneFileHeader_t {
+	char magic[4];       //!< "CMSC"
+	uint32_t version;    //!< SCENE_FILE_VERSION
+	uint32_t recordSize; //!< sizeof(SceneObjectRecord) of the writer
+	uint32_t numObjects; //!< number of records following the header
+} SceneFileHeader;
+
+/** a scene object as stored in scene files */
+typedef struct SceneObjectRecord_t {
+	float modelMX[16];   //!< model matrix (column major)
+	uint8_t texture;     //!< SceneTexture
+	uint8_t flags;       //!< SceneObjectFlags
+	uint8_t warpFN;      //!< warping function (0 identity, 1 tangent, 2 COBE)
+	uint8_t mesh;        //!< 1-based index into the mesh table (0 = cube or sphere)
+	uint8_t reserved[4]; //!< zero
+} SceneObjectRecord;
+
+static_assert(sizeof(SceneFileHeader) == 16, "scene file header must not be padded");
+static_assert(sizeof(SceneObjectRecord) == 72, "scene object record must not be padded");
+
+/** read only memory mapping of a whole file */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& file);
+	void close();
+	const unsigned char* data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char* view;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
+
+/** binary scene file mapped into memory */
+class SceneFile {
+public:
+	SceneFile() : records(nullptr), count(0) {}
+
+	bool open(const std::string& file);
+	void close() { mapping.close(); records = nullptr; count = 0; meshNames.clear(); }
+	uint32_t numObjects() const { return count; }
+	const SceneObjectRecord* objects() const { return records; }
+	const std::vector<std::string>& meshes() const { return meshNames; }
+
+private:
+	MappedFile mapping;
+	const SceneObjectRecord* records;
+	uint32_t count;
+	std::vector<std::string> meshNames;
+};
+
+bool writeSceneFile(const std::string& file, const std::vector<SceneObjectRecord>& objects,
+		const std::vector<std::string>& meshes = std::vector<std::string>());
+bool parseSceneText(const std::string& file, std::vector<SceneObjectRecord>& objects, std::vector<std::string>& meshes);
+const char* sceneTextureName(int texture);
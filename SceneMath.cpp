@@ -0,0 +1,262 @@
+// SceneMath.cpp
+//
+
+#include "SceneMath.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Convert object ID to unique color (ids are spread over the color range,
+ * so neighbouring ids are distinguishable in the picking buffer)
+ * @param id   object ID.
+ * @return color
+ */
+glm::vec3 pickIdToColor(unsigned int id) {
+	id = id*111;
+	unsigned int r = (id>>16)& 0xff;
+	unsigned int g = (id>>8 )& 0xff;
+	unsigned int b = (id    )& 0xff;
+	float toFloat = 1.0f/255;
+	return glm::vec3(r*toFloat,g*toFloat,b*toFloat);
+}
+
+/**
+ * Convert color to object ID.
+ * @param rgb  color defined as 3-array [red,green,blue]
+ * @return object ID
+ */
+unsigned int pickColorToId(const unsigned char rgb[3]) {
+	unsigned int num = (static_cast<unsigned int>(rgb[0]) << 16) | (static_cast<unsigned int>(rgb[1]) << 8) | rgb[2];
+	return num/111;
+}
+
+/** perspective projection of the camera (fovY in degrees) */
+glm::mat4 cameraProjection(float fovY, float aspect, float zNear, float zFar) {
+	return glm::perspective(glm::radians(fovY), aspect, zNear, zFar);
+}
+
+/**
+ * Computes the camera matrices of a frame.
+ * @param reflectionCenter  world position the reflection cubemap is rendered from
+ */
+void computeFrameMatrices(const glm::mat4& viewMX, float fovY, float aspect, float zNear, float zFar,
+		const glm::vec3& reflectionCenter, FrameMatrices& m) {
+	m.projMX = cameraProjection(fovY, aspect, zNear, zFar);
+	m.invViewMX = glm::inverse(viewMX);
+	m.boxProjMX = glm::perspective(glm::radians(90.0f), 1.0f, zNear, zFar);
+	m.boxTranslMX = glm::translate(glm::mat4(1.0f), -reflectionCenter);
+}
+
+/**
+ * Translation in world space that moves an object with the mouse.
+ * The object position is projected to the screen, moved by the mouse delta
+ * (in the image plane, or along the view direction if depth is set) and
+ * transformed back.
+ * @param position  object position in world space
+ * @param dx,dy     mouse movement in pixels
+ * @param width,height  window size in pixels
+ */
+glm::vec3 dragTranslation(const glm::mat4& projMX, const glm::mat4& viewMX, const glm::vec3& position,
+		int dx, int dy, int width, int height, bool depth) {
+	glm::mat4 translMX = glm::translate(glm::mat4(1.0f), position);
+	// obtain obj position in screen space
+	glm::mat4 forward = projMX*viewMX*translMX;
+	glm::vec4 objpos = forward*glm::vec4(0,0,0,1);
+	if(!depth){
+		// projection to image plane
+		float w = objpos.w;
+		objpos = (1.0f/w)*objpos;
+		// translate obj in screen space according to mouse movement (x-y-plane)
+		objpos = objpos + glm::vec4(dx*2.0f/width,-dy*2.0f/height,0,0);
+		// un-projection
+		objpos = w*objpos;
+	} else {
+		// translate obj in (pre-)screen space according to mouse-y movement (z direction)
+		objpos = objpos + glm::vec4(0,0,-dy*0.02f/height,0);
+	}
+	// do backwards transformation to obtain translation in object space
+	return glm::vec3(glm::inverse(forward)*objpos);
+}
+
+/**
+ * Fraction of the viewport covered by the screen space bounding rectangle of a sphere.
+ * @return value in [0,1], 1 if the sphere reaches behind the camera
+ */
+float projectedSphereCoverage(const glm::mat4& viewProjMX, const glm::vec3& center, float radius) {
+	glm::vec2 lo(1.0f), hi(-1.0f);
+	for(int i = 0; i < 8; i++){
+		glm::vec3 corner = center + radius*glm::vec3(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1);
+		glm::vec4 p = viewProjMX*glm::vec4(corner, 1.0f);
+		if(p.w <= 1e-6f){
+			return 1.0f;
+		}
+		glm::vec2 ndc = glm::vec2(p)/p.w;
+		lo = glm::min(lo, ndc);
+		hi = glm::max(hi, ndc);
+	}
+	lo = glm::max(lo, glm::vec2(-1.0f));
+	hi = glm::min(hi, glm::vec2(1.0f));
+	if(hi.x <= lo.x || hi.y <= lo.y){
+		return 0.0f;
+	}
+	return 0.25f*(hi.x - lo.x)*(hi.y - lo.y);
+}
+
+/**
+ * Chooses one of a list of resolutions for a required resolution with hysteresis:
+ * a larger one is taken as soon as the current one is too small, a smaller one only
+ * after the requirement stayed below hysteresis times its size for delay calls,
+ * so a requirement close to a boundary does not switch every frame.
+ * @param sizes       ascending resolutions
+ * @param current     index of the resolution in use
+ * @param belowCount  consecutive calls the requirement was below the smaller size (kept by the caller)
+ * @return index of the resolution to use
+ */
+int selectResolutionLevel(float required, const int* sizes, int count, int current,
+		float hysteresis, int delay, int& belowCount) {
+	int wanted = 0;
+	while(wanted < count - 1 && static_cast<float>(sizes[wanted]) < required){
+		wanted++;
+	}
+	if(wanted >= current){
+		belowCount = 0;
+		return wanted;
+	}
+	if(required > hysteresis*static_cast<float>(sizes[current - 1])){
+		belowCount = 0;
+		return current;
+	}
+	if(++belowCount < delay){
+		return current;
+	}
+	belowCount = 0;
+	return current - 1;
+}
+
+/**
+ * PI controller of the frame time governor: lowers the quality while the measured
+ * frames are slower than the target and raises it again while they are faster.
+ * Deviations within 5% of the target are ignored, so the settings do not change with
+ * every frame, and the integral is only accumulated while the quality is not limited
+ * (no wind up when the target cannot be reached).
+ * @param frameMs  measured GPU time of a frame
+ * @return the new quality (also in state.quality)
+ */
+float governFrameTime(float frameMs, float targetMs, GovernorState& state) {
+	const float kp = 0.3f;
+	const float ki = 0.05f;
+	const float deadband = 0.05f;
+	// relative error, positive while too slow, single spikes are limited
+	float error = (frameMs - targetMs)/std::max(targetMs, 0.1f);
+	if(std::fabs(error) < deadband){
+		error = 0.0f;
+	}
+	error = glm::clamp(error, -1.0f, 1.0f);
+	float integral = state.integral + error;
+	float quality = 1.0f - kp*error - ki*integral;
+	if(quality >= 0.0f && quality <= 1.0f){
+		state.integral = integral;
+	}
+	state.quality = glm::clamp(quality, 0.0f, 1.0f);
+	return state.quality;
+}
+
+/**
+ * Maps the quality of the governor to the settings. Going down from the best quality
+ * the subdivision is reduced first (the geometry amplification dominates), then the
+ * reflection is refreshed less often (every 2nd to 4th frame) and last the camera views
+ * are rendered at a lower resolution (down to half the size, in steps of 1/8).
+ * @param maxSubDivLevel  largest subdivision level the geometry shaders can emit
+ */
+QualitySettings qualitySettings(float quality, int maxSubDivLevel) {
+	QualitySettings s;
+	s.subDivLevel = 1;
+	s.renderScale = 1.0f;
+	s.reflectionInterval = 1;
+	if(quality >= 0.5f){
+		s.subDivLevel = 1 + static_cast<int>((quality - 0.5f)*2.0f*(maxSubDivLevel - 1) + 0.5f);
+	} else if(quality >= 0.25f){
+		s.reflectionInterval = 1 + static_cast<int>((0.5f - quality)*12.0f + 0.5f);
+	} else {
+		s.reflectionInterval = 4;
+		s.renderScale = std::floor((0.5f + 2.0f*std::max(quality, 0.0f))*8.0f + 0.5f)/8.0f;
+	}
+	return s;
+}
+
+/**
+ * Divides the window among the cameras of a split screen layout.
+ * Camera 0 gets the left or top tile, the grid is filled row by row from the top.
+ * @param tiles  receives x, y, width and height of the tile of each camera in GL window
+ *               coordinates (origin bottom left), room for 4 tiles
+ * @return number of cameras of the layout
+ */
+int splitViewports(int layout, int width, int height, glm::ivec4* tiles) {
+	int halfW = width/2;
+	int halfH = height/2;
+	switch(layout){
+		case SPLIT_SIDE_BY_SIDE:
+			tiles[0] = glm::ivec4(0, 0, halfW, height);
+			tiles[1] = glm::ivec4(halfW, 0, width - halfW, height);
+			return 2;
+		case SPLIT_STACKED:
+			tiles[0] = glm::ivec4(0, halfH, width, height - halfH);
+			tiles[1] = glm::ivec4(0, 0, width, halfH);
+			return 2;
+		case SPLIT_GRID:
+			tiles[0] = glm::ivec4(0, halfH, halfW, height - halfH);
+			tiles[1] = glm::ivec4(halfW, halfH, width - halfW, height - halfH);
+			tiles[2] = glm::ivec4(0, 0, halfW, halfH);
+			tiles[3] = glm::ivec4(halfW, 0, width - halfW, halfH);
+			return 4;
+		default:
+			tiles[0] = glm::ivec4(0, 0, width, height);
+			return 1;
+	}
+}
+
+/**
+ * Changes the max_vertices declaration of a geometry shader source
+ * (which is a compile time constant). Sources without the declaration are returned unchanged.
+ */
+std::string setupMaxVertices(const std::string& source, unsigned int maxVerts) {
+	static const std::string toReplace("max_vertices=73");
+	std::string content = source;
+	size_t idx = content.find(toReplace);
+	if(idx != std::string::npos){
+		content.replace(idx, toReplace.length(), std::string("max_vertices=") + std::to_string(maxVerts));
+	}
+	return content;
+}
+
+/**
+ * Inserts preprocessor definitions into a shader source after the #version line
+ * (which has to stay the first statement).
+ */
+std::string insertShaderDefines(const std::string& source, const std::string& defines) {
+	if(defines.empty()){
+		return source;
+	}
+	size_t idx = source.find("#version");
+	if(idx == std::string::npos){
+		return defines + source;
+	}
+	idx = source.find('\n', idx);
+	if(idx == std::string::npos){
+		return source + "\n" + defines;
+	}
+	std::string content = source;
+	content.insert(idx + 1, defines);
+	return content;
+}
+
+/** continues a 64 bit FNV-1a hash with the given bytes */
+uint64_t hashBytes(const void* data, size_t bytes, uint64_t h) {
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < bytes; i++){
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * CPU side math of the plugin that runs every frame or every input event:
+ * pick color encoding, the camera matrices of a frame, the unprojection of
+ * mouse drags, the resolution of the reflection, the frame time governor, the split
+ * screen layout of the cameras, the patching of the geometry shader sources and the
+ * hash the cache keys are built from.
+ * Nothing in here depends on GL or OGL4Core so it can be used offline as well
+ * (see tools/cmbench.cpp).
+ */
+
+/** camera matrices of a frame */
+typedef struct FrameMatrices_t {
+	glm::mat4 projMX;      //!< camera projection
+	glm::mat4 invViewMX;   //!< inverse camera view
+	glm::mat4 boxProjMX;   //!< 90 degree projection of the reflection views
+	glm::mat4 boxTranslMX; //!< translation to the center of the reflection
+} FrameMatrices;
+
+glm::vec3 pickIdToColor(unsigned int id);
+unsigned int pickColorToId(const unsigned char rgb[3]);
+
+glm::mat4 cameraProjection(float fovY, float aspect, float zNear, float zFar);
+void computeFrameMatrices(const glm::mat4& viewMX, float fovY, float aspect, float zNear, float zFar,
+		const glm::vec3& reflectionCenter, FrameMatrices& m);
+
+glm::vec3 dragTranslation(const glm::mat4& projMX, const glm::mat4& viewMX, const glm::vec3& position,
+		int dx, int dy, int width, int height, bool depth);
+
+/** split screen layouts of the cameras (see splitViewports) */
+enum SplitLayout {
+	SPLIT_SINGLE = 0,   //!< one camera covering the window
+	SPLIT_SIDE_BY_SIDE, //!< two cameras, left and right half
+	SPLIT_STACKED,      //!< two cameras, top and bottom half
+	SPLIT_GRID,         //!< four cameras in a 2x2 grid
+	SPLIT_LAYOUT_COUNT
+};
+
+int splitViewports(int layout, int width, int height, glm::ivec4* tiles);
+
+float projectedSphereCoverage(const glm::mat4& viewProjMX, const glm::vec3& center, float radius);
+int selectResolutionLevel(float required, const int* sizes, int count, int current,
+		float hysteresis, int delay, int& belowCount);
+
+/** state of the frame time governor kept between frames (see governFrameTime) */
+typedef struct GovernorState_t {
+	float quality;   //!< 0 (cheapest settings) to 1 (best settings)
+	float integral;  //!< accumulated relative frame time error
+
+	GovernorState_t() {
+		quality = 1.0f;
+		integral = 0.0f;
+	}
+} GovernorState;
+
+/** quality settings the governor chooses (see qualitySettings) */
+typedef struct QualitySettings_t {
+	int subDivLevel;        //!< maximum subdivision level of the objects
+	float renderScale;      //!< size of the camera views relative to their tiles
+	int reflectionInterval; //!< the reflection faces are rendered every n-th frame
+
+	bool operator==(const QualitySettings_t& o) const {
+		return subDivLevel == o.subDivLevel && renderScale == o.renderScale && reflectionInterval == o.reflectionInterval;
+	}
+	bool operator!=(const QualitySettings_t& o) const { return !(*this == o); }
+} QualitySettings;
+
+float governFrameTime(float frameMs, float targetMs, GovernorState& state);
+QualitySettings qualitySettings(float quality, int maxSubDivLevel);
+
+std::string setupMaxVertices(const std::string& source, unsigned int maxVerts);
+std::string insertShaderDefines(const std::string& source, const std::string& defines);
+
+const uint64_t hashBasis = 14695981039346656037ULL; //!< FNV-1a offset basis
+uint64_t hashBytes(const void* data, size_t bytes, uint64_t h = hashBasis);
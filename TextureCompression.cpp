@@ -0,0 +1,683 @@
+// TextureCompression.cpp
+//
+
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TC_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/** block of 16 pixels in structure of arrays layout (values in [0,255]) */
+typedef struct PixelBlock_t {
+	float r[16];
+	float g[16];
+	float b[16];
+} PixelBlock;
+
+/** BC7 interpolation weights for 4 bit indices */
+static const int bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/** peak signal to noise ratio in dB (8 bit) */
+double BlockCompressionStats_t::psnr() const {
+	if(samples <= 0){
+		return 0;
+	}
+	double mse = sqError/samples;
+	if(mse <= 0){
+		return 99.0;
+	}
+	return 10.0*std::log10(255.0*255.0/mse);
+}
+
+/** bytes per 4x4 block */
+size_t blockFormatBytes(BlockFormat format) {
+	switch(format){
+		case BLOCK_FORMAT_BC1: return 8;
+		case BLOCK_FORMAT_BC7: return 16;
+		default: return 0;
+	}
+}
+
+/** size of the compressed image in bytes */
+size_t blockCompressedSize(BlockFormat format, int width, int height) {
+	size_t bw = static_cast<size_t>((width+3)/4);
+	size_t bh = static_cast<size_t>((height+3)/4);
+	return bw*bh*blockFormatBytes(format);
+}
+
+/** human readable name of a format */
+const char* blockFormatName(BlockFormat format) {
+	switch(format){
+		case BLOCK_FORMAT_BC1: return "BC1";
+		case BLOCK_FORMAT_BC7: return "BC7";
+		default: return "none";
+	}
+}
+
+/** copies a 4x4 block out of the image (clamping at the borders) */
+static void fetchBlock(const unsigned char* rgb, int width, int height, int bx, int by, unsigned char block[16*3]) {
+	for(int y = 0; y < 4; y++){
+		int sy = std::min(by*4+y, height-1);
+		for(int x = 0; x < 4; x++){
+			int sx = std::min(bx*4+x, width-1);
+			const unsigned char* src = rgb + (static_cast<size_t>(sy)*width + sx)*3;
+			unsigned char* dst = block + (y*4+x)*3;
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+		}
+	}
+}
+
+static void toPixelBlock(const unsigned char rgb[16*3], PixelBlock& blk) {
+	for(int i = 0; i < 16; i++){
+		blk.r[i] = rgb[i*3+0];
+		blk.g[i] = rgb[i*3+1];
+		blk.b[i] = rgb[i*3+2];
+	}
+}
+
+/**
+ * Assigns each pixel of the block the index of its closest palette entry.
+ * @return the accumulated squared error
+ */
+static float assignIndices(const PixelBlock& blk, const float palette[][3], int numColors, unsigned char indices[16]) {
+#ifdef TC_USE_SSE2
+	__m128 total = _mm_setzero_ps();
+	for(int i = 0; i < 16; i += 4){
+		__m128 r = _mm_loadu_ps(blk.r+i);
+		__m128 g = _mm_loadu_ps(blk.g+i);
+		__m128 b = _mm_loadu_ps(blk.b+i);
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128i bestIdx = _mm_setzero_si128();
+		for(int p = 0; p < numColors; p++){
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr,dr), _mm_mul_ps(dg,dg)), _mm_mul_ps(db,db));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(d, best);
+			bestIdx = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIdx));
+		}
+		total = _mm_add_ps(total, best);
+		int idx[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(idx), bestIdx);
+		indices[i+0] = static_cast<unsigned char>(idx[0]);
+		indices[i+1] = static_cast<unsigned char>(idx[1]);
+		indices[i+2] = static_cast<unsigned char>(idx[2]);
+		indices[i+3] = static_cast<unsigned char>(idx[3]);
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0]+sums[1]+sums[2]+sums[3];
+#else
+	float total = 0;
+	for(int i = 0; i < 16; i++){
+		float best = 1e30f;
+		int bestIdx = 0;
+		for(int p = 0; p < numColors; p++){
+			float dr = blk.r[i]-palette[p][0];
+			float dg = blk.g[i]-palette[p][1];
+			float db = blk.b[i]-palette[p][2];
+			float d = dr*dr + dg*dg + db*db;
+			if(d < best){
+				best = d;
+				bestIdx = p;
+			}
+		}
+		indices[i] = static_cast<unsigned char>(bestIdx);
+		total += best;
+	}
+	return total;
+#endif
+}
+
+/**
+ * Estimates endpoints along the principal axis of the block's colors.
+ * The extremes of the projections onto the axis are inset by the
+ * specified fraction of their distance.
+ */
+static void principalEndpoints(const PixelBlock& blk, float inset, float e0[3], float e1[3]) {
+	float mean[3] = {0,0,0};
+	for(int i = 0; i < 16; i++){
+		mean[0] += blk.r[i];
+		mean[1] += blk.g[i];
+		mean[2] += blk.b[i];
+	}
+	for(int c = 0; c < 3; c++){
+		mean[c] /= 16;
+	}
+	// covariance matrix (symmetric)
+	float cov[6] = {0,0,0,0,0,0};
+	for(int i = 0; i < 16; i++){
+		float r = blk.r[i]-mean[0];
+		float g = blk.g[i]-mean[1];
+		float b = blk.b[i]-mean[2];
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+		cov[3] += g*g; cov[4] += g*b;
+		cov[5] += b*b;
+	}
+	// power iteration for the dominant eigenvector
+	float axis[3] = {1,1,1};
+	for(int it = 0; it < 8; it++){
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if(len < 1e-6f){
+			break;
+		}
+		axis[0] = x/len;
+		axis[1] = y/len;
+		axis[2] = z/len;
+	}
+	float len2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+	if(len2 < 1e-12f){
+		// solid color block
+		for(int c = 0; c < 3; c++){
+			e0[c] = e1[c] = mean[c];
+		}
+		return;
+	}
+	float tMin = 1e30f, tMax = -1e30f;
+	for(int i = 0; i < 16; i++){
+		float t = (blk.r[i]-mean[0])*axis[0] + (blk.g[i]-mean[1])*axis[1] + (blk.b[i]-mean[2])*axis[2];
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	float d = (tMax-tMin)*inset;
+	tMin += d;
+	tMax -= d;
+	for(int c = 0; c < 3; c++){
+		e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c]*tMax/len2));
+		e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c]*tMin/len2));
+	}
+}
+
+/**
+ * Least squares fit of two endpoints for the given per pixel interpolation weights
+ * (weight 0 = e0, weight 1 = e1).
+ * @return false if the system is degenerate (all pixels use the same weight)
+ */
+static bool leastSquaresEndpoints(const PixelBlock& blk, const float weights[16], float e0[3], float e1[3]) {
+	float A = 0, B = 0, C = 0;
+	float X[3] = {0,0,0}, Y[3] = {0,0,0};
+	for(int i = 0; i < 16; i++){
+		float w = weights[i];
+		float iw = 1-w;
+		A += iw*iw;
+		B += iw*w;
+		C += w*w;
+		float px[3] = {blk.r[i], blk.g[i], blk.b[i]};
+		for(int c = 0; c < 3; c++){
+			X[c] += iw*px[c];
+			Y[c] += w*px[c];
+		}
+	}
+	float det = A*C - B*B;
+	if(std::fabs(det) < 1e-6f){
+		return false;
+	}
+	float invDet = 1.0f/det;
+	for(int c = 0; c < 3; c++){
+		e0[c] = std::min(255.0f, std::max(0.0f, (C*X[c] - B*Y[c])*invDet));
+		e1[c] = std::min(255.0f, std::max(0.0f, (A*Y[c] - B*X[c])*invDet));
+	}
+	return true;
+}
+
+//-----//
+// BC1 //
+//-----//
+
+static uint16_t quantize565(const float c[3]) {
+	int r = static_cast<int>(c[0]*31.0f/255.0f + 0.5f);
+	int g = static_cast<int>(c[1]*63.0f/255.0f + 0.5f);
+	int b = static_cast<int>(c[2]*31.0f/255.0f + 0.5f);
+	r = std::min(31, std::max(0, r));
+	g = std::min(63, std::max(0, g));
+	b = std::min(31, std::max(0, b));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void expand565(uint16_t v, int c[3]) {
+	int r = (v >> 11) & 31;
+	int g = (v >> 5) & 63;
+	int b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+/** 4 color palette of a BC1 block with c0 > c1 (index 0 = c0, 1 = c1, 2 = 2/3 c0, 3 = 1/3 c0) */
+static void paletteBC1(uint16_t c0, uint16_t c1, int palette[4][3]) {
+	expand565(c0, palette[0]);
+	expand565(c1, palette[1]);
+	for(int c = 0; c < 3; c++){
+		if(c0 > c1){
+			palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+			palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c])/2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+/** evaluates the endpoints (in 4 color mode), fills indices and returns the error */
+static float evaluateBC1(const PixelBlock& blk, uint16_t& c0, uint16_t& c1, unsigned char indices[16]) {
+	if(c0 < c1){
+		std::swap(c0, c1);
+	}
+	int pal[4][3];
+	paletteBC1(c0, c1, pal);
+	int numColors = c0 == c1 ? 1 : 4;
+	float fpal[4][3];
+	for(int p = 0; p < 4; p++){
+		for(int c = 0; c < 3; c++){
+			fpal[p][c] = static_cast<float>(pal[p][c]);
+		}
+	}
+	return assignIndices(blk, fpal, numColors, indices);
+}
+
+/** encodes a single 4x4 block of RGB pixels to BC1 */
+void encodeBC1Block(const unsigned char rgb[16*3], unsigned char out[8]) {
+	PixelBlock blk;
+	toPixelBlock(rgb, blk);
+	float e0[3], e1[3];
+	principalEndpoints(blk, 1.0f/16, e0, e1);
+
+	uint16_t bestC0 = quantize565(e0);
+	uint16_t bestC1 = quantize565(e1);
+	unsigned char bestIdx[16];
+	float bestErr = evaluateBC1(blk, bestC0, bestC1, bestIdx);
+
+	// refine endpoints by least squares on the current index assignment
+	const float idxToWeight[4] = {0.0f, 1.0f, 1.0f/3, 2.0f/3};
+	for(int it = 0; it < 2 && bestErr > 0; it++){
+		float weights[16];
+		for(int i = 0; i < 16; i++){
+			weights[i] = idxToWeight[bestIdx[i]];
+		}
+		if(!leastSquaresEndpoints(blk, weights, e0, e1)){
+			break;
+		}
+		uint16_t c0 = quantize565(e0);
+		uint16_t c1 = quantize565(e1);
+		unsigned char idx[16];
+		float err = evaluateBC1(blk, c0, c1, idx);
+		if(err >= bestErr){
+			break;
+		}
+		bestErr = err;
+		bestC0 = c0;
+		bestC1 = c1;
+		std::memcpy(bestIdx, idx, 16);
+	}
+
+	uint32_t bits = 0;
+	for(int i = 0; i < 16; i++){
+		bits |= static_cast<uint32_t>(bestC0 == bestC1 ? 0 : bestIdx[i]) << (2*i);
+	}
+	out[0] = static_cast<unsigned char>(bestC0 & 0xff);
+	out[1] = static_cast<unsigned char>(bestC0 >> 8);
+	out[2] = static_cast<unsigned char>(bestC1 & 0xff);
+	out[3] = static_cast<unsigned char>(bestC1 >> 8);
+	out[4] = static_cast<unsigned char>(bits & 0xff);
+	out[5] = static_cast<unsigned char>((bits >> 8) & 0xff);
+	out[6] = static_cast<unsigned char>((bits >> 16) & 0xff);
+	out[7] = static_cast<unsigned char>(bits >> 24);
+}
+
+/** decodes a BC1 block to 16 RGB pixels */
+void decodeBC1Block(const unsigned char in[8], unsigned char rgb[16*3]) {
+	uint16_t c0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+	uint16_t c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+	uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+	int pal[4][3];
+	paletteBC1(c0, c1, pal);
+	for(int i = 0; i < 16; i++){
+		int idx = (bits >> (2*i)) & 3;
+		for(int c = 0; c < 3; c++){
+			rgb[i*3+c] = static_cast<unsigned char>(pal[idx][c]);
+		}
+	}
+}
+
+//-----//
+// BC7 //
+//-----//
+
+/**
+ * Quantizes an endpoint to 7 bits per channel plus shared p-bit,
+ * choosing the p-bit with the smaller error.
+ * @return the 8 bit endpoint values in q8
+ */
+static void quantizeBC7Endpoint(const float e[3], int q7[3], int& pbit, int q8[3]) {
+	float bestErr = 1e30f;
+	for(int p = 0; p < 2; p++){
+		float err = 0;
+		int c7[3];
+		for(int c = 0; c < 3; c++){
+			int v = static_cast<int>(std::floor((e[c]-p)/2.0f + 0.5f));
+			c7[c] = std::min(127, std::max(0, v));
+			float d = (c7[c]*2+p) - e[c];
+			err += d*d;
+		}
+		if(err < bestErr){
+			bestErr = err;
+			pbit = p;
+			for(int c = 0; c < 3; c++){
+				q7[c] = c7[c];
+				q8[c] = c7[c]*2+p;
+			}
+		}
+	}
+}
+
+/** 16 entry palette of a mode 6 block from its 8 bit endpoints */
+static void paletteBC7(const int a[3], const int b[3], float palette[16][3]) {
+	for(int i = 0; i < 16; i++){
+		int w = bc7Weights4[i];
+		for(int c = 0; c < 3; c++){
+			palette[i][c] = static_cast<float>(((64-w)*a[c] + w*b[c] + 32) >> 6);
+		}
+	}
+}
+
+/** little endian bit writer for a 128 bit block */
+static void putBits(unsigned char out[16], int& pos, uint32_t value, int numBits) {
+	for(int i = 0; i < numBits; i++, pos++){
+		if((value >> i) & 1){
+			out[pos >> 3] |= static_cast<unsigned char>(1 << (pos & 7));
+		}
+	}
+}
+
+static uint32_t getBits(const unsigned char in[16], int& pos, int numBits) {
+	uint32_t value = 0;
+	for(int i = 0; i < numBits; i++, pos++){
+		value |= static_cast<uint32_t>((in[pos >> 3] >> (pos & 7)) & 1) << i;
+	}
+	return value;
+}
+
+/** encodes a single 4x4 block of RGB pixels to BC7 (mode 6, opaque) */
+void encodeBC7Block(const unsigned char rgb[16*3], unsigned char out[16]) {
+	PixelBlock blk;
+	toPixelBlock(rgb, blk);
+	float e0[3], e1[3];
+	principalEndpoints(blk, 0.0f, e0, e1);
+
+	int bestQ7[2][3] = {{0,0,0},{0,0,0}};
+	int bestP[2] = {0,0};
+	unsigned char bestIdx[16];
+	float bestErr = 1e30f;
+	for(int it = 0; it < 3; it++){
+		int q7[2][3], q8[2][3], p[2];
+		quantizeBC7Endpoint(e0, q7[0], p[0], q8[0]);
+		quantizeBC7Endpoint(e1, q7[1], p[1], q8[1]);
+		float palette[16][3];
+		paletteBC7(q8[0], q8[1], palette);
+		unsigned char idx[16];
+		float err = assignIndices(blk, palette, 16, idx);
+		if(err < bestErr){
+			bestErr = err;
+			std::memcpy(bestQ7, q7, sizeof(q7));
+			bestP[0] = p[0];
+			bestP[1] = p[1];
+			std::memcpy(bestIdx, idx, 16);
+		} else {
+			break;
+		}
+		if(err <= 0){
+			break;
+		}
+		// refine endpoints by least squares on the current index assignment
+		float weights[16];
+		for(int i = 0; i < 16; i++){
+			weights[i] = bc7Weights4[idx[i]]/64.0f;
+		}
+		if(!leastSquaresEndpoints(blk, weights, e0, e1)){
+			break;
+		}
+	}
+
+	// the MSB of the first index is implicitly 0, swap endpoints if necessary
+	if(bestIdx[0] & 8){
+		for(int c = 0; c < 3; c++){
+			std::swap(bestQ7[0][c], bestQ7[1][c]);
+		}
+		std::swap(bestP[0], bestP[1]);
+		for(int i = 0; i < 16; i++){
+			bestIdx[i] = static_cast<unsigned char>(15 - bestIdx[i]);
+		}
+	}
+
+	std::memset(out, 0, 16);
+	int pos = 0;
+	putBits(out, pos, 1 << 6, 7); // mode 6
+	for(int c = 0; c < 3; c++){
+		putBits(out, pos, bestQ7[0][c], 7);
+		putBits(out, pos, bestQ7[1][c], 7);
+	}
+	putBits(out, pos, 127, 7); // alpha endpoints are opaque
+	putBits(out, pos, 127, 7);
+	putBits(out, pos, bestP[0], 1);
+	putBits(out, pos, bestP[1], 1);
+	putBits(out, pos, bestIdx[0], 3);
+	for(int i = 1; i < 16; i++){
+		putBits(out, pos, bestIdx[i], 4);
+	}
+}
+
+/** decodes a BC7 block to 16 RGB pixels (only mode 6 as produced by the encoder) */
+void decodeBC7Block(const unsigned char in[16], unsigned char rgb[16*3]) {
+	if((in[0] & 0x7f) != 0x40){
+		// other modes are not supported, decode to magenta
+		for(int i = 0; i < 16; i++){
+			rgb[i*3+0] = 255;
+			rgb[i*3+1] = 0;
+			rgb[i*3+2] = 255;
+		}
+		return;
+	}
+	int pos = 7;
+	int q7[2][3];
+	for(int c = 0; c < 3; c++){
+		q7[0][c] = static_cast<int>(getBits(in, pos, 7));
+		q7[1][c] = static_cast<int>(getBits(in, pos, 7));
+	}
+	pos += 14; // alpha
+	int p0 = static_cast<int>(getBits(in, pos, 1));
+	int p1 = static_cast<int>(getBits(in, pos, 1));
+	int a[3], b[3];
+	for(int c = 0; c < 3; c++){
+		a[c] = q7[0][c]*2 + p0;
+		b[c] = q7[1][c]*2 + p1;
+	}
+	float palette[16][3];
+	paletteBC7(a, b, palette);
+	for(int i = 0; i < 16; i++){
+		int idx = static_cast<int>(getBits(in, pos, i == 0 ? 3 : 4));
+		for(int c = 0; c < 3; c++){
+			rgb[i*3+c] = static_cast<unsigned char>(palette[idx][c]);
+		}
+	}
+}
+
+//-------//
+// image //
+//-------//
+
+/**
+ * Compresses an RGB image (rows top to bottom) to the specified block format.
+ * Block rows are distributed over the shared thread pool.
+ * When stats are given, the encoding time is measured and every block is
+ * decoded again to accumulate the error for the PSNR.
+ */
+void compressBlocks(BlockFormat format, const unsigned char* rgb, int width, int height,
+		std::vector<unsigned char>& out, BlockCompressionStats* stats)
+{
+	int blocksX = (width+3)/4;
+	int blocksY = (height+3)/4;
+	size_t bpb = blockFormatBytes(format);
+	out.resize(blockCompressedSize(format, width, height));
+	std::vector<double> rowErrors(blocksY, 0.0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ThreadPool::shared().parallelFor(blocksY, [&](unsigned by){
+		unsigned char block[16*3];
+		unsigned char decoded[16*3];
+		for(int bx = 0; bx < blocksX; bx++){
+			fetchBlock(rgb, width, height, bx, by, block);
+			unsigned char* dst = &out[(static_cast<size_t>(by)*blocksX + bx)*bpb];
+			if(format == BLOCK_FORMAT_BC1){
+				encodeBC1Block(block, dst);
+			} else {
+				encodeBC7Block(block, dst);
+			}
+			if(stats){
+				if(format == BLOCK_FORMAT_BC1){
+					decodeBC1Block(dst, decoded);
+				} else {
+					decodeBC7Block(dst, decoded);
+				}
+				double err = 0;
+				for(int i = 0; i < 16*3; i++){
+					double d = static_cast<double>(decoded[i]) - block[i];
+					err += d*d;
+				}
+				rowErrors[by] += err;
+			}
+		}
+	});
+	if(stats){
+		stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+		stats->pixels += static_cast<double>(width)*height;
+		for(int by = 0; by < blocksY; by++){
+			stats->sqError += rowErrors[by];
+		}
+		stats->samples += static_cast<double>(blocksX)*blocksY*16*3;
+	}
+}
+
+/** decompresses a block compressed image to RGB (rows top to bottom) */
+void decompressBlocks(BlockFormat format, const unsigned char* blocks, int width, int height,
+		std::vector<unsigned char>& rgb)
+{
+	int blocksX = (width+3)/4;
+	int blocksY = (height+3)/4;
+	size_t bpb = blockFormatBytes(format);
+	rgb.resize(static_cast<size_t>(width)*height*3);
+	for(int by = 0; by < blocksY; by++){
+		for(int bx = 0; bx < blocksX; bx++){
+			unsigned char decoded[16*3];
+			const unsigned char* src = blocks + (static_cast<size_t>(by)*blocksX + bx)*bpb;
+			if(format == BLOCK_FORMAT_BC1){
+				decodeBC1Block(src, decoded);
+			} else {
+				decodeBC7Block(src, decoded);
+			}
+			for(int y = 0; y < 4 && by*4+y < height; y++){
+				for(int x = 0; x < 4 && bx*4+x < width; x++){
+					std::memcpy(&rgb[(static_cast<size_t>(by*4+y)*width + bx*4+x)*3], decoded + (y*4+x)*3, 3);
+				}
+			}
+		}
+	}
+}
+
+//-------//
+// cache //
+//-------//
+
+static const char blockCacheMagic[4] = {'C','M','B','C'};
+static const uint32_t blockCacheVersion = 1;
+
+/** size and modification time of the file used to validate cache files */
+static bool sourceFileStamp(const std::string& file, uint64_t& size, int64_t& mtime) {
+	struct stat st;
+	if(stat(file.c_str(), &st) != 0){
+		return false;
+	}
+	size = static_cast<uint64_t>(st.st_size);
+	mtime = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+
+/** name of the cache file next to the source file, e.g. posx.png -> posx.png.bc7 */
+std::string blockCacheFileName(const std::string& sourceFile, BlockFormat format) {
+	return sourceFile + (format == BLOCK_FORMAT_BC1 ? ".bc1" : ".bc7");
+}
+
+/**
+ * Reads compressed blocks from a cache file. Fails if the file does not exist
+ * or does not match the format, size or modification time of the source file.
+ */
+bool readBlockCache(const std::string& cacheFile, const std::string& sourceFile, BlockFormat format,
+		int width, int height, std::vector<unsigned char>& blocks)
+{
+	uint64_t srcSize = 0;
+	int64_t srcTime = 0;
+	if(!sourceFileStamp(sourceFile, srcSize, srcTime)){
+		return false;
+	}
+	std::ifstream in(cacheFile.c_str(), std::ios::binary);
+	if(!in.is_open()){
+		return false;
+	}
+	char magic[4];
+	uint32_t header[4];
+	uint64_t size;
+	int64_t time;
+	uint64_t dataSize;
+	in.read(magic, 4);
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	in.read(reinterpret_cast<char*>(&size), sizeof(size));
+	in.read(reinterpret_cast<char*>(&time), sizeof(time));
+	in.read(reinterpret_cast<char*>(&dataSize), sizeof(dataSize));
+	if(!in.good() || std::memcmp(magic, blockCacheMagic, 4) != 0 || header[0] != blockCacheVersion
+			|| header[1] != static_cast<uint32_t>(format) || header[2] != static_cast<uint32_t>(width)
+			|| header[3] != static_cast<uint32_t>(height) || size != srcSize || time != srcTime
+			|| dataSize != blockCompressedSize(format, width, height)){
+		return false;
+	}
+	blocks.resize(static_cast<size_t>(dataSize));
+	in.read(reinterpret_cast<char*>(&blocks[0]), static_cast<std::streamsize>(dataSize));
+	return in.good();
+}
+
+/** writes compressed blocks to a cache file stamped with the source file's size and modification time */
+bool writeBlockCache(const std::string& cacheFile, const std::string& sourceFile, BlockFormat format,
+		int width, int height, const std::vector<unsigned char>& blocks)
+{
+	uint64_t srcSize = 0;
+	int64_t srcTime = 0;
+	if(!sourceFileStamp(sourceFile, srcSize, srcTime)){
+		return false;
+	}
+	std::ofstream out(cacheFile.c_str(), std::ios::binary);
+	if(!out.is_open()){
+		std::fprintf(stderr, "could not write cache file [%s]\n", cacheFile.c_str());
+		return false;
+	}
+	uint32_t header[4] = {blockCacheVersion, static_cast<uint32_t>(format), static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+	uint64_t dataSize = blocks.size();
+	out.write(blockCacheMagic, 4);
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(&srcSize), sizeof(srcSize));
+	out.write(reinterpret_cast<const char*>(&srcTime), sizeof(srcTime));
+	out.write(reinterpret_cast<const char*>(&dataSize), sizeof(dataSize));
+	out.write(reinterpret_cast<const char*>(&blocks[0]), static_cast<std::streamsize>(dataSize));
+	return out.good();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Block compression (BC1 / BC7) of 8 bit RGB images.
+ * Images are encoded in 4x4 blocks, all blocks of an image are distributed
+ * over the cores of the shared thread pool. The block search uses SSE2
+ * when available.
+ * BC1 stores 8 bytes per block (4 bits per texel, no alpha), the BC7 encoder
+ * uses mode 6 only (single subset, 7777.1 endpoints, 4 bit indices, 16 bytes per block).
+ * Nothing in here depends on GL so it can be used offline as well.
+ */
+
+/** supported block compression formats */
+enum BlockFormat {
+	BLOCK_FORMAT_NONE = 0,
+	BLOCK_FORMAT_BC1,
+	BLOCK_FORMAT_BC7
+};
+
+/** statistics of an encoding run */
+typedef struct BlockCompressionStats_t {
+	double seconds;   //!< wall clock time spent encoding
+	double pixels;    //!< number of encoded pixels
+	double sqError;   //!< accumulated squared error over all RGB components
+	double samples;   //!< number of RGB components the error was accumulated over
+
+	BlockCompressionStats_t() {
+		seconds = pixels = sqError = samples = 0;
+	}
+	/** throughput in mega pixels per second */
+	double mpixPerSecond() const { return seconds > 0 ? pixels/seconds*1e-6 : 0; }
+	double psnr() const;
+} BlockCompressionStats;
+
+size_t blockFormatBytes(BlockFormat format);
+size_t blockCompressedSize(BlockFormat format, int width, int height);
+const char* blockFormatName(BlockFormat format);
+
+void compressBlocks(BlockFormat format, const unsigned char* rgb, int width, int height,
+		std::vector<unsigned char>& out, BlockCompressionStats* stats = nullptr);
+void decompressBlocks(BlockFormat format, const unsigned char* blocks, int width, int height,
+		std::vector<unsigned char>& rgb);
+
+void encodeBC1Block(const unsigned char rgb[16*3], unsigned char out[8]);
+void encodeBC7Block(const unsigned char rgb[16*3], unsigned char out[16]);
+void decodeBC1Block(const unsigned char in[8], unsigned char rgb[16*3]);
+void decodeBC7Block(const unsigned char in[16], unsigned char rgb[16*3]);
+
+std::string blockCacheFileName(const std::string& sourceFile, BlockFormat format);
+bool readBlockCache(const std::string& cacheFile, const std::string& sourceFile, BlockFormat format,
+		int width, int height, std::vector<unsigned char>& blocks);
+bool writeBlockCache(const std::string& cacheFile, const std::string& sourceFile, BlockFormat format,
+		int width, int height, const std::vector<unsigned char>& blocks);
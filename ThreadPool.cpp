@@ -0,0 +1,98 @@
+// ThreadPool.cpp
+//
+
+#include "ThreadPool.h"
+#include <algorithm>
+
+/**
+ * Creates the pool with the specified number of threads including the calling
+ * thread (0 = one per hardware thread).
+ */
+ThreadPool::ThreadPool(unsigned numThreads) {
+	if(numThreads == 0){
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	job = nullptr;
+	jobCount = 0;
+	jobGeneration = 0;
+	nextIndex = 0;
+	activeWorkers = 0;
+	shutdown = false;
+	for(unsigned i = 1; i < numThreads; i++){
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shutdown = true;
+	}
+	wakeWorkers.notify_all();
+	for(size_t i = 0; i < workers.size(); i++){
+		workers[i].join();
+	}
+}
+
+/** process wide pool used by the plugin */
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+/**
+ * Calls fn(i) for every i in [0,count) distributed over the pool's threads
+ * and returns when all calls have finished.
+ */
+void ThreadPool::parallelFor(unsigned count, const std::function<void(unsigned)>& fn) {
+	if(count == 0){
+		return;
+	}
+	if(count == 1 || workers.empty()){
+		for(unsigned i = 0; i < count; i++){
+			fn(i);
+		}
+		return;
+	}
+	std::lock_guard<std::mutex> submitLock(submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		jobCount = count;
+		nextIndex = 0;
+		jobGeneration++;
+	}
+	wakeWorkers.notify_all();
+	runIndices();
+	// wait until every worker that picked up the job is done with it
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this]{ return activeWorkers == 0; });
+	job = nullptr;
+}
+
+/** takes indices of the current job until none are left */
+void ThreadPool::runIndices() {
+	for(unsigned i = nextIndex++; i < jobCount; i = nextIndex++){
+		(*job)(i);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	unsigned seenGeneration = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		wakeWorkers.wait(lock, [&]{ return shutdown || (job && jobGeneration != seenGeneration); });
+		if(shutdown){
+			return;
+		}
+		seenGeneration = jobGeneration;
+		activeWorkers++;
+		lock.unlock();
+		runIndices();
+		lock.lock();
+		activeWorkers--;
+		if(activeWorkers == 0){
+			jobDone.notify_all();
+		}
+	}
+}
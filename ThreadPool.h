@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Small pool of persistent worker threads used to spread CPU work
+ * (image decoding, encoding, frame preparation) over all cores.
+ * Work is submitted as a parallel for loop over an index range,
+ * the calling thread takes part in the loop and the call blocks
+ * until all indices have been processed.
+ */
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+
+	void parallelFor(unsigned count, const std::function<void(unsigned)>& fn);
+	unsigned numThreads() const { return static_cast<unsigned>(workers.size())+1; }
+
+	static ThreadPool& shared();
+
+private:
+	void workerLoop();
+	void runIndices();
+
+	std::vector<std::thread> workers;    //!< worker threads (the caller of parallelFor is the +1)
+	std::mutex submitMutex;              //!< serializes parallelFor calls from different threads
+	std::mutex mutex;                    //!< guards the job state below
+	std::condition_variable wakeWorkers; //!< signals a new job (or shutdown) to the workers
+	std::condition_variable jobDone;     //!< signals completion of the current job to the caller
+
+	const std::function<void(unsigned)>* job; //!< current loop body
+	unsigned jobCount;                        //!< number of indices of the current job
+	unsigned jobGeneration;                   //!< incremented for every job so workers can detect new work
+	std::atomic<unsigned> nextIndex;          //!< next index to be processed
+	unsigned activeWorkers;                   //!< workers currently working on the job
+	bool shutdown;                            //!< tells workers to exit
+};
@@ -0,0 +1,250 @@
+// Trace.cpp
+//
+
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/** number of events per thread, the oldest are overwritten when a ring is full */
+static const uint64_t traceRingCapacity = 4096;
+
+/**
+ * Ring buffer of the events of one thread. Only the owning thread writes events,
+ * it publishes them by incrementing head (release), so the exporter can read
+ * all events below head without locking.
+ */
+typedef struct TraceRing_t {
+	TraceEvent events[traceRingCapacity];
+	std::atomic<uint64_t> head;  //!< number of events written so far
+	std::atomic<bool> owned;     //!< ring belongs to a running thread (free rings are reused by new threads)
+	unsigned threadID;           //!< id used as tid in the exported trace
+	char threadName[32];         //!< guarded by the registry mutex
+} TraceRing;
+
+/** all rings created so far (never freed, so that events of finished threads can still be exported) */
+typedef struct TraceRegistry_t {
+	std::mutex mutex;
+	std::vector<TraceRing*> rings;
+} TraceRegistry;
+
+static TraceRegistry& traceRegistry() {
+	// intentionally leaked, threads may still trace during static destruction
+	static TraceRegistry* registry = new TraceRegistry();
+	return *registry;
+}
+
+/** hands the ring of the calling thread back to the registry when the thread ends */
+class TraceThreadRing {
+public:
+	TraceThreadRing() : ring(nullptr) {}
+	~TraceThreadRing() {
+		if(ring){
+			ring->owned.store(false, std::memory_order_release);
+		}
+	}
+	TraceRing* ring;
+};
+
+static thread_local TraceThreadRing threadRing;
+
+/** returns the ring of the calling thread, takes a free one or creates one on first use */
+static TraceRing* getThreadRing() {
+	if(threadRing.ring){
+		return threadRing.ring;
+	}
+	TraceRegistry& registry = traceRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	TraceRing* ring = nullptr;
+	for(size_t i = 0; i < registry.rings.size() && !ring; i++){
+		if(!registry.rings[i]->owned.load(std::memory_order_acquire)){
+			ring = registry.rings[i];
+		}
+	}
+	if(!ring){
+		ring = new TraceRing();
+		ring->head.store(0);
+		ring->threadID = static_cast<unsigned>(registry.rings.size())+1;
+		registry.rings.push_back(ring);
+	}
+	ring->owned.store(true);
+	std::snprintf(ring->threadName, sizeof(ring->threadName), "thread %u", ring->threadID);
+	threadRing.ring = ring;
+	return ring;
+}
+
+/** returns the slot of the next event of the calling thread, publish it with commitEvent */
+static TraceEvent& nextEvent(TraceRing* ring) {
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	return ring->events[head % traceRingCapacity];
+}
+
+static void commitEvent(TraceRing* ring) {
+	ring->head.store(ring->head.load(std::memory_order_relaxed)+1, std::memory_order_release);
+}
+
+static void copyText(char* dst, size_t size, const char* src) {
+	if(!src){
+		dst[0] = 0;
+		return;
+	}
+	size_t len = std::min(std::strlen(src), size-1);
+	std::memcpy(dst, src, len);
+	dst[len] = 0;
+}
+
+static const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+/** @return nanoseconds since the trace module was loaded */
+uint64_t traceNow() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - traceEpoch).count());
+}
+
+/** records a span from start to end (see traceNow) */
+void traceSpan(int level, const char* name, const char* detail, uint64_t start, uint64_t end) {
+	TraceRing* ring = getThreadRing();
+	TraceEvent& e = nextEvent(ring);
+	e.timestamp = start;
+	e.duration = end - start;
+	e.value = 0;
+	e.name = name;
+	e.type = TRACE_EVENT_SPAN;
+	e.level = static_cast<uint8_t>(level);
+	copyText(e.text, sizeof(e.text), detail);
+	commitEvent(ring);
+}
+
+/** records a printf formatted message, messages up to TRACE_ECHO_LEVEL are also printed to stderr */
+void traceMessage(int level, const char* name, const char* format, ...) {
+	char text[512];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	if(level <= TRACE_ECHO_LEVEL){
+		std::fprintf(stderr, "%s\n", text);
+	}
+	TraceRing* ring = getThreadRing();
+	TraceEvent& e = nextEvent(ring);
+	e.timestamp = traceNow();
+	e.duration = 0;
+	e.value = 0;
+	e.name = name;
+	e.type = TRACE_EVENT_MESSAGE;
+	e.level = static_cast<uint8_t>(level);
+	copyText(e.text, sizeof(e.text), text);
+	commitEvent(ring);
+}
+
+/** records the current value of a counter */
+void traceCounter(int level, const char* name, double value) {
+	TraceRing* ring = getThreadRing();
+	TraceEvent& e = nextEvent(ring);
+	e.timestamp = traceNow();
+	e.duration = 0;
+	e.value = value;
+	e.name = name;
+	e.type = TRACE_EVENT_COUNTER;
+	e.level = static_cast<uint8_t>(level);
+	e.text[0] = 0;
+	commitEvent(ring);
+}
+
+/** sets the name the calling thread is shown with in the exported trace */
+void traceSetThreadName(const char* name) {
+	TraceRing* ring = getThreadRing();
+	std::lock_guard<std::mutex> lock(traceRegistry().mutex);
+	copyText(ring->threadName, sizeof(ring->threadName), name);
+}
+
+/** writes a string as JSON string literal */
+static void writeJSONString(FILE* f, const char* s) {
+	std::fputc('"', f);
+	for(; *s; s++){
+		unsigned char c = static_cast<unsigned char>(*s);
+		if(c == '"' || c == '\\'){
+			std::fprintf(f, "\\%c", c);
+		} else if(c < 0x20){
+			std::fprintf(f, "\\u%04x", c);
+		} else {
+			std::fputc(c, f);
+		}
+	}
+	std::fputc('"', f);
+}
+
+static const char* levelName(int level) {
+	static const char* names[] = {"off", "error", "warn", "info", "debug"};
+	return level >= 0 && level <= TRACE_LEVEL_DEBUG ? names[level] : "trace";
+}
+
+/**
+ * Writes the events of all threads in the Chrome trace event format.
+ * Threads may keep tracing while the file is written, events that were
+ * overwritten while being copied are skipped.
+ * @return false if the file could not be written
+ */
+bool traceWriteChromeJSON(const std::string& file) {
+	FILE* f = std::fopen(file.c_str(), "wb");
+	if(!f){
+		std::fprintf(stderr, "could not write trace [%s]\n", file.c_str());
+		return false;
+	}
+	TraceRegistry& registry = traceRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	std::vector<TraceEvent> events;
+	for(size_t r = 0; r < registry.rings.size(); r++){
+		TraceRing* ring = registry.rings[r];
+		// copy the events, then drop the ones the owner may have overwritten meanwhile
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t begin = head > traceRingCapacity ? head - traceRingCapacity : 0;
+		events.clear();
+		for(uint64_t i = begin; i < head; i++){
+			events.push_back(ring->events[i % traceRingCapacity]);
+		}
+		uint64_t headAfter = ring->head.load(std::memory_order_acquire);
+		size_t skip = headAfter >= begin + traceRingCapacity ? static_cast<size_t>(headAfter - begin - traceRingCapacity + 1) : 0;
+		skip = std::min(skip, events.size());
+
+		std::fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", ring->threadID);
+		writeJSONString(f, ring->threadName);
+		std::fprintf(f, "}}");
+		first = false;
+		for(size_t i = skip; i < events.size(); i++){
+			const TraceEvent& e = events[i];
+			std::fprintf(f, ",\n{\"name\":");
+			writeJSONString(f, e.name ? e.name : "");
+			std::fprintf(f, ",\"cat\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", levelName(e.level), ring->threadID, e.timestamp*1e-3);
+			if(e.type == TRACE_EVENT_SPAN){
+				std::fprintf(f, ",\"ph\":\"X\",\"dur\":%.3f", e.duration*1e-3);
+				if(e.text[0]){
+					std::fprintf(f, ",\"args\":{\"detail\":");
+					writeJSONString(f, e.text);
+					std::fprintf(f, "}");
+				}
+			} else if(e.type == TRACE_EVENT_MESSAGE){
+				std::fprintf(f, ",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"msg\":");
+				writeJSONString(f, e.text);
+				std::fprintf(f, "}");
+			} else {
+				std::fprintf(f, ",\"ph\":\"C\",\"args\":{\"value\":%g}", e.value);
+			}
+			std::fprintf(f, "}");
+		}
+	}
+	std::fprintf(f, "\n]}\n");
+	bool ok = !std::ferror(f);
+	std::fclose(f);
+	if(!ok){
+		std::fprintf(stderr, "could not write trace [%s]\n", file.c_str());
+	}
+	return ok;
+}
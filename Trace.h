@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Low overhead event tracing.
+ *
+ * Every thread that emits events gets its own ring buffer of fixed size events,
+ * so recording an event is a few stores and a release increment without locks
+ * or console I/O; when a ring is full the oldest events are overwritten.
+ * Events are timestamped (nanoseconds on a monotonic clock) and typed: spans
+ * (named duration with an optional detail string), messages (printf formatted)
+ * and counters. The collected events of all threads can be exported in the
+ * Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+ *
+ * Events are filtered at compile time: the TRACE_* macros of levels above
+ * TRACE_LEVEL compile to nothing. Messages up to TRACE_ECHO_LEVEL are additionally
+ * printed to stderr, so errors and warnings are still visible on the console.
+ */
+
+#define TRACE_LEVEL_OFF   0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN  2
+#define TRACE_LEVEL_INFO  3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+#ifndef TRACE_ECHO_LEVEL
+#define TRACE_ECHO_LEVEL TRACE_LEVEL_WARN
+#endif
+
+#define TRACE_ENABLED(level) ((level) <= TRACE_LEVEL)
+
+enum TraceEventType {
+	TRACE_EVENT_SPAN,
+	TRACE_EVENT_MESSAGE,
+	TRACE_EVENT_COUNTER
+};
+
+/** a single trace event as stored in the ring buffers */
+typedef struct TraceEvent_t {
+	uint64_t timestamp; //!< start of the event in ns (see traceNow)
+	uint64_t duration;  //!< duration in ns (spans only)
+	double value;       //!< value of counters
+	const char* name;   //!< event name (must be a string literal or otherwise outlive the trace)
+	uint8_t type;       //!< TraceEventType
+	uint8_t level;      //!< TRACE_LEVEL_* of the event
+	char text[94];      //!< formatted message or detail of a span (truncated)
+} TraceEvent;
+
+uint64_t traceNow();
+void traceSpan(int level, const char* name, const char* detail, uint64_t start, uint64_t end);
+void traceMessage(int level, const char* name, const char* format, ...)
+#if defined(__GNUC__)
+	__attribute__((format(printf, 3, 4)))
+#endif
+	;
+void traceCounter(int level, const char* name, double value);
+void traceSetThreadName(const char* name);
+bool traceWriteChromeJSON(const std::string& file);
+
+/** records the lifetime of the object as span (see TRACE_SPAN) */
+template<bool enabled>
+class TraceSpan {
+public:
+	TraceSpan(int level, const char* name, const char* detail = nullptr)
+		: level(level), name(name), detail(detail), start(traceNow()) {}
+	~TraceSpan() { traceSpan(level, name, detail, start, traceNow()); }
+private:
+	TraceSpan(const TraceSpan&);
+	TraceSpan& operator=(const TraceSpan&);
+	int level;
+	const char* name;
+	const char* detail; //!< copied when the span ends, so it has to live until then
+	uint64_t start;
+};
+
+/** span of a filtered level, compiles to nothing */
+template<>
+class TraceSpan<false> {
+public:
+	TraceSpan(int, const char*, const char* = nullptr) {}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/** traces the remainder of the enclosing scope as span */
+#define TRACE_SPAN(level, name) \
+	TraceSpan<TRACE_ENABLED(level)> TRACE_CONCAT(traceSpan_, __LINE__)(level, name)
+#define TRACE_SPAN_DETAIL(level, name, detail) \
+	TraceSpan<TRACE_ENABLED(level)> TRACE_CONCAT(traceSpan_, __LINE__)(level, name, detail)
+
+#define TRACE_MESSAGE(level, name, ...) \
+	do { if(TRACE_ENABLED(level)) traceMessage(level, name, __VA_ARGS__); } while(0)
+#define TRACE_ERROR(name, ...) TRACE_MESSAGE(TRACE_LEVEL_ERROR, name, __VA_ARGS__)
+#define TRACE_WARN(name, ...)  TRACE_MESSAGE(TRACE_LEVEL_WARN,  name, __VA_ARGS__)
+#define TRACE_INFO(name, ...)  TRACE_MESSAGE(TRACE_LEVEL_INFO,  name, __VA_ARGS__)
+#define TRACE_DEBUG(name, ...) TRACE_MESSAGE(TRACE_LEVEL_DEBUG, name, __VA_ARGS__)
+
+#define TRACE_COUNTER(level, name, value) \
+	do { if(TRACE_ENABLED(level)) traceCounter(level, name, value); } while(0)
@@ -0,0 +1,642 @@
+// VirtualCubeMap.cpp
+//
+
+#include "VirtualCubeMap.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+
+static const char tiledCubeMapMagic[4] = {'V','C','M','1'};
+static const uint32_t tiledCubeMapHeaderBytes = 4 + 4*sizeof(uint32_t);
+
+/** 64 bit file seek (tiled files of 16K faces are several GB) */
+static bool seekFile(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+	return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+/** byte offset of a tile in the file */
+uint64_t TiledCubeMapHeader_t::tileOffset(uint32_t level, uint32_t face, uint32_t tx, uint32_t ty) const {
+	uint64_t offset = tiledCubeMapHeaderBytes;
+	for(uint32_t l = 0; l < level; l++){
+		uint64_t n = tilesPerSide(l);
+		offset += 6*n*n*tileBytes();
+	}
+	uint64_t n = tilesPerSide(level);
+	return offset + (face*n*n + ty*n + tx)*tileBytes();
+}
+
+/**
+ * Creates a tiled cubemap file for faces of the specified resolution and writes its header.
+ * The faces are written afterwards with writeTiledCubeMapFace (in any order).
+ */
+bool createTiledCubeMap(const std::string& file, int faceResolution, int tileSize) {
+	TiledCubeMapHeader header;
+	header.faceResolution = static_cast<uint32_t>(faceResolution);
+	header.tileSize = static_cast<uint32_t>(tileSize);
+	header.border = 1;
+	header.numLevels = 1;
+	while(header.tilesPerSide(header.numLevels-1) > 1){
+		header.numLevels++;
+	}
+	if(header.numLevels > 16 || header.tilesPerSide(0) > 4096){
+		std::fprintf(stderr, "face resolution %d is too large for tiled cubemap [%s]\n", faceResolution, file.c_str());
+		return false;
+	}
+	FILE* f = std::fopen(file.c_str(), "wb");
+	if(!f){
+		std::fprintf(stderr, "could not write file [%s]\n", file.c_str());
+		return false;
+	}
+	uint32_t fields[4] = {header.faceResolution, header.tileSize, header.border, header.numLevels};
+	bool ok = std::fwrite(tiledCubeMapMagic, 1, 4, f) == 4 && std::fwrite(fields, sizeof(uint32_t), 4, f) == 4;
+	std::fclose(f);
+	return ok;
+}
+
+/** reads the header of a tiled cubemap file */
+bool readTiledCubeMapHeader(FILE* f, TiledCubeMapHeader& header) {
+	char magic[4];
+	uint32_t fields[4];
+	if(!seekFile(f, 0) || std::fread(magic, 1, 4, f) != 4 || std::fread(fields, sizeof(uint32_t), 4, f) != 4
+			|| std::memcmp(magic, tiledCubeMapMagic, 4) != 0){
+		return false;
+	}
+	header.faceResolution = fields[0];
+	header.tileSize = fields[1];
+	header.border = fields[2];
+	header.numLevels = fields[3];
+	return header.tileSize > 0 && header.numLevels > 0 && header.numLevels <= 16;
+}
+
+/**
+ * Cuts a face (8 bit RGB, rows top to bottom) into tiles for all levels of the
+ * file's mip chain. Levels are generated by 2x2 box filtering.
+ */
+bool writeTiledCubeMapFace(const std::string& file, int face, const unsigned char* rgb) {
+	FILE* f = std::fopen(file.c_str(), "r+b");
+	if(!f){
+		std::fprintf(stderr, "could not open file [%s]\n", file.c_str());
+		return false;
+	}
+	TiledCubeMapHeader header;
+	if(!readTiledCubeMapHeader(f, header)){
+		std::fprintf(stderr, "not a tiled cubemap [%s]\n", file.c_str());
+		std::fclose(f);
+		return false;
+	}
+	int res = static_cast<int>(header.faceResolution);
+	std::vector<unsigned char> level(rgb, rgb + static_cast<size_t>(res)*res*3);
+	std::vector<unsigned char> next;
+	std::vector<unsigned char> tile(header.tileBytes());
+	int T = static_cast<int>(header.tileSize);
+	int B = static_cast<int>(header.border);
+	int P = static_cast<int>(header.pageSize());
+	bool ok = true;
+	for(uint32_t l = 0; l < header.numLevels && ok; l++){
+		int n = static_cast<int>(header.tilesPerSide(l));
+		// tiles of one face and level are contiguous
+		ok = seekFile(f, header.tileOffset(l, face, 0, 0));
+		for(int ty = 0; ty < n && ok; ty++){
+			for(int tx = 0; tx < n && ok; tx++){
+				for(int y = 0; y < P; y++){
+					int sy = std::min(std::max(ty*T + y - B, 0), res-1);
+					for(int x = 0; x < P; x++){
+						int sx = std::min(std::max(tx*T + x - B, 0), res-1);
+						std::memcpy(&tile[(static_cast<size_t>(y)*P + x)*3], &level[(static_cast<size_t>(sy)*res + sx)*3], 3);
+					}
+				}
+				ok = std::fwrite(&tile[0], 1, tile.size(), f) == tile.size();
+			}
+		}
+		// box filter to the next level
+		int nres = std::max(1, res/2);
+		next.resize(static_cast<size_t>(nres)*nres*3);
+		for(int y = 0; y < nres; y++){
+			int y0 = std::min(2*y, res-1), y1 = std::min(2*y+1, res-1);
+			for(int x = 0; x < nres; x++){
+				int x0 = std::min(2*x, res-1), x1 = std::min(2*x+1, res-1);
+				for(int c = 0; c < 3; c++){
+					int sum = level[(static_cast<size_t>(y0)*res + x0)*3+c] + level[(static_cast<size_t>(y0)*res + x1)*3+c]
+							+ level[(static_cast<size_t>(y1)*res + x0)*3+c] + level[(static_cast<size_t>(y1)*res + x1)*3+c];
+					next[(static_cast<size_t>(y)*nres + x)*3+c] = static_cast<unsigned char>((sum+2)/4);
+				}
+			}
+		}
+		level.swap(next);
+		res = nres;
+	}
+	std::fclose(f);
+	if(!ok){
+		std::fprintf(stderr, "could not write face %d to file [%s]\n", face, file.c_str());
+	}
+	return ok;
+}
+
+/** reads a single tile (including border) */
+bool readTiledCubeMapTile(FILE* f, const TiledCubeMapHeader& header, uint32_t level, uint32_t face,
+		uint32_t tx, uint32_t ty, unsigned char* out)
+{
+	return seekFile(f, header.tileOffset(level, face, tx, ty))
+			&& std::fread(out, 1, header.tileBytes(), f) == header.tileBytes();
+}
+
+/**
+ * Reads the coarsest level (a single tile per face) of a tiled cubemap as 6 faces
+ * of resolution x resolution RGB texels. Used to create a regular cubemap when
+ * only the tiled file is available.
+ */
+bool readTiledCubeMapCoarsest(const std::string& file, std::vector<unsigned char> faces[6], int& resolution) {
+	FILE* f = std::fopen(file.c_str(), "rb");
+	if(!f){
+		return false;
+	}
+	TiledCubeMapHeader header;
+	bool ok = readTiledCubeMapHeader(f, header);
+	if(ok){
+		uint32_t level = header.numLevels-1;
+		int res = static_cast<int>(header.levelResolution(level));
+		int P = static_cast<int>(header.pageSize());
+		int B = static_cast<int>(header.border);
+		std::vector<unsigned char> tile(header.tileBytes());
+		for(uint32_t face = 0; face < 6 && ok; face++){
+			ok = readTiledCubeMapTile(f, header, level, face, 0, 0, &tile[0]);
+			faces[face].resize(static_cast<size_t>(res)*res*3);
+			for(int y = 0; y < res && ok; y++){
+				std::memcpy(&faces[face][static_cast<size_t>(y)*res*3], &tile[(static_cast<size_t>(y+B)*P + B)*3], res*3);
+			}
+		}
+		resolution = res;
+	}
+	std::fclose(f);
+	return ok;
+}
+
+//----------------//
+// VirtualCubeMap //
+//----------------//
+
+VirtualCubeMap::VirtualCubeMap() {
+	file = nullptr;
+	cachePagesPerSide = 0;
+	texCache = texIndirection = 0;
+	indirectionDirty = false;
+	frame = 0;
+	feedbackScale = 4;
+	fbWidth = fbHeight = 0;
+	feedbackFBO = texFeedback = texFeedbackDepth = 0;
+	pbo[0] = pbo[1] = 0;
+	pboFence[0] = pboFence[1] = 0;
+	pboIndex = 0;
+	stopStreamer = false;
+}
+
+VirtualCubeMap::~VirtualCubeMap() {
+	// GL objects are owned by the resource registry, only the streamer needs to go
+	if(streamer.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopStreamer = true;
+		}
+		wakeStreamer.notify_all();
+		streamer.join();
+	}
+	if(file){
+		std::fclose(file);
+	}
+}
+
+/**
+ * Opens a tiled cubemap file, creates the physical cache (cachePagesPerSide^2 pages)
+ * and the indirection table, makes the coarsest level resident and starts the streamer.
+ */
+bool VirtualCubeMap::open(const std::string& filepath, GPUResources& resources, GLenum cacheFormat, int pagesPerSide) {
+	close(resources);
+	file = std::fopen(filepath.c_str(), "rb");
+	if(!file){
+		TRACE_ERROR("texture", "could not open tiled cubemap [%s]", filepath.c_str());
+		return false;
+	}
+	if(!readTiledCubeMapHeader(file, header)){
+		TRACE_ERROR("texture", "not a tiled cubemap [%s]", filepath.c_str());
+		std::fclose(file);
+		file = nullptr;
+		return false;
+	}
+	filename = filepath;
+	cachePagesPerSide = pagesPerSide;
+	int cacheSize = cachePagesPerSide*static_cast<int>(header.pageSize());
+
+	texCache = resources.createTexture(GPUResources::CAT_TEXTURE, "virtual cubemap cache");
+	resources.setTextureStorage(texCache, cacheFormat, cacheSize, cacheSize, 1, 1);
+	glBindTexture(GL_TEXTURE_2D, texCache);
+	glTexStorage2D(GL_TEXTURE_2D, 1, cacheFormat, cacheSize, cacheSize);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int n = static_cast<int>(header.tilesPerSide(0));
+	int layers = 6*static_cast<int>(header.numLevels);
+	texIndirection = resources.createTexture(GPUResources::CAT_TEXTURE, "virtual cubemap indirection");
+	resources.setTextureStorage(texIndirection, GL_RGBA8UI, n, n, layers, 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texIndirection);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8UI, n, n, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	indirection.assign(static_cast<size_t>(n)*n*layers*4, 0);
+
+	Page freePage = {0, 0, false};
+	pages.assign(static_cast<size_t>(cachePagesPerSide)*cachePagesPerSide, freePage);
+	pageOfTile.clear();
+	requested.clear();
+	frame = 0;
+
+	// the coarsest level is always resident so there is something to fall back to
+	std::vector<unsigned char> tile(header.tileBytes());
+	uint32_t coarsest = header.numLevels-1;
+	for(uint32_t face = 0; face < 6; face++){
+		if(!readTiledCubeMapTile(file, header, coarsest, face, 0, 0, &tile[0])){
+			TRACE_ERROR("texture", "could not read tile from [%s]", filepath.c_str());
+			// not open: releases the textures and closes the file
+			close(resources);
+			return false;
+		}
+		uploadTile(packTileKey(coarsest, face, 0, 0), &tile[0], true);
+	}
+	rebuildIndirection();
+
+	stopStreamer = false;
+	streamer = std::thread(&VirtualCubeMap::streamerLoop, this);
+	TRACE_INFO("texture", "opened tiled cubemap %s (%u^2, %u levels, %u pages)", filepath.c_str(),
+			static_cast<unsigned>(header.faceResolution), static_cast<unsigned>(header.numLevels), static_cast<unsigned>(pages.size()));
+	return true;
+}
+
+/** stops the streamer and releases all GL objects except the feedback targets */
+void VirtualCubeMap::close(GPUResources& resources) {
+	if(streamer.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopStreamer = true;
+		}
+		wakeStreamer.notify_all();
+		streamer.join();
+	}
+	requestQueue.clear();
+	loadedTiles.clear();
+	requested.clear();
+	pageOfTile.clear();
+	pages.clear();
+	indirection.clear();
+	resources.releaseTexture(texCache);
+	resources.releaseTexture(texIndirection);
+	if(file){
+		std::fclose(file);
+		file = nullptr;
+	}
+}
+
+/**
+ * (Re)creates the feedback targets at 1/feedbackScale of the window size
+ * and the pixel buffers used for reading them back.
+ */
+void VirtualCubeMap::resizeFeedback(GPUResources& resources, int width, int height) {
+	releaseFeedback(resources);
+	fbWidth = std::max(1, width/feedbackScale);
+	fbHeight = std::max(1, height/feedbackScale);
+	const int layers = 1+6;
+
+	texFeedback = resources.createTexture(GPUResources::CAT_RENDERTARGET, "virtual cubemap feedback");
+	resources.setTextureStorage(texFeedback, GL_R32UI, fbWidth, fbHeight, layers, 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texFeedback);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32UI, fbWidth, fbHeight, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	texFeedbackDepth = resources.createTexture(GPUResources::CAT_RENDERTARGET, "virtual cubemap feedback depth");
+	resources.setTextureStorage(texFeedbackDepth, GL_DEPTH_COMPONENT32, fbWidth, fbHeight, layers, 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texFeedbackDepth);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32, fbWidth, fbHeight, layers);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	feedbackFBO = resources.createFramebuffer("virtual cubemap feedback");
+	glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texFeedback, 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texFeedbackDepth, 0);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+		std::fprintf(stderr, "FBO: virtual cubemap feedback is incomplete.\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	size_t bytes = static_cast<size_t>(fbWidth)*fbHeight*layers*sizeof(uint32_t);
+	for(int i = 0; i < 2; i++){
+		pbo[i] = resources.createBuffer("virtual cubemap feedback readback");
+		resources.setBufferSize(pbo[i], bytes);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pboIndex = 0;
+}
+
+/** releases the feedback targets and readback buffers */
+void VirtualCubeMap::releaseFeedback(GPUResources& resources) {
+	for(int i = 0; i < 2; i++){
+		if(pboFence[i]){
+			glDeleteSync(pboFence[i]);
+			pboFence[i] = 0;
+		}
+		resources.releaseBuffer(pbo[i]);
+	}
+	resources.releaseFramebuffer(feedbackFBO);
+	resources.releaseTexture(texFeedback);
+	resources.releaseTexture(texFeedbackDepth);
+}
+
+/**
+ * Starts the readback of the feedback rendered this frame and processes the
+ * feedback of the previous readback if the GPU has finished it. The readback
+ * never waits for the GPU, a frame whose buffer is still in flight is skipped.
+ */
+void VirtualCubeMap::readFeedback() {
+	if(!isOpen() || !feedbackFBO){
+		return;
+	}
+	uint32_t previous = pboIndex ^ 1;
+	if(pboFence[previous]){
+		GLenum status = glClientWaitSync(pboFence[previous], 0, 0);
+		if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED){
+			glDeleteSync(pboFence[previous]);
+			pboFence[previous] = 0;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[previous]);
+			size_t count = static_cast<size_t>(fbWidth)*fbHeight*(1+6);
+			const uint32_t* keys = static_cast<const uint32_t*>(
+					glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count*sizeof(uint32_t), GL_MAP_READ_BIT));
+			if(keys){
+				processFeedback(keys, count);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
+	if(!pboFence[pboIndex]){
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[pboIndex]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texFeedback);
+		glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pboFence[pboIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pboIndex ^= 1;
+	}
+}
+
+/**
+ * Marks the sampled tiles and their ancestors as used and replaces the
+ * streamer's queue with the tiles that are missing, coarse levels first.
+ */
+void VirtualCubeMap::processFeedback(const uint32_t* keys, size_t count) {
+	frame++;
+	std::unordered_set<uint32_t> sampled;
+	uint32_t last = 0;
+	for(size_t i = 0; i < count; i++){
+		// neighbouring texels mostly sample the same tile
+		if(keys[i] == 0 || keys[i] == last){
+			continue;
+		}
+		last = keys[i];
+		sampled.insert(last);
+	}
+	std::vector<uint32_t> missing;
+	std::unordered_set<uint32_t> visited;
+	for(std::unordered_set<uint32_t>::const_iterator it = sampled.begin(); it != sampled.end(); ++it){
+		uint32_t level = tileKeyLevel(*it);
+		uint32_t face = tileKeyFace(*it);
+		uint32_t tx = tileKeyX(*it);
+		uint32_t ty = tileKeyY(*it);
+		if(level >= header.numLevels || face >= 6 || tx >= header.tilesPerSide(level) || ty >= header.tilesPerSide(level)){
+			continue;
+		}
+		// walk up the mip chain so the fallbacks stay resident as well
+		for(; level < header.numLevels; level++){
+			uint32_t n = header.tilesPerSide(level);
+			uint32_t key = packTileKey(level, face, std::min(tx, n-1), std::min(ty, n-1));
+			if(!visited.insert(key).second){
+				break;
+			}
+			std::unordered_map<uint32_t, uint32_t>::const_iterator page = pageOfTile.find(key);
+			if(page != pageOfTile.end()){
+				pages[page->second].lastUsed = frame;
+			} else if(requested.find(key) == requested.end()){
+				missing.push_back(key);
+			}
+			tx >>= 1;
+			ty >>= 1;
+		}
+	}
+	// coarse tiles first, they cover most of the screen
+	std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b){
+		return tileKeyLevel(a) > tileKeyLevel(b);
+	});
+	// never request more tiles than can be put into the cache without evicting tiles needed now
+	size_t evictable = 0;
+	for(size_t i = 0; i < pages.size(); i++){
+		if(pages[i].key == 0 || (!pages[i].pinned && pages[i].lastUsed < frame)){
+			evictable++;
+		}
+	}
+	if(missing.size() > evictable){
+		missing.resize(evictable);
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	// requests of earlier frames that were not started yet are dropped, they might not be needed anymore
+	for(size_t i = 0; i < requestQueue.size(); i++){
+		requested.erase(requestQueue[i]);
+	}
+	requestQueue.assign(missing.begin(), missing.end());
+	requested.insert(missing.begin(), missing.end());
+	if(!requestQueue.empty()){
+		wakeStreamer.notify_one();
+	}
+}
+
+/** loop of the streamer thread: reads requested tiles from the file */
+void VirtualCubeMap::streamerLoop() {
+	traceSetThreadName("vt streamer");
+	FILE* f = std::fopen(filename.c_str(), "rb");
+	if(!f){
+		std::fprintf(stderr, "streamer could not open [%s]\n", filename.c_str());
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		wakeStreamer.wait(lock, [this]{ return stopStreamer || !requestQueue.empty(); });
+		if(stopStreamer){
+			break;
+		}
+		LoadedTile tile;
+		tile.key = requestQueue.front();
+		requestQueue.pop_front();
+		lock.unlock();
+		TRACE_SPAN(TRACE_LEVEL_DEBUG, "load tile");
+		tile.texels.resize(header.tileBytes());
+		bool ok = readTiledCubeMapTile(f, header, tileKeyLevel(tile.key), tileKeyFace(tile.key),
+				tileKeyX(tile.key), tileKeyY(tile.key), &tile.texels[0]);
+		lock.lock();
+		if(!ok){
+			tile.texels.clear(); // uploaded as failed, so the request is cleared
+		}
+		loadedTiles.push_back(std::move(tile));
+	}
+	lock.unlock();
+	std::fclose(f);
+}
+
+/**
+ * Uploads at most uploadBudget tiles loaded by the streamer into the cache
+ * and updates the indirection table.
+ * @return true if there is outstanding work (another frame should be rendered)
+ */
+bool VirtualCubeMap::update(int uploadBudget) {
+	if(!isOpen()){
+		return false;
+	}
+	std::vector<LoadedTile> tiles;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tiles.swap(loadedTiles);
+	}
+	size_t uploaded = 0;
+	for(; uploaded < tiles.size() && static_cast<int>(uploaded) < uploadBudget; uploaded++){
+		LoadedTile& tile = tiles[uploaded];
+		requested.erase(tile.key);
+		if(!tile.texels.empty() && pageOfTile.find(tile.key) == pageOfTile.end()){
+			uploadTile(tile.key, &tile.texels[0], false);
+		}
+	}
+	if(uploaded < tiles.size()){
+		// put back what exceeded the budget (in front of tiles loaded meanwhile)
+		std::lock_guard<std::mutex> lock(mutex);
+		loadedTiles.insert(loadedTiles.begin(), std::make_move_iterator(tiles.begin()+uploaded),
+				std::make_move_iterator(tiles.end()));
+	}
+	if(indirectionDirty){
+		rebuildIndirection();
+	}
+	return !requested.empty();
+}
+
+/**
+ * Puts a tile into a free page or replaces the least recently used tile
+ * that was not requested by the latest feedback.
+ * @return false if every page is in use
+ */
+bool VirtualCubeMap::uploadTile(uint32_t key, const unsigned char* texels, bool pinned) {
+	int best = -1;
+	for(size_t i = 0; i < pages.size(); i++){
+		const Page& p = pages[i];
+		if(p.key == 0){
+			best = static_cast<int>(i);
+			break;
+		}
+		if(!p.pinned && p.lastUsed < frame && (best < 0 || p.lastUsed < pages[best].lastUsed)){
+			best = static_cast<int>(i);
+		}
+	}
+	if(best < 0){
+		return false;
+	}
+	Page& page = pages[best];
+	if(page.key){
+		pageOfTile.erase(page.key);
+	}
+	page.key = key;
+	page.lastUsed = frame;
+	page.pinned = pinned;
+	pageOfTile[key] = static_cast<uint32_t>(best);
+
+	GLint P = static_cast<GLint>(header.pageSize());
+	glBindTexture(GL_TEXTURE_2D, texCache);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (best % cachePagesPerSide)*P, (best / cachePagesPerSide)*P, P, P,
+			GL_RGB, GL_UNSIGNED_BYTE, texels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	indirectionDirty = true;
+	return true;
+}
+
+/**
+ * Recomputes the indirection table from the resident tiles. Levels are processed
+ * from coarse to fine so that every tile that is not resident inherits the entry
+ * of its parent (page x, page y, level of the closest resident ancestor).
+ */
+void VirtualCubeMap::rebuildIndirection() {
+	uint32_t n0 = header.tilesPerSide(0);
+	for(int level = static_cast<int>(header.numLevels)-1; level >= 0; level--){
+		uint32_t n = header.tilesPerSide(level);
+		bool hasParent = level+1 < static_cast<int>(header.numLevels);
+		uint32_t parentN = hasParent ? header.tilesPerSide(level+1) : 1;
+		for(uint32_t face = 0; face < 6; face++){
+			unsigned char* layer = &indirection[static_cast<size_t>(level*6+face)*n0*n0*4];
+			const unsigned char* parentLayer = hasParent ? layer + static_cast<size_t>(6)*n0*n0*4 : nullptr;
+			for(uint32_t ty = 0; ty < n; ty++){
+				for(uint32_t tx = 0; tx < n; tx++){
+					unsigned char* entry = layer + (static_cast<size_t>(ty)*n0 + tx)*4;
+					std::unordered_map<uint32_t, uint32_t>::const_iterator page = pageOfTile.find(packTileKey(level, face, tx, ty));
+					if(page != pageOfTile.end()){
+						entry[0] = static_cast<unsigned char>(page->second % cachePagesPerSide);
+						entry[1] = static_cast<unsigned char>(page->second / cachePagesPerSide);
+						entry[2] = static_cast<unsigned char>(level);
+						entry[3] = 1;
+					} else if(hasParent){
+						uint32_t px = std::min(tx >> 1, parentN-1);
+						uint32_t py = std::min(ty >> 1, parentN-1);
+						std::memcpy(entry, parentLayer + (static_cast<size_t>(py)*n0 + px)*4, 4);
+					}
+				}
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texIndirection);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, n0, n0, 6*header.numLevels,
+			GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &indirection[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	indirectionDirty = false;
+}
+
+/**
+ * Binds cache and indirection texture to the specified texture units and
+ * sets the vt* uniforms of the (bound) shader.
+ */
+void VirtualCubeMap::bind(GLShader& shader, GLint cacheUnit, GLint indirectionUnit, float lodBias) {
+	glActiveTexture(GL_TEXTURE0 + cacheUnit);
+	glBindTexture(GL_TEXTURE_2D, texCache);
+	glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texIndirection);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i( shader.GetUniformLocation("vtCache"), cacheUnit );
+	glUniform1i( shader.GetUniformLocation("vtIndirection"), indirectionUnit );
+	glUniform1i( shader.GetUniformLocation("vtFaceResolution"), static_cast<GLint>(header.faceResolution) );
+	glUniform1i( shader.GetUniformLocation("vtTileSize"), static_cast<GLint>(header.tileSize) );
+	glUniform1i( shader.GetUniformLocation("vtBorder"), static_cast<GLint>(header.border) );
+	glUniform1i( shader.GetUniformLocation("vtPageSize"), static_cast<GLint>(header.pageSize()) );
+	glUniform1f( shader.GetUniformLocation("vtCacheSize"), static_cast<float>(cachePagesPerSide*header.pageSize()) );
+	glUniform1i( shader.GetUniformLocation("vtNumLevels"), static_cast<GLint>(header.numLevels) );
+	glUniform1f( shader.GetUniformLocation("vtLodBias"), lodBias );
+}
+
+/** unbinds the textures bound by bind() */
+void VirtualCubeMap::unbind(GLint cacheUnit, GLint indirectionUnit) {
+	glActiveTexture(GL_TEXTURE0 + cacheUnit);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
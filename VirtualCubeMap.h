@@ -0,0 +1,147 @@
+#pragma once
+
+#include "GL/gl3w.h"
+#include "GLShader.h"
+#include "GPUResources.h"
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Sparse tiled (virtual) cubemaps.
+ *
+ * A tiled cubemap file (tiles.vcm) stores the mip chain of the 6 faces cut into
+ * square tiles of tileSize texels plus a border of duplicated texels on each
+ * side, so that a tile can be bilinearly filtered on its own. Tiles are stored
+ * uncompressed (RGB8), ordered by level, face (negx, posx, negy, posy, negz, posz),
+ * tile row and tile column, so the offset of every tile can be computed from the header.
+ *
+ * At runtime only the tiles that are actually sampled are resident. A feedback pass
+ * writes the packed tile id (see packTileKey) of every sampled texel into an integer
+ * target, which is read back asynchronously through pixel buffers. Missing tiles are
+ * loaded by a background streamer thread and uploaded into pages of a physical cache
+ * texture. An indirection texture maps every tile of every level to the page of the
+ * tile itself or, while it is not resident, to the page of its closest resident ancestor.
+ * The coarsest level is always resident.
+ */
+
+/** header of a tiled cubemap file */
+typedef struct TiledCubeMapHeader_t {
+	uint32_t faceResolution; //!< width and height of the faces at level 0
+	uint32_t tileSize;       //!< texels per tile side (without border)
+	uint32_t border;         //!< duplicated texels on each side of a tile
+	uint32_t numLevels;      //!< number of mip levels (the last one has a single tile per face)
+
+	TiledCubeMapHeader_t() {
+		faceResolution = tileSize = border = numLevels = 0;
+	}
+	uint32_t pageSize() const { return tileSize + 2*border; }
+	uint32_t levelResolution(uint32_t level) const { return faceResolution >> level ? faceResolution >> level : 1; }
+	uint32_t tilesPerSide(uint32_t level) const { return (levelResolution(level) + tileSize - 1)/tileSize; }
+	size_t tileBytes() const { return static_cast<size_t>(pageSize())*pageSize()*3; }
+	uint64_t tileOffset(uint32_t level, uint32_t face, uint32_t tx, uint32_t ty) const;
+} TiledCubeMapHeader;
+
+bool createTiledCubeMap(const std::string& file, int faceResolution, int tileSize = 126);
+bool writeTiledCubeMapFace(const std::string& file, int face, const unsigned char* rgb);
+bool readTiledCubeMapHeader(FILE* f, TiledCubeMapHeader& header);
+bool readTiledCubeMapTile(FILE* f, const TiledCubeMapHeader& header, uint32_t level, uint32_t face,
+		uint32_t tx, uint32_t ty, unsigned char* out);
+bool readTiledCubeMapCoarsest(const std::string& file, std::vector<unsigned char> faces[6], int& resolution);
+
+/** packs a tile address into the 32 bit id written by the feedback pass (0 = no tile) */
+inline uint32_t packTileKey(uint32_t level, uint32_t face, uint32_t tx, uint32_t ty) {
+	return 0x80000000u | (level << 27) | (face << 24) | (ty << 12) | tx;
+}
+inline uint32_t tileKeyLevel(uint32_t key) { return (key >> 27) & 15; }
+inline uint32_t tileKeyFace(uint32_t key)  { return (key >> 24) & 7; }
+inline uint32_t tileKeyY(uint32_t key)     { return (key >> 12) & 0xfff; }
+inline uint32_t tileKeyX(uint32_t key)     { return key & 0xfff; }
+
+/**
+ * Runtime side of a tiled cubemap: physical page cache, indirection table,
+ * feedback targets with asynchronous readback and the background streamer.
+ */
+class VirtualCubeMap {
+public:
+	VirtualCubeMap();
+	~VirtualCubeMap();
+
+	bool open(const std::string& file, GPUResources& resources, GLenum cacheFormat, int cachePagesPerSide = 32);
+	void close(GPUResources& resources);
+	bool isOpen() const { return file != nullptr; }
+
+	void resizeFeedback(GPUResources& resources, int width, int height);
+	void releaseFeedback(GPUResources& resources);
+	GLuint feedbackFramebuffer() const { return feedbackFBO; }
+	GLuint feedbackTexture() const { return texFeedback; }
+	GLuint feedbackDepthTexture() const { return texFeedbackDepth; }
+	int feedbackWidth() const { return fbWidth; }
+	int feedbackHeight() const { return fbHeight; }
+	float feedbackLodBias() const { return -std::log2(static_cast<float>(feedbackScale)); }
+	void readFeedback();
+
+	bool update(int uploadBudget = 16);
+	void bind(GLShader& shader, GLint cacheUnit, GLint indirectionUnit, float lodBias);
+	void unbind(GLint cacheUnit, GLint indirectionUnit);
+
+	int residentPages() const { return static_cast<int>(pageOfTile.size()); }
+	int pendingTiles() const { return static_cast<int>(requested.size()); }
+	const TiledCubeMapHeader& getHeader() const { return header; }
+
+private:
+	/** a page of the physical cache */
+	typedef struct Page_t {
+		uint32_t key;       //!< tile occupying the page (0 = free)
+		uint32_t lastUsed;  //!< frame the tile was last requested by the feedback
+		bool pinned;        //!< page of the coarsest level, never evicted
+	} Page;
+
+	/** tile loaded by the streamer, waiting for upload */
+	typedef struct LoadedTile_t {
+		uint32_t key;
+		std::vector<unsigned char> texels;
+	} LoadedTile;
+
+	void streamerLoop();
+	void processFeedback(const uint32_t* keys, size_t count);
+	bool uploadTile(uint32_t key, const unsigned char* texels, bool pinned);
+	void rebuildIndirection();
+
+	TiledCubeMapHeader header;
+	std::string filename;
+	FILE* file;                 //!< file handle used by the main thread (coarsest level)
+	int cachePagesPerSide;      //!< physical cache is cachePagesPerSide^2 pages
+	GLuint texCache;            //!< physical page cache (2D texture)
+	GLuint texIndirection;      //!< indirection table (2D array, 6 layers per level, RGBA8UI: page x, page y, level)
+	std::vector<Page> pages;
+	std::unordered_map<uint32_t, uint32_t> pageOfTile; //!< resident tiles -> page index
+	std::vector<unsigned char> indirection;            //!< CPU copy of the indirection table
+	bool indirectionDirty;
+	uint32_t frame;             //!< incremented for every processed feedback
+
+	int feedbackScale;          //!< feedback targets are 1/feedbackScale of the window size
+	int fbWidth, fbHeight;
+	GLuint feedbackFBO;
+	GLuint texFeedback;         //!< R32UI array (1+6 layers like the color targets)
+	GLuint texFeedbackDepth;
+	GLuint pbo[2];              //!< readback ring
+	GLsync pboFence[2];
+	uint32_t pboIndex;
+
+	std::thread streamer;
+	std::mutex mutex;
+	std::condition_variable wakeStreamer;
+	std::deque<uint32_t> requestQueue;      //!< tiles to be loaded (guarded by mutex)
+	std::vector<LoadedTile> loadedTiles;    //!< tiles loaded by the streamer (guarded by mutex)
+	std::unordered_set<uint32_t> requested; //!< tiles queued or loaded but not yet uploaded (main thread only)
+	bool stopStreamer;
+};
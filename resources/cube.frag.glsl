@@ -1,22 +1,139 @@
 #version 330
+#ifdef CUBE_MAP_ATLAS
+// the textures are layers of cubemap arrays (set by the plugin if supported, see CubeMapAtlas.h)
+#extension GL_ARB_texture_cube_map_array : require
+#endif
 
 #define M_PI 3.1415
 
 layout(location = 0) out vec4 frag_color;
 layout(location = 1) out vec4 picking_color;
 
-uniform bool useTexture;
-uniform int warpFN;
-uniform float k_exp;
-uniform samplerCube tex;
-uniform vec3 pickColor;
-uniform vec3 lightDir;
-uniform mat4 invViewMX;
+#ifdef COUNT_OVERDRAW
+// counts the fragments shaded per layer (inserted by the plugin, see OverdrawCounter::shaderDefines)
+OVERDRAW_DECLARATIONS
+#endif
+
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
+
+#ifdef CUBE_MAP_ATLAS
+uniform samplerCubeArray texAtlas; // cubemap array of the size class of the texture (see CubeMapAtlas.h)
+#else
+uniform samplerCube tex; // cubemap of the object
+#endif
 
 in vec3 worldCoords;
 in vec2 faceCoords;
 in vec3 normal;
 flat in uint permMXidx;
+flat in int viewCamera;
+
+/* virtual (tiled) cubemap, see VirtualCubeMap.h */
+uniform int vtFaceResolution;
+uniform int vtTileSize;
+uniform int vtNumLevels;
+uniform float vtLodBias;
+
+/* Selects the cube face a direction points to (0..5 = negx, posx, negy, posy, negz, posz
+ * like the face files) and computes the face coordinates in [0,1]^2 the way GL does for cubemaps.
+ */
+int cubeFace(vec3 dir, out vec2 st) {
+	vec3 a = abs(dir);
+	int face;
+	float ma;
+	vec2 sc;
+	if(a.x >= a.y && a.x >= a.z){
+		ma = a.x;
+		face = dir.x < 0 ? 0 : 1;
+		sc = dir.x < 0 ? vec2(dir.z, -dir.y) : vec2(-dir.z, -dir.y);
+	} else if(a.y >= a.z){
+		ma = a.y;
+		face = dir.y < 0 ? 2 : 3;
+		sc = dir.y < 0 ? vec2(dir.x, -dir.z) : vec2(dir.x, dir.z);
+	} else {
+		ma = a.z;
+		face = dir.z < 0 ? 4 : 5;
+		sc = dir.z < 0 ? vec2(-dir.x, -dir.y) : vec2(dir.x, -dir.y);
+	}
+	st = 0.5*(sc/ma + 1);
+	return face;
+}
+
+/* Mip level of the virtual cubemap from the angular footprint of the pixel
+ * (a texel in the middle of a face covers about 2/faceResolution radians).
+ */
+int virtualLevel(vec3 dir) {
+	float footprint = max(length(dFdx(dir)), length(dFdy(dir))) / length(dir);
+	float level = log2(max(footprint*vtFaceResolution*0.5, 1e-6)) + vtLodBias;
+	return clamp(int(floor(level)), 0, vtNumLevels-1);
+}
+
+/* resolution of the faces at a mip level of the virtual cubemap */
+int virtualResolution(int level) {
+	return max(vtFaceResolution >> level, 1);
+}
+
+/* tile of the virtual cubemap containing the face coordinates at a mip level */
+ivec2 virtualTile(vec2 st, int level) {
+	int res = virtualResolution(level);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	return clamp(ivec2(st*res) / vtTileSize, ivec2(0), ivec2(tiles-1));
+}
+
+uniform bool useVirtual;
+uniform sampler2D vtCache;
+uniform usampler2DArray vtIndirection;
+uniform int vtBorder;
+uniform int vtPageSize;
+uniform float vtCacheSize;
+
+/* Samples the virtual cubemap in the specified direction.
+ * The indirection table points to the page of the tile or, while that is
+ * not resident yet, to the page of its closest resident ancestor.
+ */
+vec3 sampleVirtualCube(vec3 dir) {
+	vec2 st;
+	int face = cubeFace(dir, st);
+	int level = virtualLevel(dir);
+	ivec2 tile = virtualTile(st, level);
+	uvec4 entry = texelFetch(vtIndirection, ivec3(tile, level*6 + face), 0);
+	int residentLevel = int(entry.b);
+	int res = virtualResolution(residentLevel);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	ivec2 ancestor = min(tile >> (residentLevel - level), ivec2(tiles-1));
+	// position inside the tile (the border allows bilinear filtering up to the tile edges)
+	vec2 local = clamp(st*res - vec2(ancestor*vtTileSize), vec2(0), vec2(vtTileSize)) + vtBorder;
+	vec2 texel = vec2(entry.rg)*vtPageSize + local;
+	return texture(vtCache, texel / vtCacheSize).rgb;
+}
 
 /* lighting constants */
 const float k_amb  = 0.6;
@@ -112,6 +229,9 @@ vec3 blinnPhong(vec3 n, vec3 l, vec3 v) {
  * calculates blinn phong shding and sets the picking color.
  */
 void main() {
+#ifdef COUNT_OVERDRAW
+	COUNT_FRAGMENT();
+#endif
 	// warp face coordinates before using them
 	vec2 uv = 0.5*warp(2*faceCoords);
 
@@ -122,7 +242,15 @@ void main() {
 		mat3 permMX = permMatrices[permMXidx];
 		// get 3D cubemap texture coordinates
 		vec3 texCoords = permMX*vec3(uv,1);
-		color = texture(tex, texCoords).rgb;
+		if(useVirtual){
+			color = sampleVirtualCube(texCoords);
+		} else {
+#ifdef CUBE_MAP_ATLAS
+			color = texture(texAtlas, vec4(texCoords, textureLayer)).rgb;
+#else
+			color = texture(tex, texCoords).rgb;
+#endif
+		}
 	} else {
 		vec2 checker = truncateVec(10 * (uv+vec2(.5,.5)));
 		if(int(checker.x + checker.y) % 2 == 0) {
@@ -133,7 +261,8 @@ void main() {
 	}
 
 	// next up: calculate lighting
-	vec4 camPos = invViewMX * vec4(0, 0, 0, 1);
+	// the reflection views are lit for camera 0
+	vec4 camPos = cameraPos[viewCamera];
 	vec3 observerDir = normalize(camPos.xyz - worldCoords);
 	vec3 phong = blinnPhong(normalize(normal), -lightDir, observerDir);
 	
@@ -1,31 +1,63 @@
 #version 330
 #extension GL_ARB_gpu_shader5 : require
+#extension GL_ARB_viewport_array : enable
 
-layout(points, invocations = 7) in;
-/* we have a total of 14 (including gl_position and gl_Layer) components per vertex
+// camera 0, the 6 reflection faces and the cameras 1 to NUM_VIEWS-7 (set by the plugin)
+#ifndef NUM_VIEWS
+#define NUM_VIEWS 7
+#endif
+
+layout(points, invocations = NUM_VIEWS) in;
+/* we have a total of 16 (including gl_position, gl_Layer and gl_ViewportIndex) components per vertex
  * this means that the minimum number of vertices that can be generated
- * is 73 (with respect to the specification).
+ * is 64 (with respect to the specification).
  * GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS is at least 1024
- * from which follows: max_vertices = 1024/14 = 73.1
+ * from which follows: max_vertices = 1024/16 = 64
  * of course it may be larger when the hardware has a higher limit
  * on GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS
+ * (the value below is replaced when the shader is loaded)
  */
 layout(triangle_strip,max_vertices=73) out;
 
-uniform bool doSphereProjection;
-uniform int subDivisionLevel;
-uniform float totalQuadSize;
-uniform mat4 modelMX;
-uniform mat4 viewMX;
-uniform mat4 projMX;
-uniform mat4 boxProjMX;
-uniform mat4 boxTransMX;
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
 
 flat out uint permMXidx;
+flat out int viewCamera; // camera the view belongs to (0 for the reflection faces)
 out vec3 worldCoords;
 out vec2 faceCoords;
 out vec3 normal;
 
+// see depth.frag.glsl
+invariant gl_Position;
+
 in uint permMXidx_[];
 
 /* view matrices for pointing the camera to each of a cube's faces (from the center of the cube)
@@ -69,14 +101,20 @@ void makeVertex(vec2 facePos, mat4 vpMX) {
 	}
 	gl_Position = vpMX * vec4(worldCoords,1);
 	gl_Layer = gl_InvocationID;
+#ifdef GL_ARB_viewport_array
+	// the reflection layers are rendered at the resolution of the reflection cubemap, the cameras at their tile size
+	gl_ViewportIndex = gl_InvocationID;
+#endif
 	permMXidx = permMXidx_[0];
+	viewCamera = gl_InvocationID > 6 ? gl_InvocationID - 6 : 0;
 }
 
 
 /* Geometry shader for rendering a cube or sphere in the scene.
  * This GS is instanced 7 times, the first instance rendering from the
  * perspective of the camera, the other 6 rendering from the perspective of
- * the cube center in direction of each of its faces.
+ * the cube center in direction of each of its faces. Further instances render
+ * the additional cameras of a split screen layout into the layers after them.
  * This realizes a layered rendering approach where each instance
  * sends the primitives to a different layer.
  * 
@@ -86,10 +124,14 @@ void makeVertex(vec2 facePos, mat4 vpMX) {
  * determines the width and height of the quad originating from that point.
  * The quad spanned by this parameters will be covered with columns of
  * triangle strips to equally sample the area.
- * The uniform subDivisionLevel determines how many triangle strip columns
- * are created and how many "small" quads a trianglestrip contains.
+ * The uniform subDivisionLevels determines (for each view) how many triangle strip
+ * columns are created and how many "small" quads a trianglestrip contains.
  */
 void main() {
+	// nothing to do for views the object was culled from
+	if((viewMask & (1 << gl_InvocationID)) == 0){
+		return;
+	}
 	// set the permutation matrix corresponding to the current input's permutation matrix index
 	permMX = permMatrices[permMXidx_[0]];
 
@@ -97,12 +139,16 @@ void main() {
 	if(gl_InvocationID == 0){
 		// camera transform and screen view frustum projection
 		vpMX = projMX*viewMX;
+	} else if(gl_InvocationID > 6){
+		// additional camera
+		vpMX = cameraViewProjMX[gl_InvocationID-7];
 	} else {
 		// cubemap transform 90° view frustum projection onto cube face
 		vpMX = boxProjMX*boxViewMX[gl_InvocationID-1]*boxTransMX;
 	}
 
 	// create the triangle strip
+	int subDivisionLevel = subDivisionLevels[gl_InvocationID/4][gl_InvocationID%4];
 	float subQuadSize = totalQuadSize/subDivisionLevel;
 	for(int ix = 0; ix < subDivisionLevel; ix++){
 		// define the coords of the first quad
@@ -0,0 +1,176 @@
+#version 330
+
+layout(location = 0) out uint feedback;
+
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
+
+in vec3 worldCoords;
+in vec2 faceCoords;
+in vec3 normal;
+flat in uint permMXidx;
+
+/* virtual (tiled) cubemap, see VirtualCubeMap.h */
+uniform int vtFaceResolution;
+uniform int vtTileSize;
+uniform int vtNumLevels;
+uniform float vtLodBias;
+
+/* Selects the cube face a direction points to (0..5 = negx, posx, negy, posy, negz, posz
+ * like the face files) and computes the face coordinates in [0,1]^2 the way GL does for cubemaps.
+ */
+int cubeFace(vec3 dir, out vec2 st) {
+	vec3 a = abs(dir);
+	int face;
+	float ma;
+	vec2 sc;
+	if(a.x >= a.y && a.x >= a.z){
+		ma = a.x;
+		face = dir.x < 0 ? 0 : 1;
+		sc = dir.x < 0 ? vec2(dir.z, -dir.y) : vec2(-dir.z, -dir.y);
+	} else if(a.y >= a.z){
+		ma = a.y;
+		face = dir.y < 0 ? 2 : 3;
+		sc = dir.y < 0 ? vec2(dir.x, -dir.z) : vec2(dir.x, dir.z);
+	} else {
+		ma = a.z;
+		face = dir.z < 0 ? 4 : 5;
+		sc = dir.z < 0 ? vec2(-dir.x, -dir.y) : vec2(dir.x, -dir.y);
+	}
+	st = 0.5*(sc/ma + 1);
+	return face;
+}
+
+/* Mip level of the virtual cubemap from the angular footprint of the pixel
+ * (a texel in the middle of a face covers about 2/faceResolution radians).
+ */
+int virtualLevel(vec3 dir) {
+	float footprint = max(length(dFdx(dir)), length(dFdy(dir))) / length(dir);
+	float level = log2(max(footprint*vtFaceResolution*0.5, 1e-6)) + vtLodBias;
+	return clamp(int(floor(level)), 0, vtNumLevels-1);
+}
+
+/* resolution of the faces at a mip level of the virtual cubemap */
+int virtualResolution(int level) {
+	return max(vtFaceResolution >> level, 1);
+}
+
+/* tile of the virtual cubemap containing the face coordinates at a mip level */
+ivec2 virtualTile(vec2 st, int level) {
+	int res = virtualResolution(level);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	return clamp(ivec2(st*res) / vtTileSize, ivec2(0), ivec2(tiles-1));
+}
+
+/* packed id of the tile sampled in the specified direction (see packTileKey in VirtualCubeMap.h) */
+uint virtualTileKey(vec3 dir) {
+	vec2 st;
+	int face = cubeFace(dir, st);
+	int level = virtualLevel(dir);
+	ivec2 tile = virtualTile(st, level);
+	return 0x80000000u | (uint(level) << 27) | (uint(face) << 24) | (uint(tile.y) << 12) | uint(tile.x);
+}
+
+/* angle constant for tangent warp function */
+const float theta = 0.8687;
+
+/* Permutation matrices for transforming a 2D cube face vertex to its actual 3D position of the cube.
+ * Each matrix transforms to another face of the cube. 
+ */
+const mat3 permMatrices[6] = mat3[6](
+				mat3( 1,0,0,   0,1,0,    0,  0, .5 ), // front
+				mat3(-1,0,0,   0,1,0,    0,  0,-.5 ), // back
+				mat3( 0,0,-1,  0,1,0,   .5,  0,  0 ), // left
+				mat3( 0,0,1,   0,1,0,  -.5,  0,  0 ), // right
+				mat3( 1,0,0,   0,0,-1,   0, .5,  0 ), // top
+				mat3( 1,0,0,   0,0,1,    0,-.5,  0 )  // bottom
+				);
+
+
+/* Truncates the components of the vec to their integer values. */
+vec2 truncateVec(vec2 v) {
+	return vec2(int(v.x), int(v.y));
+}
+
+/* polynomial of COBE warp */
+float cobe(float a, float b){
+	float lambda  =  1.3774;
+	float gamma01 = -0.2129;
+	float gamma10 = -0.1178;
+	float gamma20 =  0.0694;
+	float gamma02 =  0.0108;
+	float gamma11 =  0.0941;
+	
+	float a2 = a*a;
+	float b2 = b*b;
+	
+	// begin calculation
+	float sum = 0;
+	sum += lambda*a;
+	sum += (1-lambda)*a2*a;
+	float f = (1-a2)*a;
+	sum += f*gamma01*b2;
+	sum += f*gamma10*a2;
+	sum += f*gamma11*a2*b2;
+	sum += f*gamma02*b2*b2;
+	sum += f*gamma20*a2*a2;
+	return sum;
+}
+
+/* warps 2D vector ( in [-1,1]^2 ) according to selected function */
+vec2 warp(vec2 pos){
+	switch(warpFN){
+		case 1:{ // tangent warp function
+			float divByTheta = 1/theta;
+			float tanTheata = tan(theta);
+			float u = divByTheta*atan(pos.x*tanTheata);
+			float v = divByTheta*atan(pos.y*tanTheata);
+			return vec2(u,v);
+		}
+		case 2:{ // COBE warp function (from Cosmic Background Explorer)
+			float u = cobe(pos.x,pos.y);
+			float v = cobe(pos.y,pos.x);
+			return vec2(u,v);
+		}
+		case 0:  // fall through
+		default: // identity warp function
+			return pos;
+	}
+}
+
+/* Fragment shader for the feedback pass of a textured cube or sphere.
+ * Computes the cubemap texture coordinates like cube.frag.glsl and writes the
+ * id of the virtual cubemap tile (and mip level) sampled at this fragment.
+ */
+void main() {
+	vec2 uv = 0.5*warp(2*faceCoords);
+	vec3 texCoords = permMatrices[permMXidx]*vec3(uv,1);
+	feedback = virtualTileKey(texCoords);
+}
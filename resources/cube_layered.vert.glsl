@@ -0,0 +1,138 @@
+#version 330
+// LAYER_FROM_VS is defined by the plugin for the vertex shader layer backend (see LayeredRenderer.h)
+#ifdef LAYER_FROM_VS
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
+
+uniform int view;            // view rendered by this pass (multi pass backend)
+uniform int maxSubDivisions; // cells per side of a quad the draw call was sized for
+
+flat out uint permMXidx;
+flat out int viewCamera; // camera the view belongs to (0 for the reflection faces)
+out vec3 worldCoords;
+out vec2 faceCoords;
+out vec3 normal;
+
+// see depth.frag.glsl
+invariant gl_Position;
+
+/* view matrices for pointing the camera to each of a cube's faces (from the center of the cube)
+ */
+const mat4 boxViewMX[6] = mat4[6](
+			mat4(vec4( 0, 0,-1,0),vec4(0, 1, 0,0),vec4( 1, 0, 0,0),vec4(0,0,0,1)), // y+90 (POSX)
+			mat4(vec4( 0, 0, 1,0),vec4(0, 1, 0,0),vec4(-1, 0, 0,0),vec4(0,0,0,1)), // y-90 (NEGX)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 0,-1,0),vec4( 0,-1, 0,0),vec4(0,0,0,1)), // x-90 (POSY)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 0, 1,0),vec4( 0, 1, 0,0),vec4(0,0,0,1)), // x+90 (NEGY)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0,-1,0),vec4(0,0,0,1)), // y180 (POSZ)
+			mat4(vec4( 1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0, 1,0),vec4(0,0,0,1))  // 0    (NEGZ)
+			);
+
+/* Permutation matrices for transforming a 2D cube face vertex to its actual 3D position of the cube.
+ * Each matrix transforms to another face of the cube.
+ */
+const mat3 permMatrices[6] = mat3[6](
+			mat3( 1,0,0,   0,1,0,    0,  0, .5 ), // front
+			mat3(-1,0,0,   0,1,0,    0,  0,-.5 ), // back
+			mat3( 0,0,-1,  0,1,0,   .5,  0,  0 ), // left
+			mat3( 0,0,1,   0,1,0,  -.5,  0,  0 ), // right
+			mat3( 1,0,0,   0,0,-1,   0, .5,  0 ), // top
+			mat3( 1,0,0,   0,0,1,    0,-.5,  0 )  // bottom
+			);
+
+/* corners of the two triangles of a cell, same winding as the strips of cube.geom.glsl */
+const vec2 cellCorners[6] = vec2[6](
+			vec2(0,0), vec2(1,0), vec2(0,1),
+			vec2(0,1), vec2(1,0), vec2(1,1)
+			);
+
+/* Vertex shader for rendering a cube or sphere in the scene without geometry shader.
+ * It generates the same refined quads as cube.geom.glsl from gl_VertexID (no vertex
+ * attributes are read): a draw of 24*6*maxSubDivisions^2 vertices covers the 4 quads of
+ * each of the 6 faces with maxSubDivisions^2 cells of 2 triangles each. Cells beyond the
+ * subdivision level of the view and views the object was culled from are collapsed to
+ * a point, so they produce no fragments.
+ * The view is the instance (one instanced draw writes all 7 layers through gl_Layer) or
+ * set per pass by the multi pass backend.
+ */
+void main() {
+#ifdef LAYER_FROM_VS
+	int v = gl_InstanceID;
+	gl_Layer = v;
+	// the reflection layers are rendered at the resolution of the reflection cubemap, the cameras at their tile size
+	gl_ViewportIndex = v;
+#else
+	int v = view;
+#endif
+	int verticesPerQuad = 6*maxSubDivisions*maxSubDivisions;
+	int quad = gl_VertexID/verticesPerQuad;
+	int cell = (gl_VertexID%verticesPerQuad)/6;
+	int level = subDivisionLevels[v/4][v%4];
+	permMXidx = uint(quad/4);
+	viewCamera = v > 6 ? v - 6 : 0;
+	if((viewMask & (1 << v)) == 0 || cell >= level*level){
+		worldCoords = vec3(0);
+		faceCoords = vec2(0);
+		normal = vec3(0,0,1);
+		gl_Position = vec4(0,0,0,1);
+		return;
+	}
+	// the 4 quads of a face start at the corners of vaCube
+	int sub = quad%4;
+	vec2 origin = vec2(-.5 + .5*float(sub & 1), -.5 + .5*float(sub >> 1));
+	float subQuadSize = totalQuadSize/float(level);
+	vec2 facePos = origin + subQuadSize*(vec2(cell/level, cell%level) + cellCorners[gl_VertexID%6]);
+
+	mat3 permMX = permMatrices[quad/4];
+	mat4 vpMX;
+	if(v == 0){
+		// camera transform and screen view frustum projection
+		vpMX = projMX*viewMX;
+	} else if(v > 6){
+		// additional camera
+		vpMX = cameraViewProjMX[v-7];
+	} else {
+		// cubemap transform 90° view frustum projection onto cube face
+		vpMX = boxProjMX*boxViewMX[v-1]*boxTransMX;
+	}
+	// transform to 3D cube position
+	vec3 pos = permMX*vec3(facePos,1);
+	faceCoords = facePos;
+	if(doSphereProjection){
+		normal = normalize(pos);
+		worldCoords = (modelMX * vec4(normal*0.69,1)).xyz;
+	} else {
+		normal = permMX*vec3(0,0,1);
+		worldCoords = (modelMX * vec4(pos,1)).xyz;
+	}
+	gl_Position = vpMX * vec4(worldCoords,1);
+}
@@ -0,0 +1,132 @@
+#version 430
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform samplerCube src;  // cubemap whose level 0 is downsampled (linear filtering)
+uniform int resolution;   // of level 0, power of two >= 64
+uniform int numLevels;    // levels of the cubemap
+uniform uint numGroups;   // work groups of the dispatch
+
+// levels 1-6, written by every work group for its tile
+layout(binding = 0) writeonly uniform imageCube dst1;
+layout(binding = 1) writeonly uniform imageCube dst2;
+layout(binding = 2) writeonly uniform imageCube dst3;
+layout(binding = 3) writeonly uniform imageCube dst4;
+layout(binding = 4) writeonly uniform imageCube dst5;
+layout(binding = 5) writeonly uniform imageCube dst6;
+
+// level 6 and the levels below it (6 faces each, row by row), the levels from 7 on
+// are copied into the cubemap from here after the dispatch
+layout(std430, binding = 0) coherent buffer Tail {
+	uint finishedGroups;
+	uint pad[3];
+	vec4 tailTexels[];
+};
+
+shared vec4 tile[16][16];
+shared bool lastGroup;
+
+/* direction of the face coordinates (s,t) in [0,1]^2, faces in GL order (+x,-x,+y,-y,+z,-z) */
+vec3 faceDirection(int face, vec2 st) {
+	vec2 c = 2.0*st - 1.0;
+	switch(face){
+		case 0: return vec3( 1.0, -c.y, -c.x);
+		case 1: return vec3(-1.0, -c.y,  c.x);
+		case 2: return vec3( c.x,  1.0,  c.y);
+		case 3: return vec3( c.x, -1.0, -c.y);
+		case 4: return vec3( c.x, -c.y,  1.0);
+		default: return vec3(-c.x, -c.y, -1.0);
+	}
+}
+
+void storeLevel(int level, ivec3 p, vec4 c) {
+	switch(level){
+		case 3: imageStore(dst3, p, c); break;
+		case 4: imageStore(dst4, p, c); break;
+		case 5: imageStore(dst5, p, c); break;
+		default: imageStore(dst6, p, c); break;
+	}
+}
+
+/* Single pass downsampler for the mip chain of a cubemap (2x2 box filter).
+ * Each work group reduces a 64x64 tile of a face to levels 1-6 in shared memory.
+ * A level 1 texel is a single bilinear fetch at the corner of its 4 level 0 texels,
+ * which never crosses a face edge. The last work group to finish (counted with an
+ * atomic) reduces the level 6 texels of all tiles to the remaining levels.
+ */
+void main() {
+	int tilesPerSide = resolution/64;
+	int face = int(gl_WorkGroupID.x)/(tilesPerSide*tilesPerSide);
+	int tileIndex = int(gl_WorkGroupID.x)%(tilesPerSide*tilesPerSide);
+	ivec2 tileXY = ivec2(tileIndex%tilesPerSide, tileIndex/tilesPerSide);
+	ivec2 t = ivec2(gl_LocalInvocationID.xy);
+
+	// level 1 (2x2 texels per invocation) and 2 (1 texel per invocation)
+	float res1 = float(resolution/2);
+	vec4 sum = vec4(0.0);
+	for(int j = 0; j < 2; j++){
+		for(int i = 0; i < 2; i++){
+			ivec2 p1 = tileXY*32 + t*2 + ivec2(i, j);
+			vec4 c = textureLod(src, faceDirection(face, (vec2(p1) + 0.5)/res1), 0.0);
+			imageStore(dst1, ivec3(p1, face), c);
+			sum += c;
+		}
+	}
+	vec4 c = 0.25*sum;
+	imageStore(dst2, ivec3(tileXY*16 + t, face), c);
+	tile[t.y][t.x] = c;
+
+	// levels 3-6 from shared memory
+	int size = 8;
+	for(int level = 3; level <= 6; level++){
+		barrier();
+		bool active = t.x < size && t.y < size;
+		if(active){
+			c = 0.25*(tile[2*t.y][2*t.x] + tile[2*t.y][2*t.x+1] + tile[2*t.y+1][2*t.x] + tile[2*t.y+1][2*t.x+1]);
+			storeLevel(level, ivec3(tileXY*size + t, face), c);
+		}
+		barrier();
+		if(active){
+			tile[t.y][t.x] = c;
+		}
+		size /= 2;
+	}
+	if(numLevels <= 7){
+		return;
+	}
+
+	// level 6 texel of the tile for the last group
+	int side = tilesPerSide;
+	if(t == ivec2(0)){
+		tailTexels[face*side*side + tileXY.y*side + tileXY.x] = c;
+		memoryBarrierBuffer();
+		lastGroup = atomicAdd(finishedGroups, 1u) == numGroups - 1u;
+	}
+	barrier();
+	if(!lastGroup){
+		return;
+	}
+	memoryBarrierBuffer();
+	int srcOffset = 0;
+	int dstOffset = 6*side*side;
+	int index = t.y*16 + t.x;
+	for(int level = 7; level < numLevels; level++){
+		int halfSide = side/2;
+		for(int k = index; k < 6*halfSide*halfSide; k += 256){
+			int f = k/(halfSide*halfSide);
+			int x = k%halfSide;
+			int y = (k/halfSide)%halfSide;
+			int s = srcOffset + f*side*side + 2*y*side + 2*x;
+			tailTexels[dstOffset + k] = 0.25*(tailTexels[s] + tailTexels[s+1] + tailTexels[s+side] + tailTexels[s+side+1]);
+		}
+		memoryBarrierBuffer();
+		barrier();
+		srcOffset = dstOffset;
+		dstOffset += 6*halfSide*halfSide;
+		side = halfSide;
+	}
+	// ready for the next dispatch
+	if(index == 0){
+		finishedGroups = 0u;
+	}
+}
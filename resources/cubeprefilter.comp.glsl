@@ -0,0 +1,52 @@
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform samplerCube src; // the cubemap, level-1 is read (seamless linear filtering)
+uniform int level;       // level that is written
+uniform int size;        // width and height of its faces
+uniform float spread;    // distance of the taps in texels of the previous level
+
+layout(binding = 0) writeonly uniform imageCube dst;
+
+/* direction of the face coordinates (s,t) in [0,1]^2, faces in GL order (+x,-x,+y,-y,+z,-z) */
+vec3 faceDirection(int face, vec2 st) {
+	vec2 c = 2.0*st - 1.0;
+	switch(face){
+		case 0: return vec3( 1.0, -c.y, -c.x);
+		case 1: return vec3(-1.0, -c.y,  c.x);
+		case 2: return vec3( c.x,  1.0,  c.y);
+		case 3: return vec3( c.x, -1.0, -c.y);
+		case 4: return vec3( c.x, -c.y,  1.0);
+		default: return vec3(-c.x, -c.y, -1.0);
+	}
+}
+
+/* Cheap glossy prefilter, builds level 'level' from the previous (already filtered) level.
+ * The 3x3 taps around the direction of a texel are spread in the tangent plane of the
+ * direction, so taps near an edge are taken from the neighbouring face, and weighted
+ * 1-2-1. Every level widens the blur of the previous one, which approximates the growing
+ * lobe of rougher surfaces.
+ */
+void main() {
+	ivec3 p = ivec3(gl_GlobalInvocationID);
+	if(p.x >= size || p.y >= size){
+		return;
+	}
+	vec3 d = faceDirection(p.z, (vec2(p.xy) + 0.5)/float(size));
+	float len = length(d);
+	d /= len;
+	vec3 up = abs(d.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 tx = normalize(cross(up, d));
+	vec3 ty = cross(d, tx);
+	// a texel of the previous level covers 1/size of the face (face coordinates span 2)
+	float tapDistance = spread/(float(size)*len);
+	vec4 sum = vec4(0.0);
+	for(int j = -1; j <= 1; j++){
+		for(int i = -1; i <= 1; i++){
+			float w = float((2 - abs(i))*(2 - abs(j)));
+			sum += w*textureLod(src, d + tapDistance*(float(i)*tx + float(j)*ty), float(level - 1));
+		}
+	}
+	imageStore(dst, p, sum/16.0);
+}
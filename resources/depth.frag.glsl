@@ -0,0 +1,11 @@
+#version 330
+
+/* Fragment shader of the depth prepass.
+ * The objects are drawn with the vertex stages of their regular programs and the color
+ * writes masked, so only their depth is written and the shading pass that follows runs
+ * the fragment shader once per pixel. The depth prepass computes the positions with
+ * another program than the shading pass, so the vertex stages declare gl_Position
+ * invariant to get exactly the same depth in both.
+ */
+void main() {
+}
@@ -3,6 +3,7 @@
 layout(location = 0) out vec4 frag_color;
 
 uniform sampler2DArray tex;
+uniform vec2 faceScale; // part of the layers the faces were rendered to
 in vec2 texCoords;
 flat in uint texLayer;
 
@@ -12,6 +13,6 @@ flat in uint texLayer;
  */
 void main() {
 	// need to transfer image upside down because y-axis is flipped in FBO (compared to texture)
-	frag_color = texture(tex, vec3(1-texCoords,texLayer));
+	frag_color = texture(tex, vec3((1-texCoords)*faceScale,texLayer));
 }
 
@@ -0,0 +1,30 @@
+#version 330
+// LAYER_FROM_VS is defined by the plugin for the vertex shader layer backend (see LayeredRenderer.h)
+#ifdef LAYER_FROM_VS
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+layout(location = 0) in vec2  in_position;
+
+uniform mat4 projMX;
+uniform int face; // cubemap face written by this pass (multi pass backend)
+
+out vec2 texCoords;
+flat out uint texLayer;
+
+/* vertex shader for drawing a quad which is used to transfer the
+ * contents of a 2D texture array to a cubemap FBO without geometry shader.
+ * The face is the instance (written to gl_Layer) or set per pass by the
+ * multi pass backend, the layers to be transferred start at the second layer.
+ */
+void main() {
+#ifdef LAYER_FROM_VS
+	int f = gl_InstanceID;
+	gl_Layer = f;
+#else
+	int f = face;
+#endif
+	gl_Position = projMX * vec4(in_position,0,1);
+	texCoords = in_position;
+	texLayer = uint(f+1); // starting at second layer of tex array
+}
@@ -0,0 +1,109 @@
+#version 330
+// LAYER_FROM_VS is defined by the plugin if the meshes are drawn instanced (see LayeredRenderer::meshShaderDefines)
+#ifdef LAYER_FROM_VS
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
+
+uniform int view;          // view rendered by this pass (multi pass backend or meshes drawn per view)
+uniform vec3 meshCenter;   // bounds of the quantized positions (see MeshImport.h)
+uniform vec3 meshExtent;
+uniform vec2 meshUVOffset; // range of the quantized texture coordinates
+uniform vec2 meshUVScale;
+
+layout(location = 0) in vec3 in_position; // snorm16 relative to the bounds
+layout(location = 1) in vec4 in_normal;   // snorm 10_10_10_2
+layout(location = 2) in vec2 in_texCoord; // unorm16 relative to the texture coordinate range
+
+flat out uint permMXidx;
+flat out int viewCamera; // camera the view belongs to (0 for the reflection faces)
+out vec3 worldCoords;
+out vec2 faceCoords;
+out vec3 normal;
+
+// see depth.frag.glsl
+invariant gl_Position;
+
+/* view matrices for pointing the camera to each of a cube's faces (from the center of the cube)
+ */
+const mat4 boxViewMX[6] = mat4[6](
+			mat4(vec4( 0, 0,-1,0),vec4(0, 1, 0,0),vec4( 1, 0, 0,0),vec4(0,0,0,1)), // y+90 (POSX)
+			mat4(vec4( 0, 0, 1,0),vec4(0, 1, 0,0),vec4(-1, 0, 0,0),vec4(0,0,0,1)), // y-90 (NEGX)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 0,-1,0),vec4( 0,-1, 0,0),vec4(0,0,0,1)), // x-90 (POSY)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 0, 1,0),vec4( 0, 1, 0,0),vec4(0,0,0,1)), // x+90 (NEGY)
+			mat4(vec4(-1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0,-1,0),vec4(0,0,0,1)), // y180 (POSZ)
+			mat4(vec4( 1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0, 1,0),vec4(0,0,0,1))  // 0    (NEGZ)
+			);
+
+/* Vertex shader for rendering an imported triangle mesh (MeshLibrary) into the views.
+ * The vertices are quantized: positions and texture coordinates are relative to ranges
+ * passed as uniforms, the normal is packed into 10 bits per component. The mesh is
+ * shaded like the front face of a cube (the texture coordinates address that face of
+ * the cubemap texture). Views the object was culled from are collapsed to a point.
+ * The view is the instance (one instanced draw writes all layers through gl_Layer) or
+ * set per pass, by the multi pass backend or if the layer extension is missing.
+ */
+void main() {
+#ifdef LAYER_FROM_VS
+	int v = gl_InstanceID;
+	gl_Layer = v;
+	// the reflection layers are rendered at the resolution of the reflection cubemap, the cameras at their tile size
+	gl_ViewportIndex = v;
+#else
+	int v = view;
+#endif
+	permMXidx = 0u;
+	viewCamera = v > 6 ? v - 6 : 0;
+	if((viewMask & (1 << v)) == 0){
+		worldCoords = vec3(0);
+		faceCoords = vec2(0);
+		normal = vec3(0,0,1);
+		gl_Position = vec4(0,0,0,1);
+		return;
+	}
+	mat4 vpMX;
+	if(v == 0){
+		// camera transform and screen view frustum projection
+		vpMX = projMX*viewMX;
+	} else if(v > 6){
+		// additional camera
+		vpMX = cameraViewProjMX[v-7];
+	} else {
+		// cubemap transform 90° view frustum projection onto cube face
+		vpMX = boxProjMX*boxViewMX[v-1]*boxTransMX;
+	}
+	vec3 pos = meshCenter + meshExtent*in_position;
+	faceCoords = meshUVOffset + meshUVScale*in_texCoord - vec2(.5);
+	normal = normalize(mat3(modelMX)*in_normal.xyz);
+	worldCoords = (modelMX * vec4(pos,1)).xyz;
+	gl_Position = vpMX * vec4(worldCoords,1);
+}
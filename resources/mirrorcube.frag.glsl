@@ -1,24 +1,54 @@
 #version 330
+// the level the hardware selects for the reflection, estimated from the derivatives without it
+#extension GL_ARB_texture_query_lod : enable
 
 #define M_PI 3.1415
 
 layout(location = 0) out vec4 frag_color;
 layout(location = 1) out vec4 picking_color;
 
-uniform mat4 invViewMX;
-uniform bool useTexture;
+#ifdef COUNT_OVERDRAW
+// counts the fragments shaded per layer (inserted by the plugin, see OverdrawCounter::shaderDefines)
+OVERDRAW_DECLARATIONS
+#endif
+
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
+
 uniform samplerCube tex;
-uniform vec3 pickColor;
-uniform vec3 lightDir;
-uniform float k_exp;
-uniform vec3 cubeCenterWorldCoords;
-uniform float parallaxCorrectionFactor;
-uniform int warpFN;
 
 in vec3 worldCoords;
 in vec2 faceCoords;
 in vec3 normal;
 flat in uint permMXidx;
+flat in int viewCamera;
 
 /* lighting constants */
 const float k_amb  = 0.6;
@@ -117,8 +147,11 @@ vec3 blinnPhong(vec3 n, vec3 l, vec3 v) {
  * around the object.
  */
 void main() {
+#ifdef COUNT_OVERDRAW
+	COUNT_FRAGMENT();
+#endif
 	// next up: calculate lighting
-	vec4 camPos = invViewMX * vec4(0, 0, 0, 1);
+	vec4 camPos = cameraPos[viewCamera];
 	vec3 observerDir = normalize(camPos.xyz - worldCoords);
 	vec3 phong = blinnPhong(normalize(normal), -lightDir, observerDir);
 
@@ -130,8 +163,18 @@ void main() {
 		// correct reflection vector to account for parallax
 		vec3 center2surfpoint = worldCoords - cubeCenterWorldCoords;
 		R = R + parallaxCorrectionFactor*center2surfpoint;
-		// sample texture in direction of corrected reflection vector
-		vec4 texColor = texture(tex, R);
+		// sample texture in direction of corrected reflection vector, rough surfaces
+		// sample a coarser (prefiltered) level, distant ones are minified as usual
+#ifdef GL_ARB_texture_query_lod
+		float minifiedLod = textureQueryLod(tex, R).y;
+#else
+		// texels of the face R points to per pixel
+		float major = max(abs(R.x), max(abs(R.y), abs(R.z)));
+		float texels = 0.5*float(textureSize(tex, 0).x)*max(length(dFdx(R)), length(dFdy(R)))/major;
+		float minifiedLod = log2(max(texels, 1e-6));
+#endif
+		float lod = max(roughness*reflectionMaxLod, minifiedLod);
+		vec4 texColor = textureLod(tex, R, lod);
 		color = texColor.rgb;
 	} else {
 		// warp face coordinates before using them
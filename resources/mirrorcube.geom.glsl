@@ -1,28 +1,63 @@
 #version 330
+#extension GL_ARB_gpu_shader5 : require
+#extension GL_ARB_viewport_array : enable
 
-layout(points) in;
-/* we have a total of 14 (including gl_position and gl_Layer) components per vertex
+// cameras of the split screen layout (set by the plugin)
+#ifndef NUM_CAMERAS
+#define NUM_CAMERAS 1
+#endif
+
+layout(points, invocations = NUM_CAMERAS) in;
+/* we have a total of 16 (including gl_position, gl_Layer and gl_ViewportIndex) components per vertex
  * this means that the minimum number of vertices that can be generated
- * is 73 (with respect to the specification).
+ * is 64 (with respect to the specification).
  * GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS is at least 1024
- * from which follows: max_vertices = 1024/14 = 73.1
+ * from which follows: max_vertices = 1024/16 = 64
  * of course it may be larger when the hardware has a higher limit
  * on GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS
+ * (the value below is replaced when the shader is loaded)
  */
 layout(triangle_strip,max_vertices=73) out;
 
-uniform mat4 modelMX;
-uniform mat4 viewMX;
-uniform mat4 projMX;
-uniform bool doSphereProjection;
-uniform int subDivisionLevel;
-uniform float totalQuadSize;
+/* per frame data, written by the CPU into the frame data ring (FrameUniforms in CubeMapping.h) */
+layout(std140) uniform FrameData {
+	mat4 projMX;
+	mat4 viewMX;
+	mat4 invViewMX;
+	mat4 boxProjMX;
+	mat4 boxTransMX;
+	vec3 lightDir;
+	float k_exp;
+	float totalQuadSize;
+	float parallaxCorrectionFactor;
+	float reflectionMaxLod; // last mip level of the reflection cubemap
+	mat4 cameraViewProjMX[3]; // view projection of the cameras 1-3 (views 7-9), camera 0 is projMX*viewMX
+	vec4 cameraPos[4];        // world position of each camera
+};
+
+/* per object data (ObjectUniforms in CubeMapping.h) */
+layout(std140) uniform ObjectData {
+	mat4 modelMX;
+	vec3 pickColor;
+	float roughness; // selects the mip level of the reflection (0 = mirror)
+	vec3 cubeCenterWorldCoords;
+	bool useTexture;
+	bool doSphereProjection;
+	int warpFN;
+	int viewMask; // views (invocations) the object is visible in, determined by frustum culling
+	int textureLayer; // layer of the texture in the cubemap atlas
+	ivec4 subDivisionLevels[3]; // subdivision level of each view (level of detail), view i is [i/4][i%4]
+};
 
 flat out uint permMXidx;
+flat out int viewCamera; // camera the view belongs to
 out vec3 worldCoords;
 out vec2 faceCoords;
 out vec3 normal;
 
+// see depth.frag.glsl
+invariant gl_Position;
+
 
 in uint permMXidx_[];
 
@@ -39,6 +74,7 @@ const mat3 permMatrices[6] = mat3[6](
 			);
 			
 mat3 permMX;
+int view; // layer of the camera (0 or 7 and up)
 
 /* Creates a vertex ready to be emmited from the specified 2D position, 
  * the specified viewprojection matrix and the currently set permutation matrix.
@@ -55,13 +91,17 @@ void makeVertex(vec2 facePos, mat4 vpMX) {
 		worldCoords = (modelMX * vec4(pos,1)).xyz;
 	}
 	gl_Position = vpMX * vec4(worldCoords,1);
-	gl_Layer = 0;
+	gl_Layer = view;
+#ifdef GL_ARB_viewport_array
+	gl_ViewportIndex = view;
+#endif
 	permMXidx = permMXidx_[0];
+	viewCamera = gl_InvocationID;
 }
 
 /* Geometry shader for rendering a cube or sphere in the scene.
- * This is similar to cube.geom.glsl but without instancing
- * since there is no need for a layered rendering.
+ * This is similar to cube.geom.glsl but only instanced for the cameras
+ * (the reflecting object is not visible in its own reflection).
  * This shader is intended for drawing the reflecting object.
  * 
  * Also this GS introduces new vertices to refine the geometry of the
@@ -70,16 +110,22 @@ void makeVertex(vec2 facePos, mat4 vpMX) {
  * determines the width and height of the quad originating from that point.
  * The quad spanned by this parameters will be covered with columns of
  * triangle strips to equally sample the area.
- * The uniform subDivisionLevel determines how many triangle strip columns
+ * The camera views' entries of subDivisionLevels determine how many triangle strip columns
  * are created and how many "small" quads a trianglestrip contains.
  */
 void main() {
+	view = gl_InvocationID == 0 ? 0 : 6 + gl_InvocationID;
+	// nothing to do for cameras the object was culled from
+	if((viewMask & (1 << view)) == 0){
+		return;
+	}
 	// set the permutation matrix corresponding to the current input's permutation matrix index
 	permMX = permMatrices[permMXidx_[0]];
 
-	mat4 vpMX = projMX*viewMX;
+	mat4 vpMX = gl_InvocationID == 0 ? projMX*viewMX : cameraViewProjMX[gl_InvocationID-1];
 
-	// create the triangle strip
+	// create the triangle strip (with the level of detail of the camera view)
+	int subDivisionLevel = subDivisionLevels[view/4][view%4];
 	float subQuadSize = totalQuadSize/subDivisionLevel;
 	for(int ix = 0; ix < subDivisionLevel; ix++){
 		// define the coords of the first quad
@@ -0,0 +1,64 @@
+#version 430
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2DArray pickTex; // picking attachment, layer 0 is the camera view
+uniform ivec4 region;           // pixel rectangle (x0, y0, x1, y1), x1 and y1 exclusive
+uniform int numLassoPoints;     // 0 = select the whole rectangle
+uniform uint maxIds;            // capacity of the id list
+
+layout(std430, binding = 0) buffer SelectionBits {
+	uint bits[];
+};
+layout(std430, binding = 1) buffer SelectionList {
+	uint count;
+	uint ids[];
+};
+layout(std430, binding = 2) readonly buffer Lasso {
+	vec2 lassoPoints[];
+};
+
+/* even-odd rule point in polygon test */
+bool insideLasso(vec2 p) {
+	bool inside = false;
+	vec2 a = lassoPoints[numLassoPoints-1];
+	for(int i = 0; i < numLassoPoints; i++){
+		vec2 b = lassoPoints[i];
+		if((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y)*(b.x - a.x)/(b.y - a.y)){
+			inside = !inside;
+		}
+		a = b;
+	}
+	return inside;
+}
+
+/* Reduces the object ids of the pixels in a region to a list of unique ids.
+ * Every id found sets its bit in the bitset, the invocation that sets the bit
+ * appends the id to the list. The color decoding is the inverse of pickIdToColor.
+ */
+void main() {
+	ivec2 pixel = region.xy + ivec2(gl_GlobalInvocationID.xy);
+	if(any(greaterThanEqual(pixel, region.zw))){
+		return;
+	}
+	if(numLassoPoints >= 3 && !insideLasso(vec2(pixel) + 0.5)){
+		return;
+	}
+	uvec3 c = uvec3(texelFetch(pickTex, ivec3(pixel, 0), 0).rgb*255.0 + 0.5);
+	uint id = ((c.r << 16) | (c.g << 8) | c.b)/111u;
+	if(id == 0u){
+		return;
+	}
+	uint word = id >> 5;
+	uint mask = 1u << (id & 31u);
+	// most pixels belong to an object that was found already, skip the atomic for them
+	if((bits[word] & mask) != 0u){
+		return;
+	}
+	if((atomicOr(bits[word], mask) & mask) == 0u){
+		uint slot = atomicAdd(count, 1u);
+		if(slot < maxIds){
+			ids[slot] = id;
+		}
+	}
+}
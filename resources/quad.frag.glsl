@@ -4,19 +4,55 @@ layout(location = 0) out vec4 frag_color;
 
 uniform int useTexture;
 uniform sampler2DArray tex;
+uniform vec2 texScale;    // part of the layers the camera was rendered to
+uniform int layer;        // layer of the camera
+uniform float exposure;   // exposure multiplier (2^stops)
+uniform int toneMapping;  // 0 = none, 1 = Reinhard, 2 = ACES
+uniform bool linearInput; // texture contains linear (HDR) values which need gamma encoding
 
 in vec2 texCoords;
 
+/* ACES filmic curve fit (Narkowicz 2015) */
+vec3 acesFilm(vec3 x) {
+	const float a = 2.51;
+	const float b = 0.03;
+	const float c = 2.43;
+	const float d = 0.59;
+	const float e = 0.14;
+	return clamp((x*(a*x+b))/(x*(c*x+d)+e), 0.0, 1.0);
+}
+
+/* applies exposure and the selected tone mapping operator */
+vec3 toneMap(vec3 color) {
+	color *= exposure;
+	switch(toneMapping){
+		case 1: // Reinhard
+			return color/(1+color);
+		case 2: // ACES
+			return acesFilm(color);
+		case 0:  // fall through
+		default: // none (clamp)
+			return clamp(color, 0.0, 1.0);
+	}
+}
+
 /* Quad fragment shader for drawing window filling quad that
  * displays rendered testure from FBO.
  * The texture is a texture array with the first layer containing
  * the image rendered from the camera, other 6 layers contain the
- * images rendered from each of the cubefaces of the reflecting object.
+ * images rendered from each of the cubefaces of the reflecting object,
+ * the layers after them the images of the additional cameras (each
+ * camera's quad covers its tile of the split screen layout).
+ * Exposure and tone mapping are applied here, and linear values
+ * are gamma encoded for display.
  */
 void main() {
 	if(useTexture != 0){
-		vec4 texColor = texture(tex, vec3(texCoords,0));
-		frag_color = texColor;
+		vec3 color = toneMap(texture(tex, vec3(texCoords*texScale,layer)).rgb);
+		if(linearInput){
+			color = pow(color, vec3(1.0/2.2));
+		}
+		frag_color = vec4(color,1);
 	} else {
 		frag_color = vec4(texCoords,0,1);
 	}
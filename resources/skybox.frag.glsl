@@ -2,12 +2,96 @@
 
 layout(location = 0) out vec4 frag_color;
 
+#ifdef COUNT_OVERDRAW
+// counts the fragments shaded per layer (inserted by the plugin, see OverdrawCounter::shaderDefines)
+OVERDRAW_DECLARATIONS
+#endif
+
 uniform bool useTexture;
 uniform samplerCube tex;
 
 in vec2 faceCoords;
 in vec3 texCoords;
 
+/* virtual (tiled) cubemap, see VirtualCubeMap.h */
+uniform int vtFaceResolution;
+uniform int vtTileSize;
+uniform int vtNumLevels;
+uniform float vtLodBias;
+
+/* Selects the cube face a direction points to (0..5 = negx, posx, negy, posy, negz, posz
+ * like the face files) and computes the face coordinates in [0,1]^2 the way GL does for cubemaps.
+ */
+int cubeFace(vec3 dir, out vec2 st) {
+	vec3 a = abs(dir);
+	int face;
+	float ma;
+	vec2 sc;
+	if(a.x >= a.y && a.x >= a.z){
+		ma = a.x;
+		face = dir.x < 0 ? 0 : 1;
+		sc = dir.x < 0 ? vec2(dir.z, -dir.y) : vec2(-dir.z, -dir.y);
+	} else if(a.y >= a.z){
+		ma = a.y;
+		face = dir.y < 0 ? 2 : 3;
+		sc = dir.y < 0 ? vec2(dir.x, -dir.z) : vec2(dir.x, dir.z);
+	} else {
+		ma = a.z;
+		face = dir.z < 0 ? 4 : 5;
+		sc = dir.z < 0 ? vec2(-dir.x, -dir.y) : vec2(dir.x, -dir.y);
+	}
+	st = 0.5*(sc/ma + 1);
+	return face;
+}
+
+/* Mip level of the virtual cubemap from the angular footprint of the pixel
+ * (a texel in the middle of a face covers about 2/faceResolution radians).
+ */
+int virtualLevel(vec3 dir) {
+	float footprint = max(length(dFdx(dir)), length(dFdy(dir))) / length(dir);
+	float level = log2(max(footprint*vtFaceResolution*0.5, 1e-6)) + vtLodBias;
+	return clamp(int(floor(level)), 0, vtNumLevels-1);
+}
+
+/* resolution of the faces at a mip level of the virtual cubemap */
+int virtualResolution(int level) {
+	return max(vtFaceResolution >> level, 1);
+}
+
+/* tile of the virtual cubemap containing the face coordinates at a mip level */
+ivec2 virtualTile(vec2 st, int level) {
+	int res = virtualResolution(level);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	return clamp(ivec2(st*res) / vtTileSize, ivec2(0), ivec2(tiles-1));
+}
+
+uniform bool useVirtual;
+uniform sampler2D vtCache;
+uniform usampler2DArray vtIndirection;
+uniform int vtBorder;
+uniform int vtPageSize;
+uniform float vtCacheSize;
+
+/* Samples the virtual cubemap in the specified direction.
+ * The indirection table points to the page of the tile or, while that is
+ * not resident yet, to the page of its closest resident ancestor.
+ */
+vec3 sampleVirtualCube(vec3 dir) {
+	vec2 st;
+	int face = cubeFace(dir, st);
+	int level = virtualLevel(dir);
+	ivec2 tile = virtualTile(st, level);
+	uvec4 entry = texelFetch(vtIndirection, ivec3(tile, level*6 + face), 0);
+	int residentLevel = int(entry.b);
+	int res = virtualResolution(residentLevel);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	ivec2 ancestor = min(tile >> (residentLevel - level), ivec2(tiles-1));
+	// position inside the tile (the border allows bilinear filtering up to the tile edges)
+	vec2 local = clamp(st*res - vec2(ancestor*vtTileSize), vec2(0), vec2(vtTileSize)) + vtBorder;
+	vec2 texel = vec2(entry.rg)*vtPageSize + local;
+	return texture(vtCache, texel / vtCacheSize).rgb;
+}
+
 /* Truncates the components of the vec to their integer values. */
 vec2 truncateVec(vec2 v) {
 		return vec2(int(v.x), int(v.y));
@@ -15,11 +99,16 @@ vec2 truncateVec(vec2 v) {
 
 /* Fragment shader for drawing a cube for a skybox.
  * This either textures the cubefaces using a cubemap texture
- * or a procedural checkerboard pattern.
+ * (regular or virtual) or a procedural checkerboard pattern.
  */
 void main() {
+#ifdef COUNT_OVERDRAW
+	COUNT_FRAGMENT();
+#endif
 	vec3 color = vec3(0,0,0);
-	if(useTexture){
+	if(useVirtual){
+		color = sampleVirtualCube(texCoords);
+	} else if(useTexture){
 		color = texture(tex, texCoords).rgb;
 	} else {
 		vec2 checker = truncateVec(10 * faceCoords);
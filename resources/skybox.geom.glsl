@@ -1,12 +1,19 @@
 #version 330
 #extension GL_ARB_gpu_shader5 : require
+#extension GL_ARB_viewport_array : enable
 
-layout(triangles, invocations = 7) in;
+// camera 0, the 6 reflection faces and the cameras 1 to NUM_VIEWS-7 (set by the plugin)
+#ifndef NUM_VIEWS
+#define NUM_VIEWS 7
+#endif
+
+layout(triangles, invocations = NUM_VIEWS) in;
 layout(triangle_strip,max_vertices=3) out;
 
 uniform mat4 viewMX;
 uniform mat4 projMX;
 uniform mat4 boxProjMX;
+uniform mat4 cameraViewProjMX[3]; // cameras 1-3 (views 7-9), without translation
 
 out vec2 faceCoords;
 out vec3 texCoords;
@@ -29,7 +36,8 @@ const mat4 boxViewMX[6] = mat4[6](
  * This stage performs the view transformation and projection and is instanced
  * 7 times. The first instantiation is for the actual rendering from perspective
  * of the camera. The following 6 instances are for rendering from the perspective
- * of the reflecting object onto each of the 6 cube faces.
+ * of the reflecting object onto each of the 6 cube faces. Further instances
+ * render the additional cameras of a split screen layout.
  * This realizes a layered rendering approach.
  */
 void main() {
@@ -37,6 +45,9 @@ void main() {
 	if(gl_InvocationID == 0){
 		// camera transform and screen view frustum projection
 		vpMX = projMX*viewMX;
+	} else if(gl_InvocationID > 6){
+		// additional camera
+		vpMX = cameraViewProjMX[gl_InvocationID-7];
 	} else {
 		// cubemap transform 90° view frustum projection onto cube face
 		vpMX = boxProjMX*boxViewMX[gl_InvocationID-1];
@@ -45,8 +56,12 @@ void main() {
 	for(int i = 0; i < 3; i++){
 		texCoords = texCoords_[i];
 		faceCoords = faceCoords_[i];
-		gl_Position = vpMX*gl_in[i].gl_Position;
+		// depth at the far plane, the skybox is drawn last where no object covers it (GL_LEQUAL)
+		gl_Position = (vpMX*gl_in[i].gl_Position).xyww;
 		gl_Layer = gl_InvocationID;
+#ifdef GL_ARB_viewport_array
+		gl_ViewportIndex = gl_InvocationID;
+#endif
 		EmitVertex();
 	}
 	EndPrimitive();
@@ -0,0 +1,75 @@
+#version 330
+
+layout(location = 0) out uint feedback;
+
+in vec2 faceCoords;
+in vec3 texCoords;
+
+/* virtual (tiled) cubemap, see VirtualCubeMap.h */
+uniform int vtFaceResolution;
+uniform int vtTileSize;
+uniform int vtNumLevels;
+uniform float vtLodBias;
+
+/* Selects the cube face a direction points to (0..5 = negx, posx, negy, posy, negz, posz
+ * like the face files) and computes the face coordinates in [0,1]^2 the way GL does for cubemaps.
+ */
+int cubeFace(vec3 dir, out vec2 st) {
+	vec3 a = abs(dir);
+	int face;
+	float ma;
+	vec2 sc;
+	if(a.x >= a.y && a.x >= a.z){
+		ma = a.x;
+		face = dir.x < 0 ? 0 : 1;
+		sc = dir.x < 0 ? vec2(dir.z, -dir.y) : vec2(-dir.z, -dir.y);
+	} else if(a.y >= a.z){
+		ma = a.y;
+		face = dir.y < 0 ? 2 : 3;
+		sc = dir.y < 0 ? vec2(dir.x, -dir.z) : vec2(dir.x, dir.z);
+	} else {
+		ma = a.z;
+		face = dir.z < 0 ? 4 : 5;
+		sc = dir.z < 0 ? vec2(-dir.x, -dir.y) : vec2(dir.x, -dir.y);
+	}
+	st = 0.5*(sc/ma + 1);
+	return face;
+}
+
+/* Mip level of the virtual cubemap from the angular footprint of the pixel
+ * (a texel in the middle of a face covers about 2/faceResolution radians).
+ */
+int virtualLevel(vec3 dir) {
+	float footprint = max(length(dFdx(dir)), length(dFdy(dir))) / length(dir);
+	float level = log2(max(footprint*vtFaceResolution*0.5, 1e-6)) + vtLodBias;
+	return clamp(int(floor(level)), 0, vtNumLevels-1);
+}
+
+/* resolution of the faces at a mip level of the virtual cubemap */
+int virtualResolution(int level) {
+	return max(vtFaceResolution >> level, 1);
+}
+
+/* tile of the virtual cubemap containing the face coordinates at a mip level */
+ivec2 virtualTile(vec2 st, int level) {
+	int res = virtualResolution(level);
+	int tiles = (res + vtTileSize - 1) / vtTileSize;
+	return clamp(ivec2(st*res) / vtTileSize, ivec2(0), ivec2(tiles-1));
+}
+
+/* packed id of the tile sampled in the specified direction (see packTileKey in VirtualCubeMap.h) */
+uint virtualTileKey(vec3 dir) {
+	vec2 st;
+	int face = cubeFace(dir, st);
+	int level = virtualLevel(dir);
+	ivec2 tile = virtualTile(st, level);
+	return 0x80000000u | (uint(level) << 27) | (uint(face) << 24) | (uint(tile.y) << 12) | uint(tile.x);
+}
+
+/* Fragment shader for the feedback pass of the skybox.
+ * Instead of a color it writes the id of the virtual cubemap tile
+ * (and mip level) the skybox samples at this fragment.
+ */
+void main() {
+	feedback = virtualTileKey(texCoords);
+}
@@ -0,0 +1,62 @@
+#version 330
+// LAYER_FROM_VS is defined by the plugin for the vertex shader layer backend (see LayeredRenderer.h)
+#ifdef LAYER_FROM_VS
+#extension GL_ARB_shader_viewport_layer_array : require
+#endif
+
+layout(location = 0) in vec2  in_position;
+layout(location = 1) in vec3  pmRowX;
+layout(location = 2) in vec3  pmRowY;
+layout(location = 3) in vec3  pmRowZ;
+
+uniform mat4 modelMX;
+uniform mat4 viewMX;
+uniform mat4 projMX;
+uniform mat4 boxProjMX;
+uniform mat4 cameraViewProjMX[3]; // cameras 1-3 (views 7-9), without translation
+uniform int view; // view rendered by this pass (multi pass backend)
+
+out vec2 faceCoords;
+out vec3 texCoords;
+
+/* view matrices for pointing the camera to each of a cube's faces (from the center of the cube)
+ */
+const mat4 boxViewMX[6] = mat4[6](
+	mat4(vec4( 0, 0,-1,0),vec4(0, 1, 0,0),vec4( 1, 0, 0,0),vec4(0,0,0,1)), // y+90 (POSX)
+	mat4(vec4( 0, 0, 1,0),vec4(0, 1, 0,0),vec4(-1, 0, 0,0),vec4(0,0,0,1)), // y-90 (NEGX)
+	mat4(vec4(-1, 0, 0,0),vec4(0, 0,-1,0),vec4( 0,-1, 0,0),vec4(0,0,0,1)), // x-90 (POSY)
+	mat4(vec4(-1, 0, 0,0),vec4(0, 0, 1,0),vec4( 0, 1, 0,0),vec4(0,0,0,1)), // x+90 (NEGY)
+	mat4(vec4(-1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0,-1,0),vec4(0,0,0,1)), // y180 (POSZ)
+	mat4(vec4( 1, 0, 0,0),vec4(0, 1, 0,0),vec4( 0, 0, 1,0),vec4(0,0,0,1))  // 0    (NEGZ)
+);
+
+/* vertex shader for drawing a cube for a skybox without geometry shader.
+ * Does the work of skybox.vert.glsl and skybox.geom.glsl for one view, which is the
+ * instance (written to gl_Layer) or set per pass by the multi pass backend.
+ */
+void main() {
+#ifdef LAYER_FROM_VS
+	int v = gl_InstanceID;
+	gl_Layer = v;
+	gl_ViewportIndex = v;
+#else
+	int v = view;
+#endif
+	vec3 coord = vec3(in_position,1);
+	vec3 pos = vec3(dot(pmRowX,coord), dot(pmRowY,coord), dot(pmRowZ,coord));
+	mat4 vpMX;
+	if(v == 0){
+		// camera transform and screen view frustum projection
+		vpMX = projMX*viewMX;
+	} else if(v > 6){
+		// additional camera
+		vpMX = cameraViewProjMX[v-7];
+	} else {
+		// cubemap transform 90° view frustum projection onto cube face
+		vpMX = boxProjMX*boxViewMX[v-1];
+	}
+	// depth at the far plane, the skybox is drawn last where no object covers it (GL_LEQUAL)
+	gl_Position = (vpMX*modelMX*vec4(pos,1)).xyww;
+	faceCoords = in_position+vec2(.5,.5);
+	texCoords = pos;
+}
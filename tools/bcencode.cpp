@@ -0,0 +1,79 @@
+// bcencode.cpp
+//
+// Offline block compression of the skybox faces. Writes the same cache files
+// the plugin reads at load time (posx.png -> posx.png.bc1 / posx.png.bc7),
+// so the first start of the plugin does not have to encode anything.
+//
+// usage: bcencode bc1|bc7 <skybox directory> [...]
+//
+
+#include "../TextureCompression.h"
+#include <png.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char* faceNames[6] = {"negx", "posx", "negy", "posy", "negz", "posz"};
+
+/** loads a PNG file as 8 bit RGB (rows top to bottom) */
+static bool loadPNG(const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgb) {
+	png_image image;
+	std::memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	if(!png_image_begin_read_from_file(&image, filename.c_str())){
+		fprintf(stderr, "could not read file [%s]\n", filename.c_str());
+		return false;
+	}
+	image.format = PNG_FORMAT_RGB;
+	width = static_cast<int>(image.width);
+	height = static_cast<int>(image.height);
+	rgb.resize(PNG_IMAGE_SIZE(image));
+	if(!png_image_finish_read(&image, nullptr, &rgb[0], 0, nullptr)){
+		fprintf(stderr, "could not decode file [%s]: %s\n", filename.c_str(), image.message);
+		png_image_free(&image);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 3){
+		fprintf(stderr, "usage: %s bc1|bc7 <skybox directory> [...]\n", argv[0]);
+		return 1;
+	}
+	BlockFormat format;
+	if(std::strcmp(argv[1], "bc1") == 0){
+		format = BLOCK_FORMAT_BC1;
+	} else if(std::strcmp(argv[1], "bc7") == 0){
+		format = BLOCK_FORMAT_BC7;
+	} else {
+		fprintf(stderr, "unknown format [%s]\n", argv[1]);
+		return 1;
+	}
+
+	int result = 0;
+	for(int a = 2; a < argc; a++){
+		std::string dir = argv[a];
+		BlockCompressionStats stats;
+		size_t rawBytes = 0, compressedBytes = 0;
+		for(int i = 0; i < 6; i++){
+			std::string filename = dir + "/" + faceNames[i] + ".png";
+			int width, height;
+			std::vector<unsigned char> rgb, blocks;
+			if(!loadPNG(filename, width, height, rgb)){
+				result = 1;
+				continue;
+			}
+			compressBlocks(format, &rgb[0], width, height, blocks, &stats);
+			if(!writeBlockCache(blockCacheFileName(filename, format), filename, format, width, height, blocks)){
+				result = 1;
+			}
+			rawBytes += rgb.size();
+			compressedBytes += blocks.size();
+		}
+		printf("%s: %s %.1f MPix/s, PSNR %.2f dB, %.1f MB -> %.1f MB\n", dir.c_str(), blockFormatName(format),
+			stats.mpixPerSecond(), stats.psnr(), rawBytes/1048576.0, compressedBytes/1048576.0);
+	}
+	return result;
+}
@@ -0,0 +1,509 @@
+// cmbench.cpp
+//
+// Microbenchmarks of the CPU hot paths of the plugin that do not need GL
+// (SceneMath.h, the mesh import of MeshImport.h and the PNG decode of the skybox faces), so CPU regressions
+// can be tracked without OGL4Core or a GL context.
+//
+// Every benchmark is calibrated to run for about --time milliseconds per sample,
+// then measured for --samples samples after one warm up sample. Reported are the
+// median time per operation and the median absolute deviation (MAD) of the samples,
+// which are insensitive to single outliers (interrupts, frequency changes).
+// Before measuring the results are checked against the reference implementation
+// of the plugin, a failed check gives a non zero exit code.
+//
+// usage: cmbench [--json | --csv] [--samples n] [--time ms] [--filter text] [resource directory]
+//   the resource directory defaults to "resources" (run from the plugin directory)
+//
+
+#include "../SceneMath.h"
+#include "../MeshImport.h"
+#include "pngload.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/** result of a benchmark */
+typedef struct Result_t {
+	std::string name;
+	double median;     //!< nanoseconds per operation
+	double mad;        //!< median absolute deviation (nanoseconds per operation)
+	double min;        //!< fastest sample (nanoseconds per operation)
+	size_t iterations; //!< operations per sample
+	int samples;
+} Result;
+
+/** keeps results alive so the compiler cannot remove the benchmarked code */
+static volatile float sink;
+
+static double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	return n % 2 ? v[n/2] : 0.5*(v[n/2 - 1] + v[n/2]);
+}
+
+/**
+ * Measures a function that performs the given number of operations.
+ * The number of operations per sample is doubled until a sample takes sampleTime.
+ */
+static Result measure(const std::string& name, const std::function<void(size_t)>& run, int samples, double sampleTime) {
+	size_t iterations = 1;
+	for(;;){
+		double start = seconds();
+		run(iterations);
+		double t = seconds() - start;
+		if(t >= sampleTime || iterations >= (size_t(1) << 40)){
+			break;
+		}
+		// jump close to the target once the time is measurable
+		iterations = t > 1e-4 ? static_cast<size_t>(iterations*sampleTime/t*1.1) + 1 : iterations*2;
+	}
+	run(iterations);
+	std::vector<double> times(samples);
+	for(int s = 0; s < samples; s++){
+		double start = seconds();
+		run(iterations);
+		times[s] = (seconds() - start)*1e9/iterations;
+	}
+	Result r;
+	r.name = name;
+	r.median = median(times);
+	std::vector<double> deviations(samples);
+	for(int s = 0; s < samples; s++){
+		deviations[s] = std::fabs(times[s] - r.median);
+	}
+	r.mad = median(deviations);
+	r.min = *std::min_element(times.begin(), times.end());
+	r.iterations = iterations;
+	r.samples = samples;
+	return r;
+}
+
+static std::string readFile(const std::string& filename, bool binary) {
+	std::ifstream ifs(filename.c_str(), binary ? std::ios::binary : std::ios::in);
+	return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+/** regular grid of side*side quads in the xy plane with the triangles in a shuffled order */
+static void makeGridMesh(int side, MeshData& mesh) {
+	mesh = MeshData();
+	for(int y = 0; y <= side; y++){
+		for(int x = 0; x <= side; x++){
+			float p[3] = {static_cast<float>(x)/side - 0.5f, static_cast<float>(y)/side - 0.5f, 0.0f};
+			float n[3] = {0.0f, 0.0f, 1.0f};
+			mesh.positions.insert(mesh.positions.end(), p, p + 3);
+			mesh.normals.insert(mesh.normals.end(), n, n + 3);
+			mesh.texCoords.push_back(p[0] + 0.5f);
+			mesh.texCoords.push_back(p[1] + 0.5f);
+		}
+	}
+	std::vector<uint32_t> triangles;
+	for(int y = 0; y < side; y++){
+		for(int x = 0; x < side; x++){
+			uint32_t a = y*(side+1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+			uint32_t quad[6] = {a, b, c, c, b, d};
+			triangles.insert(triangles.end(), quad, quad + 6);
+		}
+	}
+	// fixed sequence, so the result only depends on the size
+	uint32_t state = 12345;
+	size_t numTriangles = triangles.size()/3;
+	std::vector<size_t> order(numTriangles);
+	for(size_t t = 0; t < numTriangles; t++){
+		order[t] = t;
+	}
+	for(size_t t = numTriangles; t > 1; t--){
+		state = state*1664525u + 1013904223u;
+		std::swap(order[t-1], order[(state >> 8) % t]);
+	}
+	for(size_t t = 0; t < numTriangles; t++){
+		mesh.indices.insert(mesh.indices.end(), &triangles[3*order[t]], &triangles[3*order[t]] + 3);
+	}
+}
+
+/** writes a value of a binary PLY file, reversing the bytes of the little endian host for big endian files */
+static void writePlyValue(FILE* f, const void* value, size_t size, bool bigEndian) {
+	unsigned char b[4];
+	std::memcpy(b, value, size);
+	if(bigEndian){
+		std::reverse(b, b + size);
+	}
+	fwrite(b, 1, size, f);
+}
+
+/**
+ * Writes a PLY quad in an encoding: 4 vertices with texture_u/texture_v, 1 face whose
+ * last index is passed and a tristrips element of 300 indices the loader skips.
+ */
+static void writePlyQuad(const std::string& file, const char* format, int lastIndex) {
+	FILE* f = fopen(file.c_str(), "wb");
+	if(!f){
+		return;
+	}
+	fprintf(f, "ply\nformat %s 1.0\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\n"
+			"property float texture_u\nproperty float texture_v\nelement face 1\nproperty list uchar int vertex_indices\n"
+			"element tristrips 1\nproperty list int int vertex_indices\nend_header\n", format);
+	const float vertices[4][5] = {{0, 0, 0, 0, 0}, {2, 0, 0, 1, 0}, {2, 1, 0, 1, 1}, {0, 1, 0, 0, 1}};
+	const int face[4] = {0, 1, 2, lastIndex};
+	const int stripLength = 300;
+	bool ascii = !std::strcmp(format, "ascii");
+	bool bigEndian = !std::strcmp(format, "binary_big_endian");
+	for(int v = 0; v < 4; v++){
+		for(int k = 0; k < 5; k++){
+			if(ascii){
+				fprintf(f, k < 4 ? "%g " : "%g\n", vertices[v][k]);
+			} else {
+				writePlyValue(f, &vertices[v][k], 4, bigEndian);
+			}
+		}
+	}
+	if(ascii){
+		fprintf(f, "4 %d %d %d %d\n%d", face[0], face[1], face[2], face[3], stripLength);
+		for(int i = 0; i < stripLength; i++){
+			fprintf(f, " %d", i % 4);
+		}
+		fprintf(f, "\n");
+	} else {
+		unsigned char corners = 4;
+		fwrite(&corners, 1, 1, f);
+		for(int k = 0; k < 4; k++){
+			writePlyValue(f, &face[k], 4, bigEndian);
+		}
+		writePlyValue(f, &stripLength, 4, bigEndian);
+		for(int i = 0; i < stripLength; i++){
+			int index = i % 4;
+			writePlyValue(f, &index, 4, bigEndian);
+		}
+	}
+	fclose(f);
+}
+
+/** checks of the library against the behaviour of the plugin, returns the number of failed checks */
+static int runChecks(const std::string& geomSource) {
+	int failed = 0;
+	// every id of the pick buffer survives the 8 bit color round trip
+	unsigned int bad = 0;
+	for(unsigned int id = 0; id < (1u << 24)/111; id++){
+		glm::vec3 c = pickIdToColor(id);
+		unsigned char rgb[3] = {
+			static_cast<unsigned char>(c.x*255 + 0.5f),
+			static_cast<unsigned char>(c.y*255 + 0.5f),
+			static_cast<unsigned char>(c.z*255 + 0.5f)};
+		bad += pickColorToId(rgb) != id;
+	}
+	if(bad){
+		fprintf(stderr, "check failed: %u pick ids do not round trip\n", bad);
+		failed++;
+	}
+	// dragging a point in the image plane and back leaves it where it was
+	FrameMatrices m;
+	glm::mat4 viewMX(1.0f);
+	viewMX[3] = glm::vec4(0, 0, -5, 1);
+	computeFrameMatrices(viewMX, 60.0f, 16.0f/9, 0.1f, 100.0f, glm::vec3(1, 2, 3), m);
+	glm::vec3 p(0.5f, -0.25f, 1.0f);
+	glm::vec3 t = dragTranslation(m.projMX, viewMX, p, 13, -7, 1280, 720, false);
+	glm::vec3 back = dragTranslation(m.projMX, viewMX, p + t, -13, 7, 1280, 720, false);
+	if(glm::length(t + back) > 1e-4f || std::fabs((m.boxTranslMX*glm::vec4(1, 2, 3, 1)).x) > 1e-6f){
+		fprintf(stderr, "check failed: drag round trip error %g\n", glm::length(t + back));
+		failed++;
+	}
+	// a sphere in front of the camera covers part of the screen, one behind the near plane all of it,
+	// and the reflection resolution only drops after the requirement stayed low
+	glm::mat4 viewProjMX = m.projMX*viewMX;
+	float coverage = projectedSphereCoverage(viewProjMX, glm::vec3(0.0f), 0.5f);
+	const int sizes[] = {128, 256, 512, 1024};
+	int below = 0;
+	int level = selectResolutionLevel(1000.0f, sizes, 4, 0, 0.8f, 3, below);
+	int held = selectResolutionLevel(450.0f, sizes, 4, level, 0.8f, 3, below);
+	int dropped = level;
+	for(int i = 0; i < 3; i++){
+		dropped = selectResolutionLevel(300.0f, sizes, 4, dropped, 0.8f, 3, below);
+	}
+	if(coverage <= 0.0f || coverage >= 1.0f || projectedSphereCoverage(viewProjMX, glm::vec3(0, 0, 5), 1.0f) != 1.0f
+			|| level != 3 || held != 3 || dropped != 2){
+		fprintf(stderr, "check failed: reflection resolution (coverage %g, levels %d %d %d)\n", coverage, level, held, dropped);
+		failed++;
+	}
+	// max_vertices is replaced exactly once
+	std::string patched = setupMaxVertices(geomSource, 128);
+	if(!geomSource.empty() && patched.find("max_vertices=128") == std::string::npos){
+		fprintf(stderr, "check failed: max_vertices not patched\n");
+		failed++;
+	}
+	// the split tiles cover the window without overlap
+	glm::ivec4 tiles[4];
+	for(int layout = 0; layout < SPLIT_LAYOUT_COUNT; layout++){
+		int n = splitViewports(layout, 801, 601, tiles);
+		long area = 0;
+		for(int i = 0; i < n; i++){
+			area += static_cast<long>(tiles[i].z)*tiles[i].w;
+		}
+		if(area != 801L*601 || tiles[0].x != 0 || tiles[0].y + tiles[0].w != 601){
+			fprintf(stderr, "check failed: split layout %d\n", layout);
+			failed++;
+		}
+	}
+	// the defines of the layered backends follow the #version line
+	std::string defined = insertShaderDefines("#version 330\nvoid main() {}\n", "#define LAYER_FROM_VS\n");
+	if(defined != "#version 330\n#define LAYER_FROM_VS\nvoid main() {}\n"){
+		fprintf(stderr, "check failed: shader defines not inserted\n");
+		failed++;
+	}
+	// the governor holds a frame time model near the target and keeps the best settings when fast
+	QualitySettings best = qualitySettings(1.0f, 10);
+	QualitySettings cheapest = qualitySettings(0.0f, 10);
+	GovernorState slowState, fastState;
+	double lateMs = 0.0;
+	for(int frame = 0; frame < 400; frame++){
+		QualitySettings q = qualitySettings(slowState.quality, 10);
+		float ms = q.renderScale*q.renderScale*(6.0f + 0.25f*q.subDivLevel*q.subDivLevel) + 6.0f/q.reflectionInterval;
+		governFrameTime(ms, 12.0f, slowState);
+		governFrameTime(5.0f, 12.0f, fastState);
+		if(frame >= 300){
+			lateMs += ms/100.0;
+		}
+	}
+	if(best.subDivLevel != 10 || best.renderScale != 1.0f || best.reflectionInterval != 1
+			|| cheapest.subDivLevel != 1 || cheapest.renderScale != 0.5f || cheapest.reflectionInterval != 4
+			|| lateMs > 12.0*1.1 || lateMs < 12.0*0.6 || fastState.quality != 1.0f){
+		fprintf(stderr, "check failed: frame time governor (%.2f ms for a 12 ms target)\n", lateMs);
+		failed++;
+	}
+	// the optimized grid keeps its triangles and transforms far fewer vertices per triangle
+	MeshData grid;
+	makeGridMesh(32, grid);
+	std::vector<uint32_t> sortedSource;
+	for(size_t i = 0; i + 2 < grid.indices.size(); i += 3){
+		const float* p = &grid.positions[3*grid.indices[i]];
+		sortedSource.push_back(static_cast<uint32_t>((p[0] + 0.5f)*32.5f) + 64*static_cast<uint32_t>((p[1] + 0.5f)*32.5f));
+	}
+	float acmrSource = 0.0f, acmr = 0.0f;
+	optimizeMesh(grid, acmrSource, acmr);
+	bool indicesValid = grid.indices.size() == 3*32*32*2 && grid.numVertices() == 33*33;
+	std::vector<uint32_t> sortedResult;
+	for(size_t i = 0; indicesValid && i + 2 < grid.indices.size(); i += 3){
+		indicesValid = grid.indices[i] < grid.numVertices() && grid.indices[i+1] < grid.numVertices() && grid.indices[i+2] < grid.numVertices();
+		const float* p = &grid.positions[3*grid.indices[i]];
+		sortedResult.push_back(static_cast<uint32_t>((p[0] + 0.5f)*32.5f) + 64*static_cast<uint32_t>((p[1] + 0.5f)*32.5f));
+	}
+	std::sort(sortedSource.begin(), sortedSource.end());
+	std::sort(sortedResult.begin(), sortedResult.end());
+	if(!indicesValid || sortedSource != sortedResult || acmr > 0.8f || acmr > 0.5f*acmrSource){
+		fprintf(stderr, "check failed: vertex cache optimization (%.3f -> %.3f misses per triangle)\n", acmrSource, acmr);
+		failed++;
+	}
+	// quantized positions are within half a step of 16 bits of the bounds
+	QuantizedMesh q;
+	quantizeMesh(grid, q);
+	float quantError = 0.0f;
+	for(size_t v = 0; v < grid.numVertices(); v++){
+		for(int k = 0; k < 3; k++){
+			float p = q.header.center[k] + q.header.extent[k]*q.vertices[v].position[k]/32767.0f;
+			quantError = std::max(quantError, std::fabs(p - grid.positions[3*v+k]));
+		}
+	}
+	if(q.header.indexSize != 2 || q.indices.size() != 2*grid.indices.size() || quantError > 1.0f/32767.0f){
+		fprintf(stderr, "check failed: mesh quantization (error %g)\n", quantError);
+		failed++;
+	}
+	// an OBJ quad with negative indices is imported into 2 triangles, the second import maps the cache
+	std::string objFile = "cmbench_quad.obj";
+	FILE* obj = fopen(objFile.c_str(), "w");
+	if(obj){
+		fprintf(obj, "v 0 0 0\nv 2 0 0\nv 2 1 0\nv 0 1 0\nvt 0 0\nvt 1 1\nf -4/1 -3/1 -2/2 -1/2\n");
+		fclose(obj);
+	}
+	MeshCacheFile imported, mapped;
+	bool builtOk = imported.import(objFile) && imported.header().numIndices == 6 && imported.header().numVertices == 4;
+	imported.close();
+	bool mappedOk = mapped.import(objFile) && mapped.header().numIndices == 6 && mapped.header().extent[0] == 0.5f
+			&& mapped.header().extent[1] == 0.25f && static_cast<const uint16_t*>(mapped.indices())[5] < 4;
+	mapped.close();
+	if(!builtOk || !mappedOk){
+		fprintf(stderr, "check failed: obj import and mesh cache\n");
+		failed++;
+	}
+	std::remove(objFile.c_str());
+	std::remove((objFile + ".cmesh").c_str());
+	// the PLY quad is read from every encoding with its texture coordinates and without the skipped
+	// list, an index out of the vertices is rejected (the loader reports it on stderr)
+	std::string plyFile = "cmbench_quad.ply";
+	const char* plyFormats[] = {"ascii", "binary_little_endian", "binary_big_endian"};
+	for(int i = 0; i < 3; i++){
+		MeshData ply;
+		writePlyQuad(plyFile, plyFormats[i], 3);
+		bool loadedOk = loadPLY(plyFile, ply) && ply.indices.size() == 6 && ply.numVertices() == 4
+				&& ply.positions[3] == 2.0f && ply.texCoords[4] == 1.0f && ply.texCoords[5] == 1.0f;
+		writePlyQuad(plyFile, plyFormats[i], i == 1 ? -1 : 4);
+		bool rejectedOk = !loadPLY(plyFile, ply);
+		if(!loadedOk || !rejectedOk){
+			fprintf(stderr, "check failed: %s ply import\n", plyFormats[i]);
+			failed++;
+		}
+	}
+	std::remove(plyFile.c_str());
+	return failed;
+}
+
+static void printResults(const std::vector<Result>& results, const char* format) {
+	if(!std::strcmp(format, "json")){
+		printf("{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [\n");
+		for(size_t i = 0; i < results.size(); i++){
+			const Result& r = results[i];
+			printf("    {\"name\": \"%s\", \"median\": %.4f, \"mad\": %.4f, \"min\": %.4f, \"iterations\": %zu, \"samples\": %d}%s\n",
+					r.name.c_str(), r.median, r.mad, r.min, r.iterations, r.samples, i + 1 < results.size() ? "," : "");
+		}
+		printf("  ]\n}\n");
+	} else if(!std::strcmp(format, "csv")){
+		printf("name,median_ns,mad_ns,min_ns,iterations,samples\n");
+		for(size_t i = 0; i < results.size(); i++){
+			const Result& r = results[i];
+			printf("%s,%.4f,%.4f,%.4f,%zu,%d\n", r.name.c_str(), r.median, r.mad, r.min, r.iterations, r.samples);
+		}
+	} else {
+		printf("%-28s %14s %12s %14s\n", "benchmark", "median ns/op", "MAD", "min ns/op");
+		for(size_t i = 0; i < results.size(); i++){
+			const Result& r = results[i];
+			printf("%-28s %14.2f %11.2f%% %14.2f\n", r.name.c_str(), r.median, 100*r.mad/r.median, r.min);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* format = "text";
+	int samples = 21;
+	double sampleTime = 0.02;
+	std::string filter;
+	std::string resources = "resources";
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "--json" || arg == "--csv"){
+			format = argv[i] + 2;
+		} else if(arg == "--samples" && i + 1 < argc){
+			samples = std::max(3, atoi(argv[++i]));
+		} else if(arg == "--time" && i + 1 < argc){
+			sampleTime = std::max(1.0, atof(argv[++i]))*1e-3;
+		} else if(arg == "--filter" && i + 1 < argc){
+			filter = argv[++i];
+		} else if(arg[0] == '-'){
+			fprintf(stderr, "usage: %s [--json | --csv] [--samples n] [--time ms] [--filter text] [resource directory]\n", argv[0]);
+			return 1;
+		} else {
+			resources = arg;
+		}
+	}
+
+	std::string geomSource = readFile(resources + "/cube.geom.glsl", false);
+	std::string pngFile = readFile(resources + "/skyboxes/bridge/posx.png", true);
+	std::vector<unsigned char> pngData(pngFile.begin(), pngFile.end());
+	if(geomSource.empty() || pngData.empty()){
+		fprintf(stderr, "resources not found in [%s], shader and png benchmarks are skipped\n", resources.c_str());
+	}
+	int failed = runChecks(geomSource);
+
+	// inputs
+	glm::mat4 viewMX(1.0f);
+	viewMX[3] = glm::vec4(0.3f, -0.2f, -5, 1);
+	FrameMatrices matrices;
+	computeFrameMatrices(viewMX, 60.0f, 16.0f/9, 0.1f, 100.0f, glm::vec3(1, 2, 3), matrices);
+
+	std::vector<std::pair<std::string, std::function<void(size_t)> > > benchmarks;
+	benchmarks.push_back(std::make_pair("pick.idToColor", [](size_t n){
+		float s = 0;
+		for(size_t i = 0; i < n; i++){
+			s += pickIdToColor(static_cast<unsigned int>(i & 0xffff)).y;
+		}
+		sink = s;
+	}));
+	benchmarks.push_back(std::make_pair("pick.colorToId", [](size_t n){
+		unsigned int s = 0;
+		for(size_t i = 0; i < n; i++){
+			unsigned char rgb[3] = {static_cast<unsigned char>(i >> 16), static_cast<unsigned char>(i >> 8), static_cast<unsigned char>(i)};
+			s += pickColorToId(rgb);
+		}
+		sink = static_cast<float>(s);
+	}));
+	benchmarks.push_back(std::make_pair("frame.matrices", [&](size_t n){
+		FrameMatrices m;
+		float s = 0;
+		for(size_t i = 0; i < n; i++){
+			computeFrameMatrices(viewMX, 60.0f + (i & 7), 16.0f/9, 0.1f, 100.0f, glm::vec3(1, 2, 3), m);
+			s += m.invViewMX[3].x + m.projMX[0].x;
+		}
+		sink = s;
+	}));
+	benchmarks.push_back(std::make_pair("motion.dragTranslation", [&](size_t n){
+		float s = 0;
+		for(size_t i = 0; i < n; i++){
+			s += dragTranslation(matrices.projMX, viewMX, glm::vec3(0.5f, -0.25f, 1.0f),
+					static_cast<int>(i & 15) - 8, 3, 1280, 720, (i & 1) != 0).x;
+		}
+		sink = s;
+	}));
+	benchmarks.push_back(std::make_pair("frame.sphereCoverage", [&](size_t n){
+		glm::mat4 viewProjMX = matrices.projMX*viewMX;
+		float s = 0;
+		for(size_t i = 0; i < n; i++){
+			s += projectedSphereCoverage(viewProjMX, glm::vec3(0.1f*(i & 15), 0.0f, 0.0f), 0.5f);
+		}
+		sink = s;
+	}));
+	MeshData benchGrid;
+	makeGridMesh(32, benchGrid);
+	benchmarks.push_back(std::make_pair("mesh.optimizeVertexCache", [&](size_t n){
+		size_t s = 0;
+		for(size_t i = 0; i < n; i++){
+			std::vector<uint32_t> indices = benchGrid.indices;
+			optimizeVertexCache(indices, benchGrid.numVertices());
+			s += indices[0];
+		}
+		sink = static_cast<float>(s);
+	}));
+	if(!geomSource.empty()){
+		benchmarks.push_back(std::make_pair("shader.setupMaxVertices", [&](size_t n){
+			size_t s = 0;
+			for(size_t i = 0; i < n; i++){
+				s += setupMaxVertices(geomSource, 64 + static_cast<unsigned int>(i & 63)).size();
+			}
+			sink = static_cast<float>(s);
+		}));
+	}
+	if(!pngData.empty()){
+		benchmarks.push_back(std::make_pair("png.decodeFace", [&](size_t n){
+			std::vector<unsigned char> rgb;
+			int width = 0, height = 0;
+			for(size_t i = 0; i < n; i++){
+				decodePNG(pngData, width, height, rgb);
+			}
+			sink = rgb.empty() ? 0.0f : rgb[0];
+		}));
+	}
+
+	std::vector<Result> results;
+	for(size_t b = 0; b < benchmarks.size(); b++){
+		if(!filter.empty() && benchmarks[b].first.find(filter) == std::string::npos){
+			continue;
+		}
+		// the png decode takes milliseconds, fewer samples keep the run short
+		int n = benchmarks[b].first.compare(0, 4, "png.") ? samples : std::max(3, samples/3);
+		results.push_back(measure(benchmarks[b].first, benchmarks[b].second, n, sampleTime));
+	}
+	printResults(results, format);
+
+	if(failed){
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,215 @@
+// cubesample.cpp
+//
+// Checks and benchmark of the CPU cubemap sampler (CubeSampler.h).
+// Verifies the face addressing (round trip of cubeFaceOf / cubeFaceDirection,
+// AVX batch against the scalar lookups) and the seam aware filtering of a smooth
+// synthetic cubemap, then measures lookups per second per core.
+// With a skybox directory the png faces are benchmarked instead of the synthetic map.
+//
+// usage: cubesample [skybox directory]
+//
+
+#include "../CubeSampler.h"
+#include "../ThreadPool.h"
+#include "pngload.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/** smooth test function of the direction */
+static void smoothColor(float x, float y, float z, float rgb[3]) {
+	float len = std::sqrt(x*x + y*y + z*z);
+	rgb[0] = 0.5f + 0.5f*x/len;
+	rgb[1] = 0.5f + 0.5f*y/len;
+	rgb[2] = 0.5f + 0.5f*z/len;
+}
+
+/** cubemap of the smooth test function sampled at the texel centers */
+static void makeSmoothCubeMap(CubeMapSampler& sampler, int resolution) {
+	std::vector<float> faces[6];
+	const float* ptrs[6];
+	for(int f = 0; f < 6; f++){
+		faces[f].resize(static_cast<size_t>(resolution)*resolution*3);
+		for(int j = 0; j < resolution; j++){
+			for(int i = 0; i < resolution; i++){
+				float x, y, z;
+				cubeFaceDirection(f, (i + 0.5f)/resolution, (j + 0.5f)/resolution, x, y, z);
+				smoothColor(x, y, z, &faces[f][(static_cast<size_t>(j)*resolution + i)*3]);
+			}
+		}
+		ptrs[f] = &faces[f][0];
+	}
+	sampler.setFaces(ptrs, resolution);
+}
+
+/** random unit directions, split into coordinate arrays */
+static void randomDirections(size_t count, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z) {
+	std::mt19937 rng(1234);
+	std::normal_distribution<float> normal;
+	x.resize(count); y.resize(count); z.resize(count);
+	for(size_t i = 0; i < count; i++){
+		float a = normal(rng), b = normal(rng), c = normal(rng);
+		float len = std::sqrt(a*a + b*b + c*c);
+		x[i] = a/len; y[i] = b/len; z[i] = c/len;
+	}
+}
+
+static double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** checks of the addressing and filtering, returns the number of failed checks */
+static int runChecks() {
+	int failed = 0;
+	const int resolution = 64;
+	CubeMapSampler sampler;
+	makeSmoothCubeMap(sampler, resolution);
+	sampler.buildMipChain();
+
+	// round trip of face coordinates
+	float worst = 0;
+	for(int f = 0; f < 6; f++){
+		for(int k = 0; k < 1000; k++){
+			float s = (k % 37 + 0.5f)/37, t = (k / 37 % 27 + 0.5f)/27;
+			float x, y, z, s2, t2;
+			cubeFaceDirection(f, s, t, x, y, z);
+			int f2 = cubeFaceOf(x, y, z, s2, t2);
+			if(f2 != f){
+				worst = 1e9f;
+			}
+			worst = std::max(worst, std::max(std::fabs(s2 - s), std::fabs(t2 - t)));
+		}
+	}
+	printf("face round trip: max error %g\n", worst);
+	failed += worst > 1e-5f;
+
+	// batch kernel against the scalar lookups
+	std::vector<float> x, y, z;
+	randomDirections(100003, x, y, z);
+	std::vector<float> batch(x.size()*3);
+	sampler.sampleBilinearBatch(&x[0], &y[0], &z[0], x.size(), 0, &batch[0]);
+	size_t mismatches = 0;
+	for(size_t i = 0; i < x.size(); i++){
+		float rgb[3];
+		sampler.sampleBilinear(x[i], y[i], z[i], 0, rgb);
+		for(int c = 0; c < 3; c++){
+			mismatches += std::fabs(rgb[c] - batch[i*3 + c]) > 1e-6f;
+		}
+	}
+	printf("batch (%s) vs scalar: %zu mismatches\n", CubeMapSampler::usesAVX() ? "AVX" : "scalar", mismatches);
+	failed += mismatches > 0;
+
+	// seam aware filtering reconstructs the smooth function at the face edges as well as inside
+	float errInside = 0, errEdge = 0;
+	for(size_t i = 0; i < x.size(); i++){
+		float s, t, rgb[3], ref[3];
+		cubeFaceOf(x[i], y[i], z[i], s, t);
+		sampler.sampleBilinear(x[i], y[i], z[i], 0, rgb);
+		smoothColor(x[i], y[i], z[i], ref);
+		float e = std::max(std::fabs(rgb[0] - ref[0]), std::max(std::fabs(rgb[1] - ref[1]), std::fabs(rgb[2] - ref[2])));
+		float border = 1.0f/resolution;
+		bool edge = s < border || t < border || s > 1 - border || t > 1 - border;
+		if(edge){
+			errEdge = std::max(errEdge, e);
+		} else {
+			errInside = std::max(errInside, e);
+		}
+	}
+	printf("bilinear reconstruction error: inside %g, at the edges %g\n", errInside, errEdge);
+	failed += errEdge > 4*errInside + 1e-3f;
+
+	// the 1x1 level of a face is the average of that face (the chain is built per face),
+	// sampled at the center of +X
+	double mean[3] = {0, 0, 0};
+	for(int j = 0; j < resolution; j++){
+		for(int i = 0; i < resolution; i++){
+			float x, y, z, rgb[3];
+			cubeFaceDirection(CUBE_FACE_POSX, (i + 0.5f)/resolution, (j + 0.5f)/resolution, x, y, z);
+			smoothColor(x, y, z, rgb);
+			for(int c = 0; c < 3; c++){
+				mean[c] += rgb[c]/(resolution*resolution);
+			}
+		}
+	}
+	float top[3];
+	sampler.sampleTrilinear(1, 0, 0, static_cast<float>(sampler.numLevels()-1), top);
+	float errTop = 0;
+	for(int c = 0; c < 3; c++){
+		errTop = std::max(errTop, static_cast<float>(std::fabs(top[c] - mean[c])));
+	}
+	printf("1x1 level of +X: %.3f %.3f %.3f (face mean %.3f %.3f %.3f)\n", top[0], top[1], top[2], mean[0], mean[1], mean[2]);
+	failed += errTop > 1e-4f;
+	return failed;
+}
+
+/** lookups per second on one core and on all cores of the pool */
+static void runBenchmark(const CubeMapSampler& sampler) {
+	std::vector<float> x, y, z;
+	const size_t count = 1 << 20;
+	randomDirections(count, x, y, z);
+	std::vector<float> rgb(count*3);
+
+	double start = seconds();
+	for(size_t i = 0; i < count; i++){
+		sampler.sampleBilinear(x[i], y[i], z[i], 0, &rgb[i*3]);
+	}
+	double scalar = count/(seconds() - start);
+
+	start = seconds();
+	sampler.sampleBilinearBatch(&x[0], &y[0], &z[0], count, 0, &rgb[0]);
+	double batch = count/(seconds() - start);
+
+	start = seconds();
+	sampler.sampleTrilinearBatch(&x[0], &y[0], &z[0], count, 1.5f, &rgb[0]);
+	double trilinear = count/(seconds() - start);
+
+	ThreadPool& pool = ThreadPool::shared();
+	const unsigned chunk = 4096;
+	start = seconds();
+	pool.parallelFor(static_cast<unsigned>(count/chunk), [&](unsigned c){
+		size_t i = static_cast<size_t>(c)*chunk;
+		sampler.sampleBilinearBatch(&x[i], &y[i], &z[i], chunk, 0, &rgb[i*3]);
+	});
+	double parallel = count/(seconds() - start);
+
+	printf("bilinear scalar:  %8.2f M lookups/s\n", scalar*1e-6);
+	printf("bilinear batch:   %8.2f M lookups/s (%s)\n", batch*1e-6, CubeMapSampler::usesAVX() ? "AVX" : "scalar");
+	printf("trilinear batch:  %8.2f M lookups/s\n", trilinear*1e-6);
+	printf("bilinear batch on %u cores: %8.2f M lookups/s (%.2f per core)\n",
+			pool.numThreads(), parallel*1e-6, parallel*1e-6/pool.numThreads());
+}
+
+int main(int argc, char** argv) {
+	int failed = runChecks();
+
+	CubeMapSampler sampler;
+	if(argc > 1){
+		std::string dir = argv[1];
+		std::vector<unsigned char> faces[6];
+		const unsigned char* ptrs[6];
+		int width = 0, height = 0;
+		for(int f = 0; f < 6; f++){
+			if(!loadPNG(dir + "/" + cubeFaceName(f) + ".png", width, height, faces[f])){
+				return 1;
+			}
+			ptrs[f] = &faces[f][0];
+		}
+		sampler.setFaces(ptrs, width);
+		printf("benchmarking %s (%dx%d)\n", dir.c_str(), width, height);
+	} else {
+		makeSmoothCubeMap(sampler, 1024);
+		printf("benchmarking synthetic cubemap (1024x1024)\n");
+	}
+	sampler.buildMipChain();
+	runBenchmark(sampler);
+
+	if(failed){
+		fprintf(stderr, "%d checks failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+// pngload.cpp
+//
+
+#include "pngload.h"
+#include <png.h>
+#include <cstdio>
+#include <cstring>
+
+/** finishes decoding a started image as 8 bit RGB (rows top to bottom) */
+static bool finishRead(png_image& image, const char* name, int& width, int& height, std::vector<unsigned char>& rgb) {
+	image.format = PNG_FORMAT_RGB;
+	width = static_cast<int>(image.width);
+	height = static_cast<int>(image.height);
+	rgb.resize(PNG_IMAGE_SIZE(image));
+	if(!png_image_finish_read(&image, nullptr, &rgb[0], 0, nullptr)){
+		fprintf(stderr, "could not decode file [%s]: %s\n", name, image.message);
+		png_image_free(&image);
+		return false;
+	}
+	return true;
+}
+
+/** loads a PNG file as 8 bit RGB (rows top to bottom) */
+bool loadPNG(const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgb) {
+	png_image image;
+	std::memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	if(!png_image_begin_read_from_file(&image, filename.c_str())){
+		fprintf(stderr, "could not read file [%s]\n", filename.c_str());
+		return false;
+	}
+	return finishRead(image, filename.c_str(), width, height, rgb);
+}
+
+/** decodes a PNG file already read into memory as 8 bit RGB */
+bool decodePNG(const std::vector<unsigned char>& data, int& width, int& height, std::vector<unsigned char>& rgb) {
+	png_image image;
+	std::memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	if(data.empty() || !png_image_begin_read_from_memory(&image, &data[0], data.size())){
+		fprintf(stderr, "could not read png from memory\n");
+		return false;
+	}
+	return finishRead(image, "memory", width, height, rgb);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * PNG decoding of the standalone tools (the plugin decodes with OGL4Core's PngBitmapCodec).
+ */
+
+bool loadPNG(const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgb);
+bool decodePNG(const std::vector<unsigned char>& data, int& width, int& height, std::vector<unsigned char>& rgb);
@@ -0,0 +1,75 @@
+// scenec.cpp
+//
+// Converts scenes from the text format to the binary format the plugin maps
+// at load time (see SceneFile.h), or generates large grid scenes for
+// reproducible performance measurements.
+//
+// usage: scenec <scene.txt> <out.scene>
+//        scenec --grid <number of objects> <out.scene>
+//
+
+#include "../SceneFile.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Places the objects on a cubic grid around a reflective object at the origin.
+ * Texture, shape and warp function cycle through all values, so the result only
+ * depends on the number of objects.
+ */
+static void generateGrid(uint32_t count, std::vector<SceneObjectRecord>& objects) {
+	objects.resize(count);
+	int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(count))));
+	const float spacing = 2.0f;
+	for(uint32_t i = 0; i < count; i++){
+		SceneObjectRecord& o = objects[i];
+		std::memset(&o, 0, sizeof(o));
+		int x = i % side;
+		int y = (i / side) % side;
+		int z = i / (side*side);
+		o.modelMX[0] = o.modelMX[5] = o.modelMX[10] = 0.5f;
+		o.modelMX[12] = (x - side/2)*spacing;
+		o.modelMX[13] = (y - side/2)*spacing;
+		o.modelMX[14] = (z - side/2)*spacing;
+		o.modelMX[15] = 1.0f;
+		o.texture = static_cast<uint8_t>(i % SCENE_TEXTURE_COUNT);
+		o.flags = SCENE_OBJECT_TEXTURED | ((i % 3 == 1) ? SCENE_OBJECT_SPHERE : 0);
+		o.warpFN = static_cast<uint8_t>(i % 3);
+	}
+	if(count > 0){
+		// the first object is the mirror in the center of the grid
+		objects[0].modelMX[12] = objects[0].modelMX[13] = objects[0].modelMX[14] = 0.0f;
+		objects[0].modelMX[0] = objects[0].modelMX[5] = objects[0].modelMX[10] = 1.0f;
+		objects[0].texture = SCENE_TEXTURE_NONE;
+		objects[0].flags = SCENE_OBJECT_TEXTURED | SCENE_OBJECT_REFLECTIVE;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<SceneObjectRecord> objects;
+	std::vector<std::string> meshes;
+	std::string outFile;
+	if(argc == 4 && std::strcmp(argv[1], "--grid") == 0){
+		generateGrid(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)), objects);
+		outFile = argv[3];
+	} else if(argc == 3){
+		if(!parseSceneText(argv[1], objects, meshes)){
+			return 1;
+		}
+		outFile = argv[2];
+	} else {
+		fprintf(stderr, "usage: %s <scene.txt> <out.scene>\n       %s --grid <number of objects> <out.scene>\n", argv[0], argv[0]);
+		return 1;
+	}
+	if(!writeSceneFile(outFile, objects, meshes)){
+		return 1;
+	}
+	printf("%s: %u objects, %u meshes, %.1f KB\n", outFile.c_str(), static_cast<unsigned>(objects.size()),
+		static_cast<unsigned>(meshes.size()), (sizeof(SceneFileHeader) + objects.size()*sizeof(SceneObjectRecord)
+		+ sizeof(uint32_t) + meshes.size()*SCENE_MESH_NAME_SIZE)/1024.0);
+	return 0;
+}